@@ -18,6 +18,15 @@
 #pragma once
 
 #include "blackbox/blackbox_fielddefs.h"
+#include "config/parameter_group.h"
+
+typedef struct blackboxConfig_s {
+    uint8_t rate_num;
+    uint8_t rate_denom;
+    uint8_t device;
+} blackboxConfig_t;
+
+PG_DECLARE(blackboxConfig_t, blackboxConfig);
 
 void blackboxLogEvent(FlightLogEvent event, flightLogEventData_t *data);
 
@@ -77,6 +77,8 @@
 
 #include "io/flashfs.h"
 
+#include "blackbox/blackbox.h"
+
 #ifdef BLACKBOX
 
 #define BLACKBOX_SERIAL_PORT_MODE MODE_TX
@@ -92,7 +94,7 @@ static portSharing_e blackboxPortSharing;
 
 void blackboxWrite(uint8_t value)
 {
-    switch (masterConfig.blackbox_device) {
+    switch (blackboxConfig()->device) {
 #ifdef USE_FLASHFS
         case BLACKBOX_DEVICE_FLASH:
             flashfsWriteByte(value); // Write byte asynchronously
@@ -159,7 +161,7 @@ int blackboxPrint(const char *s)
     int length;
     const uint8_t *pos;
 
-    switch (masterConfig.blackbox_device) {
+    switch (blackboxConfig()->device) {
 
 #ifdef USE_FLASHFS
         case BLACKBOX_DEVICE_FLASH:
@@ -494,7 +496,7 @@ void blackboxWriteFloat(float value)
  */
 bool blackboxDeviceFlush(void)
 {
-    switch (masterConfig.blackbox_device) {
+    switch (blackboxConfig()->device) {
         case BLACKBOX_DEVICE_SERIAL:
             //Nothing to speed up flushing on serial, as serial is continuously being drained out of its buffer
             return isSerialTransmitBufferEmpty(blackboxPort);
@@ -514,7 +516,7 @@ bool blackboxDeviceFlush(void)
  */
 bool blackboxDeviceOpen(void)
 {
-    switch (masterConfig.blackbox_device) {
+    switch (blackboxConfig()->device) {
         case BLACKBOX_DEVICE_SERIAL:
             {
                 serialPortConfig_t *portConfig = findSerialPortConfig(FUNCTION_BLACKBOX);
@@ -577,7 +579,7 @@ bool blackboxDeviceOpen(void)
  */
 void blackboxDeviceClose(void)
 {
-    switch (masterConfig.blackbox_device) {
+    switch (blackboxConfig()->device) {
         case BLACKBOX_DEVICE_SERIAL:
             closeSerialPort(blackboxPort);
             blackboxPort = NULL;
@@ -600,7 +602,7 @@ void blackboxDeviceClose(void)
 
 bool isBlackboxDeviceFull(void)
 {
-    switch (masterConfig.blackbox_device) {
+    switch (blackboxConfig()->device) {
         case BLACKBOX_DEVICE_SERIAL:
             return false;
 
@@ -622,7 +624,7 @@ void blackboxReplenishHeaderBudget()
 {
     int32_t freeSpace;
 
-    switch (masterConfig.blackbox_device) {
+    switch (blackboxConfig()->device) {
         case BLACKBOX_DEVICE_SERIAL:
             freeSpace = serialTxBytesFree(blackboxPort);
         break;
@@ -663,7 +665,7 @@ blackboxBufferReserveStatus_e blackboxDeviceReserveBufferSpace(int32_t bytes)
     }
 
     // Handle failure:
-    switch (masterConfig.blackbox_device) {
+    switch (blackboxConfig()->device) {
         case BLACKBOX_DEVICE_SERIAL:
             /*
              * One byte of the tx buffer isn't available for user data (due to its circular list implementation),
@@ -46,3 +46,11 @@ uint32_t zigzagEncode(int32_t value)
 {
     return (uint32_t)((value << 1) ^ (value >> 31));
 }
+
+/**
+ * Inverse of zigzagEncode().
+ */
+int32_t zigzagDecode(uint32_t value)
+{
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
@@ -0,0 +1,110 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "streambuf.h"
+
+sbuf_t *sbufInit(sbuf_t *sbuf, uint8_t *ptr, uint8_t *end)
+{
+    sbuf->ptr = ptr;
+    sbuf->end = end;
+    return sbuf;
+}
+
+void sbufWriteU8(sbuf_t *dst, uint8_t val)
+{
+    if (dst->ptr < dst->end) {
+        *dst->ptr++ = val;
+    }
+}
+
+void sbufWriteU16(sbuf_t *dst, uint16_t val)
+{
+    sbufWriteU8(dst, val >> 0);
+    sbufWriteU8(dst, val >> 8);
+}
+
+void sbufWriteU32(sbuf_t *dst, uint32_t val)
+{
+    sbufWriteU16(dst, val >> 0);
+    sbufWriteU16(dst, val >> 16);
+}
+
+void sbufWriteData(sbuf_t *dst, const void *data, int len)
+{
+    if (len > sbufBytesRemaining(dst)) {
+        len = sbufBytesRemaining(dst);
+    }
+    memcpy(dst->ptr, data, len);
+    dst->ptr += len;
+}
+
+void sbufWriteString(sbuf_t *dst, const char *string)
+{
+    sbufWriteData(dst, string, strlen(string));
+}
+
+uint8_t sbufReadU8(sbuf_t *src)
+{
+    if (src->ptr < src->end) {
+        return *src->ptr++;
+    }
+    return 0;
+}
+
+uint16_t sbufReadU16(sbuf_t *src)
+{
+    uint16_t ret;
+    ret = sbufReadU8(src);
+    ret |= sbufReadU8(src) << 8;
+    return ret;
+}
+
+uint32_t sbufReadU32(sbuf_t *src)
+{
+    uint32_t ret;
+    ret = sbufReadU16(src);
+    ret |= (uint32_t)sbufReadU16(src) << 16;
+    return ret;
+}
+
+int sbufBytesRemaining(const sbuf_t *buf)
+{
+    return buf->end - buf->ptr;
+}
+
+uint8_t *sbufPtr(sbuf_t *buf)
+{
+    return buf->ptr;
+}
+
+void sbufAdvance(sbuf_t *buf, int size)
+{
+    if (size > sbufBytesRemaining(buf)) {
+        size = sbufBytesRemaining(buf);
+    }
+    buf->ptr += size;
+}
+
+// Convert a buffer that was written into to one that can be read from: data is between base and the last written byte
+void sbufSwitchToReader(sbuf_t *buf, uint8_t *base)
+{
+    buf->end = buf->ptr;
+    buf->ptr = base;
+}
@@ -16,6 +16,7 @@
  */
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <string.h>
 
@@ -35,6 +36,7 @@
 #include "drivers/gpio.h"
 #include "drivers/timer.h"
 #include "drivers/pwm_rx.h"
+#include "drivers/dshot.h"
 #include "drivers/rx_nrf24l01.h"
 #include "drivers/serial.h"
 
@@ -70,6 +72,9 @@
 
 #include "config/runtime_config.h"
 #include "config/config.h"
+#include "config/config_eeprom.h"
+#include "config/config_storage.h"
+#include "config/parameter_group.h"
 
 #include "config/config_profile.h"
 #include "config/config_master.h"
@@ -90,64 +95,14 @@ void useRcControlsConfig(modeActivationCondition_t *modeActivationConditions, es
 #define NRF24_DEFAULT_PROTOCOL 0
 #endif
 
-#if !defined(FLASH_SIZE)
-#error "Flash size not defined for target. (specify in KB)"
-#endif
-
-
-#ifndef FLASH_PAGE_SIZE
-    #ifdef STM32F303xC
-        #define FLASH_PAGE_SIZE                 ((uint16_t)0x800)
-    #endif
-
-    #ifdef STM32F10X_MD
-        #define FLASH_PAGE_SIZE                 ((uint16_t)0x400)
-    #endif
-
-    #ifdef STM32F10X_HD
-        #define FLASH_PAGE_SIZE                 ((uint16_t)0x800)
-    #endif
-#endif
-
-#if !defined(FLASH_SIZE) && !defined(FLASH_PAGE_COUNT)
-    #ifdef STM32F10X_MD
-        #define FLASH_PAGE_COUNT 128
-    #endif
-
-    #ifdef STM32F10X_HD
-        #define FLASH_PAGE_COUNT 128
-    #endif
-#endif
-
-#if defined(FLASH_SIZE)
-#define FLASH_PAGE_COUNT ((FLASH_SIZE * 0x400) / FLASH_PAGE_SIZE)
-#endif
-
-#if !defined(FLASH_PAGE_SIZE)
-#error "Flash page size not defined for target."
-#endif
-
-#if !defined(FLASH_PAGE_COUNT)
-#error "Flash page count not defined for target."
-#endif
-
-#if FLASH_SIZE <= 128
-#define FLASH_TO_RESERVE_FOR_CONFIG 0x800
-#else
-#define FLASH_TO_RESERVE_FOR_CONFIG 0x1000
-#endif
-
-// use the last flash pages for storage
-#define CONFIG_START_FLASH_ADDRESS (0x08000000 + (uint32_t)((FLASH_PAGE_SIZE * FLASH_PAGE_COUNT) - FLASH_TO_RESERVE_FOR_CONFIG))
-
-master_t masterConfig;                 // master config struct with data independent from profiles
+master_t masterConfig __attribute__ ((section(".bss.config_master"), aligned(4)));  // master config struct with data independent from profiles, size checked by linker script
 profile_t *currentProfile;
 static uint32_t activeFeaturesLatch = 0;
 
 static uint8_t currentControlRateProfileIndex = 0;
 controlRateConfig_t *currentControlRateProfile;
 
-static const uint8_t EEPROM_CONF_VERSION = 119;
+static const uint8_t EEPROM_CONF_VERSION = 126;
 
 static void resetAccelerometerTrims(flightDynamicsTrims_t * accZero, flightDynamicsTrims_t * accGain)
 {
@@ -220,6 +175,10 @@ void resetNavConfig(navConfig_t * navConfig)
 #endif
     navConfig->inav.gps_min_sats = 6;
     navConfig->inav.gps_delay_ms = 200;
+    navConfig->inav.baro_delay_ms = 30;
+#if defined(NAV_POS_ESTIMATOR_EKF)
+    navConfig->inav.use_ekf = 0;
+#endif
     navConfig->inav.accz_unarmed_cal = 1;
     navConfig->inav.use_gps_velned = 0;         // "Disabled" is mandatory with gps_nav_model = LOW_G
 
@@ -256,6 +215,8 @@ void resetNavConfig(navConfig_t * navConfig)
     navConfig->mc_max_bank_angle = 30;      // 30 deg
     navConfig->mc_hover_throttle = 1500;
     navConfig->mc_min_fly_throttle = 1200;
+    navConfig->mc_traj_max_accel = 250;     // 2.5 m/s^2
+    navConfig->mc_traj_max_jerk = 0;        // legacy controller, 500 (5 m/s^3) is a good start for the trajectory generator
 
     // Fixed wing
     navConfig->fw_max_bank_angle = 20;      // 30 deg
@@ -267,6 +228,13 @@ void resetNavConfig(navConfig_t * navConfig)
     navConfig->fw_pitch_to_throttle = 10;
     navConfig->fw_roll_to_pitch = 75;
     navConfig->fw_loiter_radius = 5000;     // 50m
+    navConfig->fw_nav_controller = NAV_FW_CONTROLLER_HEADING;
+    navConfig->fw_l1_period = 20;           // 20 sec
+    navConfig->fw_l1_damping = 75;          // 0.75
+    navConfig->fw_alt_controller = NAV_FW_ALT_CONTROLLER_PITCH;
+    navConfig->fw_cruise_speed = 0;         // Don't control speed
+    navConfig->fw_tecs_time_const = 50;     // 5 sec
+    navConfig->fw_tecs_speed_weight = 100;  // Altitude and speed are equally important
 }
 
 void validateNavConfig(navConfig_t * navConfig)
@@ -276,11 +244,6 @@ void validateNavConfig(navConfig_t * navConfig)
 }
 #endif
 
-void resetBarometerConfig(barometerConfig_t *barometerConfig)
-{
-    barometerConfig->use_median_filtering = 1;
-}
-
 void resetSensorAlignment(sensorAlignmentConfig_t *sensorAlignmentConfig)
 {
     sensorAlignmentConfig->gyro_align = ALIGN_DEFAULT;
@@ -389,6 +352,9 @@ void resetRcControlsConfig(rcControlsConfig_t *rcControlsConfig) {
 void resetMixerConfig(mixerConfig_t *mixerConfig) {
     mixerConfig->yaw_motor_direction = 1;
     mixerConfig->yaw_jump_prevention_limit = 200;
+    mixerConfig->desaturation_mode = MIXER_DESAT_UNIFORM;
+    mixerConfig->thrust_linearization = 0;
+    mixerConfig->vbat_compensation = 0;
 #ifdef USE_SERVOS
     mixerConfig->tri_unarmed_servo = 1;
     mixerConfig->servo_lowpass_freq = 400;
@@ -433,6 +399,7 @@ static void resetConf(void)
 
     // Clear all configuration
     memset(&masterConfig, 0, sizeof(master_t));
+    pgResetAll();
     setProfile(0);
     setControlRateProfile(0);
 
@@ -516,6 +483,8 @@ static void resetConf(void)
     masterConfig.motor_pwm_rate = BRUSHLESS_MOTORS_PWM_RATE;
 #endif
     masterConfig.servo_pwm_rate = 50;
+    masterConfig.dshot_protocol = DSHOT_DISABLED;
+    masterConfig.pwm_output_sync = 0;
 
 #ifdef GPS
     // gps/nav stuff
@@ -547,7 +516,6 @@ static void resetConf(void)
 
     currentProfile->mag_declination = 0;
 
-    resetBarometerConfig(&masterConfig.barometerConfig);
 
     // Radio
     parseRcChannels("AETR1234", &masterConfig.rxConfig);
@@ -589,15 +557,8 @@ static void resetConf(void)
     applyDefaultLedStripConfig(masterConfig.ledConfigs);
 #endif
 
-#ifdef BLACKBOX
-#ifdef ENABLE_BLACKBOX_LOGGING_ON_SPIFLASH_BY_DEFAULT
+#if defined(BLACKBOX) && defined(ENABLE_BLACKBOX_LOGGING_ON_SPIFLASH_BY_DEFAULT)
     featureSet(FEATURE_BLACKBOX);
-    masterConfig.blackbox_device = BLACKBOX_DEVICE_FLASH;
-#else
-    masterConfig.blackbox_device = BLACKBOX_DEVICE_SERIAL;
-#endif
-    masterConfig.blackbox_rate_num = 1;
-    masterConfig.blackbox_rate_denom = 1;
 #endif
 
     // alternative defaults settings for COLIBRI RACE targets
@@ -716,28 +677,144 @@ static uint8_t calculateChecksum(const uint8_t *data, uint32_t length)
     return checksum;
 }
 
-static bool isEEPROMContentValid(void)
+/*
+ * Stored image is master_t followed by parameter groups, each prefixed with a header, and an end header with
+ * pgn 0. master_t.chk makes XOR of the whole image zero.
+ */
+typedef struct pgStoredHeader_s {
+    pgn_t pgn;
+    uint8_t version;
+    uint8_t reserved;
+    uint16_t size;
+} pgStoredHeader_t;
+
+#define PG_STORED_END 0
+
+static void configImageCopy(uint32_t *segmentOffset, const void *segment, uint32_t segmentSize, uint32_t offset, uint8_t *dst, uint32_t size)
 {
-    const master_t *temp = (const master_t *) CONFIG_START_FLASH_ADDRESS;
+    const uint32_t start = MAX(offset, *segmentOffset);
+    const uint32_t end = MIN(offset + size, *segmentOffset + segmentSize);
+
+    if (start < end) {
+        memcpy(dst + (start - offset), (const uint8_t *)segment + (start - *segmentOffset), end - start);
+    }
+    *segmentOffset += segmentSize;
+}
+
+// Assemble piece of the image to be stored, the image doesn't exist in RAM as a whole
+static void configImageRead(uint32_t offset, void *dst, uint32_t size)
+{
+    uint32_t segmentOffset = 0;
+    pgStoredHeader_t header;
+
+    configImageCopy(&segmentOffset, &masterConfig, sizeof(master_t), offset, dst, size);
+
+    PG_FOREACH(reg) {
+        header = (pgStoredHeader_t) { .pgn = reg->pgn, .version = reg->version, .reserved = 0, .size = reg->size };
+        configImageCopy(&segmentOffset, &header, sizeof(header), offset, dst, size);
+        configImageCopy(&segmentOffset, reg->address, reg->size, offset, dst, size);
+    }
+
+    header = (pgStoredHeader_t) { .pgn = PG_STORED_END, .version = 0, .reserved = 0, .size = 0 };
+    configImageCopy(&segmentOffset, &header, sizeof(header), offset, dst, size);
+}
+
+static uint32_t configImageSize(void)
+{
+    uint32_t size = sizeof(master_t) + sizeof(pgStoredHeader_t);
+
+    PG_FOREACH(reg) {
+        size += sizeof(pgStoredHeader_t) + reg->size;
+    }
+    return size;
+}
+
+// Checks integrity of the stored image, which may come from older firmware with different master_t
+static bool isStoredImageIntact(void)
+{
+    uint16_t masterSize;
+    uint8_t magic_be;
+    pgStoredHeader_t header;
+    uint8_t buf[32];
     uint8_t checksum = 0;
 
-    // check version number
-    if (EEPROM_CONF_VERSION != temp->version)
+    if (!configStorageRead(offsetof(master_t, size), &masterSize, sizeof(masterSize)) ||
+        !configStorageRead(offsetof(master_t, magic_be), &magic_be, sizeof(magic_be))) {
+        return false;
+    }
+
+    if (magic_be != 0xBE) {
         return false;
+    }
 
-    // check size and magic numbers
-    if (temp->size != sizeof(master_t) || temp->magic_be != 0xBE || temp->magic_ef != 0xEF)
+    // find end of the image
+    uint32_t imageSize = masterSize;
+    do {
+        if (imageSize + sizeof(header) > CONFIG_STORAGE_MAX_SIZE || !configStorageRead(imageSize, &header, sizeof(header))) {
+            return false;
+        }
+        imageSize += sizeof(header) + header.size;
+    } while (header.pgn != PG_STORED_END);
+
+    for (uint32_t offset = 0; offset < imageSize; offset += sizeof(buf)) {
+        const uint32_t length = MIN(imageSize - offset, sizeof(buf));
+        if (!configStorageRead(offset, buf, length)) {
+            return false;
+        }
+        checksum ^= calculateChecksum(buf, length);
+    }
+
+    return checksum == 0;
+}
+
+static bool isEEPROMContentValid(void)
+{
+    uint8_t version;
+    uint16_t size;
+    uint8_t magic_ef;
+
+    if (!isStoredImageIntact()) {
+        return false;
+    }
+
+    if (!configStorageRead(offsetof(master_t, version), &version, sizeof(version)) ||
+        !configStorageRead(offsetof(master_t, size), &size, sizeof(size)) ||
+        !configStorageRead(offsetof(master_t, magic_ef), &magic_ef, sizeof(magic_ef))) {
+        return false;
+    }
+
+    // check version number
+    if (EEPROM_CONF_VERSION != version)
         return false;
 
-    // verify integrity of temporary copy
-    checksum = calculateChecksum((const uint8_t *) temp, sizeof(master_t));
-    if (checksum != 0)
+    // check size and magic numbers
+    if (size != sizeof(master_t) || magic_ef != 0xEF)
         return false;
 
     // looks good, let's roll!
     return true;
 }
 
+// Load the groups whose version and size didn't change, others keep their current values
+static void pgLoadStored(void)
+{
+    uint16_t offset;
+    pgStoredHeader_t header;
+
+    if (!isStoredImageIntact() || !configStorageRead(offsetof(master_t, size), &offset, sizeof(offset))) {
+        return;
+    }
+
+    while (configStorageRead(offset, &header, sizeof(header)) && header.pgn != PG_STORED_END) {
+        const pgRegistry_t *reg = pgFind(header.pgn);
+
+        if (reg && reg->version == header.version && reg->size == header.size) {
+            configStorageRead(offset + sizeof(header), reg->address, reg->size);
+        }
+        offset += sizeof(header) + header.size;
+    }
+}
+
 void activateControlRateConfig(void)
 {
     generateRcCurves(currentControlRateProfile);
@@ -797,10 +874,6 @@ void activateConfig(void)
     navigationUseFlight3DConfig(&masterConfig.flight3DConfig);
     navigationUseEscAndServoConfig(&masterConfig.escAndServoConfig);
 #endif
-
-#ifdef BARO
-    useBarometerConfig(&masterConfig.barometerConfig);
-#endif
 }
 
 static void validateAndFixConfig(void)
@@ -903,6 +976,18 @@ static void validateAndFixConfig(void)
     }
 #endif
 
+#ifdef USE_DSHOT
+    if (masterConfig.dshot_protocol != DSHOT_DISABLED) {
+        // DShot replaces the analog motor protocols
+        featureClear(FEATURE_ONESHOT125);
+
+        // reversible (3D) DShot commands are not supported
+        if (featureConfigured(FEATURE_3D)) {
+            masterConfig.dshot_protocol = DSHOT_DISABLED;
+        }
+    }
+#endif
+
 #if defined(NAZE) && defined(SONAR)
     if (featureConfigured(FEATURE_RX_PARALLEL_PWM) && featureConfigured(FEATURE_SONAR) && featureConfigured(FEATURE_CURRENT_METER) && masterConfig.batteryConfig.currentMeterType == CURRENT_SENSOR_ADC) {
         featureClear(FEATURE_CURRENT_METER);
@@ -977,6 +1062,7 @@ void applyAndSaveBoardAlignmentDelta(int16_t roll, int16_t pitch)
 
 void initEEPROM(void)
 {
+    configStorageInit();
 }
 
 void readEEPROM(void)
@@ -988,7 +1074,9 @@ void readEEPROM(void)
     suspendRxSignal();
 
     // Read flash
-    memcpy(&masterConfig, (char *) CONFIG_START_FLASH_ADDRESS, sizeof(master_t));
+    configStorageRead(0, &masterConfig, sizeof(master_t));
+    pgResetAll();
+    pgLoadStored();
 
     if (masterConfig.current_profile_index > MAX_PROFILE_COUNT - 1) // sanity check
         masterConfig.current_profile_index = 0;
@@ -1016,11 +1104,16 @@ void readEEPROMAndNotify(void)
 void writeEEPROM(void)
 {
     // Generate compile time error if the config does not fit in the reserved area of flash.
+    // The whole image, with parameter groups, is checked at link time by stm32_flash.ld using these sizes.
     BUILD_BUG_ON(sizeof(master_t) > FLASH_TO_RESERVE_FOR_CONFIG);
+    BUILD_BUG_ON(sizeof(master_t) > CONFIG_STORAGE_MAX_SIZE);
+    BUILD_BUG_ON(sizeof(pgStoredHeader_t) != 6);
+#ifndef UNIT_TEST
+    BUILD_BUG_ON(sizeof(pgRegistry_t) != 16);
+#endif
 
-    FLASH_Status status = 0;
-    uint32_t wordOffset;
-    int8_t attemptsRemaining = 3;
+    const uint32_t imageSize = configImageSize();
+    uint8_t buf[32];
 
     suspendRxSignal();
 
@@ -1030,39 +1123,20 @@ void writeEEPROM(void)
     masterConfig.magic_be = 0xBE;
     masterConfig.magic_ef = 0xEF;
     masterConfig.chk = 0; // erase checksum before recalculating
-    masterConfig.chk = calculateChecksum((const uint8_t *) &masterConfig, sizeof(master_t));
 
-    // write it
-    FLASH_Unlock();
-    while (attemptsRemaining--) {
-#ifdef STM32F303
-        FLASH_ClearFlag(FLASH_FLAG_EOP | FLASH_FLAG_PGERR | FLASH_FLAG_WRPERR);
-#endif
-#ifdef STM32F10X
-        FLASH_ClearFlag(FLASH_FLAG_EOP | FLASH_FLAG_PGERR | FLASH_FLAG_WRPRTERR);
-#endif
-        for (wordOffset = 0; wordOffset < sizeof(master_t); wordOffset += 4) {
-            if (wordOffset % FLASH_PAGE_SIZE == 0) {
-                status = FLASH_ErasePage(CONFIG_START_FLASH_ADDRESS + wordOffset);
-                if (status != FLASH_COMPLETE) {
-                    break;
-                }
-            }
-
-            status = FLASH_ProgramWord(CONFIG_START_FLASH_ADDRESS + wordOffset,
-                    *(uint32_t *) ((char *) &masterConfig + wordOffset));
-            if (status != FLASH_COMPLETE) {
-                break;
-            }
-        }
-        if (status == FLASH_COMPLETE) {
-            break;
-        }
+    uint8_t checksum = 0;
+    for (uint32_t offset = 0; offset < imageSize; offset += sizeof(buf)) {
+        const uint32_t length = MIN(imageSize - offset, sizeof(buf));
+        configImageRead(offset, buf, length);
+        checksum ^= calculateChecksum(buf, length);
     }
-    FLASH_Lock();
+    masterConfig.chk = checksum;
+
+    // write it, with log storage only the changed chunks are programmed
+    const bool success = configStorageWrite(configImageRead, imageSize);
 
     // Flash write failed - just die now
-    if (status != FLASH_COMPLETE || !isEEPROMContentValid()) {
+    if (!success || !isEEPROMContentValid()) {
         failureMode(FAILURE_FLASH_WRITE_FAILED);
     }
 
@@ -1075,7 +1149,10 @@ void ensureEEPROMContainsValidData(void)
         return;
     }
 
-    resetEEPROM();
+    // master_t is reset, parameter groups which didn't change since the stored config was written are kept
+    resetConf();
+    pgLoadStored();
+    writeEEPROM();
 }
 
 void resetEEPROM(void)
@@ -42,6 +42,8 @@ typedef struct master_t {
 
     uint16_t motor_pwm_rate;                // The update rate of motor outputs (50-498Hz)
     uint16_t servo_pwm_rate;                // The update rate of servo outputs (50-498Hz)
+    uint8_t dshot_protocol;                 // Digital motor protocol (dshotProtocol_e), overrides motor_pwm_rate and ONESHOT125 when enabled
+    uint8_t pwm_output_sync;                // Latch motor/servo outputs and apply them at the start of the next loop
 
     // global sensor-related stuff
 
@@ -59,8 +61,6 @@ typedef struct master_t {
 
     gyroConfig_t gyroConfig;
 
-    barometerConfig_t barometerConfig;
-
     uint8_t mag_hardware;                   // Which mag hardware to use on boards with more than one device
     uint8_t baro_hardware;                  // Barometer hardware to use
 
@@ -103,12 +103,6 @@ typedef struct master_t {
     uint8_t current_profile_index;
     controlRateConfig_t controlRateProfiles[MAX_CONTROL_RATE_PROFILE_COUNT];
 
-#ifdef BLACKBOX
-    uint8_t blackbox_rate_num;
-    uint8_t blackbox_rate_denom;
-    uint8_t blackbox_device;
-#endif
-
     uint32_t beeper_off_flags;
     uint32_t prefered_beeper_off_flags;
 
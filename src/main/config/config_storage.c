@@ -0,0 +1,424 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "platform.h"
+
+#include "build_config.h"
+
+#include "common/crc.h"
+#include "common/maths.h"
+
+#include "config/config_eeprom.h"
+#include "config/config_storage.h"
+
+#ifdef STM32F303
+#define FLASH_CLEAR_ERROR_FLAGS()   FLASH_ClearFlag(FLASH_FLAG_EOP | FLASH_FLAG_PGERR | FLASH_FLAG_WRPERR)
+#endif
+#ifdef STM32F10X
+#define FLASH_CLEAR_ERROR_FLAGS()   FLASH_ClearFlag(FLASH_FLAG_EOP | FLASH_FLAG_PGERR | FLASH_FLAG_WRPRTERR)
+#endif
+
+static bool configStorageProgram(uint32_t address, const void *data, uint32_t size)
+{
+    for (uint32_t wordOffset = 0; wordOffset < size; wordOffset += 4) {
+        uint32_t word = 0xFFFFFFFF;
+        memcpy(&word, (const uint8_t *)data + wordOffset, MIN(size - wordOffset, sizeof(word)));
+        if (FLASH_ProgramWord(address + wordOffset, word) != FLASH_COMPLETE) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool configStorageErase(uint32_t address, uint32_t size)
+{
+    for (uint32_t pageOffset = 0; pageOffset < size; pageOffset += FLASH_PAGE_SIZE) {
+        if (FLASH_ErasePage(address + pageOffset) != FLASH_COMPLETE) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#ifdef CONFIG_STORAGE_LOG
+/*
+ * The reserved area is split in two banks. The active bank starts with a header and holds a log of chunk records,
+ * each chunk of the image is valid in its latest committed record. A write appends only the chunks which
+ * differ from the stored ones, so saving a small change costs programming a few records instead of erasing
+ * and reprogramming the whole area. When the active bank is full, the whole image is written to the other bank
+ * and its header sequence is programmed last, so the old bank stays active if the write is interrupted.
+ *
+ * All records of a write carry the same save number and the write ends with a commit record (header only,
+ * in a slot of its own). Records of a save are applied only once its commit is found, so a write interrupted
+ * part way leaves the previous image intact instead of a mix of old and new chunks.
+ */
+
+#define CONFIG_BANK_SIZE            (FLASH_TO_RESERVE_FOR_CONFIG / 2)
+#define CONFIG_BANK_MAGIC           0x31474643      // "CFG1"
+#define CONFIG_BANK_NONE            0xFF
+#define CONFIG_RECORD_MARKER        0xC5
+#define CONFIG_RECORD_COMMIT        0xFE            // chunk index of the record which ends a save
+#define CONFIG_RECORD_SIZE          (sizeof(configRecordHeader_t) + CONFIG_STORAGE_CHUNK_SIZE)
+
+typedef struct configBankHeader_s {
+    uint32_t magic;
+    uint32_t sequence;                  // programmed when bank content is complete, higher is newer
+    uint32_t sequenceCheck;             // ~sequence, programmed last so a torn sequence is not taken for a newer bank
+} configBankHeader_t;
+
+typedef struct configRecordHeader_s {
+    uint8_t chunk;
+    uint8_t marker;
+    uint16_t crc;                       // CRC16 of save, chunk index and data
+    uint32_t save;                      // records written by one configStorageWrite() share the save number
+} configRecordHeader_t;
+
+static struct {
+    uint8_t activeBank;
+    uint32_t sequence;
+    uint32_t save;                                  // highest save number in active bank, committed or not
+    uint16_t appendOffset;                          // first free record in active bank
+    uint16_t chunkOffset[CONFIG_STORAGE_MAX_CHUNKS];  // data of latest record of each chunk in active bank, 0 if none
+} configStorage;
+
+static uint32_t configBankAddress(uint8_t bank)
+{
+    return CONFIG_START_FLASH_ADDRESS + bank * CONFIG_BANK_SIZE;
+}
+
+static const uint8_t *configBankData(uint8_t bank)
+{
+    return (const uint8_t *)(uintptr_t)configBankAddress(bank);
+}
+
+static bool configBankIsValid(uint8_t bank)
+{
+    const configBankHeader_t *header = (const configBankHeader_t *)configBankData(bank);
+    return header->magic == CONFIG_BANK_MAGIC && header->sequence != 0xFFFFFFFF && header->sequenceCheck == ~header->sequence;
+}
+
+// commit records have no data
+static uint16_t configRecordCrc(uint32_t save, uint8_t chunk, const uint8_t *data)
+{
+    uint16_t crc = crc16_ccitt_update(0xFFFF, &save, sizeof(save));
+    crc = crc16_ccitt(crc, chunk);
+    if (data) {
+        crc = crc16_ccitt_update(crc, data, CONFIG_STORAGE_CHUNK_SIZE);
+    }
+    return crc;
+}
+
+static bool configRecordIsValid(const configRecordHeader_t *record)
+{
+    if (record->marker != CONFIG_RECORD_MARKER) {
+        return false;
+    }
+    if (record->chunk == CONFIG_RECORD_COMMIT) {
+        return record->crc == configRecordCrc(record->save, record->chunk, NULL);
+    }
+    return record->chunk < CONFIG_STORAGE_MAX_CHUNKS &&
+           record->crc == configRecordCrc(record->save, record->chunk, (const uint8_t *)record + sizeof(configRecordHeader_t));
+}
+
+void configStorageInit(void)
+{
+    configStorage.activeBank = CONFIG_BANK_NONE;
+    configStorage.sequence = 0;
+    configStorage.save = 0;
+    configStorage.appendOffset = sizeof(configBankHeader_t);
+    memset(configStorage.chunkOffset, 0, sizeof(configStorage.chunkOffset));
+
+    for (uint8_t bank = 0; bank < 2; bank++) {
+        const configBankHeader_t *header = (const configBankHeader_t *)configBankData(bank);
+        if (configBankIsValid(bank) && (configStorage.activeBank == CONFIG_BANK_NONE || header->sequence > configStorage.sequence)) {
+            configStorage.activeBank = bank;
+            configStorage.sequence = header->sequence;
+        }
+    }
+
+    if (configStorage.activeBank == CONFIG_BANK_NONE) {
+        return;
+    }
+
+    const uint8_t *bankData = configBankData(configStorage.activeBank);
+    uint16_t pendingOffset[CONFIG_STORAGE_MAX_CHUNKS];  // records of the save being scanned, not committed yet
+    uint32_t pendingSave = 0;
+    uint16_t offset = sizeof(configBankHeader_t);
+
+    memset(pendingOffset, 0, sizeof(pendingOffset));
+
+    for (; offset + CONFIG_RECORD_SIZE <= CONFIG_BANK_SIZE; offset += CONFIG_RECORD_SIZE) {
+        const configRecordHeader_t *record = (const configRecordHeader_t *)(bankData + offset);
+
+        if (*(const uint32_t *)record == 0xFFFFFFFF) {
+            break;  // end of log
+        }
+
+        // Records which were being written on power loss fail the CRC and are skipped
+        if (!configRecordIsValid(record)) {
+            continue;
+        }
+
+        configStorage.save = MAX(configStorage.save, record->save);
+
+        // A save without commit was interrupted, its records are dropped when the next save starts
+        if (record->save != pendingSave) {
+            memset(pendingOffset, 0, sizeof(pendingOffset));
+            pendingSave = record->save;
+        }
+
+        if (record->chunk == CONFIG_RECORD_COMMIT) {
+            for (uint8_t chunk = 0; chunk < CONFIG_STORAGE_MAX_CHUNKS; chunk++) {
+                if (pendingOffset[chunk]) {
+                    configStorage.chunkOffset[chunk] = pendingOffset[chunk];
+                }
+            }
+            memset(pendingOffset, 0, sizeof(pendingOffset));
+        } else {
+            pendingOffset[record->chunk] = offset + sizeof(configRecordHeader_t);
+        }
+    }
+
+    configStorage.appendOffset = offset;
+}
+
+bool configStorageRead(uint32_t offset, void *dst, uint32_t size)
+{
+    if (configStorage.activeBank == CONFIG_BANK_NONE) {
+        return false;
+    }
+
+    const uint8_t *bankData = configBankData(configStorage.activeBank);
+
+    while (size > 0) {
+        const uint32_t chunk = offset / CONFIG_STORAGE_CHUNK_SIZE;
+        const uint32_t chunkOffset = offset % CONFIG_STORAGE_CHUNK_SIZE;
+        const uint32_t length = MIN(size, CONFIG_STORAGE_CHUNK_SIZE - chunkOffset);
+
+        if (chunk >= CONFIG_STORAGE_MAX_CHUNKS || configStorage.chunkOffset[chunk] == 0) {
+            return false;
+        }
+
+        memcpy(dst, bankData + configStorage.chunkOffset[chunk] + chunkOffset, length);
+
+        dst = (uint8_t *)dst + length;
+        offset += length;
+        size -= length;
+    }
+
+    return true;
+}
+
+// Image is fetched a chunk at a time so it doesn't have to exist in RAM as a whole, the last chunk is zero padded
+static void configReadChunk(configStorageSourceFn source, uint32_t size, uint8_t chunk, uint8_t *data)
+{
+    const uint32_t offset = chunk * CONFIG_STORAGE_CHUNK_SIZE;
+
+    memset(data, 0, CONFIG_STORAGE_CHUNK_SIZE);
+    source(offset, data, MIN(size - offset, (uint32_t)CONFIG_STORAGE_CHUNK_SIZE));
+}
+
+static bool configChunkIsStored(uint8_t chunk, const uint8_t *data)
+{
+    if (configStorage.activeBank == CONFIG_BANK_NONE || configStorage.chunkOffset[chunk] == 0) {
+        return false;
+    }
+
+    const uint8_t *stored = configBankData(configStorage.activeBank) + configStorage.chunkOffset[chunk];
+    return memcmp(stored, data, CONFIG_STORAGE_CHUNK_SIZE) == 0;
+}
+
+static bool configWriteRecord(uint32_t address, uint32_t save, uint8_t chunk, const uint8_t *data)
+{
+    const configRecordHeader_t header = {
+        .chunk = chunk,
+        .marker = CONFIG_RECORD_MARKER,
+        .crc = configRecordCrc(save, chunk, data),
+        .save = save,
+    };
+
+    // header goes first, a record interrupted while programming the data fails the CRC
+    return configStorageProgram(address, &header, sizeof(header)) &&
+           (data == NULL || configStorageProgram(address + sizeof(header), data, CONFIG_STORAGE_CHUNK_SIZE));
+}
+
+// Written last, the records of the save are ignored until it is programmed
+static bool configWriteCommit(uint32_t address, uint32_t save)
+{
+    return configWriteRecord(address, save, CONFIG_RECORD_COMMIT, NULL);
+}
+
+static bool configAppendChangedChunks(configStorageSourceFn source, uint32_t size, uint8_t chunkCount)
+{
+    uint8_t data[CONFIG_STORAGE_CHUNK_SIZE];
+    uint32_t address = configBankAddress(configStorage.activeBank) + configStorage.appendOffset;
+    const uint32_t save = configStorage.save + 1;
+
+    for (uint8_t chunk = 0; chunk < chunkCount; chunk++) {
+        configReadChunk(source, size, chunk, data);
+        if (configChunkIsStored(chunk, data)) {
+            continue;
+        }
+        if (!configWriteRecord(address, save, chunk, data)) {
+            return false;
+        }
+        address += CONFIG_RECORD_SIZE;
+    }
+
+    return configWriteCommit(address, save);
+}
+
+static bool configWriteBank(configStorageSourceFn source, uint32_t size, uint8_t chunkCount)
+{
+    uint8_t data[CONFIG_STORAGE_CHUNK_SIZE];
+    const uint8_t bank = (configStorage.activeBank == 0) ? 1 : 0;
+    const uint32_t bankAddress = configBankAddress(bank);
+    const uint32_t save = configStorage.save + 1;
+    const configBankHeader_t header = {
+        .magic = CONFIG_BANK_MAGIC,
+        .sequence = configStorage.sequence + 1,
+        .sequenceCheck = ~(configStorage.sequence + 1),
+    };
+
+    if (!configStorageErase(bankAddress, CONFIG_BANK_SIZE)) {
+        return false;
+    }
+
+    if (!configStorageProgram(bankAddress, &header.magic, sizeof(header.magic))) {
+        return false;
+    }
+
+    for (uint8_t chunk = 0; chunk < chunkCount; chunk++) {
+        configReadChunk(source, size, chunk, data);
+        if (!configWriteRecord(bankAddress + sizeof(configBankHeader_t) + chunk * CONFIG_RECORD_SIZE, save, chunk, data)) {
+            return false;
+        }
+    }
+
+    if (!configWriteCommit(bankAddress + sizeof(configBankHeader_t) + chunkCount * CONFIG_RECORD_SIZE, save)) {
+        return false;
+    }
+
+    // bank becomes active once its sequence is programmed
+    return configStorageProgram(bankAddress + offsetof(configBankHeader_t, sequence), &header.sequence, sizeof(header.sequence)) &&
+           configStorageProgram(bankAddress + offsetof(configBankHeader_t, sequenceCheck), &header.sequenceCheck, sizeof(header.sequenceCheck));
+}
+
+bool configStorageWrite(configStorageSourceFn source, uint32_t size)
+{
+    BUILD_BUG_ON(CONFIG_BANK_SIZE % FLASH_PAGE_SIZE != 0);
+    BUILD_BUG_ON(sizeof(configBankHeader_t) + (CONFIG_STORAGE_MAX_CHUNKS + 1) * CONFIG_RECORD_SIZE > CONFIG_BANK_SIZE);
+
+    uint8_t data[CONFIG_STORAGE_CHUNK_SIZE];
+    const uint8_t chunkCount = (size + CONFIG_STORAGE_CHUNK_SIZE - 1) / CONFIG_STORAGE_CHUNK_SIZE;
+    uint8_t changedCount = 0;
+    bool success = false;
+
+    if (size > CONFIG_STORAGE_MAX_SIZE) {
+        return false;
+    }
+
+    for (uint8_t chunk = 0; chunk < chunkCount; chunk++) {
+        configReadChunk(source, size, chunk, data);
+        if (!configChunkIsStored(chunk, data)) {
+            changedCount++;
+        }
+    }
+
+    if (changedCount == 0) {
+        return true;
+    }
+
+    FLASH_Unlock();
+    FLASH_CLEAR_ERROR_FLAGS();
+
+    if (configStorage.activeBank != CONFIG_BANK_NONE && configStorage.appendOffset + (changedCount + 1) * CONFIG_RECORD_SIZE <= CONFIG_BANK_SIZE) {
+        success = configAppendChangedChunks(source, size, chunkCount);
+    }
+
+    // Active bank is full (or failed to program), start over in the other bank
+    if (!success) {
+        FLASH_CLEAR_ERROR_FLAGS();
+        success = configWriteBank(source, size, chunkCount);
+    }
+
+    FLASH_Lock();
+
+    configStorageInit();
+
+    return success;
+}
+
+#else
+
+void configStorageInit(void)
+{
+}
+
+bool configStorageRead(uint32_t offset, void *dst, uint32_t size)
+{
+    if (offset + size > FLASH_TO_RESERVE_FOR_CONFIG) {
+        return false;
+    }
+
+    memcpy(dst, (const uint8_t *)CONFIG_START_FLASH_ADDRESS + offset, size);
+    return true;
+}
+
+static bool configStorageProgramImage(configStorageSourceFn source, uint32_t size)
+{
+    uint8_t data[CONFIG_STORAGE_CHUNK_SIZE];
+
+    if (!configStorageErase(CONFIG_START_FLASH_ADDRESS, size)) {
+        return false;
+    }
+
+    for (uint32_t offset = 0; offset < size; offset += sizeof(data)) {
+        const uint32_t length = MIN(size - offset, sizeof(data));
+        source(offset, data, length);
+        if (!configStorageProgram(CONFIG_START_FLASH_ADDRESS + offset, data, length)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool configStorageWrite(configStorageSourceFn source, uint32_t size)
+{
+    bool success = false;
+    int8_t attemptsRemaining = 3;
+
+    if (size > FLASH_TO_RESERVE_FOR_CONFIG) {
+        return false;
+    }
+
+    FLASH_Unlock();
+    while (attemptsRemaining-- && !success) {
+        FLASH_CLEAR_ERROR_FLAGS();
+        success = configStorageProgramImage(source, size);
+    }
+    FLASH_Lock();
+
+    return success;
+}
+#endif
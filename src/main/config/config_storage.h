@@ -0,0 +1,32 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// Persistent storage of the config image in the flash area reserved for it (see config_eeprom.h).
+// Without CONFIG_STORAGE_LOG the whole image is erased and reprogrammed on each write.
+
+#define CONFIG_STORAGE_CHUNK_SIZE   64      // unit of partial saves
+#define CONFIG_STORAGE_MAX_CHUNKS   48
+#define CONFIG_STORAGE_MAX_SIZE     (CONFIG_STORAGE_CHUNK_SIZE * CONFIG_STORAGE_MAX_CHUNKS)
+
+// Provides the image to be written, piece by piece
+typedef void (*configStorageSourceFn)(uint32_t offset, void *dst, uint32_t size);
+
+void configStorageInit(void);
+bool configStorageRead(uint32_t offset, void *dst, uint32_t size);
+bool configStorageWrite(configStorageSourceFn source, uint32_t size);
@@ -0,0 +1,47 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "config/parameter_group.h"
+
+const pgRegistry_t *pgFind(pgn_t pgn)
+{
+    PG_FOREACH(reg) {
+        if (reg->pgn == pgn) {
+            return reg;
+        }
+    }
+    return NULL;
+}
+
+void pgReset(const pgRegistry_t *reg)
+{
+    memset(reg->address, 0, reg->size);
+    if (reg->reset) {
+        reg->reset(reg->address);
+    }
+}
+
+void pgResetAll(void)
+{
+    PG_FOREACH(reg) {
+        pgReset(reg);
+    }
+}
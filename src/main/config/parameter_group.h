@@ -0,0 +1,76 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// Parameter groups are configuration structs owned by a subsystem. Each group is registered with its own id and
+// version, is stored after master_t and is reset to its defaults alone when its version changes.
+
+typedef uint16_t pgn_t;
+
+typedef void (*pgResetFunc)(void *base);
+
+typedef struct pgRegistry_s {
+    pgn_t pgn;              // stored id of the group, see parameter_group_ids.h
+    uint8_t version;        // increment when layout or meaning of the struct changes
+    uint16_t size;
+    uint8_t *address;
+    pgResetFunc reset;      // fills in defaults, NULL if defaults are all zero
+} pgRegistry_t;
+
+#ifdef UNIT_TEST
+// host linker provides start and end of sections named as C identifiers
+#define __pg_registry_start __start_pg_registry
+#define __pg_registry_end __stop_pg_registry
+#endif
+
+extern const pgRegistry_t __pg_registry_start[];
+extern const pgRegistry_t __pg_registry_end[];
+
+#define PG_FOREACH(_reg) \
+    for (const pgRegistry_t *(_reg) = __pg_registry_start; (_reg) < __pg_registry_end; (_reg)++)
+
+#define PG_REGISTER_ATTRIBUTES __attribute__ ((section("pg_registry"), used, aligned(4)))
+// Group data is kept together in .bss, so the linker script can check the stored image fits into the reserved flash
+#define PG_STORAGE_ATTRIBUTES __attribute__ ((section(".bss.pg_storage"), aligned(4)))
+
+// Declare accessors of a group, in the header of the owning subsystem
+#define PG_DECLARE(_type, _name) \
+    extern _type _name ## _System; \
+    static inline const _type* _name(void) { return &_name ## _System; } \
+    static inline _type* _name ## Mutable(void) { return &_name ## _System; } \
+    struct _dummy
+
+// Register a group, in the source of the owning subsystem. Group is compiled out together with the subsystem.
+#define PG_REGISTER_WITH_RESET_FN(_type, _name, _pgn, _version) \
+    _type _name ## _System PG_STORAGE_ATTRIBUTES; \
+    void pgResetFn_ ## _name(_type *); \
+    extern const pgRegistry_t _name ## _Registry; \
+    const pgRegistry_t _name ## _Registry PG_REGISTER_ATTRIBUTES = { \
+        _pgn, _version, sizeof(_type), (uint8_t *)&_name ## _System, (pgResetFunc)pgResetFn_ ## _name \
+    }
+
+#define PG_REGISTER(_type, _name, _pgn, _version) \
+    _type _name ## _System PG_STORAGE_ATTRIBUTES; \
+    extern const pgRegistry_t _name ## _Registry; \
+    const pgRegistry_t _name ## _Registry PG_REGISTER_ATTRIBUTES = { \
+        _pgn, _version, sizeof(_type), (uint8_t *)&_name ## _System, NULL \
+    }
+
+const pgRegistry_t *pgFind(pgn_t pgn);
+void pgReset(const pgRegistry_t *reg);
+void pgResetAll(void);
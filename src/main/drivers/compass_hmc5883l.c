@@ -31,7 +31,6 @@
 #include "nvic.h"
 #include "gpio.h"
 #include "bus_i2c.h"
-#include "light_led.h"
 
 #include "sensor.h"
 #include "compass.h"
@@ -214,13 +213,27 @@ bool hmc5883lDetect(mag_t* mag, const hmc5883Config_t *hmc5883ConfigToUse)
     return true;
 }
 
+// Self test is run by hmc5883lRead() from the compass task, one single measurement per call, so it overlaps
+// with gyro and baro calibration instead of blocking the boot for over a second. It takes 21 compass task runs
+// (about 2.1s at 10Hz), arming is blocked until it is done (see isCalibrating()). If the measurements don't arrive
+// in time, the default gain is used.
+#define HMC_SELF_TEST_SAMPLES 10
+#define HMC_SELF_TEST_TIMEOUT_MS 5000
+
+typedef enum {
+    HMC_SELF_TEST_FIRST_SAMPLE = 0,     // first measurement after gain change still uses previous gain, discarded
+    HMC_SELF_TEST_POSITIVE_BIAS,
+    HMC_SELF_TEST_NEGATIVE_BIAS,
+    HMC_SELF_TEST_DONE
+} hmc5883SelfTestState_e;
+
+static hmc5883SelfTestState_e selfTestState = HMC_SELF_TEST_DONE;
+static uint8_t selfTestSampleCount;
+static int32_t selfTestTotal[3];        // 32 bit totals so they won't overflow.
+static uint32_t selfTestStartedAt;
+
 void hmc5883lInit(void)
 {
-    int16_t magADC[3];
-    int i;
-    int32_t xyz_total[3] = { 0, 0, 0 }; // 32 bit totals so they won't overflow.
-    bool bret = true;           // Error indicator
-
     gpio_config_t gpio;
 
     if (hmc5883Config) {
@@ -240,79 +253,102 @@ void hmc5883lInit(void)
         gpioInit(hmc5883Config->gpioPort, &gpio);
     }
 
-    delay(50);
+    magGain[X] = 1.0f;
+    magGain[Y] = 1.0f;
+    magGain[Z] = 1.0f;
+    selfTestTotal[X] = 0;
+    selfTestTotal[Y] = 0;
+    selfTestTotal[Z] = 0;
+    selfTestSampleCount = 0;
+    selfTestState = HMC_SELF_TEST_FIRST_SAMPLE;
+    selfTestStartedAt = millis();
+
     i2cWrite(MAG_ADDRESS, HMC58X3_R_CONFA, 0x010 + HMC_POS_BIAS);   // Reg A DOR = 0x010 + MS1, MS0 set to pos bias
     // Note that the  very first measurement after a gain change maintains the same gain as the previous setting.
     // The new gain setting is effective from the second measurement and on.
     i2cWrite(MAG_ADDRESS, HMC58X3_R_CONFB, 0x60); // Set the Gain to 2.5Ga (7:5->011)
-    delay(100);
-    hmc5883lRead(magADC);
+    i2cWrite(MAG_ADDRESS, HMC58X3_R_MODE, 1);
 
-    for (i = 0; i < 10; i++) {  // Collect 10 samples
-        i2cWrite(MAG_ADDRESS, HMC58X3_R_MODE, 1);
-        delay(50);
-        hmc5883lRead(magADC);       // Get the raw values in case the scales have already been changed.
-
-        // Since the measurements are noisy, they should be averaged rather than taking the max.
-        xyz_total[X] += magADC[X];
-        xyz_total[Y] += magADC[Y];
-        xyz_total[Z] += magADC[Z];
+    hmc5883lConfigureDataReadyInterruptHandling();
+}
 
-        // Detect saturation.
-        if (-4096 >= MIN(magADC[X], MIN(magADC[Y], magADC[Z]))) {
-            bret = false;
-            break;              // Breaks out of the for loop.  No sense in continuing if we saturated.
-        }
-        LED1_TOGGLE;
+static void hmc5883lFinishSelfTest(bool success)
+{
+    if (success) {
+        magGain[X] = fabsf(660.0f * HMC58X3_X_SELF_TEST_GAUSS * 2.0f * 10.0f / selfTestTotal[X]);
+        magGain[Y] = fabsf(660.0f * HMC58X3_Y_SELF_TEST_GAUSS * 2.0f * 10.0f / selfTestTotal[Y]);
+        magGain[Z] = fabsf(660.0f * HMC58X3_Z_SELF_TEST_GAUSS * 2.0f * 10.0f / selfTestTotal[Z]);
+    } else {
+        // Something went wrong so get a best guess
+        magGain[X] = 1.0f;
+        magGain[Y] = 1.0f;
+        magGain[Z] = 1.0f;
     }
 
-    // Apply the negative bias. (Same gain)
-    i2cWrite(MAG_ADDRESS, HMC58X3_R_CONFA, 0x010 + HMC_NEG_BIAS);   // Reg A DOR = 0x010 + MS1, MS0 set to negative bias.
-    for (i = 0; i < 10; i++) {
-        i2cWrite(MAG_ADDRESS, HMC58X3_R_MODE, 1);
-        delay(50);
-        hmc5883lRead(magADC);               // Get the raw values in case the scales have already been changed.
+    // leave test mode
+    i2cWrite(MAG_ADDRESS, HMC58X3_R_CONFA, 0x70);   // Configuration Register A  -- 0 11 100 00  num samples: 8 ; output rate: 15Hz ; normal measurement mode
+    i2cWrite(MAG_ADDRESS, HMC58X3_R_CONFB, 0x20);   // Configuration Register B  -- 001 00000    configuration gain 1.3Ga
+    i2cWrite(MAG_ADDRESS, HMC58X3_R_MODE, 0x00);    // Mode register             -- 000000 00    continuous Conversion Mode
+
+    selfTestState = HMC_SELF_TEST_DONE;
+}
 
-        // Since the measurements are noisy, they should be averaged.
-        xyz_total[X] -= magADC[X];
-        xyz_total[Y] -= magADC[Y];
-        xyz_total[Z] -= magADC[Z];
+// Consumes the single measurement started by the previous step and starts the next one
+static void hmc5883lSelfTestStep(const int16_t *magADC)
+{
+    if (selfTestState != HMC_SELF_TEST_FIRST_SAMPLE) {
+        // Since the measurements are noisy, they should be averaged rather than taking the max.
+        const int sign = (selfTestState == HMC_SELF_TEST_POSITIVE_BIAS) ? 1 : -1;
+        selfTestTotal[X] += sign * magADC[X];
+        selfTestTotal[Y] += sign * magADC[Y];
+        selfTestTotal[Z] += sign * magADC[Z];
 
-        // Detect saturation.
+        // Detect saturation, no sense in continuing if we saturated.
         if (-4096 >= MIN(magADC[X], MIN(magADC[Y], magADC[Z]))) {
-            bret = false;
-            break;              // Breaks out of the for loop.  No sense in continuing if we saturated.
+            hmc5883lFinishSelfTest(false);
+            return;
         }
-        LED1_TOGGLE;
     }
 
-    magGain[X] = fabsf(660.0f * HMC58X3_X_SELF_TEST_GAUSS * 2.0f * 10.0f / xyz_total[X]);
-    magGain[Y] = fabsf(660.0f * HMC58X3_Y_SELF_TEST_GAUSS * 2.0f * 10.0f / xyz_total[Y]);
-    magGain[Z] = fabsf(660.0f * HMC58X3_Z_SELF_TEST_GAUSS * 2.0f * 10.0f / xyz_total[Z]);
-
-    // leave test mode
-    i2cWrite(MAG_ADDRESS, HMC58X3_R_CONFA, 0x70);   // Configuration Register A  -- 0 11 100 00  num samples: 8 ; output rate: 15Hz ; normal measurement mode
-    i2cWrite(MAG_ADDRESS, HMC58X3_R_CONFB, 0x20);   // Configuration Register B  -- 001 00000    configuration gain 1.3Ga
-    i2cWrite(MAG_ADDRESS, HMC58X3_R_MODE, 0x00);    // Mode register             -- 000000 00    continuous Conversion Mode
-    delay(100);
-
-    if (!bret) {                // Something went wrong so get a best guess
-        magGain[X] = 1.0f;
-        magGain[Y] = 1.0f;
-        magGain[Z] = 1.0f;
+    if (selfTestState == HMC_SELF_TEST_FIRST_SAMPLE || ++selfTestSampleCount == HMC_SELF_TEST_SAMPLES) {
+        selfTestSampleCount = 0;
+        selfTestState++;
+        if (selfTestState == HMC_SELF_TEST_NEGATIVE_BIAS) {
+            // Apply the negative bias. (Same gain)
+            i2cWrite(MAG_ADDRESS, HMC58X3_R_CONFA, 0x010 + HMC_NEG_BIAS);   // Reg A DOR = 0x010 + MS1, MS0 set to negative bias.
+        } else if (selfTestState == HMC_SELF_TEST_DONE) {
+            hmc5883lFinishSelfTest(true);
+            return;
+        }
     }
 
-    hmc5883lConfigureDataReadyInterruptHandling();
+    i2cWrite(MAG_ADDRESS, HMC58X3_R_MODE, 1);
 }
 
 bool hmc5883lRead(int16_t *magData)
 {
     uint8_t buf[6];
 
+    if (selfTestState != HMC_SELF_TEST_DONE && millis() - selfTestStartedAt > HMC_SELF_TEST_TIMEOUT_MS) {
+        hmc5883lFinishSelfTest(false);
+    }
+
     bool ack = i2cRead(MAG_ADDRESS, MAG_DATA_REGISTER, 6, buf);
     if (!ack) {
         return false;
     }
+
+    if (selfTestState != HMC_SELF_TEST_DONE) {
+        const int16_t magADC[3] = {
+            [X] = (int16_t)(buf[0] << 8 | buf[1]),
+            [Z] = (int16_t)(buf[2] << 8 | buf[3]),
+            [Y] = (int16_t)(buf[4] << 8 | buf[5])
+        };
+        hmc5883lSelfTestStep(magADC);
+        // no valid data until the first measurement in normal mode
+        return false;
+    }
+
     // During calibration, magGain is 1.0, so the read returns normal non-calibrated values.
     // After calibration is done, magGain is set to calculated gain values.
     magData[X] = (int16_t)(buf[0] << 8 | buf[1]) * magGain[X];
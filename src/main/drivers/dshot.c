@@ -0,0 +1,102 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "dshot.h"
+
+/*
+ * DShot frame layout (MSB first):
+ *
+ *   [ 11 bit value ][ 1 bit telemetry request ][ 4 bit checksum ]
+ *
+ * Bits are sent as pulses of constant period, a "1" is high for 75% of the period and a "0" for 37.5%.
+ * The checksum is the XOR of the three nibbles of the first 12 bits.
+ */
+
+uint32_t dshotGetBitrate(dshotProtocol_e protocol)
+{
+    switch (protocol) {
+        case DSHOT_150:
+            return 150000;
+        case DSHOT_300:
+            return 300000;
+        case DSHOT_600:
+            return 600000;
+        default:
+            return 0;
+    }
+}
+
+uint16_t dshotGetBitPeriod(dshotProtocol_e protocol)
+{
+    uint32_t bitrate = dshotGetBitrate(protocol);
+
+    if (!bitrate) {
+        return 0;
+    }
+
+    return (DSHOT_TIMER_MHZ * 1000000) / bitrate;
+}
+
+/*
+ * Map the motor range of the mixer (minthrottle..maxthrottle) onto DShot throttle values, so the motors
+ * idle at the lowest DShot throttle and reach full throttle at maxthrottle.
+ * Anything below minthrottle (mincommand, disarmed or motor stop) is sent as the disarm command.
+ */
+uint16_t dshotPulseToValue(uint16_t pulse, uint16_t minThrottle, uint16_t maxThrottle)
+{
+    if (pulse < minThrottle) {
+        return DSHOT_DISARM_COMMAND;
+    }
+
+    if (pulse >= maxThrottle) {
+        return DSHOT_MAX_THROTTLE;
+    }
+
+    return DSHOT_MIN_THROTTLE + ((uint32_t)(pulse - minThrottle) * (DSHOT_MAX_THROTTLE - DSHOT_MIN_THROTTLE)) / (maxThrottle - minThrottle);
+}
+
+uint16_t dshotEncodeFrame(uint16_t value, bool requestTelemetry)
+{
+    uint16_t packet = ((value & 0x07FF) << 1) | (requestTelemetry ? 1 : 0);
+    uint16_t checksum = (packet ^ (packet >> 4) ^ (packet >> 8)) & 0x0F;
+
+    return (packet << 4) | checksum;
+}
+
+/*
+ * Timer DMA bursts write channelCount consecutive CCR registers on every update event,
+ * so bits of all channels of a timer are interleaved: buffer[bit * channelCount + channelOffset].
+ */
+void dshotLoadDmaBuffer(uint32_t *buffer, uint8_t channelOffset, uint8_t channelCount, uint16_t frame, uint16_t bitPeriod)
+{
+    const uint16_t bit1Width = (bitPeriod * 3) / 4;
+    const uint16_t bit0Width = (bitPeriod * 3) / 8;
+    int i;
+
+    for (i = 0; i < DSHOT_FRAME_BITS; i++) {
+        buffer[i * channelCount + channelOffset] = (frame & 0x8000) ? bit1Width : bit0Width;
+        frame <<= 1;
+    }
+
+    for (; i < DSHOT_DMA_BUFFER_SLOTS; i++) {
+        buffer[i * channelCount + channelOffset] = 0;
+    }
+}
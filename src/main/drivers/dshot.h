@@ -0,0 +1,46 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+typedef enum {
+    DSHOT_DISABLED = 0,
+    DSHOT_150,
+    DSHOT_300,
+    DSHOT_600,
+} dshotProtocol_e;
+
+// Timer tick rate used for DShot outputs, bit periods are expressed in ticks of this clock
+#define DSHOT_TIMER_MHZ                 24
+
+#define DSHOT_FRAME_BITS                16
+// Extra idle (zero width) periods after the frame, they keep the line low once the burst is over
+#define DSHOT_FRAME_TAIL_BITS           2
+#define DSHOT_DMA_BUFFER_SLOTS          (DSHOT_FRAME_BITS + DSHOT_FRAME_TAIL_BITS)
+
+// Values 1..47 are reserved for ESC commands, 0 is disarmed
+#define DSHOT_DISARM_COMMAND            0
+#define DSHOT_MIN_THROTTLE              48
+#define DSHOT_MAX_THROTTLE              2047
+
+uint32_t dshotGetBitrate(dshotProtocol_e protocol);
+uint16_t dshotGetBitPeriod(dshotProtocol_e protocol);
+
+uint16_t dshotPulseToValue(uint16_t pulse, uint16_t minThrottle, uint16_t maxThrottle);
+uint16_t dshotEncodeFrame(uint16_t value, bool requestTelemetry);
+void dshotLoadDmaBuffer(uint32_t *buffer, uint8_t channelOffset, uint8_t channelCount, uint16_t frame, uint16_t bitPeriod);
@@ -29,9 +29,18 @@
 #include "pwm_rx.h"
 #include "pwm_mapping.h"
 
+#ifdef USE_DSHOT
+#include "dshot.h"
+#endif
+
 void pwmBrushedMotorConfig(const timerHardware_t *timerHardware, uint8_t motorIndex, uint16_t motorPwmRate, uint16_t idlePulse);
 void pwmBrushlessMotorConfig(const timerHardware_t *timerHardware, uint8_t motorIndex, uint16_t motorPwmRate, uint16_t idlePulse);
 void pwmOneshotMotorConfig(const timerHardware_t *timerHardware, uint8_t motorIndex);
+#ifdef USE_DSHOT
+bool pwmIsTimerDshotCapable(const timerHardware_t *timerHardware, bool useLEDStrip);
+void pwmDshotMotorMissing(uint8_t motorIndex);
+void pwmDshotMotorConfig(const timerHardware_t *timerHardware, uint8_t motorIndex, dshotProtocol_e protocol, uint16_t minThrottle, uint16_t maxThrottle);
+#endif
 void pwmServoConfig(const timerHardware_t *timerHardware, uint8_t servoIndex, uint16_t servoPwmRate, uint16_t servoCenterPulse);
 
 /*
@@ -294,6 +303,21 @@ pwmIOConfiguration_t *pwmInit(drv_pwm_config_t *init)
                 if (timerHardwarePtr->tim == TIM2)
                     continue;
             }
+#endif
+#ifdef USE_DSHOT
+            if (init->dshotProtocol != DSHOT_DISABLED) {
+                // An output that can't get an update DMA channel is left unused, mixing protocols would confuse the ESCs.
+                // Its motor keeps the index so the other motors stay on their outputs, arming is blocked instead.
+                if (!pwmIsTimerDshotCapable(timerHardwarePtr, init->useLEDStrip)) {
+                    pwmDshotMotorMissing(pwmIOConfiguration.motorCount);
+                    pwmIOConfiguration.motorCount++;
+                    continue;
+                }
+
+                pwmDshotMotorConfig(timerHardwarePtr, pwmIOConfiguration.motorCount, init->dshotProtocol, init->minThrottle, init->maxThrottle);
+                pwmIOConfiguration.ioConfigurations[pwmIOConfiguration.ioCount].flags = PWM_PF_MOTOR | PWM_PF_OUTPUT_PROTOCOL_DSHOT;
+
+            } else
 #endif
             if (init->useOneshot) {
 
@@ -68,6 +68,11 @@ typedef struct drv_pwm_config_s {
 #endif
     bool useVbat;
     bool useOneshot;
+#ifdef USE_DSHOT
+    uint8_t dshotProtocol;  // dshotProtocol_e, DSHOT_DISABLED for analog outputs
+    uint16_t minThrottle;   // motor range of the mixer, mapped onto the DShot throttle range
+    uint16_t maxThrottle;
+#endif
     bool useSoftSerial;
     bool useLEDStrip;
 #ifdef SONAR
@@ -102,7 +107,8 @@ typedef enum {
     PWM_PF_OUTPUT_PROTOCOL_PWM = (1 << 3),
     PWM_PF_OUTPUT_PROTOCOL_ONESHOT = (1 << 4),
     PWM_PF_PPM = (1 << 5),
-    PWM_PF_PWM = (1 << 6)
+    PWM_PF_PWM = (1 << 6),
+    PWM_PF_OUTPUT_PROTOCOL_DSHOT = (1 << 7)
 } pwmPortFlags_e;
 
 
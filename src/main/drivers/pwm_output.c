@@ -19,9 +19,12 @@
 #include <stdint.h>
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "platform.h"
 
+#include "common/utils.h"
+
 #include "gpio.h"
 #include "timer.h"
 
@@ -31,6 +34,10 @@
 
 #include "pwm_output.h"
 
+#ifdef USE_DSHOT
+#include "dshot.h"
+#endif
+
 #if (MAX_MOTORS > MAX_SERVOS)
 #define MAX_PWM_OUTPUT_PORTS MAX_MOTORS
 #else
@@ -39,11 +46,34 @@
 
 typedef void (*pwmWriteFuncPtr)(uint8_t index, uint16_t value);  // function pointer used to write motors
 
+#ifdef USE_DSHOT
+#define MAX_DSHOT_TIMERS 4
+
+typedef struct {
+    TIM_TypeDef *tim;
+    DMA_Channel_TypeDef *dmaChannel;
+    uint8_t firstChannelIndex;      // lowest CCR written by the DMA burst, 0 = CCR1
+    uint8_t burstLength;            // number of consecutive CCR registers written on every update event
+    uint32_t dmaBuffer[DSHOT_DMA_BUFFER_SLOTS * 4];
+} dshotTimer_t;
+
+static dshotTimer_t dshotTimers[MAX_DSHOT_TIMERS];
+static uint8_t dshotTimerCount = 0;
+static uint16_t dshotBitPeriod = 0;
+static uint16_t dshotMinThrottle;
+static uint16_t dshotMaxThrottle;
+static uint32_t dshotMissingMotorMask = 0;     // motors left without output, see pwmDshotMotorMissing()
+#endif
+
 typedef struct {
     volatile timCCR_t *ccr;
     TIM_TypeDef *tim;
     uint16_t period;
     pwmWriteFuncPtr pwmWritePtr;
+#ifdef USE_DSHOT
+    dshotTimer_t *dshotTimer;
+    uint8_t dshotChannelIndex;
+#endif
 } pwmOutputPort_t;
 
 static pwmOutputPort_t pwmOutputPorts[MAX_PWM_OUTPUT_PORTS];
@@ -57,6 +87,26 @@ static pwmOutputPort_t *servos[MAX_PWM_SERVOS];
 static uint8_t allocatedOutputPortCount = 0;
 
 static bool pwmMotorsEnabled = true;
+
+/*
+ * Output synchronisation - when enabled motor and servo writes only latch the values, they are applied
+ * to the hardware together by pwmCommitOutputs() at a fixed point of the loop.
+ */
+typedef enum {
+    MOTOR_UPDATE_NONE = 0,
+    MOTOR_UPDATE_ONESHOT,
+    MOTOR_UPDATE_DSHOT,
+} motorUpdateCompletion_e;
+
+static bool pwmOutputSyncEnabled = false;
+static uint16_t motorOutputLatch[MAX_PWM_MOTORS];
+static uint16_t latchedMotorMask = 0;
+static motorUpdateCompletion_e latchedMotorCompletion = MOTOR_UPDATE_NONE;
+static uint8_t latchedMotorCount = 0;
+#ifdef USE_SERVOS
+static uint16_t servoOutputLatch[MAX_PWM_SERVOS];
+static uint16_t latchedServoMask = 0;
+#endif
 static void pwmOCConfig(TIM_TypeDef *tim, uint8_t channel, uint16_t value)
 {
     TIM_OCInitTypeDef  TIM_OCInitStructure;
@@ -144,8 +194,14 @@ static void pwmWriteStandard(uint8_t index, uint16_t value)
 
 void pwmWriteMotor(uint8_t index, uint16_t value)
 {
-    if (motors[index] && index < MAX_MOTORS && pwmMotorsEnabled)
-        motors[index]->pwmWritePtr(index, value);
+    if (motors[index] && index < MAX_MOTORS && pwmMotorsEnabled) {
+        if (pwmOutputSyncEnabled) {
+            motorOutputLatch[index] = value;
+            latchedMotorMask |= (1 << index);
+        } else {
+            motors[index]->pwmWritePtr(index, value);
+        }
+    }
 }
 
 void pwmShutdownPulsesForAllMotors(uint8_t motorCount)
@@ -168,7 +224,7 @@ void pwmEnableMotors(void)
     pwmMotorsEnabled = true;
 }
 
-void pwmCompleteOneshotMotorUpdate(uint8_t motorCount)
+static void completeOneshotMotorUpdate(uint8_t motorCount)
 {
     uint8_t index;
     TIM_TypeDef *lastTimerPtr = NULL;
@@ -188,6 +244,17 @@ void pwmCompleteOneshotMotorUpdate(uint8_t motorCount)
     }
 }
 
+void pwmCompleteOneshotMotorUpdate(uint8_t motorCount)
+{
+    if (pwmOutputSyncEnabled) {
+        latchedMotorCompletion = MOTOR_UPDATE_ONESHOT;
+        latchedMotorCount = motorCount;
+        return;
+    }
+
+    completeOneshotMotorUpdate(motorCount);
+}
+
 bool isMotorBrushed(uint16_t motorPwmRate)
 {
     return (motorPwmRate > 500);
@@ -213,6 +280,238 @@ void pwmOneshotMotorConfig(const timerHardware_t *timerHardware, uint8_t motorIn
     motors[motorIndex]->pwmWritePtr = pwmWriteStandard;
 }
 
+#ifdef USE_DSHOT
+/*
+ * Timer update events are the DMA request source for DShot, each timer has a fixed DMA channel for it.
+ * See "DMA request mapping" in the reference manuals (RM0008 table 78, RM0316 table 78).
+ */
+static DMA_Channel_TypeDef *dshotGetUpdateDmaChannel(TIM_TypeDef *tim)
+{
+    if (tim == TIM1)
+        return DMA1_Channel5;
+    if (tim == TIM2)
+        return DMA1_Channel2;
+    if (tim == TIM3)
+        return DMA1_Channel3;
+    if (tim == TIM4)
+        return DMA1_Channel7;
+#ifdef STM32F303xC
+    if (tim == TIM8)
+        return DMA2_Channel1;
+    if (tim == TIM15)
+        return DMA1_Channel5;
+    if (tim == TIM16)
+        return DMA1_Channel3;
+    if (tim == TIM17)
+        return DMA1_Channel1;
+#endif
+    return NULL;
+}
+
+static dshotTimer_t *dshotFindTimer(TIM_TypeDef *tim)
+{
+    uint8_t index;
+
+    for (index = 0; index < dshotTimerCount; index++) {
+        if (dshotTimers[index].tim == tim)
+            return &dshotTimers[index];
+    }
+
+    return NULL;
+}
+
+bool isMotorProtocolDshot(void)
+{
+    return dshotTimerCount > 0;
+}
+
+// The motor keeps its index so the following motors stay on their outputs, it just doesn't get any
+void pwmDshotMotorMissing(uint8_t motorIndex)
+{
+    dshotMissingMotorMask |= (1 << motorIndex);
+}
+
+// True if any of the first motorCount motors has no output, arming is blocked then
+bool isDshotMotorMissing(uint8_t motorCount)
+{
+    return (dshotMissingMotorMask & ((1 << motorCount) - 1)) != 0;
+}
+
+/*
+ * DMA channels used by other drivers on this target, see adc_stm32f*.c, light_ws2811strip_stm32f*.c
+ * and serial_uart_stm32f*.c. UART DMA is not enabled on F3 targets.
+ */
+static bool dshotIsDmaChannelUsedByPeripherals(DMA_Channel_TypeDef *dmaChannel, bool useLEDStrip)
+{
+#ifdef STM32F10X
+    // ADC, USART1 TX and RX
+    if (dmaChannel == DMA1_Channel1 || dmaChannel == DMA1_Channel4 || dmaChannel == DMA1_Channel5)
+        return true;
+
+    // LED strip on TIM3_CH1
+    if (useLEDStrip && dmaChannel == DMA1_Channel6)
+        return true;
+#endif
+
+#ifdef STM32F303xC
+#ifdef ADC_DMA_CHANNEL
+    if (dmaChannel == ADC_DMA_CHANNEL)
+        return true;
+#else
+    if (dmaChannel == DMA1_Channel1)
+        return true;
+#endif
+
+#ifdef LED_STRIP
+#ifdef WS2811_DMA_CHANNEL
+    if (useLEDStrip && dmaChannel == WS2811_DMA_CHANNEL)
+        return true;
+#else
+    if (useLEDStrip && dmaChannel == DMA1_Channel3)
+        return true;
+#endif
+#endif
+#endif
+
+    UNUSED(useLEDStrip);
+    return false;
+}
+
+/*
+ * An output can drive DShot if its timer has an update DMA channel which no other DShot timer or peripheral uses.
+ * The DMA burst writes a contiguous range of CCRs, so further outputs on a DShot timer must extend that range
+ * without gaps - otherwise the burst would overwrite channels driven by something else.
+ */
+bool pwmIsTimerDshotCapable(const timerHardware_t *timerHardware, bool useLEDStrip)
+{
+    uint8_t index;
+    uint8_t channelIndex = timerHardware->channel >> 2;
+    DMA_Channel_TypeDef *dmaChannel = dshotGetUpdateDmaChannel(timerHardware->tim);
+    dshotTimer_t *dshotTimer = dshotFindTimer(timerHardware->tim);
+
+    if (!dmaChannel)
+        return false;
+
+    if (dshotTimer) {
+        return (channelIndex + 1 == dshotTimer->firstChannelIndex) ||
+               (channelIndex == dshotTimer->firstChannelIndex + dshotTimer->burstLength);
+    }
+
+    if (dshotTimerCount >= MAX_DSHOT_TIMERS)
+        return false;
+
+    if (dshotIsDmaChannelUsedByPeripherals(dmaChannel, useLEDStrip))
+        return false;
+
+    for (index = 0; index < dshotTimerCount; index++) {
+        if (dshotTimers[index].dmaChannel == dmaChannel)
+            return false;
+    }
+
+    return true;
+}
+
+static void dshotConfigureDma(dshotTimer_t *dshotTimer)
+{
+    DMA_InitTypeDef DMA_InitStructure;
+
+#ifdef STM32F303xC
+    if (dshotTimer->tim == TIM8)
+        RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA2, ENABLE);
+    else
+#endif
+        RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
+
+    DMA_Cmd(dshotTimer->dmaChannel, DISABLE);
+    DMA_DeInit(dshotTimer->dmaChannel);
+
+    DMA_StructInit(&DMA_InitStructure);
+    DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)&dshotTimer->tim->DMAR;
+    DMA_InitStructure.DMA_MemoryBaseAddr = (uint32_t)dshotTimer->dmaBuffer;
+    DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralDST;
+    DMA_InitStructure.DMA_BufferSize = DSHOT_DMA_BUFFER_SLOTS * dshotTimer->burstLength;
+    DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+    DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+    DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Word;
+    DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Word;
+    DMA_InitStructure.DMA_Mode = DMA_Mode_Normal;
+    DMA_InitStructure.DMA_Priority = DMA_Priority_High;
+    DMA_InitStructure.DMA_M2M = DMA_M2M_Disable;
+    DMA_Init(dshotTimer->dmaChannel, &DMA_InitStructure);
+
+    // TIM_DMABase_CCRx are consecutive, burst length is encoded as (transfers - 1) << 8
+    TIM_DMAConfig(dshotTimer->tim, TIM_DMABase_CCR1 + dshotTimer->firstChannelIndex, (dshotTimer->burstLength - 1) << 8);
+    TIM_DMACmd(dshotTimer->tim, TIM_DMA_Update, ENABLE);
+}
+
+static void pwmWriteDshot(uint8_t index, uint16_t value)
+{
+    dshotTimer_t *dshotTimer = motors[index]->dshotTimer;
+    uint16_t frame = dshotEncodeFrame(dshotPulseToValue(value, dshotMinThrottle, dshotMaxThrottle), false);
+
+    dshotLoadDmaBuffer(dshotTimer->dmaBuffer, motors[index]->dshotChannelIndex - dshotTimer->firstChannelIndex,
+        dshotTimer->burstLength, frame, dshotBitPeriod);
+}
+
+void pwmDshotMotorConfig(const timerHardware_t *timerHardware, uint8_t motorIndex, dshotProtocol_e protocol, uint16_t minThrottle, uint16_t maxThrottle)
+{
+    uint8_t channelIndex = timerHardware->channel >> 2;
+    dshotTimer_t *dshotTimer = dshotFindTimer(timerHardware->tim);
+
+    dshotBitPeriod = dshotGetBitPeriod(protocol);
+    dshotMinThrottle = minThrottle;
+    dshotMaxThrottle = maxThrottle;
+
+    if (!dshotTimer) {
+        dshotTimer = &dshotTimers[dshotTimerCount++];
+        dshotTimer->tim = timerHardware->tim;
+        dshotTimer->dmaChannel = dshotGetUpdateDmaChannel(timerHardware->tim);
+        dshotTimer->firstChannelIndex = channelIndex;
+        dshotTimer->burstLength = 1;
+    } else {
+        // extend the burst by one adjacent channel (see pwmIsTimerDshotCapable), data already in the buffer is rewritten on the next update
+        if (channelIndex < dshotTimer->firstChannelIndex)
+            dshotTimer->firstChannelIndex = channelIndex;
+
+        dshotTimer->burstLength++;
+        memset(dshotTimer->dmaBuffer, 0, sizeof(dshotTimer->dmaBuffer));
+    }
+
+    motors[motorIndex] = pwmOutConfig(timerHardware, DSHOT_TIMER_MHZ, dshotBitPeriod, 0);
+    motors[motorIndex]->pwmWritePtr = pwmWriteDshot;
+    motors[motorIndex]->dshotTimer = dshotTimer;
+    motors[motorIndex]->dshotChannelIndex = channelIndex;
+
+    dshotConfigureDma(dshotTimer);
+}
+
+static void completeDshotMotorUpdate(void)
+{
+    uint8_t index;
+
+    for (index = 0; index < dshotTimerCount; index++) {
+        dshotTimer_t *dshotTimer = &dshotTimers[index];
+
+        // Restart the burst from the beginning of the buffer, the previous frame is long finished at any sane loop rate
+        TIM_DMACmd(dshotTimer->tim, TIM_DMA_Update, DISABLE);
+        DMA_Cmd(dshotTimer->dmaChannel, DISABLE);
+        DMA_SetCurrDataCounter(dshotTimer->dmaChannel, DSHOT_DMA_BUFFER_SLOTS * dshotTimer->burstLength);
+        DMA_Cmd(dshotTimer->dmaChannel, ENABLE);
+        TIM_DMACmd(dshotTimer->tim, TIM_DMA_Update, ENABLE);
+    }
+}
+
+void pwmCompleteDshotMotorUpdate(void)
+{
+    if (pwmOutputSyncEnabled) {
+        latchedMotorCompletion = MOTOR_UPDATE_DSHOT;
+        return;
+    }
+
+    completeDshotMotorUpdate();
+}
+#endif
+
 #ifdef USE_SERVOS
 void pwmServoConfig(const timerHardware_t *timerHardware, uint8_t servoIndex, uint16_t servoPwmRate, uint16_t servoCenterPulse)
 {
@@ -221,7 +520,61 @@ void pwmServoConfig(const timerHardware_t *timerHardware, uint8_t servoIndex, ui
 
 void pwmWriteServo(uint8_t index, uint16_t value)
 {
-    if (servos[index] && index < MAX_SERVOS)
-        *servos[index]->ccr = value;
+    if (servos[index] && index < MAX_SERVOS) {
+        if (pwmOutputSyncEnabled) {
+            servoOutputLatch[index] = value;
+            latchedServoMask |= (1 << index);
+        } else {
+            *servos[index]->ccr = value;
+        }
+    }
+}
+#endif
+
+void pwmSetOutputSync(bool enabled)
+{
+    // apply anything latched so far before the mode changes
+    pwmCommitOutputs();
+    pwmOutputSyncEnabled = enabled;
 }
+
+/*
+ * Apply all latched motor and servo values and finish the motor update (oneshot pulse or DShot burst).
+ * Does nothing if output synchronisation is disabled or nothing was written since the last commit.
+ */
+void pwmCommitOutputs(void)
+{
+    uint8_t index;
+
+#ifdef USE_SERVOS
+    for (index = 0; latchedServoMask; index++) {
+        if (latchedServoMask & (1 << index)) {
+            *servos[index]->ccr = servoOutputLatch[index];
+            latchedServoMask &= ~(1 << index);
+        }
+    }
+#endif
+
+    for (index = 0; latchedMotorMask; index++) {
+        if (latchedMotorMask & (1 << index)) {
+            if (pwmMotorsEnabled)
+                motors[index]->pwmWritePtr(index, motorOutputLatch[index]);
+            latchedMotorMask &= ~(1 << index);
+        }
+    }
+
+    switch (latchedMotorCompletion) {
+        case MOTOR_UPDATE_ONESHOT:
+            completeOneshotMotorUpdate(latchedMotorCount);
+            break;
+#ifdef USE_DSHOT
+        case MOTOR_UPDATE_DSHOT:
+            completeDshotMotorUpdate();
+            break;
 #endif
+        default:
+            break;
+    }
+
+    latchedMotorCompletion = MOTOR_UPDATE_NONE;
+}
@@ -20,6 +20,9 @@
 void pwmWriteMotor(uint8_t index, uint16_t value);
 void pwmShutdownPulsesForAllMotors(uint8_t motorCount);
 void pwmCompleteOneshotMotorUpdate(uint8_t motorCount);
+bool isMotorProtocolDshot(void);
+bool isDshotMotorMissing(uint8_t motorCount);
+void pwmCompleteDshotMotorUpdate(void);
 
 void pwmWriteServo(uint8_t index, uint16_t value);
 
@@ -27,3 +30,6 @@ bool isMotorBrushed(uint16_t motorPwmRate);
 
 void pwmDisableMotors(void);
 void pwmEnableMotors(void);
+
+void pwmSetOutputSync(bool enabled);
+void pwmCommitOutputs(void);
@@ -17,9 +17,12 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "platform.h"
 
+#include "common/maths.h"
+
 #include "serial.h"
 
 void serialPrint(serialPort_t *instance, const char *str)
@@ -56,12 +59,12 @@ void serialWriteBuf(serialPort_t *instance, uint8_t *data, int count)
     }
 }
 
-uint8_t serialRxBytesWaiting(serialPort_t *instance)
+uint32_t serialRxBytesWaiting(serialPort_t *instance)
 {
     return instance->vTable->serialTotalRxWaiting(instance);
 }
 
-uint8_t serialTxBytesFree(serialPort_t *instance)
+uint32_t serialTxBytesFree(serialPort_t *instance)
 {
     return instance->vTable->serialTotalTxFree(instance);
 }
@@ -71,6 +74,33 @@ uint8_t serialRead(serialPort_t *instance)
     return instance->vTable->serialRead(instance);
 }
 
+uint32_t serialGetRxSpan(serialPort_t *instance, const uint8_t **data)
+{
+    return instance->vTable->getRxSpan(instance, data);
+}
+
+void serialConsumeRx(serialPort_t *instance, uint32_t count)
+{
+    instance->vTable->consumeRx(instance, count);
+}
+
+uint32_t serialReadBuf(serialPort_t *instance, uint8_t *data, uint32_t maxCount)
+{
+    const uint8_t *span;
+    uint32_t spanCount;
+    uint32_t count = 0;
+
+    // Received data may wrap around the end of driver buffer, so it takes up to two spans
+    while (count < maxCount && (spanCount = serialGetRxSpan(instance, &span)) > 0) {
+        spanCount = MIN(spanCount, maxCount - count);
+        memcpy(data + count, span, spanCount);
+        serialConsumeRx(instance, spanCount);
+        count += spanCount;
+    }
+
+    return count;
+}
+
 void serialSetBaudRate(serialPort_t *instance, uint32_t baudRate)
 {
     instance->vTable->serialSetBaudRate(instance, baudRate);
@@ -102,3 +132,13 @@ void serialEndWrite(serialPort_t *instance)
     if (instance->vTable->endWrite)
         instance->vTable->endWrite(instance);
 }
+
+// Returns false if the port can't detect frame boundaries, the receive callback given to openSerialPort stays in use then
+bool serialSetFrameCallback(serialPort_t *instance, serialFrameCallbackPtr callback)
+{
+    if (!instance->vTable->setFrameCallback)
+        return false;
+
+    instance->vTable->setFrameCallback(instance, callback);
+    return true;
+}
@@ -35,6 +35,8 @@ typedef enum portOptions_t {
 } portOptions_t;
 
 typedef void (*serialReceiveCallbackPtr)(uint16_t data);   // used by serial drivers to return frames to app
+// Used by serial drivers which detect frame boundaries (idle line) to pass a whole frame at once, frameEndAt is micros() at the last stop bit
+typedef void (*serialFrameCallbackPtr)(const uint8_t *frame, uint32_t length, uint32_t frameEndAt);
 
 typedef struct serialPort_s {
 
@@ -62,11 +64,16 @@ typedef struct serialPort_s {
 struct serialPortVTable {
     void (*serialWrite)(serialPort_t *instance, uint8_t ch);
 
-    uint8_t (*serialTotalRxWaiting)(serialPort_t *instance);
-    uint8_t (*serialTotalTxFree)(serialPort_t *instance);
+    uint32_t (*serialTotalRxWaiting)(serialPort_t *instance);
+    uint32_t (*serialTotalTxFree)(serialPort_t *instance);
 
     uint8_t (*serialRead)(serialPort_t *instance);
 
+    // Zero-copy access to received data. getRxSpan returns the number of contiguous bytes available at *data (there may be
+    // more after the span is consumed), consumeRx releases count bytes of that span back to the driver.
+    uint32_t (*getRxSpan)(serialPort_t *instance, const uint8_t **data);
+    void (*consumeRx)(serialPort_t *instance, uint32_t count);
+
     // Specified baud rate may not be allowed by an implementation, use serialGetBaudRate to determine actual baud rate in use.
     void (*serialSetBaudRate)(serialPort_t *instance, uint32_t baudRate);
 
@@ -78,13 +85,19 @@ struct serialPortVTable {
     // Optional functions used to buffer large writes.
     void (*beginWrite)(serialPort_t *instance);
     void (*endWrite)(serialPort_t *instance);
+
+    // Optional, switches receive to whole frames delimited by an idle line. NULL callback restores byte reception.
+    void (*setFrameCallback)(serialPort_t *instance, serialFrameCallbackPtr callback);
 };
 
 void serialWrite(serialPort_t *instance, uint8_t ch);
-uint8_t serialRxBytesWaiting(serialPort_t *instance);
-uint8_t serialTxBytesFree(serialPort_t *instance);
+uint32_t serialRxBytesWaiting(serialPort_t *instance);
+uint32_t serialTxBytesFree(serialPort_t *instance);
 void serialWriteBuf(serialPort_t *instance, uint8_t *data, int count);
 uint8_t serialRead(serialPort_t *instance);
+uint32_t serialGetRxSpan(serialPort_t *instance, const uint8_t **data);
+void serialConsumeRx(serialPort_t *instance, uint32_t count);
+uint32_t serialReadBuf(serialPort_t *instance, uint8_t *data, uint32_t maxCount);
 void serialSetBaudRate(serialPort_t *instance, uint32_t baudRate);
 void serialSetMode(serialPort_t *instance, portMode_t mode);
 bool isSerialTransmitBufferEmpty(serialPort_t *instance);
@@ -95,3 +108,4 @@ uint32_t serialGetBaudRate(serialPort_t *instance);
 void serialWriteBufShim(void *instance, uint8_t *data, int count);
 void serialBeginWrite(serialPort_t *instance);
 void serialEndWrite(serialPort_t *instance);
+bool serialSetFrameCallback(serialPort_t *instance, serialFrameCallbackPtr callback);
@@ -403,7 +403,7 @@ void onSerialRxPinChange(timerCCHandlerRec_t *cbRec, captureCompare_t capture)
     }
 }
 
-uint8_t softSerialRxBytesWaiting(serialPort_t *instance)
+uint32_t softSerialRxBytesWaiting(serialPort_t *instance)
 {
     if ((instance->mode & MODE_RX) == 0) {
         return 0;
@@ -414,7 +414,7 @@ uint8_t softSerialRxBytesWaiting(serialPort_t *instance)
     return (s->port.rxBufferHead - s->port.rxBufferTail) & (s->port.rxBufferSize - 1);
 }
 
-uint8_t softSerialTxBytesFree(serialPort_t *instance)
+uint32_t softSerialTxBytesFree(serialPort_t *instance)
 {
     if ((instance->mode & MODE_TX) == 0) {
         return 0;
@@ -422,7 +422,7 @@ uint8_t softSerialTxBytesFree(serialPort_t *instance)
 
     softSerial_t *s = (softSerial_t *)instance;
 
-    uint8_t bytesUsed = (s->port.txBufferHead - s->port.txBufferTail) & (s->port.txBufferSize - 1);
+    uint32_t bytesUsed = (s->port.txBufferHead - s->port.txBufferTail) & (s->port.txBufferSize - 1);
 
     return (s->port.txBufferSize - 1) - bytesUsed;
 }
@@ -444,6 +444,27 @@ uint8_t softSerialReadByte(serialPort_t *instance)
     return ch;
 }
 
+uint32_t softSerialGetRxSpan(serialPort_t *instance, const uint8_t **data)
+{
+    *data = (const uint8_t *)&instance->rxBuffer[instance->rxBufferTail];
+
+    if ((instance->mode & MODE_RX) == 0) {
+        return 0;
+    }
+
+    uint32_t rxBufferHead = instance->rxBufferHead;
+    if (rxBufferHead >= instance->rxBufferTail) {
+        return rxBufferHead - instance->rxBufferTail;
+    } else {
+        return instance->rxBufferSize - instance->rxBufferTail;
+    }
+}
+
+void softSerialConsumeRx(serialPort_t *instance, uint32_t count)
+{
+    instance->rxBufferTail = (instance->rxBufferTail + count) % instance->rxBufferSize;
+}
+
 void softSerialWriteByte(serialPort_t *s, uint8_t ch)
 {
     if ((s->mode & MODE_TX) == 0) {
@@ -476,12 +497,15 @@ const struct serialPortVTable softSerialVTable[] = {
         .serialTotalRxWaiting = softSerialRxBytesWaiting,
         .serialTotalTxFree = softSerialTxBytesFree,
         .serialRead = softSerialReadByte,
+        .getRxSpan = softSerialGetRxSpan,
+        .consumeRx = softSerialConsumeRx,
         .serialSetBaudRate = softSerialSetBaudRate,
         .isSerialTransmitBufferEmpty = isSoftSerialTransmitBufferEmpty,
         .setMode = softSerialSetMode,
         .writeBuf = NULL,
         .beginWrite = NULL,
         .endWrite = NULL,
+        .setFrameCallback = NULL,
     }
 };
 
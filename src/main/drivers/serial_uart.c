@@ -23,14 +23,17 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "platform.h"
 
 #include "build_config.h"
 
+#include "common/maths.h"
 #include "common/utils.h"
 #include "gpio.h"
 #include "inverter.h"
+#include "system.h"
 
 #include "serial.h"
 #include "serial_uart.h"
@@ -84,6 +87,16 @@ static void uartReconfigure(uartPort_t *uartPort)
 
     USART_Init(uartPort->USARTx, &USART_InitStructure);
 
+    // bits per char on the line, parity comes on top of the 8 data bits, e.g. 12 for SBUS (8E2)
+    uint32_t bitsPerChar = 1 + 8 + 1;   // start, data and first stop bit
+    if (uartPort->port.options & SERIAL_PARITY_EVEN) {
+        bitsPerChar++;
+    }
+    if (uartPort->port.options & SERIAL_STOPBITS_2) {
+        bitsPerChar++;
+    }
+    uartPort->rxCharTime = bitsPerChar * 1000000 / uartPort->port.baudRate;
+
     usartConfigurePinInversion(uartPort);
 
     if(uartPort->port.options & SERIAL_BIDIR)
@@ -118,10 +131,12 @@ serialPort_t *uartOpen(USART_TypeDef *USARTx, serialReceiveCallbackPtr callback,
     s->port.txBufferHead = s->port.txBufferTail = 0;
     // callback works for IRQ-based RX ONLY
     s->port.callback = callback;
+    s->frameCallback = NULL;
     s->port.mode = mode;
     s->port.baudRate = baudRate;
     s->port.options = options;
 
+    USART_ITConfig(s->USARTx, USART_IT_IDLE, DISABLE);
     uartReconfigure(s);
 
     // Receive DMA or IRQ
@@ -211,15 +226,16 @@ void uartStartTxDMA(uartPort_t *s)
     DMA_Cmd(s->txDMAChannel, ENABLE);
 }
 
-uint8_t uartTotalRxBytesWaiting(serialPort_t *instance)
+uint32_t uartTotalRxBytesWaiting(serialPort_t *instance)
 {
     uartPort_t *s = (uartPort_t*)instance;
     if (s->rxDMAChannel) {
+        // Both DMA counter and read position count down from the buffer size
         uint32_t rxDMAHead = s->rxDMAChannel->CNDTR;
-        if (rxDMAHead >= s->rxDMAPos) {
-            return rxDMAHead - s->rxDMAPos;
+        if (s->rxDMAPos >= rxDMAHead) {
+            return s->rxDMAPos - rxDMAHead;
         } else {
-            return s->port.rxBufferSize + rxDMAHead - s->rxDMAPos;
+            return s->port.rxBufferSize + s->rxDMAPos - rxDMAHead;
         }
     }
 
@@ -230,7 +246,7 @@ uint8_t uartTotalRxBytesWaiting(serialPort_t *instance)
     }
 }
 
-uint8_t uartTotalTxBytesFree(serialPort_t *instance)
+uint32_t uartTotalTxBytesFree(serialPort_t *instance)
 {
     uartPort_t *s = (uartPort_t*)instance;
 
@@ -295,16 +311,117 @@ uint8_t uartRead(serialPort_t *instance)
     return ch;
 }
 
-void uartWrite(serialPort_t *instance, uint8_t ch)
+uint32_t uartGetRxSpan(serialPort_t *instance, const uint8_t **data)
 {
     uartPort_t *s = (uartPort_t *)instance;
-    s->port.txBuffer[s->port.txBufferHead] = ch;
-    if (s->port.txBufferHead + 1 >= s->port.txBufferSize) {
-        s->port.txBufferHead = 0;
+
+    if (s->rxDMAChannel) {
+        uint32_t rxDMATail = s->port.rxBufferSize - s->rxDMAPos;
+        uint32_t rxDMAHead = s->port.rxBufferSize - s->rxDMAChannel->CNDTR;
+
+        *data = (const uint8_t *)&s->port.rxBuffer[rxDMATail];
+        if (rxDMAHead >= rxDMATail) {
+            return rxDMAHead - rxDMATail;
+        } else {
+            return s->port.rxBufferSize - rxDMATail;
+        }
+    }
+
+    // Head is updated from USART IRQ, take a snapshot
+    uint32_t rxBufferHead = s->port.rxBufferHead;
+
+    *data = (const uint8_t *)&s->port.rxBuffer[s->port.rxBufferTail];
+    if (rxBufferHead >= s->port.rxBufferTail) {
+        return rxBufferHead - s->port.rxBufferTail;
     } else {
-        s->port.txBufferHead++;
+        return s->port.rxBufferSize - s->port.rxBufferTail;
+    }
+}
+
+void uartConsumeRx(serialPort_t *instance, uint32_t count)
+{
+    uartPort_t *s = (uartPort_t *)instance;
+
+    if (s->rxDMAChannel) {
+        s->rxDMAPos -= count;
+        if (s->rxDMAPos == 0)
+            s->rxDMAPos = s->port.rxBufferSize;
+    } else {
+        uint32_t rxBufferTail = s->port.rxBufferTail + count;
+        s->port.rxBufferTail = (rxBufferTail >= s->port.rxBufferSize) ? rxBufferTail - s->port.rxBufferSize : rxBufferTail;
+    }
+}
+
+void uartSetFrameCallback(serialPort_t *instance, serialFrameCallbackPtr callback)
+{
+    uartPort_t *s = (uartPort_t *)instance;
+
+    USART_ITConfig(s->USARTx, USART_IT_IDLE, DISABLE);
+    s->frameCallback = callback;
+
+    if (!(s->port.mode & MODE_RX)) {
+        return;
+    }
+
+    // Restart reception from the beginning of the buffer, frames are passed to the callback in place.
+    // In frame mode DMA stops once the buffer is full instead of wrapping, so an overrun can be told from a frame.
+    if (s->rxDMAChannel) {
+        DMA_Cmd(s->rxDMAChannel, DISABLE);
+        if (callback) {
+            s->rxDMAChannel->CCR &= ~DMA_Mode_Circular;
+        } else {
+            s->rxDMAChannel->CCR |= DMA_Mode_Circular;
+        }
+        s->rxDMAChannel->CNDTR = s->port.rxBufferSize;
+        s->rxDMAPos = s->port.rxBufferSize;
+        DMA_Cmd(s->rxDMAChannel, ENABLE);
+    } else {
+        s->port.rxBufferHead = s->port.rxBufferTail = 0;
+    }
+
+    if (callback) {
+        USART_ITConfig(s->USARTx, USART_IT_IDLE, ENABLE);
+    }
+}
+
+// Called from USART IRQ for each byte received while in frame mode without RX DMA
+void uartFrameReceiveByte(uartPort_t *s, uint8_t ch)
+{
+    // Bytes which don't fit are dropped, the frame will fail the protocol checks
+    if (s->port.rxBufferHead < s->port.rxBufferSize) {
+        s->port.rxBuffer[s->port.rxBufferHead++] = ch;
     }
+}
+
+// Called from USART IRQ once the line went idle after a frame, the IDLE flag must be already cleared
+void uartFrameIdleLine(uartPort_t *s)
+{
+    uint32_t frameEndAt = micros() - s->rxCharTime;
+    uint32_t length;
 
+    // DMA is stopped while the callback runs so the frame can't be overwritten, the USART holds one more byte meanwhile
+    if (s->rxDMAChannel) {
+        DMA_Cmd(s->rxDMAChannel, DISABLE);
+        length = s->port.rxBufferSize - s->rxDMAChannel->CNDTR;
+    } else {
+        length = s->port.rxBufferHead;
+    }
+
+    // A full buffer means bytes were dropped, the frame (or several merged ones) can't be trusted
+    if (length > 0 && length < s->port.rxBufferSize) {
+        s->frameCallback((const uint8_t *)s->port.rxBuffer, length, frameEndAt);
+    }
+
+    if (s->rxDMAChannel) {
+        s->rxDMAChannel->CNDTR = s->port.rxBufferSize;
+        DMA_Cmd(s->rxDMAChannel, ENABLE);
+    } else {
+        s->port.rxBufferHead = 0;
+    }
+}
+
+static void uartStartTx(uartPort_t *s)
+{
     if (s->txDMAChannel) {
         if (!(s->txDMAChannel->CCR & 1))
             uartStartTxDMA(s);
@@ -313,17 +430,59 @@ void uartWrite(serialPort_t *instance, uint8_t ch)
     }
 }
 
+// Never waits for the transmitter, bytes that don't fit into the TX buffer are dropped
+void uartWriteBuf(serialPort_t *instance, void *data, int count)
+{
+    uartPort_t *s = (uartPort_t *)instance;
+    const uint8_t *p = data;
+    uint32_t remaining = MIN((uint32_t)MAX(count, 0), uartTotalTxBytesFree(instance));
+
+    if (remaining == 0) {
+        return;
+    }
+
+    while (remaining > 0) {
+        // Copy up to the end of the ring, the rest goes to the beginning on next pass
+        uint32_t chunk = MIN(remaining, s->port.txBufferSize - s->port.txBufferHead);
+        memcpy((uint8_t *)&s->port.txBuffer[s->port.txBufferHead], p, chunk);
+
+        uint32_t txBufferHead = s->port.txBufferHead + chunk;
+        s->port.txBufferHead = (txBufferHead >= s->port.txBufferSize) ? 0 : txBufferHead;
+
+        p += chunk;
+        remaining -= chunk;
+    }
+
+    uartStartTx(s);
+}
+
+void uartWrite(serialPort_t *instance, uint8_t ch)
+{
+    uartPort_t *s = (uartPort_t *)instance;
+    s->port.txBuffer[s->port.txBufferHead] = ch;
+    if (s->port.txBufferHead + 1 >= s->port.txBufferSize) {
+        s->port.txBufferHead = 0;
+    } else {
+        s->port.txBufferHead++;
+    }
+
+    uartStartTx(s);
+}
+
 const struct serialPortVTable uartVTable[] = {
     {
         .serialWrite = uartWrite,
         .serialTotalRxWaiting = uartTotalRxBytesWaiting,
         .serialTotalTxFree = uartTotalTxBytesFree,
         .serialRead = uartRead,
+        .getRxSpan = uartGetRxSpan,
+        .consumeRx = uartConsumeRx,
         .serialSetBaudRate = uartSetBaudRate,
         .isSerialTransmitBufferEmpty = isUartTransmitBufferEmpty,
         .setMode = uartSetMode,
-        .writeBuf = NULL,
+        .writeBuf = uartWriteBuf,
         .beginWrite = NULL,
         .endWrite = NULL,
+        .setFrameCallback = uartSetFrameCallback,
     }
 };
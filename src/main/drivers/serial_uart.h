@@ -21,8 +21,6 @@
 // The two largest things that need to be sent are: 1, MSP responses, 2, UBLOX SVINFO packet.
 
 // Size must be a power of two due to various optimizations which use 'and' instead of 'mod'
-// Various serial routines return the buffer occupied size as uint8_t which would need to be extended in order to
-// increase size further.
 #define UART1_RX_BUFFER_SIZE    256
 #define UART1_TX_BUFFER_SIZE    256
 #define UART2_RX_BUFFER_SIZE    256
@@ -42,6 +40,10 @@ typedef struct {
     uint32_t rxDMAPos;
     bool txDMAEmpty;
 
+    // Set when receiving whole frames, frames always start at the beginning of rxBuffer then
+    serialFrameCallbackPtr frameCallback;
+    uint32_t rxCharTime;                // micros to receive one character, the idle line is detected that long after the frame ends
+
     uint32_t txDMAPeripheralBaseAddr;
     uint32_t rxDMAPeripheralBaseAddr;
 
@@ -52,8 +54,12 @@ serialPort_t *uartOpen(USART_TypeDef *USARTx, serialReceiveCallbackPtr callback,
 
 // serialPort API
 void uartWrite(serialPort_t *instance, uint8_t ch);
-uint8_t uartTotalRxBytesWaiting(serialPort_t *instance);
-uint8_t uartTotalTxBytesFree(serialPort_t *instance);
+uint32_t uartTotalRxBytesWaiting(serialPort_t *instance);
+uint32_t uartTotalTxBytesFree(serialPort_t *instance);
 uint8_t uartRead(serialPort_t *instance);
+uint32_t uartGetRxSpan(serialPort_t *instance, const uint8_t **data);
+void uartConsumeRx(serialPort_t *instance, uint32_t count);
+void uartWriteBuf(serialPort_t *instance, void *data, int count);
 void uartSetBaudRate(serialPort_t *s, uint32_t baudRate);
 bool isUartTransmitBufferEmpty(serialPort_t *s);
+void uartSetFrameCallback(serialPort_t *instance, serialFrameCallbackPtr callback);
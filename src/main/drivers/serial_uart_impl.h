@@ -22,6 +22,8 @@
 extern const struct serialPortVTable uartVTable[];
 
 void uartStartTxDMA(uartPort_t *s);
+void uartFrameReceiveByte(uartPort_t *s, uint8_t ch);
+void uartFrameIdleLine(uartPort_t *s);
 
 uartPort_t *serialUSART1(uint32_t baudRate, portMode_t mode, portOptions_t options);
 uartPort_t *serialUSART2(uint32_t baudRate, portMode_t mode, portOptions_t options);
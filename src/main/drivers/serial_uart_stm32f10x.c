@@ -48,7 +48,7 @@ static uartPort_t uartPort2;
 static uartPort_t uartPort3;
 #endif
 
-// Using RX DMA disables the use of receive callbacks
+// Using RX DMA disables the use of receive callbacks, frame callbacks still work
 #define USE_USART1_RX_DMA
 
 #if defined(CC3D) // FIXME move board specific code to target.h files.
@@ -60,8 +60,10 @@ void usartIrqCallback(uartPort_t *s)
     uint16_t SR = s->USARTx->SR;
 
     if (SR & USART_FLAG_RXNE && !s->rxDMAChannel) {
-        // If we registered a callback, pass crap there
-        if (s->port.callback) {
+        if (s->frameCallback) {
+            uartFrameReceiveByte(s, s->USARTx->DR);
+        } else if (s->port.callback) {
+            // If we registered a callback, pass crap there
             s->port.callback(s->USARTx->DR);
         } else {
             s->port.rxBuffer[s->port.rxBufferHead++] = s->USARTx->DR;
@@ -70,7 +72,19 @@ void usartIrqCallback(uartPort_t *s)
             }
         }
     }
-    if (SR & USART_FLAG_TXE) {
+    // IDLE is cleared by reading SR followed by DR. When RXNE was in the snapshot the DR read above (or by DMA) already
+    // did that. Otherwise DR is read here, a byte which arrived since SR was read is the first one of the next frame.
+    if (SR & USART_FLAG_IDLE && s->frameCallback) {
+        uartFrameIdleLine(s);
+        if (!(SR & USART_FLAG_RXNE)) {
+            if (!(s->USARTx->SR & USART_FLAG_RXNE)) {
+                (void)s->USARTx->DR;
+            } else if (!s->rxDMAChannel) {
+                uartFrameReceiveByte(s, s->USARTx->DR);
+            }
+        }
+    }
+    if (SR & USART_FLAG_TXE && !s->txDMAChannel) {
         if (s->port.txBufferTail != s->port.txBufferHead) {
             s->USARTx->DR = s->port.txBuffer[s->port.txBufferTail++];
             if (s->port.txBufferTail >= s->port.txBufferSize) {
@@ -143,14 +157,12 @@ uartPort_t *serialUSART1(uint32_t baudRate, portMode_t mode, portOptions_t optio
     NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
     NVIC_Init(&NVIC_InitStructure);
 
-#ifndef USE_USART1_RX_DMA
-    // RX/TX Interrupt
+    // RX/TX Interrupt, also needed with RX DMA for idle line detection
     NVIC_InitStructure.NVIC_IRQChannel = USART1_IRQn;
     NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = NVIC_PRIORITY_BASE(NVIC_PRIO_SERIALUART1);
     NVIC_InitStructure.NVIC_IRQChannelSubPriority = NVIC_PRIORITY_SUB(NVIC_PRIO_SERIALUART1);
     NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
     NVIC_Init(&NVIC_InitStructure);
-#endif
 
     return s;
 }
@@ -58,14 +58,16 @@ void usbVcpSetMode(serialPort_t *instance, portMode_t mode)
 bool isUsbVcpTransmitBufferEmpty(serialPort_t *instance)
 {
     UNUSED(instance);
-    return true;
+
+    // nothing will drain the buffer without a host
+    return !usbIsConfigured() || !CDC_Send_Busy();
 }
 
-uint8_t usbVcpAvailable(serialPort_t *instance)
+uint32_t usbVcpAvailable(serialPort_t *instance)
 {
     UNUSED(instance);
 
-    return receiveLength & 0xFF; // FIXME use uint32_t return type everywhere
+    return CDC_Receive_BytesAvailable();
 }
 
 uint8_t usbVcpRead(serialPort_t *instance)
@@ -83,25 +85,46 @@ uint8_t usbVcpRead(serialPort_t *instance)
     return buf[0];
 }
 
-static void usbVcpWriteBuf(serialPort_t *instance, void *data, int count)
+static uint32_t usbVcpGetRxSpan(serialPort_t *instance, const uint8_t **data)
+{
+    UNUSED(instance);
+
+    return CDC_Receive_Span(data);
+}
+
+static void usbVcpConsumeRx(serialPort_t *instance, uint32_t count)
 {
     UNUSED(instance);
 
+    CDC_Receive_Consume(count);
+}
 
+// Queue data, waiting for room while the host is reading. Returns false if data was dropped.
+static bool usbVcpQueue(const uint8_t *data, uint32_t count)
+{
     if (!(usbIsConnected() && usbIsConfigured())) {
-        return;
+        return false;
     }
 
     uint32_t start = millis();
-    for (uint8_t *p = data; count > 0; ) {
-        uint32_t txed = CDC_Send_DATA(p, count);
+    while (count > 0) {
+        uint32_t txed = CDC_Send_DATA(data, count);
         count -= txed;
-        p += txed;
+        data += txed;
 
         if (millis() - start > USB_TIMEOUT) {
-            break;
+            return false;
         }
     }
+
+    return true;
+}
+
+static void usbVcpWriteBuf(serialPort_t *instance, void *data, int count)
+{
+    UNUSED(instance);
+
+    usbVcpQueue(data, count);
 }
 
 static bool usbVcpFlush(vcpPort_t *port)
@@ -112,18 +135,8 @@ static bool usbVcpFlush(vcpPort_t *port)
     if (count == 0) {
         return true;
     }
-    if (!usbIsConnected() || !usbIsConfigured()) {
-        return false;
-    }
-    
-    uint32_t txed;
-    uint32_t start = millis();
-
-    do {
-        txed = CDC_Send_DATA(port->txBuf, count);
-    } while (txed != count && (millis() - start < USB_TIMEOUT));
 
-    return txed == count;
+    return usbVcpQueue(port->txBuf, count);
 }
 
 static void usbVcpWrite(serialPort_t *instance, uint8_t c)
@@ -142,9 +155,9 @@ static void usbVcpBeginWrite(serialPort_t *instance)
     port->buffering = true;
 }
 
-uint8_t usbTxBytesFree() {
-    // Because we block upon transmit and don't buffer bytes, our "buffer" capacity is effectively unlimited.
-    return 255;
+uint32_t usbTxBytesFree() {
+    // Data is queued and sent from the USB interrupt, writes only block once the queue is full.
+    return CDC_Send_FreeBytes();
 }
 
 static void usbVcpEndWrite(serialPort_t *instance)
@@ -160,12 +173,15 @@ static const struct serialPortVTable usbVTable[] = {
         .serialTotalRxWaiting = usbVcpAvailable,
         .serialTotalTxFree = usbTxBytesFree,
         .serialRead = usbVcpRead,
+        .getRxSpan = usbVcpGetRxSpan,
+        .consumeRx = usbVcpConsumeRx,
         .serialSetBaudRate = usbVcpSetBaudRate,
         .isSerialTransmitBufferEmpty = isUsbVcpTransmitBufferEmpty,
         .setMode = usbVcpSetMode,
         .writeBuf = usbVcpWriteBuf,
         .beginWrite = usbVcpBeginWrite,
-        .endWrite = usbVcpEndWrite
+        .endWrite = usbVcpEndWrite,
+        .setFrameCallback = NULL,
     }
 };
 
@@ -31,7 +31,7 @@ typedef struct {
 
 serialPort_t *usbVcpOpen(void);
 
-uint8_t usbVcpAvailable(serialPort_t *instance);
+uint32_t usbVcpAvailable(serialPort_t *instance);
 
 uint8_t usbVcpRead(serialPort_t *instance);
 
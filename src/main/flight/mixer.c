@@ -19,6 +19,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 
 #include "platform.h"
 #include "debug.h"
@@ -44,6 +45,7 @@
 
 #include "sensors/sensors.h"
 #include "sensors/acceleration.h"
+#include "sensors/battery.h"
 
 #include "flight/mixer.h"
 #include "flight/failsafe.h"
@@ -70,6 +72,10 @@ static rxConfig_t *rxConfig;
 
 static mixerMode_e currentMixerMode;
 static motorMixer_t currentMixer[MAX_SUPPORTED_MOTORS];
+static motorMixerFixed_t mixerMatrix[MAX_SUPPORTED_MOTORS];
+
+static bool thrustLinearizationEnabled;
+static uint16_t thrustLinearizationCurve[THRUST_LINEARIZATION_SEGMENTS + 1];
 
 
 #ifdef USE_SERVOS
@@ -86,6 +92,26 @@ static uint8_t maxServoIndex;
 static servoParam_t *servoConf;
 static biquad_t servoFitlerState[MAX_SUPPORTED_SERVOS];
 static bool servoFilterIsSet;
+
+/*
+ * Servo rules compiled for execution by servoMixer(). Only rules that can contribute are kept, grouped by target servo,
+ * with servo reversal and rule limits resolved. Rebuilt by servoMixerUpdatePlan().
+ */
+typedef struct servoMixerPlanEntry_s {
+    uint8_t targetChannel;
+    uint8_t inputSource;
+    uint8_t box;                            // 0 = always active, otherwise BOXSERVO1 + box - 1
+    uint8_t speed;                          // 0 = unlimited
+    int16_t rate;                           // percent, negative if the servo is reversed for this input
+    int16_t min;                            // output limits relative to servo middle
+    int16_t max;
+    int16_t currentOutput;                  // speed limited input
+} servoMixerPlanEntry_t;
+
+static servoMixerPlanEntry_t servoMixerPlan[MAX_SERVO_RULES];
+static uint8_t servoMixerPlanLength = 0;
+static uint32_t servoMixerPlanInputs = 0;   // bitmask of input sources used by the plan
+static uint16_t servoFilterMask = 0;        // servos that are output and need filtering
 #endif
 
 static const motorMixer_t mixerQuadX[] = {
@@ -347,11 +373,17 @@ void mixerUseConfigs(
 #ifdef USE_SERVOS
     servoConf = servoConfToUse;
     gimbalConfig = gimbalConfigToUse;
+    servoMixerUpdatePlan();
 #endif
     flight3DConfig = flight3DConfigToUse;
     escAndServoConfig = escAndServoConfigToUse;
     mixerConfig = mixerConfigToUse;
     rxConfig = rxConfigToUse;
+
+    // yaw direction and thrust curve are baked into the precomputed matrix
+    if (motorCount > 0) {
+        mixerUpdateMatrix();
+    }
 }
 
 #ifdef USE_SERVOS
@@ -375,6 +407,65 @@ int servoDirection(int servoIndex, int inputSource)
     else
         return 1;
 }
+
+/*
+ * Must be called whenever servo rules or servo configuration change.
+ */
+void servoMixerUpdatePlan(void)
+{
+    uint8_t target;
+    uint8_t i;
+
+    servoMixerPlanLength = 0;
+    servoMixerPlanInputs = 0;
+    servoFilterMask = 0;
+
+    if (!servoConf) {
+        return;
+    }
+
+    for (target = 0; target < MAX_SUPPORTED_SERVOS; target++) {
+        for (i = 0; i < servoRuleCount; i++) {
+            const servoMixer_t *rule = &currentServoMixer[i];
+
+            if (rule->targetChannel != target || rule->inputSource >= INPUT_SOURCE_COUNT || rule->rate == 0) {
+                continue;
+            }
+
+            servoMixerPlanEntry_t *entry = &servoMixerPlan[servoMixerPlanLength++];
+            uint16_t servo_width = servoConf[target].max - servoConf[target].min;
+            int16_t min = rule->min * servo_width / 100 - servo_width / 2;
+            int16_t max = rule->max * servo_width / 100 - servo_width / 2;
+
+            entry->targetChannel = target;
+            entry->inputSource = rule->inputSource;
+            entry->box = rule->box;
+            entry->speed = rule->speed;
+            entry->currentOutput = 0;
+
+            // -constrain(x, min, max) == constrain(-x, -max, -min)
+            if (servoDirection(target, rule->inputSource) < 0) {
+                entry->rate = -rule->rate;
+                entry->min = -max;
+                entry->max = -min;
+            } else {
+                entry->rate = rule->rate;
+                entry->min = min;
+                entry->max = max;
+            }
+
+            servoMixerPlanInputs |= (1 << rule->inputSource);
+        }
+    }
+
+    for (target = minServoIndex; target <= maxServoIndex && target < MAX_SUPPORTED_SERVOS; target++) {
+        servoFilterMask |= (1 << target);
+    }
+
+    if (feature(FEATURE_SERVO_TILT)) {
+        servoFilterMask |= (1 << SERVO_GIMBAL_PITCH) | (1 << SERVO_GIMBAL_ROLL);
+    }
+}
 #endif
 
 bool isMixerEnabled(mixerMode_e mixerMode)
@@ -430,6 +521,8 @@ void mixerInit(mixerMode_e mixerMode, motorMixer_t *initialCustomMotorMixers, se
             for (i = 0; i < servoRuleCount; i++)
                 currentServoMixer[i] = servoMixers[currentMixerMode].rule[i];
         }
+
+        servoMixerUpdatePlan();
     }
 
     /*
@@ -494,6 +587,7 @@ void mixerUsePWMIOConfiguration(void)
         }
     }
 
+    mixerUpdateMatrix();
     mixerResetDisarmedMotors();
 }
 #else
@@ -504,6 +598,7 @@ void mixerUsePWMIOConfiguration(void)
     for (i = 0; i < motorCount; i++) {
         currentMixer[i] = mixerQuadX[i];
     }
+    mixerUpdateMatrix();
     mixerResetDisarmedMotors();
 }
 #endif
@@ -538,6 +633,8 @@ void loadCustomServoMixer(void)
         currentServoMixer[i] = customServoMixers[i];
         servoRuleCount++;
     }
+
+    servoMixerUpdatePlan();
 }
 
 void servoMixerLoadMix(int index, servoMixer_t *customServoMixers)
@@ -584,6 +681,73 @@ void mixerResetDisarmedMotors(void)
         motor_disarmed[i] = feature(FEATURE_3D) ? flight3DConfig->neutral3d : escAndServoConfig->mincommand;
 }
 
+/*
+ * Thrust is modelled as T = (1 - k) * c + k * c^2, where c is normalized motor command.
+ * Store the inverse c(T) at evenly spaced thrust points so mixer can work in thrust domain.
+ */
+STATIC_UNIT_TESTED void computeThrustLinearizationCurve(uint8_t thrustLinearization, uint16_t *curve)
+{
+    const float k = thrustLinearization / 100.0f;
+
+    for (int i = 0; i <= THRUST_LINEARIZATION_SEGMENTS; i++) {
+        const float thrust = (float)i / THRUST_LINEARIZATION_SEGMENTS;
+        float command;
+
+        if (k > 0.0f) {
+            command = ((k - 1.0f) + sqrtf(sq(1.0f - k) + 4.0f * k * thrust)) / (2.0f * k);
+        } else {
+            command = thrust;
+        }
+
+        curve[i] = constrain(lrintf(command * MIXER_MATRIX_SCALE), 0, MIXER_MATRIX_SCALE);
+    }
+}
+
+/*
+ * Motor output stage: mixer output is treated as thrust demand. Thrust is scaled up to counter battery sag
+ * (vbatCompensation is full/current voltage ratio, 1000 == 1.0) and converted into motor command using thrust curve.
+ */
+STATIC_UNIT_TESTED int16_t applyMotorOutputCompensation(const uint16_t *curve, int16_t value, int16_t minValue, int16_t maxValue, uint16_t vbatCompensation)
+{
+    const int32_t range = maxValue - minValue;
+
+    if (range <= 0) {
+        return value;
+    }
+
+    // Normalize to [0;MIXER_MATRIX_SCALE], compensate and interpolate between curve points
+    int32_t thrust = ((int32_t)(value - minValue) << MIXER_MATRIX_SHIFT) / range;
+    thrust = constrain(thrust * vbatCompensation / 1000, 0, MIXER_MATRIX_SCALE);
+
+    const int segmentShift = MIXER_MATRIX_SHIFT - 5;    // 32 segments
+    const int index = thrust >> segmentShift;
+
+    int32_t command;
+    if (index >= THRUST_LINEARIZATION_SEGMENTS) {
+        command = curve[THRUST_LINEARIZATION_SEGMENTS];
+    } else {
+        const int32_t fraction = thrust & ((1 << segmentShift) - 1);
+        command = curve[index] + (((curve[index + 1] - curve[index]) * fraction) >> segmentShift);
+    }
+
+    return minValue + ((command * range) >> MIXER_MATRIX_SHIFT);
+}
+
+void mixerUpdateMatrix(void)
+{
+    int i;
+
+    for (i = 0; i < motorCount; i++) {
+        mixerMatrix[i].throttle = lrintf(currentMixer[i].throttle * MIXER_MATRIX_SCALE);
+        mixerMatrix[i].roll = lrintf(currentMixer[i].roll * MIXER_MATRIX_SCALE);
+        mixerMatrix[i].pitch = lrintf(currentMixer[i].pitch * MIXER_MATRIX_SCALE);
+        mixerMatrix[i].yaw = lrintf(-mixerConfig->yaw_motor_direction * currentMixer[i].yaw * MIXER_MATRIX_SCALE);
+    }
+
+    thrustLinearizationEnabled = (mixerConfig->thrust_linearization > 0);
+    computeThrustLinearizationCurve(mixerConfig->thrust_linearization, thrustLinearizationCurve);
+}
+
 #ifdef USE_SERVOS
 
 STATIC_UNIT_TESTED void forwardAuxChannelsToServos(uint8_t firstServoIndex)
@@ -641,6 +805,11 @@ void writeMotors(void)
         pwmWriteMotor(i, motor[i]);
 
 
+#ifdef USE_DSHOT
+    if (isMotorProtocolDshot()) {
+        pwmCompleteDshotMotorUpdate();
+    } else
+#endif
     if (feature(FEATURE_ONESHOT125)) {
         pwmCompleteOneshotMotorUpdate(motorCount);
     }
@@ -659,6 +828,7 @@ void writeAllMotors(int16_t mc)
 void stopMotors(void)
 {
     writeAllMotors(feature(FEATURE_3D) ? flight3DConfig->neutral3d : escAndServoConfig->mincommand);
+    pwmCommitOutputs();     // don't wait for the main loop if outputs are synchronised, it might not run again
 
     delay(50); // give the timers and ESCs a chance to react.
 }
@@ -668,6 +838,65 @@ void StopPwmAllMotors()
     pwmShutdownPulsesForAllMotors(motorCount);
 }
 
+/*
+ * Fit roll/pitch/yaw corrections into throttleRange. Roll and pitch authority is kept as long as possible,
+ * yaw is attenuated first. Throttle is sacrificed afterwards by the caller, by shifting it within [mixMin;mixMax].
+ * Returns true if any of the axis had to be attenuated.
+ */
+STATIC_UNIT_TESTED bool mixerDesaturateByPriority(const int32_t *rpMix, const int32_t *yawMix, int16_t *rpyMix, uint8_t count, int16_t throttleRange, int16_t *mixMin, int16_t *mixMax)
+{
+    int32_t rpMixMin = 0, rpMixMax = 0;
+    int32_t rpyMixMin = 0, rpyMixMax = 0;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        rpMixMin = MIN(rpMixMin, rpMix[i]);
+        rpMixMax = MAX(rpMixMax, rpMix[i]);
+        rpyMixMin = MIN(rpyMixMin, rpMix[i] + yawMix[i]);
+        rpyMixMax = MAX(rpyMixMax, rpMix[i] + yawMix[i]);
+    }
+
+    const int32_t rpMixRange = rpMixMax - rpMixMin;
+    const int32_t rpyMixRange = rpyMixMax - rpyMixMin;
+    bool limited = true;
+
+    if (rpMixRange > throttleRange) {
+        // Not enough room even for roll/pitch - drop yaw completely and scale roll/pitch down
+        for (i = 0; i < count; i++) {
+            rpyMix[i] = rpMix[i] * throttleRange / rpMixRange;
+        }
+    } else if (rpyMixRange > throttleRange) {
+        // Range is convex in yaw scale, so interpolating between rp and rpy range guarantees the fit
+        const int32_t yawScaleNum = throttleRange - rpMixRange;
+        const int32_t yawScaleDen = rpyMixRange - rpMixRange;
+        for (i = 0; i < count; i++) {
+            rpyMix[i] = rpMix[i] + yawMix[i] * yawScaleNum / yawScaleDen;
+        }
+    } else {
+        for (i = 0; i < count; i++) {
+            rpyMix[i] = rpMix[i] + yawMix[i];
+        }
+        limited = false;
+    }
+
+    *mixMin = 0;
+    *mixMax = 0;
+    for (i = 0; i < count; i++) {
+        *mixMin = MIN(*mixMin, rpyMix[i]);
+        *mixMax = MAX(*mixMax, rpyMix[i]);
+    }
+
+    // Make the fit explicit, integer scaling above rounds each motor separately
+    if (*mixMax - *mixMin > throttleRange) {
+        *mixMax = *mixMin + throttleRange;
+        for (i = 0; i < count; i++) {
+            rpyMix[i] = MIN(rpyMix[i], *mixMax);
+        }
+    }
+
+    return limited;
+}
+
 void mixTable(void)
 {
     uint32_t i;
@@ -678,16 +907,17 @@ void mixTable(void)
     }
 
     // Initial mixer concept by bdoiron74 reused and optimized for Air Mode
+    int32_t rpMix[MAX_SUPPORTED_MOTORS];
+    int32_t yawMix[MAX_SUPPORTED_MOTORS];
     int16_t rpyMix[MAX_SUPPORTED_MOTORS];
     int16_t rpyMixMax = 0; // assumption: symetrical about zero.
     int16_t rpyMixMin = 0;
 
     // motors for non-servo mixes
     for (i = 0; i < motorCount; i++) {
-        rpyMix[i] =
-            axisPID[PITCH] * currentMixer[i].pitch +
-            axisPID[ROLL] * currentMixer[i].roll +
-            -mixerConfig->yaw_motor_direction * axisPID[YAW] * currentMixer[i].yaw;
+        rpMix[i] = (axisPID[PITCH] * mixerMatrix[i].pitch + axisPID[ROLL] * mixerMatrix[i].roll) >> MIXER_MATRIX_SHIFT;
+        yawMix[i] = (axisPID[YAW] * mixerMatrix[i].yaw) >> MIXER_MATRIX_SHIFT;
+        rpyMix[i] = rpMix[i] + yawMix[i];
 
         if (rpyMix[i] > rpyMixMax) rpyMixMax = rpyMix[i];
         if (rpyMix[i] < rpyMixMin) rpyMixMin = rpyMix[i];
@@ -723,10 +953,29 @@ void mixTable(void)
         throttleMax = escAndServoConfig->maxthrottle;
     }
 
+    // Battery sag and thrust curve are handled in thrust domain, 3D and failsafe outputs are passed through as-is
+    const bool motorOutputCompensation = ARMING_FLAG(ARMED) && !feature(FEATURE_3D) && !failsafeIsActive();
+    uint16_t vbatCompensation = 1000;
+
+    if (motorOutputCompensation && mixerConfig->vbat_compensation) {
+        vbatCompensation = calculateBatteryCompensationFactor();
+
+        // Sagging battery can't deliver full thrust - desaturate into the thrust that is still available
+        throttleMax = throttleMin + (int32_t)(throttleMax - throttleMin) * 1000 / vbatCompensation;
+    }
+
     throttleRange = throttleMax - throttleMin;
 
     #define THROTTLE_CLIPPING_FACTOR    0.33f
-    if (rpyMixRange > throttleRange) {
+    if (mixerConfig->desaturation_mode == MIXER_DESAT_PRIORITY) {
+        motorLimitReached = mixerDesaturateByPriority(rpMix, yawMix, rpyMix, motorCount, throttleRange, &rpyMixMin, &rpyMixMax);
+
+        // Throttle goes last - move it so that the whole mix fits between throttleMin and throttleMax
+        const int16_t throttleLow = throttleMin - rpyMixMin;
+        const int16_t throttleHigh = throttleMax - rpyMixMax;
+        throttleMin = MIN(throttleLow, throttleHigh);
+        throttleMax = MAX(throttleLow, throttleHigh);
+    } else if (rpyMixRange > throttleRange) {
         motorLimitReached = true;
         float mixReduction = (float)throttleRange / rpyMixRange;
 
@@ -749,7 +998,11 @@ void mixTable(void)
         bool isFailsafeActive = failsafeIsActive();
 
         for (i = 0; i < motorCount; i++) {
-            motor[i] = rpyMix[i] + constrain(throttleCommand * currentMixer[i].throttle, throttleMin, throttleMax);
+            motor[i] = rpyMix[i] + constrain((throttleCommand * mixerMatrix[i].throttle) >> MIXER_MATRIX_SHIFT, throttleMin, throttleMax);
+
+            if (motorOutputCompensation && (thrustLinearizationEnabled || vbatCompensation != 1000)) {
+                motor[i] = applyMotorOutputCompensation(thrustLinearizationCurve, motor[i], escAndServoConfig->minthrottle, escAndServoConfig->maxthrottle, vbatCompensation);
+            }
 
             if (isFailsafeActive) {
                 motor[i] = constrain(motor[i], escAndServoConfig->mincommand, escAndServoConfig->maxthrottle);
@@ -781,8 +1034,7 @@ void mixTable(void)
 
 void servoMixer(void)
 {
-    int16_t input[INPUT_SOURCE_COUNT]; // Range [-500:+500]
-    static int16_t currentOutput[MAX_SERVO_RULES];
+    int16_t input[INPUT_SOURCE_COUNT]; // Range [-500:+500], only sources used by the plan are filled in
     uint8_t i;
 
     if (FLIGHT_MODE(PASSTHRU_MODE)) {
@@ -802,8 +1054,10 @@ void servoMixer(void)
         }
     }
 
-    input[INPUT_GIMBAL_PITCH] = scaleRange(attitude.values.pitch, -1800, 1800, -500, +500);
-    input[INPUT_GIMBAL_ROLL] = scaleRange(attitude.values.roll, -1800, 1800, -500, +500);
+    if (servoMixerPlanInputs & ((1 << INPUT_GIMBAL_PITCH) | (1 << INPUT_GIMBAL_ROLL))) {
+        input[INPUT_GIMBAL_PITCH] = scaleRange(attitude.values.pitch, -1800, 1800, -500, +500);
+        input[INPUT_GIMBAL_ROLL] = scaleRange(attitude.values.roll, -1800, 1800, -500, +500);
+    }
 
     input[INPUT_STABILIZED_THROTTLE] = motor[0] - 1000 - 500;  // Since it derives from rcCommand or mincommand and must be [-500:+500]
 
@@ -813,40 +1067,36 @@ void servoMixer(void)
     // 2000 - 1500 = +500
     // 1500 - 1500 = 0
     // 1000 - 1500 = -500
-    input[INPUT_RC_ROLL]     = rcData[ROLL]     - rxConfig->midrc;
-    input[INPUT_RC_PITCH]    = rcData[PITCH]    - rxConfig->midrc;
-    input[INPUT_RC_YAW]      = rcData[YAW]      - rxConfig->midrc;
-    input[INPUT_RC_THROTTLE] = rcData[THROTTLE] - rxConfig->midrc;
-    input[INPUT_RC_AUX1]     = rcData[AUX1]     - rxConfig->midrc;
-    input[INPUT_RC_AUX2]     = rcData[AUX2]     - rxConfig->midrc;
-    input[INPUT_RC_AUX3]     = rcData[AUX3]     - rxConfig->midrc;
-    input[INPUT_RC_AUX4]     = rcData[AUX4]     - rxConfig->midrc;
+    // INPUT_RC_ROLL..INPUT_RC_AUX4 follow the ROLL..AUX4 channel order
+    for (i = INPUT_RC_ROLL; i <= INPUT_RC_AUX4; i++) {
+        if (servoMixerPlanInputs & (1 << i)) {
+            input[i] = rcData[ROLL + i - INPUT_RC_ROLL] - rxConfig->midrc;
+        }
+    }
 
     for (i = 0; i < MAX_SUPPORTED_SERVOS; i++)
         servo[i] = 0;
 
-    // mix servos according to rules
-    for (i = 0; i < servoRuleCount; i++) {
+    // mix servos according to the compiled rules
+    for (i = 0; i < servoMixerPlanLength; i++) {
+        servoMixerPlanEntry_t *entry = &servoMixerPlan[i];
+
         // consider rule if no box assigned or box is active
-        if (currentServoMixer[i].box == 0 || IS_RC_MODE_ACTIVE(BOXSERVO1 + currentServoMixer[i].box - 1)) {
-            uint8_t target = currentServoMixer[i].targetChannel;
-            uint8_t from = currentServoMixer[i].inputSource;
-            uint16_t servo_width = servoConf[target].max - servoConf[target].min;
-            int16_t min = currentServoMixer[i].min * servo_width / 100 - servo_width / 2;
-            int16_t max = currentServoMixer[i].max * servo_width / 100 - servo_width / 2;
+        if (entry->box == 0 || IS_RC_MODE_ACTIVE(BOXSERVO1 + entry->box - 1)) {
+            const int16_t inputValue = input[entry->inputSource];
 
-            if (currentServoMixer[i].speed == 0)
-                currentOutput[i] = input[from];
+            if (entry->speed == 0)
+                entry->currentOutput = inputValue;
             else {
-                if (currentOutput[i] < input[from])
-                    currentOutput[i] = constrain(currentOutput[i] + currentServoMixer[i].speed, currentOutput[i], input[from]);
-                else if (currentOutput[i] > input[from])
-                    currentOutput[i] = constrain(currentOutput[i] - currentServoMixer[i].speed, input[from], currentOutput[i]);
+                if (entry->currentOutput < inputValue)
+                    entry->currentOutput = constrain(entry->currentOutput + entry->speed, entry->currentOutput, inputValue);
+                else if (entry->currentOutput > inputValue)
+                    entry->currentOutput = constrain(entry->currentOutput - entry->speed, inputValue, entry->currentOutput);
             }
 
-            servo[target] += servoDirection(target, from) * constrain(((int32_t)currentOutput[i] * currentServoMixer[i].rate) / 100, min, max);
+            servo[entry->targetChannel] += constrain(((int32_t)entry->currentOutput * entry->rate) / 100, entry->min, entry->max);
         } else {
-            currentOutput[i] = 0;
+            entry->currentOutput = 0;
         }
     }
 
@@ -885,23 +1135,21 @@ void filterServos(void)
 {
     uint8_t servoIdx;
 
-    if (mixerConfig->servo_lowpass_enable) {
-        // Initialize servo lowpass filter (servos are calculated at looptime rate)
-        if (!servoFilterIsSet) {
-            for (servoIdx = 0; servoIdx < MAX_SUPPORTED_SERVOS; servoIdx++) {
-                filterInitBiQuad(mixerConfig->servo_lowpass_freq, &servoFitlerState[servoIdx], 0);
-            }
-
-            servoFilterIsSet = true;
-        }
-
+    // Initialize servo lowpass filter (servos are calculated at looptime rate)
+    if (mixerConfig->servo_lowpass_enable && !servoFilterIsSet) {
         for (servoIdx = 0; servoIdx < MAX_SUPPORTED_SERVOS; servoIdx++) {
-            // Apply servo lowpass filter and do sanity cheching
-            servo[servoIdx] = (int16_t) filterApplyBiQuad((float)servo[servoIdx], &servoFitlerState[servoIdx]);
+            filterInitBiQuad(mixerConfig->servo_lowpass_freq, &servoFitlerState[servoIdx], 0);
         }
+
+        servoFilterIsSet = true;
     }
 
     for (servoIdx = 0; servoIdx < MAX_SUPPORTED_SERVOS; servoIdx++) {
+        // Apply servo lowpass filter to servos that are actually output and do sanity checking
+        if (mixerConfig->servo_lowpass_enable && (servoFilterMask & (1 << servoIdx))) {
+            servo[servoIdx] = (int16_t) filterApplyBiQuad((float)servo[servoIdx], &servoFitlerState[servoIdx]);
+        }
+
         servo[servoIdx] = constrain(servo[servoIdx], servoConf[servoIdx].min, servoConf[servoIdx].max);
     }
 }
@@ -33,6 +33,12 @@
 #define YAW_JUMP_PREVENTION_LIMIT_LOW 80
 #define YAW_JUMP_PREVENTION_LIMIT_HIGH 500
 
+// Fixed-point mixer matrix, 1.0 == (1 << MIXER_MATRIX_SHIFT)
+#define MIXER_MATRIX_SHIFT 12
+#define MIXER_MATRIX_SCALE (1 << MIXER_MATRIX_SHIFT)
+
+#define THRUST_LINEARIZATION_SEGMENTS 32
+
 
 // Note: this is called MultiType/MULTITYPE_* in baseflight.
 typedef enum mixerMode
@@ -87,9 +93,25 @@ typedef struct mixer_s {
     bool enabled;
 } mixer_t;
 
+typedef enum {
+    MIXER_DESAT_UNIFORM = 0,                // scale roll/pitch/yaw uniformly, clip throttle
+    MIXER_DESAT_PRIORITY                    // keep roll/pitch, sacrifice yaw first, then throttle
+} mixerDesaturationMode_e;
+
+// Fixed-point copy of motorMixer_t, precomputed when mixer is configured
+typedef struct motorMixerFixed_s {
+    int16_t throttle;
+    int16_t roll;
+    int16_t pitch;
+    int16_t yaw;
+} motorMixerFixed_t;
+
 typedef struct mixerConfig_s {
     int8_t yaw_motor_direction;
     uint16_t yaw_jump_prevention_limit;      // make limit configurable (original fixed value was 100)
+    uint8_t desaturation_mode;              // see mixerDesaturationMode_e
+    uint8_t thrust_linearization;           // thrust curve compensation [0;100]%, 0=linear (disabled)
+    uint8_t vbat_compensation;              // scale motor output to counter battery voltage sag
 #ifdef USE_SERVOS
     uint8_t tri_unarmed_servo;              // send tail servo correction pulses even when unarmed
     int16_t servo_lowpass_freq;             // lowpass servo filter frequency selection; 1/1000ths of loop freq
@@ -109,7 +131,7 @@ typedef struct flight3DConfig_s {
 #ifdef USE_SERVOS
 
 // These must be consecutive, see 'reversedSources'
-enum {
+typedef enum {
     INPUT_STABILIZED_ROLL = 0,
     INPUT_STABILIZED_PITCH,
     INPUT_STABILIZED_YAW,
@@ -230,9 +252,11 @@ void mixerLoadMix(int index, motorMixer_t *customMixers);
 #ifdef USE_SERVOS
 void servoMixerLoadMix(int index, servoMixer_t *customServoMixers);
 void loadCustomServoMixer(void);
+void servoMixerUpdatePlan(void);
 int servoDirection(int servoIndex, int fromChannel);
 #endif
 void mixerResetDisarmedMotors(void);
+void mixerUpdateMatrix(void);
 void mixTable(void);
 void writeMotors(void);
 void servoMixer(void);
@@ -46,6 +46,8 @@
 #include "config/runtime_config.h"
 #include "config/config.h"
 
+#include "blackbox/blackbox.h"
+
 /*-----------------------------------------------------------
  * Compatibility for home position
  *-----------------------------------------------------------*/
@@ -71,6 +73,10 @@ int16_t navActualSurface;
 uint16_t navFlags;
 #endif
 
+/* Ring buffer of recent FSM state transitions */
+static navFSMTransition_t navFSMTrace[NAV_FSM_TRACE_SIZE];
+static uint32_t navFSMTransitionCount = 0;
+
 static void updateDesiredRTHAltitude(void);
 static void resetAltitudeController(void);
 static void resetPositionController(void);
@@ -79,6 +85,8 @@ void resetNavigation(void);
 
 static void calcualteAndSetActiveWaypoint(navWaypoint_t * waypoint);
 static void calcualteAndSetActiveWaypointToLocalPosition(t_fp_vector * pos);
+static int32_t calculateActiveWaypointTurnAngle(void);
+static void updateGCSCommandStatus(void);
 void calculateInitialHoldPosition(t_fp_vector * pos);
 void calculateFarAwayTarget(t_fp_vector * farAwayPos, int32_t yaw, int32_t distance);
 
@@ -113,7 +121,7 @@ static navigationFSMEvent_t navOnEnteringState_NAV_STATE_EMERGENCY_LANDING_INITI
 static navigationFSMEvent_t navOnEnteringState_NAV_STATE_EMERGENCY_LANDING_IN_PROGRESS(navigationFSMState_t previousState);
 static navigationFSMEvent_t navOnEnteringState_NAV_STATE_EMERGENCY_LANDING_FINISHED(navigationFSMState_t previousState);
 
-static navigationFSMStateDescriptor_t navFSM[NAV_STATE_COUNT] = {
+static const navigationFSMStateDescriptor_t navFSM[NAV_STATE_COUNT] = {
     /** Idle state ******************************************************/
     [NAV_STATE_IDLE] = {
         .onEntry = navOnEnteringState_NAV_STATE_IDLE,
@@ -991,7 +999,7 @@ static navigationFSMEvent_t navOnEnteringState_NAV_STATE_WAYPOINT_INITIALIZE(nav
 {
     UNUSED(previousState);
 
-    if (posControl.waypointCount == 0 || !posControl.waypointListValid) {
+    if (!missionIsValid()) {
         return NAV_FSM_EVENT_ERROR;
     }
     else {
@@ -1010,9 +1018,15 @@ static navigationFSMEvent_t navOnEnteringState_NAV_STATE_WAYPOINT_PRE_ACTION(nav
     /* A helper function to do waypoint-specific action */
     UNUSED(previousState);
 
-    switch (posControl.waypointList[posControl.activeWaypointIndex].action) {
+    // Page in the active waypoint from mission storage
+    if (!missionGetWaypoint(posControl.activeWaypointIndex, &posControl.activeWaypointData)) {
+        return NAV_FSM_EVENT_ERROR;
+    }
+
+    switch (posControl.activeWaypointData.action) {
         case NAV_WP_ACTION_WAYPOINT:
-            calcualteAndSetActiveWaypoint(&posControl.waypointList[posControl.activeWaypointIndex]);
+            calcualteAndSetActiveWaypoint(&posControl.activeWaypointData);
+            posControl.activeWaypointTurnAngle = calculateActiveWaypointTurnAngle();
             return NAV_FSM_EVENT_SUCCESS;       // will switch to NAV_STATE_WAYPOINT_IN_PROGRESS
 
         case NAV_WP_ACTION_RTH:
@@ -1028,11 +1042,11 @@ static navigationFSMEvent_t navOnEnteringState_NAV_STATE_WAYPOINT_IN_PROGRESS(na
 
     // If no position sensor available - land immediately
     if (posControl.flags.hasValidPositionSensor && posControl.flags.hasValidHeadingSensor) {
-        switch (posControl.waypointList[posControl.activeWaypointIndex].action) {
+        switch (posControl.activeWaypointData.action) {
             case NAV_WP_ACTION_WAYPOINT:
             case NAV_WP_ACTION_RTH:
             default:
-                if (isWaypointReached(&posControl.activeWaypoint) || isWaypointMissed(&posControl.activeWaypoint)) {
+                if (isWaypointReached(&posControl.activeWaypoint) || isWaypointMissed(&posControl.activeWaypoint) || isActiveWaypointTurnDue()) {
                     // Waypoint reached
                     return NAV_FSM_EVENT_SUCCESS;   // will switch to NAV_STATE_WAYPOINT_REACHED
                 }
@@ -1057,8 +1071,8 @@ static navigationFSMEvent_t navOnEnteringState_NAV_STATE_WAYPOINT_REACHED(naviga
 {
     UNUSED(previousState);
 
-    bool isLastWaypoint = (posControl.waypointList[posControl.activeWaypointIndex].flag == NAV_WP_FLAG_LAST) ||
-                          (posControl.activeWaypointIndex >= (posControl.waypointCount - 1));
+    bool isLastWaypoint = (posControl.activeWaypointData.flag == NAV_WP_FLAG_LAST) ||
+                          (posControl.activeWaypointIndex >= (missionGetWaypointCount() - 1));
 
     if (isLastWaypoint) {
         // Last waypoint reached
@@ -1113,61 +1127,78 @@ static navigationFSMEvent_t navOnEnteringState_NAV_STATE_EMERGENCY_LANDING_FINIS
     return NAV_FSM_EVENT_SUCCESS;
 }
 
-static navigationFSMState_t navSetNewFSMState(navigationFSMState_t newState)
+static void navRecordFSMTransition(navigationFSMState_t fromState, navigationFSMState_t toState, navigationFSMEvent_t event)
+{
+    navFSMTransition_t * entry = &navFSMTrace[navFSMTransitionCount % NAV_FSM_TRACE_SIZE];
+
+    entry->timeMs = millis();
+    entry->fromState = fromState;
+    entry->toState = toState;
+    entry->event = event;
+    navFSMTransitionCount++;
+
+#if defined(NAV_BLACKBOX)
+    if (feature(FEATURE_BLACKBOX)) {
+        flightLogEvent_navStateChange_t eventData;
+        eventData.timeMs = entry->timeMs;
+        eventData.fromState = fromState;
+        eventData.toState = toState;
+        eventData.event = event;
+        blackboxLogEvent(FLIGHT_LOG_EVENT_NAV_STATE_CHANGE, (flightLogEventData_t *)&eventData);
+    }
+#endif
+}
+
+static navigationFSMState_t navSetNewFSMState(navigationFSMState_t newState, navigationFSMEvent_t event)
 {
     navigationFSMState_t previousState;
 
     previousState = posControl.navState;
     posControl.navState = newState;
+
+    // Periodic re-entry of the same state is not a transition
+    if (previousState != newState) {
+        navRecordFSMTransition(previousState, newState, event);
+    }
+
     return previousState;
 }
 
+static void navApplyFSMEvent(navigationFSMEvent_t event)
+{
+    /* Update state */
+    navigationFSMState_t previousState = navSetNewFSMState(navFSM[posControl.navState].onEvent[event], event);
+
+    /* Call new state's entry function */
+    while (navFSM[posControl.navState].onEntry) {
+        navigationFSMEvent_t newEvent = navFSM[posControl.navState].onEntry(previousState);
+
+        if ((newEvent != NAV_FSM_EVENT_NONE) && (navFSM[posControl.navState].onEvent[newEvent] != NAV_STATE_UNDEFINED)) {
+            previousState = navSetNewFSMState(navFSM[posControl.navState].onEvent[newEvent], newEvent);
+        }
+        else {
+            break;
+        }
+    }
+}
+
 static void navProcessFSMEvents(navigationFSMEvent_t injectedEvent)
 {
     uint32_t currentMillis = millis();
-    navigationFSMState_t previousState;
     static uint32_t lastStateProcessTime = 0;
 
     /* If timeout event defined and timeout reached - switch state */
     if ((navFSM[posControl.navState].timeoutMs > 0) && (navFSM[posControl.navState].onEvent[NAV_FSM_EVENT_TIMEOUT] != NAV_STATE_UNDEFINED) &&
             ((currentMillis - lastStateProcessTime) >= navFSM[posControl.navState].timeoutMs)) {
-		/* Update state */
-        previousState = navSetNewFSMState(navFSM[posControl.navState].onEvent[NAV_FSM_EVENT_TIMEOUT]);
-
-		/* Call new state's entry function */
-		while (navFSM[posControl.navState].onEntry) {
-			navigationFSMEvent_t newEvent = navFSM[posControl.navState].onEntry(previousState);
-
-			if ((newEvent != NAV_FSM_EVENT_NONE) && (navFSM[posControl.navState].onEvent[newEvent] != NAV_STATE_UNDEFINED)) {
-                previousState = navSetNewFSMState(navFSM[posControl.navState].onEvent[newEvent]);
-			}
-			else {
-				break;
-			}
-		}
-
-		lastStateProcessTime  = currentMillis;
+        navApplyFSMEvent(NAV_FSM_EVENT_TIMEOUT);
+        lastStateProcessTime  = currentMillis;
     }
 
-	/* Inject new event */
-	if (injectedEvent != NAV_FSM_EVENT_NONE && navFSM[posControl.navState].onEvent[injectedEvent] != NAV_STATE_UNDEFINED) {
-		/* Update state */
-        previousState = navSetNewFSMState(navFSM[posControl.navState].onEvent[injectedEvent]);
-
-		/* Call new state's entry function */
-		while (navFSM[posControl.navState].onEntry) {
-			navigationFSMEvent_t newEvent = navFSM[posControl.navState].onEntry(previousState);
-
-			if ((newEvent != NAV_FSM_EVENT_NONE) && (navFSM[posControl.navState].onEvent[newEvent] != NAV_STATE_UNDEFINED)) {
-                previousState = navSetNewFSMState(navFSM[posControl.navState].onEvent[newEvent]);
-			}
-			else {
-				break;
-			}
-		}
-
-		lastStateProcessTime  = currentMillis;
-	}
+    /* Inject new event */
+    if (injectedEvent != NAV_FSM_EVENT_NONE && navFSM[posControl.navState].onEvent[injectedEvent] != NAV_STATE_UNDEFINED) {
+        navApplyFSMEvent(injectedEvent);
+        lastStateProcessTime  = currentMillis;
+    }
 
     /* Update public system state information */
     NAV_Status.mode = MW_GPS_MODE_NONE;
@@ -1198,8 +1229,8 @@ static void navProcessFSMEvents(navigationFSMEvent_t injectedEvent)
 
     NAV_Status.activeWpNumber = posControl.activeWaypointIndex + 1;
     NAV_Status.activeWpAction = 0;
-    if ((posControl.activeWaypointIndex >= 0) && (posControl.activeWaypointIndex < NAV_MAX_WAYPOINTS)) {
-        NAV_Status.activeWpAction = posControl.waypointList[posControl.activeWaypointIndex].action;
+    if ((posControl.activeWaypointIndex >= 0) && (posControl.activeWaypointIndex < missionGetWaypointCount())) {
+        NAV_Status.activeWpAction = posControl.activeWaypointData.action;
     }
 }
 
@@ -1448,6 +1479,20 @@ bool isWaypointReached(navWaypointPosition_t * waypoint)
     return (wpDistance <= posControl.navConfig->waypoint_radius);
 }
 
+/*-----------------------------------------------------------
+ * Check if fixed wing should start turning onto the next track, so it rolls out on it instead of overshooting the waypoint
+ *-----------------------------------------------------------*/
+bool isActiveWaypointTurnDue(void)
+{
+    if (STATE(FIXED_WING) && (posControl.activeWaypointTurnAngle > 0)) {
+        uint32_t wpDistance = calculateDistanceToDestination(&posControl.activeWaypoint.pos);
+        return (wpDistance <= calculateFixedWingTurnAnticipationDistance(posControl.activeWaypointTurnAngle));
+    }
+    else {
+        return false;
+    }
+}
+
 static void updateHomePositionCompatibility(void)
 {
     geoConvertLocalToGeodetic(&posControl.gpsOrigin, &posControl.homePosition.pos, &GPS_home);
@@ -1777,11 +1822,9 @@ void getWaypoint(uint8_t wpNumber, navWaypoint_t * wpData)
         wpData->lon = wpLLH.lon;
         wpData->alt = wpLLH.alt;
     }
-    // WP #1 - #15 - common waypoints - pre-programmed mission
-    else if ((wpNumber >= 1) && (wpNumber <= NAV_MAX_WAYPOINTS)) {
-        if (wpNumber <= posControl.waypointCount) {
-            *wpData = posControl.waypointList[wpNumber - 1];
-        }
+    // WP #1 - #254 - common waypoints - pre-programmed mission
+    else {
+        getMissionWaypoint(wpNumber, wpData);
     }
 }
 
@@ -1822,16 +1865,9 @@ void setWaypoint(uint8_t wpNumber, navWaypoint_t * wpData)
 
         setDesiredPosition(&wpPos.pos, DEGREES_TO_DECIDEGREES(wpData->p1), waypointUpdateFlags);
     }
-    // WP #1 - #15 - common waypoints - pre-programmed mission
-    else if ((wpNumber >= 1) && (wpNumber <= NAV_MAX_WAYPOINTS) && !ARMING_FLAG(ARMED)) {
-        if (wpData->action == NAV_WP_ACTION_WAYPOINT || wpData->action == NAV_WP_ACTION_RTH) {
-            // Only allow upload next waypoint (continue upload mission) or first waypoint (new mission)
-            if (wpNumber == (posControl.waypointCount + 1) || wpNumber == 1) {
-                posControl.waypointList[wpNumber - 1] = *wpData;
-                posControl.waypointCount = wpNumber;
-                posControl.waypointListValid = (wpData->flag == NAV_WP_FLAG_LAST);
-            }
-        }
+    // WP #1 - #254 - common waypoints - pre-programmed mission
+    else if ((wpNumber >= 1) && (wpNumber != 255)) {
+        setMissionWaypoint(wpNumber, wpData);
     }
 }
 
@@ -1839,13 +1875,54 @@ void resetWaypointList(void)
 {
     /* Can only reset waypoint list if not armed */
     if (!ARMING_FLAG(ARMED)) {
-        posControl.waypointCount = 0;
-        posControl.waypointListValid = false;
+        missionReset();
+    }
+}
+
+/* Mission waypoints, numbered from 1 */
+bool getMissionWaypoint(int wpNumber, navWaypoint_t * wpData)
+{
+    return missionGetWaypoint(wpNumber - 1, wpData);
+}
+
+bool setMissionWaypoint(int wpNumber, navWaypoint_t * wpData)
+{
+    if (ARMING_FLAG(ARMED) || !(wpData->action == NAV_WP_ACTION_WAYPOINT || wpData->action == NAV_WP_ACTION_RTH)) {
+        return false;
+    }
+
+    // Only allow upload next waypoint (continue upload mission) or first waypoint (new mission)
+    if (wpNumber == 1) {
+        missionReset();
     }
+    else if (wpNumber != (missionGetWaypointCount() + 1)) {
+        return false;
+    }
+
+    return missionAppendWaypoint(wpData);
+}
+
+int getWaypointCount(void)
+{
+    return missionGetWaypointCount();
+}
+
+bool isWaypointListValid(void)
+{
+    return missionIsValid();
 }
 
 static void calcualteAndSetActiveWaypointToLocalPosition(t_fp_vector * pos)
 {
+    // Track towards the waypoint starts at the previous one when executing a mission, otherwise at current position
+    if ((navGetStateFlags(posControl.navState) & NAV_AUTO_WP) && (posControl.activeWaypointIndex > 0)) {
+        posControl.activeWaypointTrackStart = posControl.activeWaypoint.pos;
+    }
+    else {
+        posControl.activeWaypointTrackStart = posControl.actualState.pos;
+    }
+
+    posControl.activeWaypointTurnAngle = 0;
     posControl.activeWaypoint.pos = *pos;
 
     // Calculate initial bearing towards waypoint and store it in waypoint yaw parameter (this will further be used to detect missed waypoints)
@@ -1868,6 +1945,37 @@ static void calcualteAndSetActiveWaypoint(navWaypoint_t * waypoint)
     calcualteAndSetActiveWaypointToLocalPosition(&localPos);
 }
 
+/* Turn angle (deg*100) at the active waypoint from the track leading to it onto the track towards the next waypoint */
+static int32_t calculateActiveWaypointTurnAngle(void)
+{
+    navWaypoint_t nextWaypoint;
+    t_fp_vector nextPos;
+
+    if ((posControl.activeWaypointData.flag == NAV_WP_FLAG_LAST) || !missionGetWaypoint(posControl.activeWaypointIndex + 1, &nextWaypoint)) {
+        return 0;
+    }
+
+    if (nextWaypoint.action == NAV_WP_ACTION_WAYPOINT) {
+        gpsLocation_t wpLLH;
+
+        wpLLH.lat = nextWaypoint.lat;
+        wpLLH.lon = nextWaypoint.lon;
+        wpLLH.alt = nextWaypoint.alt;
+
+        geoConvertGeodeticToLocal(&posControl.gpsOrigin, &wpLLH, &nextPos, GEO_ALT_RELATIVE);
+    }
+    else {
+        nextPos = posControl.homeWaypointAbove.pos;
+    }
+
+    float trackBearing = atan2_approx(posControl.activeWaypoint.pos.V.Y - posControl.activeWaypointTrackStart.V.Y,
+                                      posControl.activeWaypoint.pos.V.X - posControl.activeWaypointTrackStart.V.X);
+    float nextTrackBearing = atan2_approx(nextPos.V.Y - posControl.activeWaypoint.pos.V.Y,
+                                          nextPos.V.X - posControl.activeWaypoint.pos.V.X);
+
+    return ABS(wrap_18000(RADIANS_TO_CENTIDEGREES(nextTrackBearing - trackBearing)));
+}
+
 /**
  * Returns TRUE if we are in WP mode and executing last waypoint on the list, or in RTH mode, or in PH mode
  *  In RTH mode our only and last waypoint is home
@@ -1875,12 +1983,12 @@ static void calcualteAndSetActiveWaypoint(navWaypoint_t * waypoint)
 bool isApproachingLastWaypoint(void)
 {
     if (navGetStateFlags(posControl.navState) & NAV_AUTO_WP) {
-        if (posControl.waypointCount == 0) {
+        if (missionGetWaypointCount() == 0) {
             /* No waypoints */
             return true;
         }
-        else if ((posControl.activeWaypointIndex == (posControl.waypointCount - 1)) ||
-                 (posControl.waypointList[posControl.activeWaypointIndex].flag == NAV_WP_FLAG_LAST)) {
+        else if ((posControl.activeWaypointIndex == (missionGetWaypointCount() - 1)) ||
+                 (posControl.activeWaypointData.flag == NAV_WP_FLAG_LAST)) {
             return true;
         }
         else {
@@ -1901,8 +2009,8 @@ float getActiveWaypointSpeed(void)
     uint16_t waypointSpeed = posControl.navConfig->max_speed;
 
     if (navGetStateFlags(posControl.navState) & NAV_AUTO_WP) {
-        if (posControl.waypointCount > 0 && posControl.waypointList[posControl.activeWaypointIndex].action == NAV_WP_ACTION_WAYPOINT) {
-            waypointSpeed = posControl.waypointList[posControl.activeWaypointIndex].p1;
+        if (missionGetWaypointCount() > 0 && posControl.activeWaypointData.action == NAV_WP_ACTION_WAYPOINT) {
+            waypointSpeed = posControl.activeWaypointData.p1;
 
             if (waypointSpeed < 50 || waypointSpeed > posControl.navConfig->max_speed) {
                 waypointSpeed = posControl.navConfig->max_speed;
@@ -2041,8 +2149,32 @@ static navigationFSMEvent_t selectNavEventFromBoxModeInput(void)
             return NAV_FSM_EVENT_SWITCH_TO_IDLE;
         }
 
+        // Ground station commands override WP/PH/AH for as long as pilot keeps GCS NAV mode enabled
+        if (posControl.flags.isGCSAssistedNavigationEnabled) {
+            switch (posControl.flags.gcsCommand) {
+                case NAV_GCS_COMMAND_RTH:
+                    canActivateWaypoint = false;
+                    return NAV_FSM_EVENT_SWITCH_TO_RTH;
+
+                case NAV_GCS_COMMAND_LAND:
+                    canActivateWaypoint = false;
+                    return NAV_FSM_EVENT_SWITCH_TO_EMERGENCY_LANDING;
+
+                case NAV_GCS_COMMAND_HOLD:
+                    if ((FLIGHT_MODE(NAV_ALTHOLD_MODE) && FLIGHT_MODE(NAV_POSHOLD_MODE)) || (canActivatePosHold && canActivateAltHold))
+                        return NAV_FSM_EVENT_SWITCH_TO_POSHOLD_3D;
+                    break;
+
+                default:
+                    break;
+            }
+        }
+        else {
+            posControl.flags.gcsCommand = NAV_GCS_COMMAND_NONE;
+        }
+
         if (IS_RC_MODE_ACTIVE(BOXNAVWP)) {
-            if ((FLIGHT_MODE(NAV_WP_MODE)) || (canActivateWaypoint && canActivatePosHold && canActivateAltHold && STATE(GPS_FIX_HOME) && ARMING_FLAG(ARMED) && posControl.waypointListValid && (posControl.waypointCount > 0)))
+            if ((FLIGHT_MODE(NAV_WP_MODE)) || (canActivateWaypoint && canActivatePosHold && canActivateAltHold && STATE(GPS_FIX_HOME) && ARMING_FLAG(ARMED) && missionIsValid()))
                 return NAV_FSM_EVENT_SWITCH_TO_WAYPOINT;
         }
         else {
@@ -2067,6 +2199,7 @@ static navigationFSMEvent_t selectNavEventFromBoxModeInput(void)
     }
     else {
         canActivateWaypoint = false;
+        posControl.flags.gcsCommand = NAV_GCS_COMMAND_NONE;
     }
 
     return NAV_FSM_EVENT_SWITCH_TO_IDLE;
@@ -2171,6 +2304,11 @@ void updateWaypointsAndNavigationMode(void)
     // Process switch to a different navigation mode (if needed)
     navProcessFSMEvents(selectNavEventFromBoxModeInput());
 
+    // Ground station command latched since the last pass was applied by the transition above
+    if (posControl.flags.gcsCommandStatus == NAV_GCS_COMMAND_STATUS_PENDING) {
+        updateGCSCommandStatus();
+    }
+
     // Process pilot's RC input to adjust behaviour
     processNavigationRCAdjustments();
 
@@ -2274,9 +2412,8 @@ void navigationInit(navConfig_t *initialnavConfig,
     posControl.flags.hasValidHeadingSensor = 0;
 
     posControl.flags.forcedRTHActivated = 0;
-    posControl.waypointCount = 0;
     posControl.activeWaypointIndex = 0;
-    posControl.waypointListValid = false;
+    missionInit();
 
     /* Set initial surface invalid */
     posControl.actualState.surface = -1.0f;
@@ -2336,6 +2473,87 @@ rthState_e getStateOfForcedRTH(void)
     }
 }
 
+/*-----------------------------------------------------------
+ * FSM transition trace
+ *-----------------------------------------------------------*/
+uint32_t navGetFSMTransitionCount(void)
+{
+    return navFSMTransitionCount;
+}
+
+bool navGetFSMTransition(uint32_t sequence, navFSMTransition_t * transition)
+{
+    // Only the last NAV_FSM_TRACE_SIZE transitions are kept
+    uint32_t age = navFSMTransitionCount - sequence - 1;
+    if (age >= MIN(navFSMTransitionCount, (uint32_t)NAV_FSM_TRACE_SIZE)) {
+        return false;
+    }
+
+    *transition = navFSMTrace[sequence % NAV_FSM_TRACE_SIZE];
+    return true;
+}
+
+/*-----------------------------------------------------------
+ * Ground station commands (MAVLink COMMAND_LONG, SET_POSITION_TARGET)
+ * Commands are only latched here, the FSM applies them in updateWaypointsAndNavigationMode()
+ * so state handlers never run from the telemetry task.
+ *-----------------------------------------------------------*/
+bool navigationSetGCSCommand(navGCSCommand_e command, const navWaypoint_t * target)
+{
+    if (!ARMING_FLAG(ARMED) || !posControl.flags.isGCSAssistedNavigationEnabled || posControl.flags.gcsCommandStatus == NAV_GCS_COMMAND_STATUS_PENDING) {
+        return false;
+    }
+
+    posControl.flags.gcsCommand = command;
+    posControl.flags.gcsCommandStatus = NAV_GCS_COMMAND_STATUS_PENDING;
+    posControl.flags.gcsTargetPending = false;
+    if (target) {
+        posControl.gcsTarget = *target;
+        posControl.flags.gcsTargetPending = true;
+    }
+
+    return true;
+}
+
+navGCSCommandStatus_e navigationGetGCSCommandStatus(void)
+{
+    return posControl.flags.gcsCommandStatus;
+}
+
+// Called after the FSM processed a latched command, checks whether it actually switched to the requested mode
+static void updateGCSCommandStatus(void)
+{
+    bool accepted;
+    switch (posControl.flags.gcsCommand) {
+        case NAV_GCS_COMMAND_HOLD:
+            accepted = (posControl.navState == NAV_STATE_POSHOLD_3D_IN_PROGRESS);
+            break;
+        case NAV_GCS_COMMAND_RTH:
+            // RTH falls back to emergency landing without valid position
+            accepted = (navGetStateFlags(posControl.navState) & (NAV_AUTO_RTH | NAV_CTL_EMERG)) != 0;
+            break;
+        case NAV_GCS_COMMAND_LAND:
+            accepted = (navGetStateFlags(posControl.navState) & NAV_CTL_EMERG) != 0;
+            break;
+        default:
+            accepted = false;
+            break;
+    }
+
+    if (accepted) {
+        posControl.flags.gcsCommandStatus = NAV_GCS_COMMAND_STATUS_ACCEPTED;
+        if (posControl.flags.gcsTargetPending) {
+            setWaypoint(255, &posControl.gcsTarget);
+        }
+    }
+    else {
+        posControl.flags.gcsCommand = NAV_GCS_COMMAND_NONE;
+        posControl.flags.gcsCommandStatus = NAV_GCS_COMMAND_STATUS_REJECTED;
+    }
+
+    posControl.flags.gcsTargetPending = false;
+}
+
 #else // NAV
 
 #ifdef GPS
@@ -41,7 +41,11 @@ void onNewGPSData(void);
 #define NAV_BLACKBOX
 #endif
 
-#define NAV_MAX_WAYPOINTS           15
+#if defined(NAV_MISSION_STORAGE)
+#define NAV_MAX_WAYPOINTS           300     // Mission is kept in MCU flash
+#else
+#define NAV_MAX_WAYPOINTS           30
+#endif
 
 enum {
     NAV_GPS_ATTI    = 0,                    // Pitch/roll stick controls attitude (pitch/roll lean angles)
@@ -56,6 +60,16 @@ enum {
     NAV_RTH_AT_LEAST_ALT    = 4,            // Climb to predefined altitude if below it
 };
 
+enum {
+    NAV_FW_CONTROLLER_HEADING   = 0,        // Steer towards a virtual target ahead of the aircraft with a heading PID
+    NAV_FW_CONTROLLER_L1        = 1,        // L1 nonlinear guidance: track following, loiter circles and turn anticipation
+};
+
+enum {
+    NAV_FW_ALT_CONTROLLER_PITCH = 0,        // Pitch from altitude error, throttle from pitch angle
+    NAV_FW_ALT_CONTROLLER_TECS  = 1,        // Total energy control: throttle from total energy, pitch from energy balance
+};
+
 enum {
     NAV_HEADING_CONTROL_NONE = 0,
     NAV_HEADING_CONTROL_AUTO,
@@ -80,6 +94,10 @@ typedef struct navConfig_s {
         uint8_t accz_unarmed_cal;
         uint8_t use_gps_velned;
         uint16_t gps_delay_ms;
+        uint16_t baro_delay_ms;     // Baro measurement latency, median filter and conversion time
+#if defined(NAV_POS_ESTIMATOR_EKF)
+        uint8_t use_ekf;            // Use Kalman filter instead of complementary filter
+#endif
 
         float w_z_baro_p;   // Weight (cutoff frequency) for barometer altitude measurements
 
@@ -116,6 +134,8 @@ typedef struct navConfig_s {
     uint8_t  mc_max_bank_angle;             // multicopter max banking angle (deg)
     uint16_t mc_hover_throttle;             // multicopter hover throttle
     uint16_t mc_min_fly_throttle;           // multicopter minimum throttle to consider machine flying
+    uint16_t mc_traj_max_accel;             // multicopter trajectory generator max horizontal acceleration (cm/s^2)
+    uint16_t mc_traj_max_jerk;              // multicopter trajectory generator max horizontal jerk (cm/s^3), 0 - disable trajectory generator
 
     uint16_t fw_cruise_throttle;            // Cruise throttle
     uint16_t fw_min_throttle;               // Minimum allowed throttle in auto mode
@@ -126,14 +146,33 @@ typedef struct navConfig_s {
     uint8_t  fw_pitch_to_throttle;          // Pitch angle (in deg) to throttle gain (in 1/1000's of throttle) (*10)
     uint8_t  fw_roll_to_pitch;              // Roll to pitch compensation (in %)
     uint16_t fw_loiter_radius;              // Loiter radius when executing PH on a fixed wing
+    uint8_t  fw_nav_controller;             // NAV_FW_CONTROLLER_HEADING or NAV_FW_CONTROLLER_L1
+    uint8_t  fw_l1_period;                  // L1 guidance period (s), roughly the time to settle on a track
+    uint8_t  fw_l1_damping;                 // L1 guidance damping ratio (in %)
+    uint8_t  fw_alt_controller;             // NAV_FW_ALT_CONTROLLER_PITCH or NAV_FW_ALT_CONTROLLER_TECS
+    uint16_t fw_cruise_speed;               // TECS speed demand (cm/s), 0 - speed is not controlled
+    uint8_t  fw_tecs_time_const;            // TECS time constant (s*10)
+    uint8_t  fw_tecs_speed_weight;          // TECS speed vs altitude priority (in %), 0 - altitude only, 200 - speed only
 } navConfig_t;
 
+/* Second-order expansion of the WGS84 local tangent plane projection around a point close to the aircraft */
+typedef struct gpsProjectionAnchor_s {
+    int32_t lat;            // Expansion point, 1e-7 deg
+    int32_t lon;
+    float   pos[2];         // Local N/E position of the expansion point (cm)
+    float   jac[2][2];      // d(N,E) / d(lat,lon) (cm/rad)
+    float   hess[2][3];     // Halved second derivatives of N and E for lat^2, lat*lon and lon^2 (cm/rad^2)
+} gpsProjectionAnchor_t;
+
 typedef struct gpsOrigin_s {
     bool    valid;
-    float   scale;
     int32_t lat;    // Lattitude * 1e+7
     int32_t lon;    // Longitude * 1e+7
     int32_t alt;    // Altitude in centimeters (meters * 100)
+    float   sinLat; // Precomputed for the origin latitude
+    float   cosLat;
+    float   primeVerticalRadius;    // WGS84 prime vertical radius of curvature at origin latitude (cm)
+    gpsProjectionAnchor_t anchor;
 } gpsOrigin_s;
 
 typedef enum {
@@ -209,7 +248,7 @@ typedef struct {
     navSystemStatus_State_e state;
     navSystemStatus_Error_e error;
     navSystemStatus_Flags_e flags;
-    uint8_t                 activeWpNumber;
+    uint16_t                activeWpNumber;
     navWaypointActions_e    activeWpAction;
 } navSystemStatus_t;
 
@@ -230,6 +269,8 @@ void navigationInit(navConfig_t *initialnavConfig,
 void updateWaypointsAndNavigationMode(void);
 void updatePositionEstimator_BaroTopic(uint32_t currentTime);
 void updatePositionEstimator_SonarTopic(uint32_t currentTime);
+void updatePositionEstimator_AccelTopic(uint32_t currentTime);
+bool isPositionEstimatorUpdateRequired(uint32_t currentDeltaTime);
 void updatePositionEstimator(void);
 void applyWaypointNavigationAndAltitudeHold(void);
 
@@ -248,6 +289,10 @@ float getEstimatedActualPosition(int axis);
 void getWaypoint(uint8_t wpNumber, navWaypoint_t * wpData);
 void setWaypoint(uint8_t wpNumber, navWaypoint_t * wpData);
 void resetWaypointList(void);
+bool getMissionWaypoint(int wpNumber, navWaypoint_t * wpData);
+bool setMissionWaypoint(int wpNumber, navWaypoint_t * wpData);
+int getWaypointCount(void);
+bool isWaypointListValid(void);
 
 /* Geodetic functions */
 typedef enum {
@@ -255,6 +300,7 @@ typedef enum {
     GEO_ALT_RELATIVE
 } geoAltitudeConversionMode_e;
 
+void geoUpdateProjectionAnchor(gpsOrigin_s * origin, gpsLocation_t * llh);
 void geoConvertGeodeticToLocal(gpsOrigin_s * origin, gpsLocation_t * llh, t_fp_vector * pos, geoAltitudeConversionMode_e altConv);
 void geoConvertLocalToGeodetic(gpsOrigin_s * origin, t_fp_vector * pos, gpsLocation_t * llh);
 float geoCalculateMagDeclination(gpsLocation_t * llh); // degrees units
@@ -264,6 +310,37 @@ void activateForcedRTH(void);
 void abortForcedRTH(void);
 rthState_e getStateOfForcedRTH(void);
 
+/* Navigation FSM transition trace */
+#define NAV_FSM_TRACE_SIZE  16
+
+typedef struct {
+    uint32_t timeMs;
+    uint8_t  fromState;
+    uint8_t  toState;
+    uint8_t  event;
+} navFSMTransition_t;
+
+uint32_t navGetFSMTransitionCount(void);
+bool navGetFSMTransition(uint32_t sequence, navFSMTransition_t * transition);
+
+/* Ground station commands, only accepted when armed and GCS NAV mode is enabled */
+typedef enum {
+    NAV_GCS_COMMAND_NONE = 0,
+    NAV_GCS_COMMAND_HOLD,
+    NAV_GCS_COMMAND_RTH,
+    NAV_GCS_COMMAND_LAND
+} navGCSCommand_e;
+
+typedef enum {
+    NAV_GCS_COMMAND_STATUS_NONE = 0,
+    NAV_GCS_COMMAND_STATUS_PENDING,     // latched, applied by the next updateWaypointsAndNavigationMode()
+    NAV_GCS_COMMAND_STATUS_ACCEPTED,
+    NAV_GCS_COMMAND_STATUS_REJECTED
+} navGCSCommandStatus_e;
+
+bool navigationSetGCSCommand(navGCSCommand_e command, const navWaypoint_t * target);
+navGCSCommandStatus_e navigationGetGCSCommandStatus(void);
+
 /* Compatibility data */
 extern navSystemStatus_t    NAV_Status;
 
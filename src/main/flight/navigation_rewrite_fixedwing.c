@@ -48,6 +48,19 @@
 static bool isPitchAndThrottleAdjustmentValid = false;
 static bool isRollAdjustmentValid = false;
 
+typedef struct {
+    bool    initialized;
+    float   heightDemand;           // Height demand slewed at the climb/sink rate aircraft is capable of (cm)
+    float   speedDemand;            // Speed demand slewed at NAV_FW_TECS_MAX_ACCELERATION (cm/s)
+    float   previousSpeed;
+    float   speedRate;              // Filtered speed derivative (cm/s^2)
+    filterStatePt1_t speedRateFilterState;
+    float   throttleIntegrator;     // Throttle units
+    float   balanceIntegrator;      // Specific energy (cm^2/s^2)
+} fwTotalEnergyState_t;
+
+static fwTotalEnergyState_t tecs;
+
 /*-----------------------------------------------------------
  * Altitude controller
  *-----------------------------------------------------------*/
@@ -59,6 +72,7 @@ void setupFixedWingAltitudeController(void)
 void resetFixedWingAltitudeController()
 {
     navPidReset(&posControl.pids.fw_alt);
+    tecs.initialized = false;
     posControl.rcAdjustment[PITCH] = 0;
     isPitchAndThrottleAdjustmentValid = false;
 }
@@ -78,6 +92,21 @@ bool adjustFixedWingAltitudeFromRCInput(void)
     }
 }
 
+/*
+ * There is no airspeed sensor support, fixed wing controllers work with speed over ground instead. It reads low
+ * flying into the wind and high with the wind, so climb rate limits and the TECS speed/height energy balance
+ * are off by the wind speed. Both controllers get their speed from here so an airspeed source can replace it.
+ */
+static float getFixedWingHorizontalSpeed(void)
+{
+    return sqrtf(sq(posControl.actualState.vel.V.X) + sq(posControl.actualState.vel.V.Y));
+}
+
+static float getFixedWingSpeed(void)
+{
+    return sqrtf(sq(posControl.actualState.vel.V.X) + sq(posControl.actualState.vel.V.Y) + sq(posControl.actualState.vel.V.Z));
+}
+
 // Position to velocity controller for Z axis
 static void updateAltitudeVelocityAndPitchController_FW(uint32_t deltaMicros)
 {
@@ -86,8 +115,7 @@ static void updateAltitudeVelocityAndPitchController_FW(uint32_t deltaMicros)
     // On a fixed wing we might not have a reliable climb rate source (if no BARO available), so we can't apply PID controller to
     // velocity error. We use PID controller on altitude error and calculate desired pitch angle from desired climb rate and forward velocity
 
-    // FIXME: Use airspeed here
-    float forwardVelocity = sqrtf(sq(posControl.actualState.vel.V.X) + sq(posControl.actualState.vel.V.Y));
+    float forwardVelocity = getFixedWingHorizontalSpeed();
     forwardVelocity = MAX(forwardVelocity, 300.0f);   // Limit min velocity for PID controller at about 10 km/h
 
     // Calculate max climb rate from current forward velocity and maximum pitch angle (climb angle is fairly small, approximate tan=sin)
@@ -112,6 +140,119 @@ static void updateAltitudeVelocityAndPitchController_FW(uint32_t deltaMicros)
 #endif
 }
 
+/*-----------------------------------------------------------
+ * Total energy control system (TECS). Throttle controls total specific energy (potential + kinetic),
+ * pitch controls the balance between them. Climbing trades speed for altitude on pitch and adds the
+ * missing energy with throttle, instead of holding altitude with pitch and speed with throttle separately.
+ *-----------------------------------------------------------*/
+#define NAV_FW_TECS_MIN_SPEED                   300.0f  // cm/s, same limit as the pitch controller
+#define NAV_FW_TECS_MAX_ACCELERATION            100.0f  // cm/s^2, slew rate of speed demand
+#define NAV_FW_TECS_SPEED_RATE_CUTOFF_HZ        1.0f
+#define NAV_FW_TECS_INTEGRATOR_GAIN             0.1f    // 1/s
+#define NAV_FW_TECS_THROTTLE_DAMPING            0.5f
+
+static void updateTotalEnergyController_FW(uint32_t deltaMicros)
+{
+    const float dt = US2S(deltaMicros);
+    const float timeConstant = posControl.navConfig->fw_tecs_time_const / 10.0f;
+    const float speed = MAX(getFixedWingSpeed(), NAV_FW_TECS_MIN_SPEED);
+
+    // Climb angle is fairly small, approximate tan=sin
+    const float sinMaxClimbAngle = sin_approx(DEGREES_TO_RADIANS(posControl.navConfig->fw_max_climb_angle));
+    const float sinMaxDiveAngle = sin_approx(DEGREES_TO_RADIANS(posControl.navConfig->fw_max_dive_angle));
+    const float maxClimbRate = speed * sinMaxClimbAngle;
+    const float maxSinkRate = speed * sinMaxDiveAngle;
+
+    if (!tecs.initialized) {
+        tecs.heightDemand = posControl.actualState.pos.V.Z;
+        tecs.speedDemand = speed;
+        tecs.previousSpeed = speed;
+        tecs.throttleIntegrator = 0;
+        tecs.balanceIntegrator = 0;
+        filterResetPt1(&tecs.speedRateFilterState, 0);
+        tecs.initialized = true;
+    }
+
+    tecs.speedRate = filterApplyPt1((speed - tecs.previousSpeed) / dt, &tecs.speedRateFilterState, NAV_FW_TECS_SPEED_RATE_CUTOFF_HZ, dt);
+    tecs.previousSpeed = speed;
+
+    // Move height demand towards the target no faster than the aircraft can climb or sink, this gives climb rate demand
+    float heightDemand = constrainf(posControl.desiredState.pos.V.Z, tecs.heightDemand - maxSinkRate * dt, tecs.heightDemand + maxClimbRate * dt);
+    float climbRateDemand = (heightDemand - tecs.heightDemand) / dt;
+    tecs.heightDemand = heightDemand;
+
+    // Without a cruise speed configured speed is not controlled, pitch is used for altitude only
+    float speedRateDemand = 0;
+    float speedWeight = 0;
+
+    if (posControl.navConfig->fw_cruise_speed > 0) {
+        float speedDemand = constrainf(posControl.navConfig->fw_cruise_speed, tecs.speedDemand - NAV_FW_TECS_MAX_ACCELERATION * dt, tecs.speedDemand + NAV_FW_TECS_MAX_ACCELERATION * dt);
+        speedRateDemand = (speedDemand - tecs.speedDemand) / dt;
+        tecs.speedDemand = speedDemand;
+        speedWeight = posControl.navConfig->fw_tecs_speed_weight / 100.0f;
+    }
+    else {
+        tecs.speedDemand = speed;
+    }
+
+    // Specific potential and kinetic energy errors (cm^2/s^2) and rates (cm^2/s^3)
+    const float potentialEnergyError = GRAVITY_CMSS * (tecs.heightDemand - posControl.actualState.pos.V.Z);
+    const float kineticEnergyError = 0.5f * (sq(tecs.speedDemand) - sq(speed));
+    const float potentialEnergyRateDemand = GRAVITY_CMSS * climbRateDemand;
+    const float potentialEnergyRate = GRAVITY_CMSS * posControl.actualState.vel.V.Z;
+    const float kineticEnergyRateDemand = speed * speedRateDemand;
+    const float kineticEnergyRate = speed * tecs.speedRate;
+
+    // Throttle: full throttle range is assumed to cover total energy rates from max dive to max climb at current speed
+    const float maxTotalEnergyRate = GRAVITY_CMSS * maxClimbRate;
+    const float minTotalEnergyRate = -GRAVITY_CMSS * maxSinkRate;
+    const float throttlePerEnergyRate = (posControl.navConfig->fw_max_throttle - posControl.navConfig->fw_min_throttle) / (maxTotalEnergyRate - minTotalEnergyRate);
+
+    const float totalEnergyError = potentialEnergyError + kineticEnergyError;
+    const float totalEnergyRateDemand = constrainf(potentialEnergyRateDemand + kineticEnergyRateDemand, minTotalEnergyRate, maxTotalEnergyRate);
+    const float totalEnergyRateError = totalEnergyRateDemand - (potentialEnergyRate + kineticEnergyRate);
+
+    float throttle = posControl.navConfig->fw_cruise_throttle + tecs.throttleIntegrator +
+                     throttlePerEnergyRate * (totalEnergyRateDemand + totalEnergyError / timeConstant + totalEnergyRateError * NAV_FW_TECS_THROTTLE_DAMPING);
+
+    // Integrate only while throttle is not saturated in the direction of the error
+    const float throttleIntegratorDelta = throttlePerEnergyRate * totalEnergyError / timeConstant * NAV_FW_TECS_INTEGRATOR_GAIN * dt;
+    if ((throttle < posControl.navConfig->fw_max_throttle || throttleIntegratorDelta < 0) && (throttle > posControl.navConfig->fw_min_throttle || throttleIntegratorDelta > 0)) {
+        tecs.throttleIntegrator += throttleIntegratorDelta;
+    }
+
+    // Pitch: energy balance, speed weight 0 - potential energy only, 2 - kinetic energy only
+    const float potentialWeight = MIN(2.0f - speedWeight, 1.0f);
+    const float kineticWeight = MIN(speedWeight, 1.0f);
+    const float balanceError = potentialEnergyError * potentialWeight - kineticEnergyError * kineticWeight;
+    const float balanceRateDemand = potentialEnergyRateDemand * potentialWeight - kineticEnergyRateDemand * kineticWeight;
+
+    // For a point mass potential energy rate is g * speed * sin(pitch) and kinetic energy gets whatever is left of the
+    // total energy rate, so balance rate is (wp + wk) * g * speed * sin(pitch) - wk * total rate. Approximate sin=angle
+    const float totalEnergyRate = potentialEnergyRate + kineticEnergyRate;
+    const float pitchGain = 1.0f / ((potentialWeight + kineticWeight) * GRAVITY_CMSS * speed * timeConstant);
+    float pitch = (balanceError + (balanceRateDemand + kineticWeight * totalEnergyRate) * timeConstant + tecs.balanceIntegrator) * pitchGain;
+
+    const float balanceIntegratorDelta = balanceError * NAV_FW_TECS_INTEGRATOR_GAIN * dt;
+    if ((pitch < sinMaxClimbAngle || balanceIntegratorDelta < 0) && (pitch > -sinMaxDiveAngle || balanceIntegratorDelta > 0)) {
+        tecs.balanceIntegrator += balanceIntegratorDelta;
+    }
+
+    // Calculate climb angle ( >0 - climb, <0 - dive)
+    int16_t climbAngleDeciDeg = RADIANS_TO_DECIDEGREES(pitch);
+    climbAngleDeciDeg = constrain(climbAngleDeciDeg, -posControl.navConfig->fw_max_dive_angle * 10, posControl.navConfig->fw_max_climb_angle * 10);
+    posControl.rcAdjustment[PITCH] = climbAngleDeciDeg;
+
+    posControl.rcAdjustment[THROTTLE] = constrain(lrintf(throttle), posControl.navConfig->fw_min_throttle, posControl.navConfig->fw_max_throttle);
+
+    posControl.desiredState.vel.V.Z = climbRateDemand;
+
+#if defined(NAV_BLACKBOX)
+    navDesiredVelocity[Z] = constrain(posControl.desiredState.vel.V.Z, -32678, 32767);
+    navTargetPosition[Z] = constrain(tecs.heightDemand, -32678, 32767);
+#endif
+}
+
 void applyFixedWingAltitudeController(uint32_t currentTime)
 {
     static uint32_t previousTimePositionUpdate;         // Occurs @ altitude sensor update rate (max MAX_ALTITUDE_UPDATE_RATE_HZ)
@@ -136,7 +277,12 @@ void applyFixedWingAltitudeController(uint32_t currentTime)
 
             // Check if last correction was too log ago - ignore this update
             if (deltaMicrosPositionUpdate < HZ2US(MIN_POSITION_UPDATE_RATE_HZ)) {
-                updateAltitudeVelocityAndPitchController_FW(deltaMicrosPositionUpdate);
+                if (posControl.navConfig->fw_alt_controller == NAV_FW_ALT_CONTROLLER_TECS) {
+                    updateTotalEnergyController_FW(deltaMicrosPositionUpdate);
+                }
+                else {
+                    updateAltitudeVelocityAndPitchController_FW(deltaMicrosPositionUpdate);
+                }
             }
             else {
                 // due to some glitch position update has not occurred in time, reset altitude controller
@@ -266,6 +412,229 @@ static void updatePositionHeadingController_FW(uint32_t deltaMicros)
     //posControl.rcAdjustment[PITCH] = -CENTIDEGREES_TO_DECIDEGREES(ABS(rollAdjustment)) * 0.50f;
 }
 
+/*-----------------------------------------------------------
+ * L1 nonlinear guidance (Park, Deyst, How). Lateral acceleration is commanded towards a reference point
+ * on the desired path at a distance L1 ahead of the aircraft. L1 distance is proportional to groundspeed,
+ * so the guidance loop has constant period and damping regardless of speed and wind.
+ *-----------------------------------------------------------*/
+#define NAV_FW_L1_MIN_GROUNDSPEED       300.0f      // cm/s, below that ground track is too noisy, use heading instead
+#define NAV_FW_L1_LOITER_DIRECTION      1           // Loiter clockwise
+
+static float crossProduct2D(float ax, float ay, float bx, float by)
+{
+    return ax * by - ay * bx;
+}
+
+// Groundspeed vector, falls back to aircraft heading when speed is too low to define ground track
+static float getGroundVelocity_FW(float * velX, float * velY)
+{
+    float groundSpeed = sqrtf(sq(posControl.actualState.vel.V.X) + sq(posControl.actualState.vel.V.Y));
+
+    if (groundSpeed < NAV_FW_L1_MIN_GROUNDSPEED) {
+        groundSpeed = NAV_FW_L1_MIN_GROUNDSPEED;
+        *velX = groundSpeed * posControl.actualState.cosYaw;
+        *velY = groundSpeed * posControl.actualState.sinYaw;
+    }
+    else {
+        *velX = posControl.actualState.vel.V.X;
+        *velY = posControl.actualState.vel.V.Y;
+    }
+
+    return groundSpeed;
+}
+
+static float getL1Distance_FW(float groundSpeed)
+{
+    return (posControl.navConfig->fw_l1_damping / 100.0f) * posControl.navConfig->fw_l1_period * groundSpeed / M_PIf;
+}
+
+// Angle between ground velocity and direction (dirX, dirY), >0 if direction is to the right
+static float calculateL1AngleTo_FW(float velX, float velY, float dirX, float dirY)
+{
+    return atan2_approx(crossProduct2D(velX, velY, dirX, dirY), velX * dirX + velY * dirY);
+}
+
+/*
+ * Follow the track from trackStart to trackEnd. Returns L1 angle (rad), >0 to turn right
+ */
+static float calculateL1TrackAngle_FW(const t_fp_vector * trackStart, const t_fp_vector * trackEnd, float velX, float velY, float groundSpeed, float l1Distance)
+{
+    float trackX = trackEnd->V.X - trackStart->V.X;
+    float trackY = trackEnd->V.Y - trackStart->V.Y;
+    float trackLength = sqrtf(sq(trackX) + sq(trackY));
+
+    // Position relative to track start
+    float posX = posControl.actualState.pos.V.X - trackStart->V.X;
+    float posY = posControl.actualState.pos.V.Y - trackStart->V.Y;
+    float distanceFromStart = sqrtf(sq(posX) + sq(posY));
+
+    if (trackLength < 100.0f) {
+        // No meaningful track, go direct to its end
+        return calculateL1AngleTo_FW(velX, velY, trackEnd->V.X - posControl.actualState.pos.V.X, trackEnd->V.Y - posControl.actualState.pos.V.Y);
+    }
+
+    trackX /= trackLength;
+    trackY /= trackLength;
+
+    // >0 if we are to the left of the track
+    float crossTrackDistance = crossProduct2D(posX, posY, trackX, trackY);
+    float alongTrackDistance = posX * trackX + posY * trackY;
+
+    if ((distanceFromStart > l1Distance) && (alongTrackDistance < -0.7071f * distanceFromStart)) {
+        // Far behind the track start, fly towards it first
+        return calculateL1AngleTo_FW(velX, velY, -posX, -posY);
+    }
+    else if (alongTrackDistance > trackLength + groundSpeed * 3.0f) {
+        // Passed track end by more than 3 seconds, head back to it
+        return calculateL1AngleTo_FW(velX, velY, trackEnd->V.X - posControl.actualState.pos.V.X, trackEnd->V.Y - posControl.actualState.pos.V.Y);
+    }
+    else {
+        // Intercept angle is limited to 45deg, so we join the track instead of flying perpendicular to it
+        float trackAngle = calculateL1AngleTo_FW(velX, velY, trackX, trackY);
+        float interceptAngle = asinf(constrainf(crossTrackDistance / l1Distance, -0.7071f, 0.7071f));
+        return trackAngle + interceptAngle;
+    }
+}
+
+/*
+ * Capture and follow a loiter circle. Returns lateral acceleration (cm/s^2), >0 to turn right
+ */
+static float calculateL1LoiterAcceleration_FW(const t_fp_vector * center, float velX, float velY, float groundSpeed, float l1Distance, float * l1Angle)
+{
+    const float loiterRadius = MAX(posControl.navConfig->fw_loiter_radius, 100);
+    const float dampingRatio = posControl.navConfig->fw_l1_damping / 100.0f;
+    const float omega = 2.0f * M_PIf / posControl.navConfig->fw_l1_period;
+
+    // Position relative to circle center, unit vector pointing outwards
+    float posX = posControl.actualState.pos.V.X - center->V.X;
+    float posY = posControl.actualState.pos.V.Y - center->V.Y;
+    float distanceFromCenter = sqrtf(sq(posX) + sq(posY));
+    float radialX, radialY;
+
+    if (distanceFromCenter > 10.0f) {
+        radialX = posX / distanceFromCenter;
+        radialY = posY / distanceFromCenter;
+    }
+    else {
+        radialX = velX / groundSpeed;
+        radialY = velY / groundSpeed;
+    }
+
+    // L1 guidance towards circle center
+    float tangentialVelocity = crossProduct2D(velX, velY, -radialX, -radialY);
+    float inwardVelocity = velX * -radialX + velY * -radialY;
+    float captureAngle = constrainf(atan2_approx(tangentialVelocity, inwardVelocity), -M_PIf / 2, M_PIf / 2);
+    float captureAcceleration = 4.0f * sq(dampingRatio) * sq(groundSpeed) / l1Distance * sin_approx(captureAngle);
+
+    // PD controller on radial error with centripetal feed-forward keeps us on the circle
+    float radialError = distanceFromCenter - loiterRadius;
+    float circleAcceleration = radialError * sq(omega) - inwardVelocity * 2.0f * dampingRatio * omega;
+    float circleTangentialVelocity = tangentialVelocity * NAV_FW_L1_LOITER_DIRECTION;
+
+    // Don't let PD controller turn the wrong way when flying away from the center in the opposite direction
+    if ((inwardVelocity < 0) && (circleTangentialVelocity < 0)) {
+        circleAcceleration = MAX(circleAcceleration, 0);
+    }
+
+    circleAcceleration += sq(circleTangentialVelocity) / MAX(0.5f * loiterRadius, distanceFromCenter);
+    circleAcceleration *= NAV_FW_L1_LOITER_DIRECTION;
+
+    // Switch from capture to circle where both commands cross over so the transition is seamless
+    if ((radialError > 0) && (NAV_FW_L1_LOITER_DIRECTION * captureAcceleration < NAV_FW_L1_LOITER_DIRECTION * circleAcceleration)) {
+        *l1Angle = captureAngle;
+        return captureAcceleration;
+    }
+    else {
+        *l1Angle = atan2_approx(circleAcceleration * l1Distance, 4.0f * sq(dampingRatio) * sq(groundSpeed));
+        return circleAcceleration;
+    }
+}
+
+static void updatePositionL1Controller_FW(float trackingPeriod)
+{
+    float velX, velY;
+    float groundSpeed = getGroundVelocity_FW(&velX, &velY);
+    float l1Distance = getL1Distance_FW(groundSpeed);
+    float l1Gain = 4.0f * sq(posControl.navConfig->fw_l1_damping / 100.0f);
+    float lateralAcceleration;
+    float l1Angle;
+
+    t_fp_vector trackStart = posControl.activeWaypointTrackStart;
+    t_fp_vector trackEnd = posControl.desiredState.pos;
+
+    // Shift the track according to pilot's ROLL input (up to max_manual_speed velocity)
+    if (posControl.flags.isAdjustingPosition) {
+        int16_t rcRollAdjustment = applyDeadband(rcCommand[ROLL], posControl.rcControlsConfig->pos_hold_deadband);
+
+        if (rcRollAdjustment) {
+            float rcShiftY = rcRollAdjustment * posControl.navConfig->max_manual_speed / 500.0f * trackingPeriod;
+
+            // Rotate this target shift from body frame to to earth frame
+            float rcShiftX = -rcShiftY * posControl.actualState.sinYaw;
+            rcShiftY = rcShiftY * posControl.actualState.cosYaw;
+
+            trackStart.V.X += rcShiftX;
+            trackStart.V.Y += rcShiftY;
+            trackEnd.V.X += rcShiftX;
+            trackEnd.V.Y += rcShiftY;
+        }
+    }
+
+    // Loiter when holding position or returning home, and when closing in on the last waypoint of a mission
+    bool needToLoiter = isApproachingLastWaypoint() &&
+                        (!(navGetCurrentStateFlags() & NAV_AUTO_WP) ||
+                         (calculateDistanceToDestination(&trackEnd) <= (posControl.navConfig->fw_loiter_radius + l1Distance)));
+
+    if (needToLoiter) {
+        lateralAcceleration = calculateL1LoiterAcceleration_FW(&trackEnd, velX, velY, groundSpeed, l1Distance, &l1Angle);
+    }
+    else {
+        l1Angle = calculateL1TrackAngle_FW(&trackStart, &trackEnd, velX, velY, groundSpeed, l1Distance);
+        l1Angle = constrainf(l1Angle, -M_PIf / 2, M_PIf / 2);
+        lateralAcceleration = l1Gain * sq(groundSpeed) / l1Distance * sin_approx(l1Angle);
+    }
+
+    // Coordinated turn: bank angle needed for the commanded lateral acceleration
+    float rollAdjustment = RADIANS_TO_CENTIDEGREES(atan2_approx(lateralAcceleration, GRAVITY_CMSS));
+    rollAdjustment = constrainf(rollAdjustment, -DEGREES_TO_CENTIDEGREES(posControl.navConfig->fw_max_bank_angle), DEGREES_TO_CENTIDEGREES(posControl.navConfig->fw_max_bank_angle));
+
+    // Convert rollAdjustment to decidegrees (rcAdjustment holds decidegrees)
+    posControl.rcAdjustment[ROLL] = CENTIDEGREES_TO_DECIDEGREES(rollAdjustment);
+
+    // Update magHold heading lock in case pilot is using MAG mode (prevent MAGHOLD to fight navigation)
+    float groundCourse = atan2_approx(velY, velX);
+    posControl.desiredState.yaw = wrap_36000(RADIANS_TO_CENTIDEGREES(groundCourse + l1Angle));
+    updateMagHoldHeading(CENTIDEGREES_TO_DEGREES(posControl.desiredState.yaw));
+}
+
+/*
+ * Distance before the waypoint to start turning onto the next track (cm). Turn is flown at max bank angle with
+ * radius R = V^2 / (g * tan(bank)) and is tangent to both tracks, which puts its start R * tan(turnAngle / 2) before
+ * the waypoint. Limited to L1 distance, beyond that L1 guidance will join the next track on its own.
+ */
+uint32_t calculateFixedWingTurnAnticipationDistance(int32_t turnAngle)
+{
+    if ((posControl.navConfig->fw_nav_controller != NAV_FW_CONTROLLER_L1) || (turnAngle <= 0)) {
+        return 0;
+    }
+
+    float velX, velY;
+    float groundSpeed = getGroundVelocity_FW(&velX, &velY);
+    float l1Distance = getL1Distance_FW(groundSpeed);
+    float turnRadius = sq(groundSpeed) / (GRAVITY_CMSS * tan_approx(DEGREES_TO_RADIANS(posControl.navConfig->fw_max_bank_angle)));
+
+    float halfTurnAngle = CENTIDEGREES_TO_RADIANS(MIN(turnAngle, 18000)) / 2;
+    float sinHalfTurnAngle = sin_approx(halfTurnAngle);
+    float cosHalfTurnAngle = cos_approx(halfTurnAngle);
+
+    if (turnRadius * sinHalfTurnAngle >= l1Distance * cosHalfTurnAngle) {
+        return l1Distance;
+    }
+    else {
+        return turnRadius * sinHalfTurnAngle / cosHalfTurnAngle;
+    }
+}
+
 void applyFixedWingPositionController(uint32_t currentTime)
 {
     static uint32_t previousTimePositionUpdate;         // Occurs @ GPS update rate
@@ -294,9 +663,13 @@ void applyFixedWingPositionController(uint32_t currentTime)
                 // Account for pilot's roll input (move position target left/right at max of max_manual_speed)
                 // POSITION_TARGET_UPDATE_RATE_HZ should be chosen keeping in mind that position target shouldn't be reached until next pos update occurs
                 // FIXME: verify the above
-                calculateVirtualPositionTarget_FW(HZ2S(MIN_POSITION_UPDATE_RATE_HZ) * 2);
-
-                updatePositionHeadingController_FW(deltaMicrosPositionUpdate);
+                if (posControl.navConfig->fw_nav_controller == NAV_FW_CONTROLLER_L1) {
+                    updatePositionL1Controller_FW(HZ2S(MIN_POSITION_UPDATE_RATE_HZ) * 2);
+                }
+                else {
+                    calculateVirtualPositionTarget_FW(HZ2S(MIN_POSITION_UPDATE_RATE_HZ) * 2);
+                    updatePositionHeadingController_FW(deltaMicrosPositionUpdate);
+                }
             }
             else {
                 resetFixedWingPositionController();
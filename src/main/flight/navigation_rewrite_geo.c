@@ -133,20 +133,126 @@ float geoCalculateMagDeclination(gpsLocation_t * llh) // degrees units
 }
 #endif
 
+/*
+ * Local frame is the WGS84 local tangent plane (North-East) at the origin, evaluated at origin altitude.
+ * Horizontal position is computed from integer lat/lon deltas to an expansion point (anchor) kept close
+ * to the aircraft, using first and second derivatives of the exact projection precomputed at the anchor.
+ * Only the position estimator moves the shared anchor (geoUpdateProjectionAnchor), other conversions far
+ * from it use a temporary anchor. Local frame itself is never moved, so positions and waypoints stay valid.
+ */
+#define GEO_WGS84_SEMI_MAJOR_AXIS       637813700.0f        // cm
+#define GEO_WGS84_ECCENTRICITY_SQ       6.69437999014e-3f
+#define GEO_DEG1E7_TO_RAD               (0.0174532925f * 1e-7f)
+#define GEO_ANCHOR_MAX_DISTANCE         50000               // 1e-7 deg, about 5.5km. Keeps third order error below 5mm
+
+static void geoSetProjectionAnchor(const gpsOrigin_s * origin, int32_t lat, int32_t lon, gpsProjectionAnchor_t * anchor)
+{
+    const float e2 = GEO_WGS84_ECCENTRICITY_SQ;
+    const float dLat = (lat - origin->lat) * GEO_DEG1E7_TO_RAD;
+    const float dLon = (lon - origin->lon) * GEO_DEG1E7_TO_RAD;
+    const float latRad = lat * GEO_DEG1E7_TO_RAD;
+    const float sinLat = sin_approx(latRad);
+    const float cosLat = cos_approx(latRad);
+    const float sinDLon = sin_approx(dLon);
+    const float cosDLon = cos_approx(dLon);
+
+    // Prime vertical radius of curvature and its derivatives wrt latitude
+    const float w = 1.0f - e2 * sq(sinLat);
+    const float N = GEO_WGS84_SEMI_MAJOR_AXIS / sqrtf(w);
+    const float N1 = N * e2 * sinLat * cosLat / w;
+    const float N2 = N * e2 * ((sq(cosLat) - sq(sinLat)) / w + 3.0f * e2 * sq(sinLat * cosLat) / sq(w));
+
+    // ECEF in a frame rotated to origin longitude is X = C*cos(dLon), Y = C*sin(dLon), Z = S
+    const float P = N + origin->alt;
+    const float Q = N * (1.0f - e2) + origin->alt;
+    const float C = P * cosLat;
+    const float C1 = N1 * cosLat - P * sinLat;
+    const float C2 = N2 * cosLat - 2.0f * N1 * sinLat - C;
+    const float S1 = N1 * (1.0f - e2) * sinLat + Q * cosLat;
+    const float S2 = (N2 * sinLat + 2.0f * N1 * cosLat) * (1.0f - e2) - Q * sinLat;
+
+    anchor->lat = lat;
+    anchor->lon = lon;
+
+    // North = -sin(lat0) * X + cos(lat0) * Z, rearranged to avoid subtracting earth radius sized terms
+    anchor->pos[X] = P * (sin_approx(dLat) + 2.0f * cosLat * origin->sinLat * sq(sin_approx(0.5f * dLon)))
+                   - e2 * origin->cosLat * (2.0f * N * cos_approx(latRad - 0.5f * dLat) * sin_approx(0.5f * dLat) + (N - origin->primeVerticalRadius) * origin->sinLat);
+    anchor->pos[Y] = C * sinDLon;
+
+    anchor->jac[X][0] = cosDLon * -origin->sinLat * C1 + origin->cosLat * S1;
+    anchor->jac[X][1] = origin->sinLat * C * sinDLon;
+    anchor->jac[Y][0] = C1 * sinDLon;
+    anchor->jac[Y][1] = C * cosDLon;
+
+    anchor->hess[X][0] = 0.5f * (cosDLon * -origin->sinLat * C2 + origin->cosLat * S2);
+    anchor->hess[X][1] = origin->sinLat * C1 * sinDLon;
+    anchor->hess[X][2] = 0.5f * origin->sinLat * C * cosDLon;
+    anchor->hess[Y][0] = 0.5f * C2 * sinDLon;
+    anchor->hess[Y][1] = C1 * cosDLon;
+    anchor->hess[Y][2] = -0.5f * C * sinDLon;
+}
+
+static bool geoIsCloseToProjectionAnchor(const gpsProjectionAnchor_t * anchor, int32_t lat, int32_t lon)
+{
+    return (ABS(lat - anchor->lat) <= GEO_ANCHOR_MAX_DISTANCE) && (ABS(lon - anchor->lon) <= GEO_ANCHOR_MAX_DISTANCE);
+}
+
+static float geoProjectionSecondOrderTerm(const gpsProjectionAnchor_t * anchor, int axis, float dLat, float dLon)
+{
+    return anchor->hess[axis][0] * sq(dLat) + anchor->hess[axis][1] * dLat * dLon + anchor->hess[axis][2] * sq(dLon);
+}
+
+static float geoApplyProjectionAnchor(const gpsProjectionAnchor_t * anchor, int axis, float dLat, float dLon)
+{
+    return anchor->pos[axis] + anchor->jac[axis][0] * dLat + anchor->jac[axis][1] * dLon + geoProjectionSecondOrderTerm(anchor, axis, dLat, dLon);
+}
+
+static void geoSetOrigin(gpsOrigin_s * origin, gpsLocation_t * llh)
+{
+    const float latRad = llh->lat * GEO_DEG1E7_TO_RAD;
+
+    origin->valid = true;
+    origin->lat = llh->lat;
+    origin->lon = llh->lon;
+    origin->alt = llh->alt;
+    origin->sinLat = sin_approx(latRad);
+    origin->cosLat = cos_approx(latRad);
+    origin->primeVerticalRadius = GEO_WGS84_SEMI_MAJOR_AXIS / sqrtf(1.0f - GEO_WGS84_ECCENTRICITY_SQ * sq(origin->sinLat));
+
+    geoSetProjectionAnchor(origin, origin->lat, origin->lon, &origin->anchor);
+}
+
+/*
+ * Keep the shared expansion point close to the aircraft, called with the aircraft position only
+ */
+void geoUpdateProjectionAnchor(gpsOrigin_s * origin, gpsLocation_t * llh)
+{
+    if (origin->valid && !geoIsCloseToProjectionAnchor(&origin->anchor, llh->lat, llh->lon)) {
+        geoSetProjectionAnchor(origin, llh->lat, llh->lon, &origin->anchor);
+    }
+}
+
 void geoConvertGeodeticToLocal(gpsOrigin_s * origin, gpsLocation_t * llh, t_fp_vector * pos, geoAltitudeConversionMode_e altConv)
 {
     // Origin can only be set if GEO_ALT_ABSOLUTE to get a valid reference
     if ((!origin->valid) && (altConv == GEO_ALT_ABSOLUTE)) {
-        origin->valid = true;
-        origin->lat = llh->lat;
-        origin->lon = llh->lon;
-        origin->alt = llh->alt;
-        origin->scale = constrainf(cos_approx((ABS(origin->lat) / 10000000.0f) * 0.0174532925f), 0.01f, 1.0f);
+        geoSetOrigin(origin, llh);
     }
 
     if (origin->valid) {
-        pos->V.X = (llh->lat - origin->lat) * DISTANCE_BETWEEN_TWO_LONGITUDE_POINTS_AT_EQUATOR;
-        pos->V.Y = (llh->lon - origin->lon) * (DISTANCE_BETWEEN_TWO_LONGITUDE_POINTS_AT_EQUATOR * origin->scale);
+        gpsProjectionAnchor_t farAnchor;
+        const gpsProjectionAnchor_t * anchor = &origin->anchor;
+
+        if (!geoIsCloseToProjectionAnchor(anchor, llh->lat, llh->lon)) {
+            geoSetProjectionAnchor(origin, llh->lat, llh->lon, &farAnchor);
+            anchor = &farAnchor;
+        }
+
+        const float dLat = (llh->lat - anchor->lat) * GEO_DEG1E7_TO_RAD;
+        const float dLon = (llh->lon - anchor->lon) * GEO_DEG1E7_TO_RAD;
+
+        pos->V.X = geoApplyProjectionAnchor(anchor, X, dLat, dLon);
+        pos->V.Y = geoApplyProjectionAnchor(anchor, Y, dLat, dLon);
 
         // If flag GEO_ALT_RELATIVE, than llh altitude is already relative to origin
         if (altConv == GEO_ALT_RELATIVE) {
@@ -164,25 +270,43 @@ void geoConvertGeodeticToLocal(gpsOrigin_s * origin, gpsLocation_t * llh, t_fp_v
 
 void geoConvertLocalToGeodetic(gpsOrigin_s * origin, t_fp_vector * pos, gpsLocation_t * llh)
 {
-    float scaleLonDown;
-
     if (origin->valid) {
-        llh->lat = origin->lat;
-        llh->lon = origin->lon;
-        llh->alt = origin->alt;
-        scaleLonDown = origin->scale;
+        gpsProjectionAnchor_t farAnchor;
+        const gpsProjectionAnchor_t * anchor = &origin->anchor;
+
+        // Invert the expansion by fixed point iteration, move expansion point if result is far from it
+        for (int attempt = 0; attempt < 3; attempt++) {
+            const float det = anchor->jac[X][0] * anchor->jac[Y][1] - anchor->jac[X][1] * anchor->jac[Y][0];
+            const float rN = pos->V.X - anchor->pos[X];
+            const float rE = pos->V.Y - anchor->pos[Y];
+            float dLat = 0;
+            float dLon = 0;
+
+            for (int iteration = 0; iteration < 3; iteration++) {
+                const float eN = rN - geoProjectionSecondOrderTerm(anchor, X, dLat, dLon);
+                const float eE = rE - geoProjectionSecondOrderTerm(anchor, Y, dLat, dLon);
+                dLat = (anchor->jac[Y][1] * eN - anchor->jac[X][1] * eE) / det;
+                dLon = (anchor->jac[X][0] * eE - anchor->jac[Y][0] * eN) / det;
+            }
+
+            llh->lat = anchor->lat + lrintf(dLat / GEO_DEG1E7_TO_RAD);
+            llh->lon = anchor->lon + lrintf(dLon / GEO_DEG1E7_TO_RAD);
+
+            if (geoIsCloseToProjectionAnchor(anchor, llh->lat, llh->lon)) {
+                break;
+            }
+
+            geoSetProjectionAnchor(origin, llh->lat, llh->lon, &farAnchor);
+            anchor = &farAnchor;
+        }
+
+        llh->alt = origin->alt + lrintf(pos->V.Z);
     }
     else {
         llh->lat = 0;
         llh->lon = 0;
-        llh->alt = 0;
-        scaleLonDown = 1.0f;
+        llh->alt = lrintf(pos->V.Z);
     }
-
-    llh->lat += lrintf(pos->V.X / DISTANCE_BETWEEN_TWO_LONGITUDE_POINTS_AT_EQUATOR);
-    llh->lon += lrintf(pos->V.Y / (DISTANCE_BETWEEN_TWO_LONGITUDE_POINTS_AT_EQUATOR * scaleLonDown));
-    llh->alt += lrintf(pos->V.Z);
 }
 
-
 #endif  // NAV
@@ -0,0 +1,429 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "build_config.h"
+#include "platform.h"
+
+#include "common/axis.h"
+#include "common/maths.h"
+#include "common/encoding.h"
+
+#include "io/gps.h"
+
+#include "rx/rx.h"
+
+#include "flight/navigation_rewrite.h"
+#include "flight/navigation_rewrite_private.h"
+
+#if defined(NAV_MISSION_STORAGE)
+#include "config/config_eeprom.h"
+#endif
+
+#if defined(NAV)
+
+/*
+ * Mission is stored in a compact form. Waypoints are grouped into blocks of NAV_MISSION_BLOCK_SIZE, each waypoint
+ * is a bitmask of present fields followed by zigzag varint deltas to the previous waypoint of the same block.
+ * Block start offsets are kept in a table, so only the block holding the active waypoint is decoded into RAM.
+ * A waypoint of a lawnmower survey pattern takes about 6 bytes instead of 21.
+ *
+ * Layout: missionStorageHeader_t | uint16_t blockOffset[NAV_MISSION_BLOCK_COUNT] | waypoint records
+ *
+ * Header is written last, so an interrupted upload never leaves a valid looking mission behind.
+ */
+#define NAV_MISSION_BLOCK_SIZE          8
+#define NAV_MISSION_BLOCK_COUNT         ((NAV_MAX_WAYPOINTS + NAV_MISSION_BLOCK_SIZE - 1) / NAV_MISSION_BLOCK_SIZE)
+#define NAV_MISSION_MAX_RECORD_SIZE     26      // bitmask + action + 3 x 5 bytes + 3 x 3 bytes
+#define NAV_MISSION_MAGIC               0x4D57
+#define NAV_MISSION_DATA_OFFSET         (sizeof(missionStorageHeader_t) + NAV_MISSION_BLOCK_COUNT * sizeof(uint16_t))
+
+#if defined(NAV_MISSION_STORAGE)
+#define NAV_MISSION_STORAGE_SIZE        FLASH_TO_RESERVE_FOR_MISSION
+#else
+#define NAV_MISSION_STORAGE_SIZE        (NAV_MISSION_DATA_OFFSET + 15 * NAV_MISSION_MAX_RECORD_SIZE)   // at least 15 waypoints in worst case
+#endif
+
+typedef enum {
+    MISSION_FIELD_LAT       = 1 << 0,
+    MISSION_FIELD_LON       = 1 << 1,
+    MISSION_FIELD_ALT       = 1 << 2,
+    MISSION_FIELD_P1        = 1 << 3,
+    MISSION_FIELD_P2        = 1 << 4,
+    MISSION_FIELD_P3        = 1 << 5,
+    MISSION_FIELD_LAST      = 1 << 6,
+    MISSION_FIELD_ACTION    = 1 << 7,
+} missionRecordFields_e;
+
+typedef struct {
+    uint16_t magic;
+    uint16_t count;
+    uint16_t size;      // Size of waypoint records (bytes)
+    uint16_t crc;       // CRC16-CCITT of waypoint records
+} missionStorageHeader_t;
+
+static struct {
+    uint16_t        count;
+    uint16_t        size;
+    uint16_t        crc;
+    bool            valid;              // Last waypoint received and header committed
+    navWaypoint_t   lastWaypoint;       // Delta reference for the next waypoint
+
+    int16_t         windowBlock;        // Block decoded into window, -1 if none
+    navWaypoint_t   window[NAV_MISSION_BLOCK_SIZE];
+
+#if defined(NAV_MISSION_STORAGE)
+    uint32_t        erasedSize;         // Storage bytes erased since last reset, ready to be programmed
+#endif
+} mission;
+
+static const navWaypoint_t missionBlockReference;
+
+#if defined(NAV_MISSION_STORAGE)
+#define missionStorageData  ((const uint8_t *)MISSION_START_FLASH_ADDRESS)
+
+static bool missionStorageErasePage(void)
+{
+    suspendRxSignal();
+
+#ifdef STM32F303
+    FLASH_ClearFlag(FLASH_FLAG_EOP | FLASH_FLAG_PGERR | FLASH_FLAG_WRPERR);
+#endif
+#ifdef STM32F10X
+    FLASH_ClearFlag(FLASH_FLAG_EOP | FLASH_FLAG_PGERR | FLASH_FLAG_WRPRTERR);
+#endif
+    FLASH_Status status = FLASH_ErasePage(MISSION_START_FLASH_ADDRESS + mission.erasedSize);
+    mission.erasedSize += FLASH_PAGE_SIZE;
+
+    resumeRxSignal();
+
+    return status == FLASH_COMPLETE;
+}
+
+static bool missionStorageWrite(uint32_t offset, const void * data, uint32_t size)
+{
+    bool success = true;
+
+    FLASH_Unlock();
+    for (uint32_t i = 0; i < size && success; i += 2) {
+        if (offset + i >= mission.erasedSize) {
+            success = missionStorageErasePage();
+        }
+
+        if (success) {
+            const uint8_t * src = (const uint8_t *)data + i;
+            success = FLASH_ProgramHalfWord(MISSION_START_FLASH_ADDRESS + offset + i, src[0] | (src[1] << 8)) == FLASH_COMPLETE;
+        }
+    }
+    FLASH_Lock();
+
+    return success;
+}
+
+static void missionStorageInvalidate(void)
+{
+    mission.erasedSize = 0;
+
+    FLASH_Unlock();
+    missionStorageErasePage();
+    FLASH_Lock();
+}
+#else
+static uint16_t missionStorage[(NAV_MISSION_STORAGE_SIZE + 1) / 2];
+#define missionStorageData  ((const uint8_t *)missionStorage)
+
+static bool missionStorageWrite(uint32_t offset, const void * data, uint32_t size)
+{
+    memcpy((uint8_t *)missionStorage + offset, data, size);
+    return true;
+}
+
+static void missionStorageInvalidate(void)
+{
+    memset(missionStorage, 0, sizeof(missionStorageHeader_t));
+}
+#endif
+
+static uint8_t * writeVarint(uint8_t * p, uint32_t value)
+{
+    while (value >= 0x80) {
+        *p++ = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    *p++ = value;
+    return p;
+}
+
+static const uint8_t * readVarint(const uint8_t * p, uint32_t * value)
+{
+    uint32_t result = 0;
+    uint8_t shift = 0;
+    uint8_t byte;
+
+    do {
+        byte = *p++;
+        result |= (uint32_t)(byte & 0x7F) << shift;
+        shift += 7;
+    } while ((byte & 0x80) && shift < 35);
+
+    *value = result;
+    return p;
+}
+
+static uint8_t encodeWaypoint(const navWaypoint_t * wp, const navWaypoint_t * reference, uint8_t * record)
+{
+    const int32_t dLat = (int32_t)((uint32_t)wp->lat - (uint32_t)reference->lat);
+    const int32_t dLon = (int32_t)((uint32_t)wp->lon - (uint32_t)reference->lon);
+    const int32_t dAlt = (int32_t)((uint32_t)wp->alt - (uint32_t)reference->alt);
+    uint8_t fields = 0;
+    uint8_t * p = record + 1;
+
+    if (wp->action != reference->action) {
+        fields |= MISSION_FIELD_ACTION;
+        *p++ = wp->action;
+    }
+    if (dLat) {
+        fields |= MISSION_FIELD_LAT;
+        p = writeVarint(p, zigzagEncode(dLat));
+    }
+    if (dLon) {
+        fields |= MISSION_FIELD_LON;
+        p = writeVarint(p, zigzagEncode(dLon));
+    }
+    if (dAlt) {
+        fields |= MISSION_FIELD_ALT;
+        p = writeVarint(p, zigzagEncode(dAlt));
+    }
+    if (wp->p1 != reference->p1) {
+        fields |= MISSION_FIELD_P1;
+        p = writeVarint(p, zigzagEncode(wp->p1 - reference->p1));
+    }
+    if (wp->p2 != reference->p2) {
+        fields |= MISSION_FIELD_P2;
+        p = writeVarint(p, zigzagEncode(wp->p2 - reference->p2));
+    }
+    if (wp->p3 != reference->p3) {
+        fields |= MISSION_FIELD_P3;
+        p = writeVarint(p, zigzagEncode(wp->p3 - reference->p3));
+    }
+    if (wp->flag == NAV_WP_FLAG_LAST) {
+        fields |= MISSION_FIELD_LAST;
+    }
+
+    record[0] = fields;
+
+    // Records are halfword aligned to allow direct flash programming
+    if ((p - record) & 1) {
+        *p++ = 0xFF;
+    }
+
+    return p - record;
+}
+
+static const uint8_t * decodeWaypoint(const uint8_t * record, const navWaypoint_t * reference, navWaypoint_t * wp)
+{
+    const uint8_t * p = record + 1;
+    const uint8_t fields = record[0];
+    uint32_t value;
+
+    *wp = *reference;
+
+    if (fields & MISSION_FIELD_ACTION) {
+        wp->action = *p++;
+    }
+    if (fields & MISSION_FIELD_LAT) {
+        p = readVarint(p, &value);
+        wp->lat = (int32_t)((uint32_t)wp->lat + (uint32_t)zigzagDecode(value));
+    }
+    if (fields & MISSION_FIELD_LON) {
+        p = readVarint(p, &value);
+        wp->lon = (int32_t)((uint32_t)wp->lon + (uint32_t)zigzagDecode(value));
+    }
+    if (fields & MISSION_FIELD_ALT) {
+        p = readVarint(p, &value);
+        wp->alt = (int32_t)((uint32_t)wp->alt + (uint32_t)zigzagDecode(value));
+    }
+    if (fields & MISSION_FIELD_P1) {
+        p = readVarint(p, &value);
+        wp->p1 += zigzagDecode(value);
+    }
+    if (fields & MISSION_FIELD_P2) {
+        p = readVarint(p, &value);
+        wp->p2 += zigzagDecode(value);
+    }
+    if (fields & MISSION_FIELD_P3) {
+        p = readVarint(p, &value);
+        wp->p3 += zigzagDecode(value);
+    }
+    wp->flag = (fields & MISSION_FIELD_LAST) ? NAV_WP_FLAG_LAST : 0;
+
+    if ((p - record) & 1) {
+        p++;
+    }
+
+    return p;
+}
+
+static uint16_t missionGetBlockOffset(int block)
+{
+    const uint8_t * entry = missionStorageData + sizeof(missionStorageHeader_t) + block * sizeof(uint16_t);
+    return entry[0] | (entry[1] << 8);
+}
+
+static void missionLoadBlock(int block)
+{
+    const uint8_t * p = missionStorageData + NAV_MISSION_DATA_OFFSET + missionGetBlockOffset(block);
+    const navWaypoint_t * reference = &missionBlockReference;
+    const int count = MIN(NAV_MISSION_BLOCK_SIZE, mission.count - block * NAV_MISSION_BLOCK_SIZE);
+
+    for (int i = 0; i < count; i++) {
+        p = decodeWaypoint(p, reference, &mission.window[i]);
+        reference = &mission.window[i];
+    }
+
+    mission.windowBlock = block;
+}
+
+static uint16_t missionCalculateCrc(uint16_t crc, const uint8_t * data, uint32_t size)
+{
+    while (size--) {
+        crc = crc16_ccitt(crc, *data++);
+    }
+    return crc;
+}
+
+static bool missionCommit(void)
+{
+    missionStorageHeader_t header;
+
+    header.count = mission.count;
+    header.size = mission.size;
+    header.crc = mission.crc;
+
+    // Magic goes last, it makes the mission valid
+    if (!missionStorageWrite(offsetof(missionStorageHeader_t, count), &header.count, sizeof(header) - sizeof(header.magic))) {
+        return false;
+    }
+
+    header.magic = NAV_MISSION_MAGIC;
+    return missionStorageWrite(offsetof(missionStorageHeader_t, magic), &header.magic, sizeof(header.magic));
+}
+
+void missionInit(void)
+{
+#if defined(NAV_MISSION_STORAGE)
+    // Mission of NAV_MAX_WAYPOINTS has to fit regardless of how well it compresses
+    BUILD_BUG_ON(NAV_MISSION_DATA_OFFSET + NAV_MAX_WAYPOINTS * NAV_MISSION_MAX_RECORD_SIZE > NAV_MISSION_STORAGE_SIZE);
+#endif
+
+    missionStorageHeader_t header;
+    memcpy(&header, missionStorageData, sizeof(header));
+
+    memset(&mission, 0, sizeof(mission));
+    mission.windowBlock = -1;
+
+    // Pick up a mission stored before reboot
+    if (header.magic == NAV_MISSION_MAGIC && header.count > 0 && header.count <= NAV_MAX_WAYPOINTS &&
+            header.size <= NAV_MISSION_STORAGE_SIZE - NAV_MISSION_DATA_OFFSET &&
+            missionCalculateCrc(0, missionStorageData + NAV_MISSION_DATA_OFFSET, header.size) == header.crc) {
+        mission.count = header.count;
+        mission.size = header.size;
+        mission.crc = header.crc;
+        mission.valid = true;
+    }
+}
+
+void missionReset(void)
+{
+    memset(&mission, 0, sizeof(mission));
+    mission.windowBlock = -1;
+
+    missionStorageInvalidate();
+}
+
+bool missionAppendWaypoint(const navWaypoint_t * wpData)
+{
+    uint8_t record[NAV_MISSION_MAX_RECORD_SIZE];
+
+    if (mission.valid || mission.count >= NAV_MAX_WAYPOINTS) {
+        return false;
+    }
+
+    const int block = mission.count / NAV_MISSION_BLOCK_SIZE;
+    const bool isFirstInBlock = (mission.count % NAV_MISSION_BLOCK_SIZE) == 0;
+    const uint8_t size = encodeWaypoint(wpData, isFirstInBlock ? &missionBlockReference : &mission.lastWaypoint, record);
+
+    if (NAV_MISSION_DATA_OFFSET + mission.size + size > NAV_MISSION_STORAGE_SIZE) {
+        return false;
+    }
+
+    if (isFirstInBlock) {
+        if (!missionStorageWrite(sizeof(missionStorageHeader_t) + block * sizeof(uint16_t), &mission.size, sizeof(mission.size))) {
+            return false;
+        }
+    }
+
+    if (!missionStorageWrite(NAV_MISSION_DATA_OFFSET + mission.size, record, size)) {
+        return false;
+    }
+
+    mission.crc = missionCalculateCrc(mission.crc, record, size);
+    mission.size += size;
+    mission.count++;
+    mission.lastWaypoint = *wpData;
+
+    if (mission.windowBlock == block) {
+        mission.windowBlock = -1;
+    }
+
+    if (wpData->flag == NAV_WP_FLAG_LAST) {
+        mission.valid = missionCommit();
+    }
+
+    return true;
+}
+
+bool missionGetWaypoint(int index, navWaypoint_t * wpData)
+{
+    if (index < 0 || index >= mission.count) {
+        return false;
+    }
+
+    const int block = index / NAV_MISSION_BLOCK_SIZE;
+    if (block != mission.windowBlock) {
+        missionLoadBlock(block);
+    }
+
+    *wpData = mission.window[index % NAV_MISSION_BLOCK_SIZE];
+    return true;
+}
+
+int missionGetWaypointCount(void)
+{
+    return mission.count;
+}
+
+bool missionIsValid(void)
+{
+    return mission.valid;
+}
+
+#endif  // NAV
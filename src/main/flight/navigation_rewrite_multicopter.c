@@ -249,6 +249,16 @@ bool adjustMulticopterHeadingFromRCInput(void)
 static filterStatePt1_t mcPosControllerAccFilterStateX, mcPosControllerAccFilterStateY;
 static float lastAccelTargetX = 0.0f, lastAccelTargetY = 0.0f;
 
+/* Jerk-limited reference trajectory followed by the position cascade */
+typedef struct {
+    bool    initialized;
+    float   pos[2];     // cm
+    float   vel[2];     // cm/s
+    float   acc[2];     // cm/s^2
+} mcTrajectory_t;
+
+static mcTrajectory_t trajectory;
+
 void resetMulticopterPositionController(void)
 {
     int axis;
@@ -260,6 +270,8 @@ void resetMulticopterPositionController(void)
         lastAccelTargetX = 0.0f;
         lastAccelTargetY = 0.0f;
     }
+
+    trajectory.initialized = false;
 }
 
 bool adjustMulticopterPositionFromRCInput(void)
@@ -352,7 +364,122 @@ static void updatePositionVelocityController_MC(void)
 #endif
 }
 
-static void updatePositionAccelController_MC(uint32_t deltaMicros, float maxAccelLimit)
+/*-----------------------------------------------------------
+ * Jerk-limited trajectory generator (S-curve). Reference position, velocity and acceleration move towards the position
+ * target with limited speed, acceleration and jerk, the cascade follows the reference with velocity and acceleration
+ * feed-forward. New waypoint or hold position does not produce a setpoint step, acceleration changes at a limited rate.
+ *-----------------------------------------------------------*/
+static bool isTrajectoryGeneratorEnabled(void)
+{
+    // Trajectory leash and stopping distance are derived from position P, nav_pos_p = 0 falls back to legacy controller
+    return posControl.navConfig->mc_traj_max_jerk > 0 && posControl.pids.pos[X].param.kP > 0.0f;
+}
+
+/*
+ * Square root controller: proportional close to zero error, beyond that output is limited by
+ * how fast it can be brought back to zero with given second-order limit
+ */
+static float sqrtController(float error, float kP, float secondOrderLimit)
+{
+    float linearDistance = secondOrderLimit / sq(kP);
+
+    if (error > linearDistance) {
+        return sqrtf(2.0f * secondOrderLimit * (error - linearDistance / 2.0f));
+    }
+    else {
+        return error * kP;
+    }
+}
+
+// Speed to pass intermediate waypoints with, so the trajectory corners instead of stopping at each waypoint
+static float getTrajectoryCornerSpeed(float maxSpeed)
+{
+    if ((navGetCurrentStateFlags() & NAV_AUTO_WP) && !isApproachingLastWaypoint()) {
+        float cosHalfTurnAngle = cos_approx(CENTIDEGREES_TO_RADIANS(posControl.activeWaypointTurnAngle) / 2.0f);
+        return maxSpeed * sq(cosHalfTurnAngle);
+    }
+    else {
+        return 0.0f;
+    }
+}
+
+static void updateTrajectory_MC(uint32_t deltaMicros)
+{
+    const float dt = US2S(deltaMicros);
+    const float maxAccel = posControl.navConfig->mc_traj_max_accel;
+    const float maxJerk = posControl.navConfig->mc_traj_max_jerk;
+    const float posP = posControl.pids.pos[X].param.kP;
+    const float maxSpeed = getActiveWaypointSpeed();
+    float error[2];
+    int axis;
+
+    if (!trajectory.initialized) {
+        for (axis = 0; axis < 2; axis++) {
+            trajectory.pos[axis] = posControl.actualState.pos.A[axis];
+            trajectory.vel[axis] = posControl.actualState.vel.A[axis];
+            trajectory.acc[axis] = 0.0f;
+        }
+        trajectory.initialized = true;
+    }
+
+    // Don't let the reference run away if aircraft can't follow it (wind, bank angle limit)
+    const float maxLeash = maxSpeed / posP;
+    error[X] = trajectory.pos[X] - posControl.actualState.pos.V.X;
+    error[Y] = trajectory.pos[Y] - posControl.actualState.pos.V.Y;
+    float leash = sqrtf(sq(error[X]) + sq(error[Y]));
+    if (leash > maxLeash) {
+        for (axis = 0; axis < 2; axis++) {
+            trajectory.pos[axis] = posControl.actualState.pos.A[axis] + error[axis] * (maxLeash / leash);
+        }
+    }
+
+    // Speed towards the target: stop there with half of max acceleration (rest is needed while jerk builds it up)
+    // or pass it with corner speed if it's an intermediate waypoint
+    error[X] = posControl.desiredState.pos.V.X - trajectory.pos[X];
+    error[Y] = posControl.desiredState.pos.V.Y - trajectory.pos[Y];
+    float distance = sqrtf(sq(error[X]) + sq(error[Y]));
+    float speed = MAX(sqrtController(distance, posP, maxAccel / 2.0f), getTrajectoryCornerSpeed(maxSpeed));
+    speed = MIN(speed, maxSpeed) * getVelocityHeadingAttenuationFactor();
+
+    // Acceleration towards that velocity, limited so it can be brought back to zero with max jerk
+    float velError[2];
+    for (axis = 0; axis < 2; axis++) {
+        velError[axis] = ((distance > 1.0f) ? (error[axis] * speed / distance) : 0.0f) - trajectory.vel[axis];
+    }
+
+    float velErrorMagnitude = sqrtf(sq(velError[X]) + sq(velError[Y]));
+    float accel = MIN(sqrtController(velErrorMagnitude, maxJerk / maxAccel, maxJerk), maxAccel);
+
+    // Acceleration changes with limited jerk
+    float accelChange[2];
+    for (axis = 0; axis < 2; axis++) {
+        accelChange[axis] = ((velErrorMagnitude > 1.0f) ? (velError[axis] * accel / velErrorMagnitude) : 0.0f) - trajectory.acc[axis];
+    }
+
+    float accelChangeMagnitude = sqrtf(sq(accelChange[X]) + sq(accelChange[Y]));
+    float maxAccelChange = maxJerk * dt;
+    if (accelChangeMagnitude > maxAccelChange) {
+        accelChange[X] *= maxAccelChange / accelChangeMagnitude;
+        accelChange[Y] *= maxAccelChange / accelChangeMagnitude;
+    }
+
+    for (axis = 0; axis < 2; axis++) {
+        trajectory.acc[axis] += accelChange[axis];
+        trajectory.pos[axis] += (trajectory.vel[axis] + trajectory.acc[axis] * dt / 2.0f) * dt;
+        trajectory.vel[axis] += trajectory.acc[axis] * dt;
+    }
+
+    // Velocity setpoint: reference velocity plus correction of position error relative to the reference
+    posControl.desiredState.vel.V.X = trajectory.vel[X] + (trajectory.pos[X] - posControl.actualState.pos.V.X) * posP;
+    posControl.desiredState.vel.V.Y = trajectory.vel[Y] + (trajectory.pos[Y] - posControl.actualState.pos.V.Y) * posP;
+
+#if defined(NAV_BLACKBOX)
+    navDesiredVelocity[X] = constrain(lrintf(posControl.desiredState.vel.V.X), -32678, 32767);
+    navDesiredVelocity[Y] = constrain(lrintf(posControl.desiredState.vel.V.Y), -32678, 32767);
+#endif
+}
+
+static void updatePositionAccelController_MC(uint32_t deltaMicros, float maxAccelLimit, float accelFeedForwardX, float accelFeedForwardY)
 {
     float velErrorX, velErrorY, newAccelX, newAccelY;
 
@@ -385,8 +512,13 @@ static void updatePositionAccelController_MC(uint32_t deltaMicros, float maxAcce
     // Apply PID with output limiting and I-term anti-windup
     // Pre-calculated accelLimit and the logic of navPidApply2 function guarantee that our newAccel won't exceed maxAccelLimit
     // Thus we don't need to do anything else with calculated acceleration
-    newAccelX = navPidApply2(posControl.desiredState.vel.V.X, posControl.actualState.vel.V.X, US2S(deltaMicros), &posControl.pids.vel[X], accelLimitXMin, accelLimitXMax, false);
-    newAccelY = navPidApply2(posControl.desiredState.vel.V.Y, posControl.actualState.vel.V.Y, US2S(deltaMicros), &posControl.pids.vel[Y], accelLimitYMin, accelLimitYMax, false);
+    // Acceleration feed-forward from trajectory generator shifts the PID output range, so the total is still within limits.
+    // Trajectory velocity setpoint is smooth, D-term tracks the error so it won't fight the feed-forward
+    bool dTermErrorTracking = isTrajectoryGeneratorEnabled();
+    newAccelX = accelFeedForwardX + navPidApply2(posControl.desiredState.vel.V.X, posControl.actualState.vel.V.X, US2S(deltaMicros), &posControl.pids.vel[X],
+                                                 accelLimitXMin - accelFeedForwardX, accelLimitXMax - accelFeedForwardX, dTermErrorTracking);
+    newAccelY = accelFeedForwardY + navPidApply2(posControl.desiredState.vel.V.Y, posControl.actualState.vel.V.Y, US2S(deltaMicros), &posControl.pids.vel[Y],
+                                                 accelLimitYMin - accelFeedForwardY, accelLimitYMax - accelFeedForwardY, dTermErrorTracking);
 
     // Save last acceleration target
     lastAccelTargetX = newAccelX;
@@ -440,8 +572,14 @@ static void applyMulticopterPositionController(uint32_t currentTime)
             if (!bypassPositionController) {
                 // Update position controller
                 if (deltaMicrosPositionUpdate < HZ2US(MIN_POSITION_UPDATE_RATE_HZ)) {
-                    updatePositionVelocityController_MC();
-                    updatePositionAccelController_MC(deltaMicrosPositionUpdate, NAV_ACCELERATION_XY_MAX);
+                    if (isTrajectoryGeneratorEnabled()) {
+                        updateTrajectory_MC(deltaMicrosPositionUpdate);
+                        updatePositionAccelController_MC(deltaMicrosPositionUpdate, NAV_ACCELERATION_XY_MAX, trajectory.acc[X], trajectory.acc[Y]);
+                    }
+                    else {
+                        updatePositionVelocityController_MC();
+                        updatePositionAccelController_MC(deltaMicrosPositionUpdate, NAV_ACCELERATION_XY_MAX, 0.0f, 0.0f);
+                    }
                 }
                 else {
                     resetMulticopterPositionController();
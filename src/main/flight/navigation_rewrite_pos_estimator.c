@@ -60,9 +60,7 @@
 #define INAV_GPS_GLITCH_RADIUS              250.0f  // 2.5m GPS glitch radius
 #define INAV_GPS_GLITCH_ACCEL               1000.0f // 10m/s/s max possible acceleration for GPS glitch detection
 
-#define INAV_POSITION_PUBLISH_RATE_HZ       50      // Publish position updates at this rate
-#define INAV_BARO_UPDATE_RATE               20
-#define INAV_SONAR_UPDATE_RATE              15      // Sonar is limited to 1/60ms update rate, go lower that that
+#define INAV_POSITION_PUBLISH_RATE_HZ       50      // Publish position updates at this rate, also minimum estimator update rate
 
 #define INAV_GPS_TIMEOUT_MS                 1500    // GPS timeout
 #define INAV_BARO_TIMEOUT_MS                200     // Baro timeout
@@ -73,6 +71,15 @@
 
 #define INAV_HISTORY_BUF_SIZE               (INAV_POSITION_PUBLISH_RATE_HZ / 2)     // Enough to hold 0.5 sec historical data
 
+#if defined(NAV_POS_ESTIMATOR_EKF)
+#define INAV_EKF_ACC_NOISE                  50.0f   // Accelerometer noise after bias removal (cm/s/s)
+#define INAV_EKF_ACC_BIAS_NOISE             2.0f    // Accelerometer bias random walk (cm/s/s/sqrt(s))
+#define INAV_EKF_GPS_VEL_NOISE              50.0f   // GPS velocity noise (cm/s)
+#define INAV_EKF_SONAR_VEL_NOISE            30.0f   // Sonar climb rate noise (cm/s)
+#define INAV_EKF_INITIAL_VEL_STD            500.0f  // cm/s
+#define INAV_EKF_INITIAL_ACC_BIAS_STD       50.0f   // cm/s/s, about 0.05G
+#endif
+
 extern float magneticDeclination;
 
 typedef struct {
@@ -82,24 +89,32 @@ typedef struct {
 
 typedef struct {
     uint32_t    lastUpdateTime; // Last update time (us)
+    uint32_t    lastFusedTime;  // Update time of the last sample compared against estimate history (us)
 #if defined(NAV_GPS_GLITCH_DETECTION)
     bool        glitchDetected;
     bool        glitchRecovery;
 #endif
     t_fp_vector pos;            // GPS position in NEU coordinate system (cm)
     t_fp_vector vel;            // GPS velocity (cms)
+    t_fp_vector posResidual;    // Position error of the estimate, not yet corrected (cm)
+    t_fp_vector velResidual;    // Velocity error of the estimate, not yet corrected (cms)
+    bool        isResidualNew;  // Residual was computed from a new sample and not fused by EKF yet
     float       eph;
     float       epv;
 } navPositionEstimatorGPS_t;
 
 typedef struct {
     uint32_t    lastUpdateTime; // Last update time (us)
+    uint32_t    lastFusedTime;  // Update time of the last sample compared against estimate history (us)
     float       alt;            // Raw barometric altitude (cm)
+    float       altResidual;    // Altitude error of the estimate, not yet corrected (cm)
+    bool        isResidualNew;  // Residual was computed from a new sample and not fused by EKF yet
     float       epv;
 } navPositionEstimatorBARO_t;
 
 typedef struct {
     uint32_t    lastUpdateTime; // Last update time (us)
+    uint32_t    lastFusedTime;  // Update time of the last sample fused by EKF (us)
     float       alt;            // Raw altitude measurement (cm)
     float       vel;
 } navPositionEstimatorSONAR_t;
@@ -122,15 +137,28 @@ typedef struct {
 
 typedef struct {
     uint8_t     index;
+    uint8_t     count;
+    uint32_t    time[INAV_HISTORY_BUF_SIZE];
     t_fp_vector pos[INAV_HISTORY_BUF_SIZE];
     t_fp_vector vel[INAV_HISTORY_BUF_SIZE];
 } navPosisitonEstimatorHistory_t;
 
 typedef struct {
-    t_fp_vector     accelNEU;
+    uint32_t        lastUpdateTime; // Last accelerometer sample time (us)
+    t_fp_vector     deltaVel;       // Velocity change accumulated since last estimator update (cm/s)
+    float           deltaTime;      // Time accumulated since last estimator update (s)
+    t_fp_vector     accelNEU;       // Average acceleration over last estimator update period
     t_fp_vector     accelBias;
 } navPosisitonEstimatorIMU_t;
 
+#if defined(NAV_POS_ESTIMATOR_EKF)
+/* Bias is in NEU frame, so axes are independent and the 9-state filter splits into three 3-state filters */
+typedef struct {
+    t_fp_vector     accelBias;      // Accelerometer bias in NEU frame (cm/s/s)
+    float           P[XYZ_AXIS_COUNT][3][3];    // Covariance of position, velocity and bias per axis
+} navPosisitonEstimatorEKF_t;
+#endif
+
 typedef struct {
     // Data sources
     navPositionEstimatorGPS_t   gps;
@@ -146,8 +174,16 @@ typedef struct {
     // Estimation history
     navPosisitonEstimatorHistory_t  history;
 
+#if defined(NAV_POS_ESTIMATOR_EKF)
+    // Kalman filter state not shared with complementary filter
+    navPosisitonEstimatorEKF_t      ekf;
+#endif
+
     // Extra state variables
     navPositionEstimatorSTATE_t state;
+
+    // Set by sensor topics, cleared by estimator update
+    bool            hasNewSensorData;
 } navigationPosEstimator_s;
 
 static navigationPosEstimator_s posEstimator;
@@ -159,16 +195,148 @@ static void inavFilterPredict(int axis, float dt, float acc)
     posEstimator.est.vel.A[axis] += acc * dt;
 }
 
-static void inavFilterCorrectPos(int axis, float dt, float e, float w)
+/* Correction functions return the amount of correction applied, so callers can take it off the outstanding residual */
+static float inavFilterCorrectPos(int axis, float dt, float e, float w)
 {
     float ewdt = e * w * dt;
     posEstimator.est.pos.A[axis] += ewdt;
     posEstimator.est.vel.A[axis] += w * ewdt;
+    return ewdt;
+}
+
+static float inavFilterCorrectVel(int axis, float dt, float e, float w)
+{
+    float ewdt = e * w * dt;
+    posEstimator.est.vel.A[axis] += ewdt;
+    return ewdt;
+}
+
+#if defined(NAV_POS_ESTIMATOR_EKF)
+#define INAV_EKF_POS    0
+#define INAV_EKF_VEL    1
+#define INAV_EKF_BIAS   2
+
+static void inavEkfReset(void)
+{
+    int axis;
+
+    memset(&posEstimator.ekf, 0, sizeof(posEstimator.ekf));
+
+    for (axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        posEstimator.ekf.P[axis][INAV_EKF_POS][INAV_EKF_POS] = sq(posControl.navConfig->inav.max_eph_epv);
+        posEstimator.ekf.P[axis][INAV_EKF_VEL][INAV_EKF_VEL] = sq(INAV_EKF_INITIAL_VEL_STD);
+        posEstimator.ekf.P[axis][INAV_EKF_BIAS][INAV_EKF_BIAS] = sq(INAV_EKF_INITIAL_ACC_BIAS_STD);
+    }
+}
+
+/**
+ * Kalman filter prediction for one axis, state is [pos, vel, accel bias]
+ *  F = | 1  dt  -dt^2/2 |
+ *      | 0  1   -dt     |
+ *      | 0  0    1      |
+ */
+static void inavEkfPredict(int axis, float dt, float acc)
+{
+    float (*P)[3] = posEstimator.ekf.P[axis];
+    const float h = dt * dt / 2.0f;
+    float FP[3][3];
+    int i;
+
+    inavFilterPredict(axis, dt, acc - posEstimator.ekf.accelBias.A[axis]);
+
+    /* FP = F * P */
+    for (i = 0; i < 3; i++) {
+        FP[0][i] = P[0][i] + dt * P[1][i] - h * P[2][i];
+        FP[1][i] = P[1][i] - dt * P[2][i];
+        FP[2][i] = P[2][i];
+    }
+
+    /* P = FP * F' + Q, acceleration noise enters through G = [dt^2/2, dt, 0] */
+    for (i = 0; i < 3; i++) {
+        P[i][0] = FP[i][0] + dt * FP[i][1] - h * FP[i][2];
+        P[i][1] = FP[i][1] - dt * FP[i][2];
+        P[i][2] = FP[i][2];
+    }
+
+    P[0][0] += sq(INAV_EKF_ACC_NOISE) * h * h;
+    P[0][1] += sq(INAV_EKF_ACC_NOISE) * h * dt;
+    P[1][0] += sq(INAV_EKF_ACC_NOISE) * h * dt;
+    P[1][1] += sq(INAV_EKF_ACC_NOISE) * dt * dt;
+    P[2][2] += sq(INAV_EKF_ACC_BIAS_NOISE) * dt;
+}
+
+/**
+ * Kalman filter correction with a direct measurement of a single state
+ *  innovation is the measurement minus the estimate, variance is measurement noise variance
+ */
+static void inavEkfCorrect(int axis, int state, float innovation, float variance)
+{
+    float (*P)[3] = posEstimator.ekf.P[axis];
+    float Pi[3];
+    float K[3];
+    int i, j;
+
+    float S = P[state][state] + variance;
+    if (S <= 0.0f) {
+        return;
+    }
+
+    for (i = 0; i < 3; i++) {
+        Pi[i] = P[state][i];
+        K[i] = P[i][state] / S;
+    }
+
+    posEstimator.est.pos.A[axis] += K[INAV_EKF_POS] * innovation;
+    posEstimator.est.vel.A[axis] += K[INAV_EKF_VEL] * innovation;
+    posEstimator.ekf.accelBias.A[axis] += K[INAV_EKF_BIAS] * innovation;
+
+    for (i = 0; i < 3; i++) {
+        for (j = 0; j < 3; j++) {
+            P[i][j] -= K[i] * Pi[j];
+        }
+    }
 }
+#endif
 
-static void inavFilterCorrectVel(int axis, float dt, float e, float w)
+/**
+ * Find the estimate at the moment a delayed measurement was taken
+ *  History is walked back from the newest entry and interpolated between the two entries around sampleTime.
+ *  Samples newer than the history are interpolated against the current estimate, samples older than the history
+ *  are compared against the oldest entry available.
+ */
+static void getHistoricalEstimate(uint32_t sampleTime, t_fp_vector * pos, t_fp_vector * vel)
 {
-    posEstimator.est.vel.A[axis] += e * w * dt;
+    uint32_t newerTime = posEstimator.est.lastUpdateTime;
+    const t_fp_vector * newerPos = &posEstimator.est.pos;
+    const t_fp_vector * newerVel = &posEstimator.est.vel;
+    int historyIndex = posEstimator.history.index;
+    int axis;
+
+    for (int n = 0; n < posEstimator.history.count; n++) {
+        historyIndex = (historyIndex == 0) ? (INAV_HISTORY_BUF_SIZE - 1) : (historyIndex - 1);
+
+        uint32_t olderTime = posEstimator.history.time[historyIndex];
+        const t_fp_vector * olderPos = &posEstimator.history.pos[historyIndex];
+        const t_fp_vector * olderVel = &posEstimator.history.vel[historyIndex];
+
+        if ((int32_t)(sampleTime - olderTime) >= 0) {
+            uint32_t span = newerTime - olderTime;
+            float k = (span > 0) ? constrainf((float)(sampleTime - olderTime) / span, 0.0f, 1.0f) : 0.0f;
+
+            for (axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+                pos->A[axis] = olderPos->A[axis] + (newerPos->A[axis] - olderPos->A[axis]) * k;
+                vel->A[axis] = olderVel->A[axis] + (newerVel->A[axis] - olderVel->A[axis]) * k;
+            }
+            return;
+        }
+
+        newerTime = olderTime;
+        newerPos = olderPos;
+        newerVel = olderVel;
+    }
+
+    *pos = *newerPos;
+    *vel = *newerVel;
 }
 
 #define resetTimer(tim, currentTime) { (tim)->deltaTime = 0; (tim)->lastTriggeredTime = currentTime; }
@@ -286,7 +454,8 @@ void onNewGPSData(void)
         /* Process position update if GPS origin is already set, or precision is good enough */
         // FIXME: use HDOP here
         if ((posControl.gpsOrigin.valid) || (gpsSol.numSat >= posControl.navConfig->inav.gps_min_sats)) {
-            /* Convert LLH position to local coordinates */
+            /* Convert LLH position to local coordinates, projection is kept accurate around the aircraft */
+            geoUpdateProjectionAnchor(&posControl.gpsOrigin, &newLLH);
             geoConvertGeodeticToLocal(&posControl.gpsOrigin, &newLLH, & posEstimator.gps.pos, GEO_ALT_ABSOLUTE);
 
             /* If not the first update - calculate velocities */
@@ -330,6 +499,7 @@ void onNewGPSData(void)
 
                 /* Indicate a last valid reading of Pos/Vel */
                 posEstimator.gps.lastUpdateTime = currentTime;
+                posEstimator.hasNewSensorData = true;
             }
 
             previousLat = gpsSol.llh.lat;
@@ -349,23 +519,20 @@ void onNewGPSData(void)
 #if defined(BARO)
 /**
  * Read BARO and update alt/vel topic
- *  Function is called at main loop rate, updates happen at reduced rate
+ *  Function is called by baro task when a new pressure conversion is complete
  */
-static void updateBaroTopic(uint32_t currentTime)
+void updatePositionEstimator_BaroTopic(uint32_t currentTime)
 {
-    static navigationTimer_t baroUpdateTimer;
-
-    if (updateTimer(&baroUpdateTimer, HZ2US(INAV_BARO_UPDATE_RATE), currentTime)) {
-        float newBaroAlt = baroCalculateAltitude();
-        if (sensors(SENSOR_BARO) && isBaroCalibrationComplete()) {
-            posEstimator.baro.alt = newBaroAlt;
-            posEstimator.baro.epv = posControl.navConfig->inav.baro_epv;
-            posEstimator.baro.lastUpdateTime = currentTime;
-        }
-        else {
-            posEstimator.baro.alt = 0;
-            posEstimator.baro.lastUpdateTime = 0;
-        }
+    float newBaroAlt = baroCalculateAltitude();
+    if (sensors(SENSOR_BARO) && isBaroCalibrationComplete()) {
+        posEstimator.baro.alt = newBaroAlt;
+        posEstimator.baro.epv = posControl.navConfig->inav.baro_epv;
+        posEstimator.baro.lastUpdateTime = currentTime;
+        posEstimator.hasNewSensorData = true;
+    }
+    else {
+        posEstimator.baro.alt = 0;
+        posEstimator.baro.lastUpdateTime = 0;
     }
 }
 #endif
@@ -373,55 +540,58 @@ static void updateBaroTopic(uint32_t currentTime)
 #if defined(SONAR)
 /**
  * Read sonar and update alt/vel topic
- *  Function is called at main loop rate, updates happen at reduced rate
+ *  Function is called by sonar task, reading is the echo of the previous ping
  */
-static void updateSonarTopic(uint32_t currentTime)
+void updatePositionEstimator_SonarTopic(uint32_t currentTime)
 {
-    static navigationTimer_t sonarUpdateTimer;
-
-    if (updateTimer(&sonarUpdateTimer, HZ2US(INAV_SONAR_UPDATE_RATE), currentTime)) {
-        if (sensors(SENSOR_SONAR)) {
-            /* Read sonar */
-            float newSonarAlt = rangefinderRead();
-            newSonarAlt = rangefinderCalculateAltitude(newSonarAlt, calculateCosTiltAngle());
-
-            /* Apply predictive filter to sonar readings (inspired by PX4Flow) */
-            if (newSonarAlt > 0 && newSonarAlt <= INAV_SONAR_MAX_DISTANCE) {
-                float sonarPredVel, sonarPredAlt;
-                float sonarDt = (currentTime - posEstimator.sonar.lastUpdateTime) * 1e-6;
-                posEstimator.sonar.lastUpdateTime = currentTime;
-
-                sonarPredVel = (sonarDt < 0.25f) ? posEstimator.sonar.vel : 0.0f;
-                sonarPredAlt = posEstimator.sonar.alt + sonarPredVel * sonarDt;
-
-                posEstimator.sonar.alt = sonarPredAlt + INAV_SONAR_W1 * (newSonarAlt - sonarPredAlt);
-                posEstimator.sonar.vel = sonarPredVel + INAV_SONAR_W2 * (newSonarAlt - sonarPredAlt);
-            }
-        }
-        else {
-            /* No sonar */
-            posEstimator.sonar.alt = 0;
-            posEstimator.sonar.vel = 0;
-            posEstimator.sonar.lastUpdateTime = 0;
+    if (sensors(SENSOR_SONAR)) {
+        /* Read sonar */
+        float newSonarAlt = rangefinderRead();
+        newSonarAlt = rangefinderCalculateAltitude(newSonarAlt, calculateCosTiltAngle());
+
+        /* Apply predictive filter to sonar readings (inspired by PX4Flow) */
+        if (newSonarAlt > 0 && newSonarAlt <= INAV_SONAR_MAX_DISTANCE) {
+            float sonarPredVel, sonarPredAlt;
+            float sonarDt = (currentTime - posEstimator.sonar.lastUpdateTime) * 1e-6;
+            posEstimator.sonar.lastUpdateTime = currentTime;
+
+            sonarPredVel = (sonarDt < 0.25f) ? posEstimator.sonar.vel : 0.0f;
+            sonarPredAlt = posEstimator.sonar.alt + sonarPredVel * sonarDt;
+
+            posEstimator.sonar.alt = sonarPredAlt + INAV_SONAR_W1 * (newSonarAlt - sonarPredAlt);
+            posEstimator.sonar.vel = sonarPredVel + INAV_SONAR_W2 * (newSonarAlt - sonarPredAlt);
+            posEstimator.hasNewSensorData = true;
         }
     }
+    else {
+        /* No sonar */
+        posEstimator.sonar.alt = 0;
+        posEstimator.sonar.vel = 0;
+        posEstimator.sonar.lastUpdateTime = 0;
+    }
 }
 #endif
 
 /**
  * Update IMU topic
- *  Function is called at main loop rate
+ *  Function is called at main loop rate. Acceleration is rotated to NEU frame and accumulated as velocity change,
+ *  estimator update consumes the accumulated value at its own rate.
  */
-static void updateIMUTopic(void)
+void updatePositionEstimator_AccelTopic(uint32_t currentTime)
 {
     static float calibratedGravityCMSS = GRAVITY_CMSS;
 
+    float dt = US2S(currentTime - posEstimator.imu.lastUpdateTime);
+    posEstimator.imu.lastUpdateTime = currentTime;
+
     if (!isImuReady()) {
-        posEstimator.imu.accelNEU.V.X = 0;
-        posEstimator.imu.accelNEU.V.Y = 0;
-        posEstimator.imu.accelNEU.V.Z = 0;
+        posEstimator.imu.deltaVel.V.X = 0;
+        posEstimator.imu.deltaVel.V.Y = 0;
+        posEstimator.imu.deltaVel.V.Z = 0;
+        posEstimator.imu.deltaTime = 0;
     }
     else {
+        t_fp_vector accelNEU;
         t_fp_vector accelBF;
 
         /* Read acceleration data in body frame */
@@ -438,21 +608,184 @@ static void updateIMUTopic(void)
         imuTransformVectorBodyToEarth(&accelBF);
 
         /* Read acceleration data in NEU frame from IMU */
-        posEstimator.imu.accelNEU.V.X = accelBF.V.X;
-        posEstimator.imu.accelNEU.V.Y = accelBF.V.Y;
-        posEstimator.imu.accelNEU.V.Z = accelBF.V.Z;
+        accelNEU.V.X = accelBF.V.X;
+        accelNEU.V.Y = accelBF.V.Y;
+        accelNEU.V.Z = accelBF.V.Z;
 
         /* When unarmed, assume that accelerometer should measure 1G. Use that to correct accelerometer gain */
         //if (!ARMING_FLAG(ARMED) && imuRuntimeConfig->acc_unarmedcal) {
         if (!ARMING_FLAG(ARMED) && posControl.navConfig->inav.accz_unarmed_cal) {
             // Slowly converge on calibrated gravity while level
-            calibratedGravityCMSS += (posEstimator.imu.accelNEU.V.Z - calibratedGravityCMSS) * 0.0025f;
+            calibratedGravityCMSS += (accelNEU.V.Z - calibratedGravityCMSS) * 0.0025f;
+        }
+
+        accelNEU.V.Z -= calibratedGravityCMSS;
+
+        /* Skip the first sample and any long gap - there is nothing sensible to integrate over */
+        if (dt > 0 && dt < HZ2S(MIN_POSITION_UPDATE_RATE_HZ)) {
+            posEstimator.imu.deltaVel.V.X += accelNEU.V.X * dt;
+            posEstimator.imu.deltaVel.V.Y += accelNEU.V.Y * dt;
+            posEstimator.imu.deltaVel.V.Z += accelNEU.V.Z * dt;
+            posEstimator.imu.deltaTime += dt;
         }
+    }
+}
 
-        posEstimator.imu.accelNEU.V.Z -= calibratedGravityCMSS;
+/**
+ * Turn velocity change accumulated by IMU topic into average acceleration for the prediction step
+ */
+static void consumeAccumulatedAcceleration(void)
+{
+    if (posEstimator.imu.deltaTime > 0) {
+        posEstimator.imu.accelNEU.V.X = posEstimator.imu.deltaVel.V.X / posEstimator.imu.deltaTime;
+        posEstimator.imu.accelNEU.V.Y = posEstimator.imu.deltaVel.V.Y / posEstimator.imu.deltaTime;
+        posEstimator.imu.accelNEU.V.Z = posEstimator.imu.deltaVel.V.Z / posEstimator.imu.deltaTime;
     }
+    else {
+        posEstimator.imu.accelNEU.V.X = 0;
+        posEstimator.imu.accelNEU.V.Y = 0;
+        posEstimator.imu.accelNEU.V.Z = 0;
+    }
+
+    posEstimator.imu.deltaVel.V.X = 0;
+    posEstimator.imu.deltaVel.V.Y = 0;
+    posEstimator.imu.deltaVel.V.Z = 0;
+    posEstimator.imu.deltaTime = 0;
 }
 
+/**
+ * Compare new GPS/BARO samples against the estimate at the time they were measured
+ *  Each sample is stamped with its sensor latency and compared only once. The resulting error is carried forward
+ *  to the current estimate and corrected over the following iterations in updateEstimatedTopic.
+ */
+static void updateMeasurementResiduals(void)
+{
+    t_fp_vector histPos;
+    t_fp_vector histVel;
+
+#if defined(GPS)
+    if (posEstimator.gps.lastUpdateTime != 0 && posEstimator.gps.lastUpdateTime != posEstimator.gps.lastFusedTime) {
+        int axis;
+        uint32_t sampleTime = posEstimator.gps.lastUpdateTime - MS2US(posControl.navConfig->inav.gps_delay_ms);
+        float sampleAge = US2S((int32_t)(posEstimator.est.lastUpdateTime - sampleTime));
+
+        getHistoricalEstimate(sampleTime, &histPos, &histVel);
+
+        for (axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            posEstimator.gps.velResidual.A[axis] = posEstimator.gps.vel.A[axis] - histVel.A[axis];
+            /* Velocity error accumulated into position error while the sample was in flight */
+            posEstimator.gps.posResidual.A[axis] = posEstimator.gps.pos.A[axis] - histPos.A[axis] + posEstimator.gps.velResidual.A[axis] * MAX(sampleAge, 0.0f);
+        }
+
+        posEstimator.gps.lastFusedTime = posEstimator.gps.lastUpdateTime;
+        posEstimator.gps.isResidualNew = true;
+    }
+#endif
+
+#if defined(BARO)
+    if (posEstimator.baro.lastUpdateTime != 0 && posEstimator.baro.lastUpdateTime != posEstimator.baro.lastFusedTime) {
+        getHistoricalEstimate(posEstimator.baro.lastUpdateTime - MS2US(posControl.navConfig->inav.baro_delay_ms), &histPos, &histVel);
+        posEstimator.baro.altResidual = posEstimator.baro.alt - histPos.V.Z;
+        posEstimator.baro.lastFusedTime = posEstimator.baro.lastUpdateTime;
+        posEstimator.baro.isResidualNew = true;
+    }
+#endif
+}
+
+static void updateEstimatedSurface(bool isSonarValid)
+{
+#if defined(SONAR)
+    if (isSonarValid) {
+        posEstimator.est.surface = posEstimator.sonar.alt;
+        posEstimator.est.surfaceVel = posEstimator.sonar.vel;
+    }
+    else {
+        posEstimator.est.surface = -1;
+        posEstimator.est.surfaceVel = 0;
+    }
+#else
+    UNUSED(isSonarValid);
+    posEstimator.est.surface = -1;
+    posEstimator.est.surfaceVel = 0;
+#endif
+}
+
+#if defined(NAV_POS_ESTIMATOR_EKF)
+/**
+ * Kalman filter estimate update
+ *  Every new GPS/BARO sample is fused exactly once using its delayed residual, measurement noise comes from reported EPH/EPV.
+ *  EPH/EPV of the estimate are taken from filter covariance.
+ */
+static void updateEstimatedTopicEKF(float dt, bool isGPSValid, bool useGpsZ, bool isBaroValid, bool isSonarValid, bool isAirCushionEffectDetected)
+{
+    t_fp_vector predPos;
+    t_fp_vector predVel;
+    int axis;
+
+    /* Without valid heading X-Y acceleration is unknown - assume none and let covariance grow */
+    if (isImuHeadingValid()) {
+        inavEkfPredict(X, dt, posEstimator.imu.accelNEU.V.X);
+        inavEkfPredict(Y, dt, posEstimator.imu.accelNEU.V.Y);
+    }
+    else {
+        inavEkfPredict(X, dt, posEstimator.ekf.accelBias.V.X);
+        inavEkfPredict(Y, dt, posEstimator.ekf.accelBias.V.Y);
+    }
+    inavEkfPredict(Z, dt, posEstimator.imu.accelNEU.V.Z);
+
+    /* Residuals were taken before prediction - take off corrections already applied in this iteration */
+    predPos = posEstimator.est.pos;
+    predVel = posEstimator.est.vel;
+
+#if defined(BARO)
+    if (isBaroValid && posEstimator.baro.isResidualNew) {
+        /* Ground altitude is not a delayed measurement - compare it against current estimate */
+        float baroInnovation = isAirCushionEffectDetected ? (posEstimator.state.baroGroundAlt - posEstimator.est.pos.V.Z) : posEstimator.baro.altResidual;
+
+        inavEkfCorrect(Z, INAV_EKF_POS, baroInnovation, sq(posEstimator.baro.epv));
+        posEstimator.baro.isResidualNew = false;
+    }
+#else
+    UNUSED(isAirCushionEffectDetected);
+#endif
+
+    if (isGPSValid && posEstimator.gps.isResidualNew) {
+        for (axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            if (axis == Z && !useGpsZ) {
+                continue;
+            }
+
+            inavEkfCorrect(axis, INAV_EKF_POS, posEstimator.gps.posResidual.A[axis] - (posEstimator.est.pos.A[axis] - predPos.A[axis]),
+                           sq((axis == Z) ? posEstimator.gps.epv : posEstimator.gps.eph));
+            inavEkfCorrect(axis, INAV_EKF_VEL, posEstimator.gps.velResidual.A[axis] - (posEstimator.est.vel.A[axis] - predVel.A[axis]),
+                           sq(INAV_EKF_GPS_VEL_NOISE));
+        }
+        posEstimator.gps.isResidualNew = false;
+    }
+
+#if defined(SONAR)
+    /* Sonar measures distance to surface, on flat ground its rate is our climb rate */
+    if (isSonarValid && posEstimator.sonar.lastUpdateTime != posEstimator.sonar.lastFusedTime) {
+        inavEkfCorrect(Z, INAV_EKF_VEL, posEstimator.sonar.vel - posEstimator.est.vel.V.Z, sq(INAV_EKF_SONAR_VEL_NOISE));
+        posEstimator.sonar.lastFusedTime = posEstimator.sonar.lastUpdateTime;
+    }
+#endif
+
+    /* No reference - slowly decrease estimated velocity. This is not a measurement, covariance is left to grow */
+    if (!isGPSValid) {
+        inavFilterCorrectVel(X, dt, 0.0f - posEstimator.est.vel.V.X, posControl.navConfig->inav.w_xy_res_v);
+        inavFilterCorrectVel(Y, dt, 0.0f - posEstimator.est.vel.V.Y, posControl.navConfig->inav.w_xy_res_v);
+    }
+
+    if (!useGpsZ && !isBaroValid && !isSonarValid) {
+        inavFilterCorrectVel(Z, dt, 0.0f - posEstimator.est.vel.V.Z, posControl.navConfig->inav.w_z_res_v);
+    }
+
+    posEstimator.est.eph = sqrtf(MAX(posEstimator.ekf.P[X][INAV_EKF_POS][INAV_EKF_POS], posEstimator.ekf.P[Y][INAV_EKF_POS][INAV_EKF_POS]));
+    posEstimator.est.epv = sqrtf(posEstimator.ekf.P[Z][INAV_EKF_POS][INAV_EKF_POS]);
+}
+#endif
+
 /**
  * Calculate next estimate using IMU and apply corrections from reference sensors (GPS, BARO etc)
  *  Function is called at main loop rate
@@ -460,6 +793,10 @@ static void updateIMUTopic(void)
 static void updateEstimatedTopic(uint32_t currentTime)
 {
     t_fp_vector accelBiasCorr;
+
+    /* Residuals are taken against history before the estimate is moved forward to currentTime */
+    updateMeasurementResiduals();
+
     float dt = US2S(currentTime - posEstimator.est.lastUpdateTime);
     posEstimator.est.lastUpdateTime = currentTime;
 
@@ -518,10 +855,19 @@ static void updateEstimatedTopic(uint32_t currentTime)
     /* Apply GPS altitude corrections only on fixed wing aircrafts */
     bool useGpsZ = STATE(FIXED_WING) && isGPSValid;
 
-    /* Pre-calculate history index for GPS delay compensation */
-    int gpsHistoryIndex = (posEstimator.history.index - 1) - constrain(((int)posControl.navConfig->inav.gps_delay_ms / (1000 / INAV_POSITION_PUBLISH_RATE_HZ)), 0, INAV_HISTORY_BUF_SIZE - 1);
-    if (gpsHistoryIndex < 0) {
-        gpsHistoryIndex += INAV_HISTORY_BUF_SIZE;
+#if defined(NAV_POS_ESTIMATOR_EKF)
+    if (posControl.navConfig->inav.use_ekf) {
+        updateEstimatedTopicEKF(dt, isGPSValid, useGpsZ, isBaroValid, isSonarValid, isAirCushionEffectDetected);
+        updateEstimatedSurface(isSonarValid);
+        return;
+    }
+#endif
+
+    /* Uncorrected velocity error keeps turning into position error */
+    if (isGPSValid) {
+        posEstimator.gps.posResidual.V.X += posEstimator.gps.velResidual.V.X * dt;
+        posEstimator.gps.posResidual.V.Y += posEstimator.gps.velResidual.V.Y * dt;
+        posEstimator.gps.posResidual.V.Z += posEstimator.gps.velResidual.V.Z * dt;
     }
 
     /* Correct accelerometer bias */
@@ -532,20 +878,20 @@ static void updateEstimatedTopic(uint32_t currentTime)
 
         /* accelerometer bias correction for GPS */
         if (isGPSValid) {
-            accelBiasCorr.V.X -= (posEstimator.gps.pos.V.X - posEstimator.history.pos[gpsHistoryIndex].V.X) * sq(posControl.navConfig->inav.w_xy_gps_p);
-            accelBiasCorr.V.X -= (posEstimator.gps.vel.V.X - posEstimator.history.vel[gpsHistoryIndex].V.X) * posControl.navConfig->inav.w_xy_gps_v;
-            accelBiasCorr.V.Y -= (posEstimator.gps.pos.V.Y - posEstimator.history.pos[gpsHistoryIndex].V.Y) * sq(posControl.navConfig->inav.w_xy_gps_p);
-            accelBiasCorr.V.Y -= (posEstimator.gps.vel.V.Y - posEstimator.history.vel[gpsHistoryIndex].V.Y) * posControl.navConfig->inav.w_xy_gps_v;
+            accelBiasCorr.V.X -= posEstimator.gps.posResidual.V.X * sq(posControl.navConfig->inav.w_xy_gps_p);
+            accelBiasCorr.V.X -= posEstimator.gps.velResidual.V.X * posControl.navConfig->inav.w_xy_gps_v;
+            accelBiasCorr.V.Y -= posEstimator.gps.posResidual.V.Y * sq(posControl.navConfig->inav.w_xy_gps_p);
+            accelBiasCorr.V.Y -= posEstimator.gps.velResidual.V.Y * posControl.navConfig->inav.w_xy_gps_v;
 
             if (useGpsZ) {
-                accelBiasCorr.V.Z -= (posEstimator.gps.pos.V.Z - posEstimator.history.pos[gpsHistoryIndex].V.Z) * sq(posControl.navConfig->inav.w_z_gps_p);
-                accelBiasCorr.V.Z -= (posEstimator.gps.vel.V.Z - posEstimator.history.vel[gpsHistoryIndex].V.Z) * posControl.navConfig->inav.w_z_gps_v;
+                accelBiasCorr.V.Z -= posEstimator.gps.posResidual.V.Z * sq(posControl.navConfig->inav.w_z_gps_p);
+                accelBiasCorr.V.Z -= posEstimator.gps.velResidual.V.Z * posControl.navConfig->inav.w_z_gps_v;
             }
         }
 
         /* accelerometer bias correction for baro */
         if (isBaroValid && !isAirCushionEffectDetected) {
-            accelBiasCorr.V.Z -= (posEstimator.baro.alt - posEstimator.est.pos.V.Z) * sq(posControl.navConfig->inav.w_z_baro_p);
+            accelBiasCorr.V.Z -= posEstimator.baro.altResidual * sq(posControl.navConfig->inav.w_z_baro_p);
         }
 
         /* transform error vector from NEU frame to body frame */
@@ -564,10 +910,11 @@ static void updateEstimatedTopic(uint32_t currentTime)
 
 #if defined(BARO)
         if (isBaroValid) {
-            float baroError = (isAirCushionEffectDetected ? posEstimator.state.baroGroundAlt : posEstimator.baro.alt) - posEstimator.est.pos.V.Z;
+            /* Ground altitude is not a delayed measurement - compare it against current estimate */
+            float baroError = isAirCushionEffectDetected ? (posEstimator.state.baroGroundAlt - posEstimator.est.pos.V.Z) : posEstimator.baro.altResidual;
 
             /* Apply only baro correction, no sonar */
-            inavFilterCorrectPos(Z, dt, baroError, posControl.navConfig->inav.w_z_baro_p);
+            posEstimator.baro.altResidual -= inavFilterCorrectPos(Z, dt, baroError, posControl.navConfig->inav.w_z_baro_p);
 
             /* Adjust EPV */
             posEstimator.est.epv = MIN(posEstimator.est.epv, posEstimator.baro.epv);
@@ -576,8 +923,8 @@ static void updateEstimatedTopic(uint32_t currentTime)
 
         /* Apply GPS correction to altitude */
         if (useGpsZ) {
-            inavFilterCorrectPos(Z, dt, posEstimator.gps.pos.V.Z - posEstimator.history.pos[gpsHistoryIndex].V.Z, posControl.navConfig->inav.w_z_gps_p);
-            inavFilterCorrectVel(Z, dt, posEstimator.gps.vel.V.Z - posEstimator.history.vel[gpsHistoryIndex].V.Z, posControl.navConfig->inav.w_z_gps_v);
+            posEstimator.gps.posResidual.V.Z -= inavFilterCorrectPos(Z, dt, posEstimator.gps.posResidual.V.Z, posControl.navConfig->inav.w_z_gps_p);
+            posEstimator.gps.velResidual.V.Z -= inavFilterCorrectVel(Z, dt, posEstimator.gps.velResidual.V.Z, posControl.navConfig->inav.w_z_gps_v);
 
             /* Adjust EPV */
             posEstimator.est.epv = MIN(posEstimator.est.epv, posEstimator.gps.epv);
@@ -596,11 +943,11 @@ static void updateEstimatedTopic(uint32_t currentTime)
 
         /* Correct position from GPS - always if GPS is valid */
         if (isGPSValid) {
-            inavFilterCorrectPos(X, dt, posEstimator.gps.pos.V.X - posEstimator.history.pos[gpsHistoryIndex].V.X, posControl.navConfig->inav.w_xy_gps_p);
-            inavFilterCorrectPos(Y, dt, posEstimator.gps.pos.V.Y - posEstimator.history.pos[gpsHistoryIndex].V.Y, posControl.navConfig->inav.w_xy_gps_p);
+            posEstimator.gps.posResidual.V.X -= inavFilterCorrectPos(X, dt, posEstimator.gps.posResidual.V.X, posControl.navConfig->inav.w_xy_gps_p);
+            posEstimator.gps.posResidual.V.Y -= inavFilterCorrectPos(Y, dt, posEstimator.gps.posResidual.V.Y, posControl.navConfig->inav.w_xy_gps_p);
 
-            inavFilterCorrectVel(X, dt, posEstimator.gps.vel.V.X - posEstimator.history.vel[gpsHistoryIndex].V.X, posControl.navConfig->inav.w_xy_gps_v);
-            inavFilterCorrectVel(Y, dt, posEstimator.gps.vel.V.Y - posEstimator.history.vel[gpsHistoryIndex].V.Y, posControl.navConfig->inav.w_xy_gps_v);
+            posEstimator.gps.velResidual.V.X -= inavFilterCorrectVel(X, dt, posEstimator.gps.velResidual.V.X, posControl.navConfig->inav.w_xy_gps_v);
+            posEstimator.gps.velResidual.V.Y -= inavFilterCorrectVel(Y, dt, posEstimator.gps.velResidual.V.Y, posControl.navConfig->inav.w_xy_gps_v);
 
             /* Adjust EPH */
             posEstimator.est.eph = MIN(posEstimator.est.eph, posEstimator.gps.eph);
@@ -612,19 +959,7 @@ static void updateEstimatedTopic(uint32_t currentTime)
     }
 
     /* Surface offset */
-#if defined(SONAR)
-    if (isSonarValid) {
-        posEstimator.est.surface = posEstimator.sonar.alt;
-        posEstimator.est.surfaceVel = posEstimator.sonar.vel;
-    }
-    else {
-        posEstimator.est.surface = -1;
-        posEstimator.est.surfaceVel = 0;
-    }
-#else
-    posEstimator.est.surface = -1;
-    posEstimator.est.surfaceVel = 0;
-#endif
+    updateEstimatedSurface(isSonarValid);
 }
 
 /**
@@ -665,12 +1000,16 @@ static void publishEstimatedTopic(uint32_t currentTime)
         }
 
         /* Store history data */
+        posEstimator.history.time[posEstimator.history.index] = currentTime;
         posEstimator.history.pos[posEstimator.history.index] = posEstimator.est.pos;
         posEstimator.history.vel[posEstimator.history.index] = posEstimator.est.vel;
         posEstimator.history.index++;
         if (posEstimator.history.index >= INAV_HISTORY_BUF_SIZE) {
             posEstimator.history.index = 0;
         }
+        if (posEstimator.history.count < INAV_HISTORY_BUF_SIZE) {
+            posEstimator.history.count++;
+        }
     }
 }
 
@@ -693,24 +1032,48 @@ void initializePositionEstimator(void)
     posEstimator.est.epv = posControl.navConfig->inav.max_eph_epv + 0.001f;
 
     posEstimator.gps.lastUpdateTime = 0;
+    posEstimator.gps.lastFusedTime = 0;
     posEstimator.baro.lastUpdateTime = 0;
+    posEstimator.baro.lastFusedTime = 0;
+    posEstimator.baro.altResidual = 0;
     posEstimator.sonar.lastUpdateTime = 0;
 
     posEstimator.history.index = 0;
+    posEstimator.history.count = 0;
+
+    posEstimator.imu.deltaTime = 0;
+    posEstimator.hasNewSensorData = false;
 
     for (axis = 0; axis < 3; axis++) {
         posEstimator.imu.accelBias.A[axis] = 0;
+        posEstimator.imu.deltaVel.A[axis] = 0;
         posEstimator.est.pos.A[axis] = 0;
         posEstimator.est.vel.A[axis] = 0;
+        posEstimator.gps.posResidual.A[axis] = 0;
+        posEstimator.gps.velResidual.A[axis] = 0;
     }
 
     memset(&posEstimator.history.pos[0], 0, sizeof(posEstimator.history.pos));
     memset(&posEstimator.history.vel[0], 0, sizeof(posEstimator.history.vel));
+
+#if defined(NAV_POS_ESTIMATOR_EKF)
+    posEstimator.sonar.lastFusedTime = 0;
+    inavEkfReset();
+#endif
+}
+
+/**
+ * Check if estimator task should run
+ *  Estimator runs on new GPS/BARO/SONAR data, but no less often than INAV_POSITION_PUBLISH_RATE_HZ
+ */
+bool isPositionEstimatorUpdateRequired(uint32_t currentDeltaTime)
+{
+    return posEstimator.hasNewSensorData || (currentDeltaTime >= HZ2US(INAV_POSITION_PUBLISH_RATE_HZ));
 }
 
 /**
  * Update estimator
- *  Update rate: loop rate (>100Hz)
+ *  Update rate: on new sensor data, at least INAV_POSITION_PUBLISH_RATE_HZ
  */
 void updatePositionEstimator(void)
 {
@@ -723,17 +1086,10 @@ void updatePositionEstimator(void)
 
     uint32_t currentTime = micros();
 
-    /* Periodic sensor updates */
-#if defined(BARO)
-    updateBaroTopic(currentTime);
-#endif
-
-#if defined(SONAR)
-    updateSonarTopic(currentTime);
-#endif
+    posEstimator.hasNewSensorData = false;
 
-    /* Read updates from IMU, preprocess */
-    updateIMUTopic();
+    /* Acceleration accumulated by IMU topic since last update */
+    consumeAccumulatedAcceleration();
 
     /* Update estimate */
     updateEstimatedTopic(currentTime);
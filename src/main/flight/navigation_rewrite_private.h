@@ -74,6 +74,9 @@ typedef struct navigationFlags_s {
     bool isTerrainFollowEnabled;            // Does iNav use sonar for terrain following (adjusting baro altitude target according to sonar readings)
 
     bool forcedRTHActivated;
+    navGCSCommand_e gcsCommand;             // Mode requested by ground station, dropped when GCS NAV mode is disabled
+    navGCSCommandStatus_e gcsCommandStatus;
+    bool gcsTargetPending;                  // gcsTarget is set as WP #255 once the GCS command is accepted
 } navigationFlags_t;
 
 typedef struct {
@@ -256,13 +259,15 @@ typedef struct {
     uint32_t                    homeDistance;   // cm
     int32_t                     homeDirection;  // deg*100
 
-    /* Waypoint list */
-    navWaypoint_t               waypointList[NAV_MAX_WAYPOINTS];
-    bool                        waypointListValid;
-    int8_t                      waypointCount;
-
+    /* Waypoint list is kept by mission storage, only the active waypoint is copied here */
+    navWaypoint_t               activeWaypointData; // Mission entry of the active waypoint
     navWaypointPosition_t       activeWaypoint;     // Local position and initial bearing, filled on waypoint activation
-    int8_t                      activeWaypointIndex;
+    t_fp_vector                 activeWaypointTrackStart;   // Start of the track towards active waypoint (previous waypoint or position at activation)
+    int32_t                     activeWaypointTurnAngle;    // Turn from this track onto the next one at the active waypoint (deg*100), 0 if none
+    int16_t                     activeWaypointIndex;
+
+    /* Position target sent along with a ground station command */
+    navWaypoint_t               gcsTarget;
 
     /* Internals */
     int16_t                     rcAdjustment[4];
@@ -299,6 +304,7 @@ void setDesiredPositionToFarAwayTarget(int32_t yaw, int32_t distance, navSetWayp
 
 bool isWaypointReached(navWaypointPosition_t * waypoint);
 bool isWaypointMissed(navWaypointPosition_t * waypoint);
+bool isActiveWaypointTurnDue(void);
 bool isApproachingLastWaypoint(void);
 float getActiveWaypointSpeed(void);
 
@@ -342,5 +348,14 @@ void applyFixedWingNavigationController(navigationFSMStateFlags_t navStateFlags,
 
 bool isFixedWingLandingDetected(uint32_t * landingTimer);
 void calculateFixedWingInitialHoldPosition(t_fp_vector * pos);
+uint32_t calculateFixedWingTurnAnticipationDistance(int32_t turnAngle);
+
+/* Mission storage */
+void missionInit(void);
+void missionReset(void);
+bool missionAppendWaypoint(const navWaypoint_t * wpData);
+bool missionGetWaypoint(int index, navWaypoint_t * wpData);
+int missionGetWaypointCount(void);
+bool missionIsValid(void);
 
 #endif
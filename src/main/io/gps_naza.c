@@ -313,12 +313,18 @@ static bool gpsReceiveData(void)
     bool hasNewData = false;
 
     if (gpsState.gpsPort) {
-        while (serialRxBytesWaiting(gpsState.gpsPort)) {
-            uint8_t newChar = serialRead(gpsState.gpsPort);
-            if (gpsNewFrameNAZA(newChar)) {
-                gpsSol.flags.gpsHeartbeat = !gpsSol.flags.gpsHeartbeat;
-                hasNewData = true;
+        const uint8_t *rxData;
+        uint32_t rxCount;
+
+        while ((rxCount = serialGetRxSpan(gpsState.gpsPort, &rxData)) > 0) {
+            for (uint32_t i = 0; i < rxCount; i++) {
+                if (gpsNewFrameNAZA(rxData[i])) {
+                    gpsSol.flags.gpsHeartbeat = !gpsSol.flags.gpsHeartbeat;
+                    hasNewData = true;
+                }
             }
+
+            serialConsumeRx(gpsState.gpsPort, rxCount);
         }
     }
 
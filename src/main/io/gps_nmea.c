@@ -234,14 +234,20 @@ static bool gpsReceiveData(void)
     bool hasNewData = false;
 
     if (gpsState.gpsPort) {
-        while (serialRxBytesWaiting(gpsState.gpsPort)) {
-            uint8_t newChar = serialRead(gpsState.gpsPort);
-            if (gpsNewFrameNMEA(newChar)) {
-                gpsSol.flags.gpsHeartbeat = !gpsSol.flags.gpsHeartbeat;
-                gpsSol.flags.validVelNE = 0;
-                gpsSol.flags.validVelD = 0;
-                hasNewData = true;
+        const uint8_t *rxData;
+        uint32_t rxCount;
+
+        while ((rxCount = serialGetRxSpan(gpsState.gpsPort, &rxData)) > 0) {
+            for (uint32_t i = 0; i < rxCount; i++) {
+                if (gpsNewFrameNMEA(rxData[i])) {
+                    gpsSol.flags.gpsHeartbeat = !gpsSol.flags.gpsHeartbeat;
+                    gpsSol.flags.validVelNE = 0;
+                    gpsSol.flags.validVelD = 0;
+                    hasNewData = true;
+                }
             }
+
+            serialConsumeRx(gpsState.gpsPort, rxCount);
         }
     }
 
@@ -649,11 +649,19 @@ static bool gpsReceiveData(void)
     bool hasNewData = false;
 
     if (gpsState.gpsPort) {
-        while (serialRxBytesWaiting(gpsState.gpsPort) && !hasNewData) {
-            uint8_t newChar = serialRead(gpsState.gpsPort);
-            if (gpsNewFrameUBLOX(newChar)) {
-                hasNewData = true;
+        const uint8_t *rxData;
+        uint32_t rxCount;
+
+        while (!hasNewData && (rxCount = serialGetRxSpan(gpsState.gpsPort, &rxData)) > 0) {
+            uint32_t rxProcessed = 0;
+
+            while (rxProcessed < rxCount && !hasNewData) {
+                if (gpsNewFrameUBLOX(rxData[rxProcessed++])) {
+                    hasNewData = true;
+                }
             }
+
+            serialConsumeRx(gpsState.gpsPort, rxProcessed);
         }
     }
 
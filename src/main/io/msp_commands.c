@@ -0,0 +1,2024 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "build_config.h"
+#include "debug.h"
+#include "platform.h"
+
+#include "scheduler/scheduler.h"
+
+#include "common/axis.h"
+#include "common/color.h"
+#include "common/maths.h"
+#include "common/streambuf.h"
+#include "common/utils.h"
+
+#include "drivers/system.h"
+
+#include "drivers/sensor.h"
+#include "drivers/accgyro.h"
+#include "drivers/compass.h"
+#include "drivers/gpio.h"
+#include "drivers/pwm_mapping.h"
+
+#include "drivers/serial.h"
+#include "drivers/bus_i2c.h"
+#include "drivers/timer.h"
+#include "drivers/pwm_rx.h"
+
+#include "rx/rx.h"
+#include "rx/msp.h"
+
+#include "io/escservo.h"
+#include "io/rc_controls.h"
+#include "io/gps.h"
+#include "io/gimbal.h"
+#include "io/serial.h"
+#include "io/ledstrip.h"
+#include "io/flashfs.h"
+#include "io/msp_protocol.h"
+#include "io/serial_msp.h"
+#include "io/serial_cli.h"
+
+#include "telemetry/telemetry.h"
+
+#include "sensors/boardalignment.h"
+#include "sensors/sensors.h"
+#include "sensors/battery.h"
+#include "sensors/rangefinder.h"
+#include "sensors/acceleration.h"
+#include "sensors/barometer.h"
+#include "sensors/compass.h"
+#include "sensors/gyro.h"
+
+#include "flight/mixer.h"
+#include "flight/pid.h"
+#include "flight/imu.h"
+#include "flight/hil.h"
+#include "flight/failsafe.h"
+#include "flight/navigation_rewrite.h"
+
+#include "mw.h"
+
+#include "config/runtime_config.h"
+#include "config/config.h"
+#include "config/config_profile.h"
+#include "config/config_master.h"
+
+#include "version.h"
+#ifdef NAZE
+#include "hardware_revision.h"
+#endif
+
+#include "io/msp_commands.h"
+
+#ifdef USE_SERIAL_4WAY_BLHELI_INTERFACE
+#include "io/serial_4way.h"
+#endif
+
+extern uint16_t cycleTime; // FIXME dependency on mw.c
+extern uint16_t rssi; // FIXME dependency on mw.c
+extern void resetPidProfile(pidProfile_t *pidProfile);
+
+void useRcControlsConfig(modeActivationCondition_t *modeActivationConditions, escAndServoConfig_t *escAndServoConfigToUse, pidProfile_t *pidProfileToUse);
+
+static const char * const flightControllerIdentifier = INAV_IDENTIFIER; // 4 UPPER CASE alpha numeric characters that identify the flight controller.
+static const char * const boardIdentifier = TARGET_BOARD_IDENTIFIER;
+
+typedef struct box_e {
+    const uint8_t boxId;            // see boxId_e
+    const char *boxName;            // GUI-readable box name
+    const uint8_t permanentId;      //
+} box_t;
+
+// FIXME remove ;'s
+static const box_t boxes[CHECKBOX_ITEM_COUNT + 1] = {
+    { BOXARM, "ARM;", 0 },
+    { BOXANGLE, "ANGLE;", 1 },
+    { BOXHORIZON, "HORIZON;", 2 },
+    { BOXNAVALTHOLD, "NAV ALTHOLD;", 3 },   // old BARO
+    { BOXMAG, "MAG;", 5 },
+    { BOXHEADFREE, "HEADFREE;", 6 },
+    { BOXHEADADJ, "HEADADJ;", 7 },
+    { BOXCAMSTAB, "CAMSTAB;", 8 },
+    { BOXCAMTRIG, "CAMTRIG;", 9 },
+    { BOXNAVRTH, "NAV RTH;", 10 },         // old GPS HOME
+    { BOXNAVPOSHOLD, "NAV POSHOLD;", 11 },     // old GPS HOLD
+    { BOXPASSTHRU, "PASSTHRU;", 12 },
+    { BOXBEEPERON, "BEEPER;", 13 },
+    { BOXLEDMAX, "LEDMAX;", 14 },
+    { BOXLEDLOW, "LEDLOW;", 15 },
+    { BOXLLIGHTS, "LLIGHTS;", 16 },
+    { BOXGOV, "GOVERNOR;", 18 },
+    { BOXOSD, "OSD SW;", 19 },
+    { BOXTELEMETRY, "TELEMETRY;", 20 },
+    //{ BOXGTUNE, "GTUNE;", 21 },
+    { BOXSERVO1, "SERVO1;", 23 },
+    { BOXSERVO2, "SERVO2;", 24 },
+    { BOXSERVO3, "SERVO3;", 25 },
+    { BOXBLACKBOX, "BLACKBOX;", 26 },
+    { BOXFAILSAFE, "FAILSAFE;", 27 },
+    { BOXNAVWP, "NAV WP;", 28 },
+    { BOXAIRMODE, "AIR MODE;", 29 },
+    { BOXHOMERESET, "HOME RESET;", 30 },
+    { BOXGCSNAV, "GCS NAV;", 31 },
+    { BOXHEADINGLOCK, "HEADING LOCK;", 32 },
+    { BOXSURFACE, "SURFACE;", 33 },
+    { CHECKBOX_ITEM_COUNT, NULL, 0xFF }
+};
+
+// this is calculated at startup based on enabled features.
+static uint8_t activeBoxIds[CHECKBOX_ITEM_COUNT];
+// this is the number of filled indexes in above array
+static uint8_t activeBoxIdCount = 0;
+// from mixer.c
+extern int16_t motor_disarmed[MAX_SUPPORTED_MOTORS];
+
+// set by a handler which has to do something after its reply is sent
+static mspPostProcessFnPtr mspPostProcessFn;
+
+#ifdef NAV
+#define MSP_WP_BATCH_ITEM_SIZE  20      // action, lat, lon, alt, p1, p2, p3, flag
+#define MSP_WP_BATCH_REPLY_HEADER_SIZE 6    // first WP#, count, mission WP count, valid flag
+// Batch has to fit into the receive buffer on upload (first WP# + items) and into a v1 reply (255 bytes) on download
+#define MSP_WP_BATCH_MAX_UPLOAD_COUNT   ((MSP_PORT_INBUF_SIZE - 2) / MSP_WP_BATCH_ITEM_SIZE)
+#define MSP_WP_BATCH_MAX_REPLY_COUNT    ((255 - MSP_WP_BATCH_REPLY_HEADER_SIZE) / MSP_WP_BATCH_ITEM_SIZE)
+#define MSP_WP_BATCH_MAX_COUNT  (MSP_WP_BATCH_MAX_UPLOAD_COUNT < MSP_WP_BATCH_MAX_REPLY_COUNT ? MSP_WP_BATCH_MAX_UPLOAD_COUNT : MSP_WP_BATCH_MAX_REPLY_COUNT)
+#define MSP_NAV_FSM_TRACE_ITEM_SIZE 7   // time, from state, to state, event
+#endif
+
+#define MSP_DATAFLASH_READ_MAX_SIZE 128
+
+static const char pidnames[] =
+    "ROLL;"
+    "PITCH;"
+    "YAW;"
+    "ALT;"
+    "Pos;"
+    "PosR;"
+    "NavR;"
+    "LEVEL;"
+    "MAG;"
+    "VEL;";
+
+static const box_t *findBoxByActiveBoxId(uint8_t activeBoxId)
+{
+    uint8_t boxIndex;
+    const box_t *candidate;
+    for (boxIndex = 0; boxIndex < sizeof(boxes) / sizeof(box_t); boxIndex++) {
+        candidate = &boxes[boxIndex];
+        if (candidate->boxId == activeBoxId) {
+            return candidate;
+        }
+    }
+    return NULL;
+}
+
+static const box_t *findBoxByPermenantId(uint8_t permenantId)
+{
+    uint8_t boxIndex;
+    const box_t *candidate;
+    for (boxIndex = 0; boxIndex < sizeof(boxes) / sizeof(box_t); boxIndex++) {
+        candidate = &boxes[boxIndex];
+        if (candidate->permanentId == permenantId) {
+            return candidate;
+        }
+    }
+    return NULL;
+}
+
+void mspCommandsInit(void)
+{
+    // calculate used boxes based on features and fill availableBoxes[] array
+    memset(activeBoxIds, 0xFF, sizeof(activeBoxIds));
+
+    activeBoxIdCount = 0;
+    activeBoxIds[activeBoxIdCount++] = BOXARM;
+
+    if (sensors(SENSOR_ACC)) {
+        activeBoxIds[activeBoxIdCount++] = BOXANGLE;
+        activeBoxIds[activeBoxIdCount++] = BOXHORIZON;
+    }
+
+    activeBoxIds[activeBoxIdCount++] = BOXAIRMODE;
+    activeBoxIds[activeBoxIdCount++] = BOXHEADINGLOCK;
+
+    if (sensors(SENSOR_ACC) || sensors(SENSOR_MAG)) {
+        activeBoxIds[activeBoxIdCount++] = BOXMAG;
+        activeBoxIds[activeBoxIdCount++] = BOXHEADFREE;
+        activeBoxIds[activeBoxIdCount++] = BOXHEADADJ;
+    }
+
+    if (feature(FEATURE_SERVO_TILT))
+        activeBoxIds[activeBoxIdCount++] = BOXCAMSTAB;
+
+    bool isFixedWing = masterConfig.mixerMode == MIXER_FLYING_WING || masterConfig.mixerMode == MIXER_AIRPLANE || masterConfig.mixerMode == MIXER_CUSTOM_AIRPLANE;
+
+#ifdef GPS
+    if (sensors(SENSOR_BARO) || (isFixedWing && feature(FEATURE_GPS))) {
+        activeBoxIds[activeBoxIdCount++] = BOXNAVALTHOLD;
+        activeBoxIds[activeBoxIdCount++] = BOXSURFACE;
+    }
+    if ((feature(FEATURE_GPS) && sensors(SENSOR_MAG) && sensors(SENSOR_ACC)) || (isFixedWing && sensors(SENSOR_ACC) && feature(FEATURE_GPS))) {
+        activeBoxIds[activeBoxIdCount++] = BOXNAVPOSHOLD;
+        activeBoxIds[activeBoxIdCount++] = BOXNAVRTH;
+        activeBoxIds[activeBoxIdCount++] = BOXNAVWP;
+        activeBoxIds[activeBoxIdCount++] = BOXHOMERESET;
+        activeBoxIds[activeBoxIdCount++] = BOXGCSNAV;
+    }
+#endif
+
+    if (isFixedWing)
+        activeBoxIds[activeBoxIdCount++] = BOXPASSTHRU;
+
+    activeBoxIds[activeBoxIdCount++] = BOXBEEPERON;
+
+#ifdef LED_STRIP
+    if (feature(FEATURE_LED_STRIP)) {
+        activeBoxIds[activeBoxIdCount++] = BOXLEDLOW;
+    }
+#endif
+
+    activeBoxIds[activeBoxIdCount++] = BOXOSD;
+
+    if (feature(FEATURE_TELEMETRY) && masterConfig.telemetryConfig.telemetry_switch)
+        activeBoxIds[activeBoxIdCount++] = BOXTELEMETRY;
+
+#ifdef USE_SERVOS
+    if (masterConfig.mixerMode == MIXER_CUSTOM_AIRPLANE) {
+        activeBoxIds[activeBoxIdCount++] = BOXSERVO1;
+        activeBoxIds[activeBoxIdCount++] = BOXSERVO2;
+        activeBoxIds[activeBoxIdCount++] = BOXSERVO3;
+    }
+#endif
+
+#ifdef BLACKBOX
+    if (feature(FEATURE_BLACKBOX)){
+        activeBoxIds[activeBoxIdCount++] = BOXBLACKBOX;
+    }
+#endif
+
+    if (feature(FEATURE_FAILSAFE)){
+        activeBoxIds[activeBoxIdCount++] = BOXFAILSAFE;
+    }
+}
+
+#define IS_ENABLED(mask) (mask == 0 ? 0 : 1)
+
+static uint32_t packFlightModeFlags(void)
+{
+    uint32_t i, junk, tmp;
+
+    // Serialize the flags in the order we delivered them, ignoring BOXNAMES and BOXINDEXES
+    // Requires new Multiwii protocol version to fix
+    // It would be preferable to setting the enabled bits based on BOXINDEX.
+    junk = 0;
+    tmp = IS_ENABLED(FLIGHT_MODE(ANGLE_MODE)) << BOXANGLE |
+        IS_ENABLED(FLIGHT_MODE(HORIZON_MODE)) << BOXHORIZON |
+        IS_ENABLED(FLIGHT_MODE(MAG_MODE)) << BOXMAG |
+        IS_ENABLED(FLIGHT_MODE(HEADFREE_MODE)) << BOXHEADFREE |
+        IS_ENABLED(IS_RC_MODE_ACTIVE(BOXHEADADJ)) << BOXHEADADJ |
+        IS_ENABLED(IS_RC_MODE_ACTIVE(BOXCAMSTAB)) << BOXCAMSTAB |
+        IS_ENABLED(IS_RC_MODE_ACTIVE(BOXCAMTRIG)) << BOXCAMTRIG |
+        IS_ENABLED(FLIGHT_MODE(PASSTHRU_MODE)) << BOXPASSTHRU |
+        IS_ENABLED(IS_RC_MODE_ACTIVE(BOXBEEPERON)) << BOXBEEPERON |
+        IS_ENABLED(IS_RC_MODE_ACTIVE(BOXLEDMAX)) << BOXLEDMAX |
+        IS_ENABLED(IS_RC_MODE_ACTIVE(BOXLEDLOW)) << BOXLEDLOW |
+        IS_ENABLED(IS_RC_MODE_ACTIVE(BOXLLIGHTS)) << BOXLLIGHTS |
+        IS_ENABLED(IS_RC_MODE_ACTIVE(BOXGOV)) << BOXGOV |
+        IS_ENABLED(IS_RC_MODE_ACTIVE(BOXOSD)) << BOXOSD |
+        IS_ENABLED(IS_RC_MODE_ACTIVE(BOXTELEMETRY)) << BOXTELEMETRY |
+        IS_ENABLED(ARMING_FLAG(ARMED)) << BOXARM |
+        IS_ENABLED(IS_RC_MODE_ACTIVE(BOXBLACKBOX)) << BOXBLACKBOX |
+        IS_ENABLED(FLIGHT_MODE(FAILSAFE_MODE)) << BOXFAILSAFE |
+        IS_ENABLED(FLIGHT_MODE(NAV_ALTHOLD_MODE)) << BOXNAVALTHOLD |
+        IS_ENABLED(FLIGHT_MODE(NAV_POSHOLD_MODE)) << BOXNAVPOSHOLD |
+        IS_ENABLED(FLIGHT_MODE(NAV_RTH_MODE)) << BOXNAVRTH |
+        IS_ENABLED(FLIGHT_MODE(NAV_WP_MODE)) << BOXNAVWP |
+        IS_ENABLED(IS_RC_MODE_ACTIVE(BOXAIRMODE)) << BOXAIRMODE |
+        IS_ENABLED(IS_RC_MODE_ACTIVE(BOXGCSNAV)) << BOXGCSNAV |
+        IS_ENABLED(FLIGHT_MODE(HEADING_LOCK)) << BOXHEADINGLOCK |
+        IS_ENABLED(IS_RC_MODE_ACTIVE(BOXSURFACE)) << BOXSURFACE |
+        IS_ENABLED(IS_RC_MODE_ACTIVE(BOXHOMERESET)) << BOXHOMERESET;
+
+    for (i = 0; i < activeBoxIdCount; i++) {
+        int flag = (tmp & (1 << activeBoxIds[i]));
+        if (flag)
+            junk |= 1 << i;
+    }
+
+    return junk;
+}
+
+/*
+ * Outgoing (read) commands
+ */
+
+static mspResult_e mspApiVersion(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    sbufWriteU8(dst, MSP_PROTOCOL_VERSION);
+    sbufWriteU8(dst, API_VERSION_MAJOR);
+    sbufWriteU8(dst, API_VERSION_MINOR);
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspFcVariant(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    sbufWriteData(dst, flightControllerIdentifier, FLIGHT_CONTROLLER_IDENTIFIER_LENGTH);
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspFcVersion(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    sbufWriteU8(dst, FC_VERSION_MAJOR);
+    sbufWriteU8(dst, FC_VERSION_MINOR);
+    sbufWriteU8(dst, FC_VERSION_PATCH_LEVEL);
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspBoardInfo(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    sbufWriteData(dst, boardIdentifier, BOARD_IDENTIFIER_LENGTH);
+#ifdef NAZE
+    sbufWriteU16(dst, hardwareRevision);
+#else
+    sbufWriteU16(dst, 0); // No other build targets currently have hardware revision detection.
+#endif
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspBuildInfo(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    sbufWriteData(dst, buildDate, BUILD_DATE_LENGTH);
+    sbufWriteData(dst, buildTime, BUILD_TIME_LENGTH);
+    sbufWriteData(dst, shortGitRevision, GIT_SHORT_REVISION_LENGTH);
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspModeRanges(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    for (int i = 0; i < MAX_MODE_ACTIVATION_CONDITION_COUNT; i++) {
+        modeActivationCondition_t *mac = &currentProfile->modeActivationConditions[i];
+        const box_t *box = findBoxByActiveBoxId(mac->modeId);
+        sbufWriteU8(dst, box ? box->permanentId : 0);
+        sbufWriteU8(dst, mac->auxChannelIndex);
+        sbufWriteU8(dst, mac->range.startStep);
+        sbufWriteU8(dst, mac->range.endStep);
+    }
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspFeature(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    sbufWriteU32(dst, featureMask());
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspBoardAlignment(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    sbufWriteU16(dst, masterConfig.boardAlignment.rollDeciDegrees);
+    sbufWriteU16(dst, masterConfig.boardAlignment.pitchDeciDegrees);
+    sbufWriteU16(dst, masterConfig.boardAlignment.yawDeciDegrees);
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspCurrentMeterConfig(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    sbufWriteU16(dst, masterConfig.batteryConfig.currentMeterScale);
+    sbufWriteU16(dst, masterConfig.batteryConfig.currentMeterOffset);
+    sbufWriteU8(dst, masterConfig.batteryConfig.currentMeterType);
+    sbufWriteU16(dst, masterConfig.batteryConfig.batteryCapacity);
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspMixer(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    sbufWriteU8(dst, masterConfig.mixerMode);
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspRxConfig(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    sbufWriteU8(dst, masterConfig.rxConfig.serialrx_provider);
+    sbufWriteU8(dst, masterConfig.rxConfig.nrf24rx_protocol);
+    sbufWriteU16(dst, masterConfig.rxConfig.maxcheck);
+    sbufWriteU16(dst, masterConfig.rxConfig.midrc);
+    sbufWriteU16(dst, masterConfig.rxConfig.mincheck);
+    sbufWriteU8(dst, masterConfig.rxConfig.spektrum_sat_bind);
+    sbufWriteU16(dst, masterConfig.rxConfig.rx_min_usec);
+    sbufWriteU16(dst, masterConfig.rxConfig.rx_max_usec);
+    return MSP_RESULT_ACK;
+}
+
+#ifdef LED_STRIP
+static mspResult_e mspLedColors(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    for (int i = 0; i < CONFIGURABLE_COLOR_COUNT; i++) {
+        hsvColor_t *color = &masterConfig.colors[i];
+        sbufWriteU16(dst, color->h);
+        sbufWriteU8(dst, color->s);
+        sbufWriteU8(dst, color->v);
+    }
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspLedStripConfig(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    for (int i = 0; i < MAX_LED_STRIP_LENGTH; i++) {
+        ledConfig_t *ledConfig = &masterConfig.ledConfigs[i];
+        sbufWriteU16(dst, (ledConfig->flags & LED_DIRECTION_MASK) >> LED_DIRECTION_BIT_OFFSET);
+        sbufWriteU16(dst, (ledConfig->flags & LED_FUNCTION_MASK) >> LED_FUNCTION_BIT_OFFSET);
+        sbufWriteU8(dst, GET_LED_X(ledConfig));
+        sbufWriteU8(dst, GET_LED_Y(ledConfig));
+        sbufWriteU8(dst, ledConfig->color);
+    }
+    return MSP_RESULT_ACK;
+}
+#endif
+
+static mspResult_e mspRssiConfig(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    sbufWriteU8(dst, masterConfig.rxConfig.rssi_channel);
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspAdjustmentRanges(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    for (int i = 0; i < MAX_ADJUSTMENT_RANGE_COUNT; i++) {
+        adjustmentRange_t *adjRange = &currentProfile->adjustmentRanges[i];
+        sbufWriteU8(dst, adjRange->adjustmentIndex);
+        sbufWriteU8(dst, adjRange->auxChannelIndex);
+        sbufWriteU8(dst, adjRange->range.startStep);
+        sbufWriteU8(dst, adjRange->range.endStep);
+        sbufWriteU8(dst, adjRange->adjustmentFunction);
+        sbufWriteU8(dst, adjRange->auxSwitchChannelIndex);
+    }
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspCfSerialConfig(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    for (int i = 0; i < SERIAL_PORT_COUNT; i++) {
+        if (!serialIsPortAvailable(masterConfig.serialConfig.portConfigs[i].identifier)) {
+            continue;
+        };
+        sbufWriteU8(dst, masterConfig.serialConfig.portConfigs[i].identifier);
+        sbufWriteU16(dst, masterConfig.serialConfig.portConfigs[i].functionMask);
+        sbufWriteU8(dst, masterConfig.serialConfig.portConfigs[i].msp_baudrateIndex);
+        sbufWriteU8(dst, masterConfig.serialConfig.portConfigs[i].gps_baudrateIndex);
+        sbufWriteU8(dst, masterConfig.serialConfig.portConfigs[i].telemetry_baudrateIndex);
+        sbufWriteU8(dst, masterConfig.serialConfig.portConfigs[i].blackbox_baudrateIndex);
+    }
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspVoltageMeterConfig(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    sbufWriteU8(dst, masterConfig.batteryConfig.vbatscale);
+    sbufWriteU8(dst, masterConfig.batteryConfig.vbatmincellvoltage);
+    sbufWriteU8(dst, masterConfig.batteryConfig.vbatmaxcellvoltage);
+    sbufWriteU8(dst, masterConfig.batteryConfig.vbatwarningcellvoltage);
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspSonarAltitude(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+#if defined(SONAR)
+    sbufWriteU32(dst, rangefinderGetLatestAltitude());
+#else
+    sbufWriteU32(dst, 0);
+#endif
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspPidController(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    sbufWriteU8(dst, 2);      // FIXME: Report as LuxFloat
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspArmingConfig(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    sbufWriteU8(dst, masterConfig.auto_disarm_delay);
+    sbufWriteU8(dst, masterConfig.disarm_kill_switch);
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspRxMap(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    sbufWriteData(dst, masterConfig.rxConfig.rcmap, MAX_MAPPABLE_RX_INPUTS);
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspBfConfig(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    sbufWriteU8(dst, masterConfig.mixerMode);
+
+    sbufWriteU32(dst, featureMask());
+
+    sbufWriteU8(dst, masterConfig.rxConfig.serialrx_provider);
+
+    sbufWriteU16(dst, masterConfig.boardAlignment.rollDeciDegrees);
+    sbufWriteU16(dst, masterConfig.boardAlignment.pitchDeciDegrees);
+    sbufWriteU16(dst, masterConfig.boardAlignment.yawDeciDegrees);
+
+    sbufWriteU16(dst, masterConfig.batteryConfig.currentMeterScale);
+    sbufWriteU16(dst, masterConfig.batteryConfig.currentMeterOffset);
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspBfBuildInfo(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    sbufWriteData(dst, buildDate, 11); // MMM DD YYYY as ascii, MMM = Jan/Feb... etc
+    sbufWriteU32(dst, 0); // future exp
+    sbufWriteU32(dst, 0); // future exp
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspDataflashSummary(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+#ifdef USE_FLASHFS
+    const flashGeometry_t *geometry = flashfsGetGeometry();
+    sbufWriteU8(dst, flashfsIsReady() ? 1 : 0);
+    sbufWriteU32(dst, geometry->sectors);
+    sbufWriteU32(dst, geometry->totalSize);
+    sbufWriteU32(dst, flashfsGetOffset()); // Effectively the current number of bytes stored on the volume
+#else
+    sbufWriteU8(dst, 0);
+    sbufWriteU32(dst, 0);
+    sbufWriteU32(dst, 0);
+    sbufWriteU32(dst, 0);
+#endif
+    return MSP_RESULT_ACK;
+}
+
+#ifdef USE_FLASHFS
+static mspResult_e mspDataflashRead(sbuf_t *src, sbuf_t *dst)
+{
+    const uint32_t readAddress = sbufReadU32(src);
+
+    sbufWriteU32(dst, readAddress);
+
+    // bytesRead will be lower than that requested if we reach end of volume
+    const int size = MIN(MSP_DATAFLASH_READ_MAX_SIZE, sbufBytesRemaining(dst));
+    const int bytesRead = flashfsReadAbs(readAddress, sbufPtr(dst), size);
+    sbufAdvance(dst, bytesRead);
+    return MSP_RESULT_ACK;
+}
+#endif
+
+static mspResult_e mspLoopTime(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    sbufWriteU16(dst, masterConfig.looptime);
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspFailsafeConfig(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    sbufWriteU8(dst, masterConfig.failsafeConfig.failsafe_delay);
+    sbufWriteU8(dst, masterConfig.failsafeConfig.failsafe_off_delay);
+    sbufWriteU16(dst, masterConfig.failsafeConfig.failsafe_throttle);
+    sbufWriteU8(dst, masterConfig.failsafeConfig.failsafe_kill_switch);
+    sbufWriteU16(dst, masterConfig.failsafeConfig.failsafe_throttle_low_delay);
+    sbufWriteU8(dst, masterConfig.failsafeConfig.failsafe_procedure);
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspRxFailConfig(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    for (int i = 0; i < rxRuntimeConfig.channelCount; i++) {
+        sbufWriteU8(dst, masterConfig.rxConfig.failsafe_channel_configurations[i].mode);
+        sbufWriteU16(dst, RXFAIL_STEP_TO_CHANNEL_VALUE(masterConfig.rxConfig.failsafe_channel_configurations[i].step));
+    }
+    return MSP_RESULT_ACK;
+}
+
+// DEPRECATED - Use MSP_API_VERSION
+static mspResult_e mspIdent(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    sbufWriteU8(dst, MW_VERSION);
+    sbufWriteU8(dst, masterConfig.mixerMode);
+    sbufWriteU8(dst, MSP_PROTOCOL_VERSION);
+    sbufWriteU32(dst, CAP_PLATFORM_32BIT | CAP_DYNBALANCE | CAP_FLAPS | CAP_NAVCAP | CAP_EXTAUX); // "capability"
+    return MSP_RESULT_ACK;
+}
+
+static void serializeStatus(sbuf_t *dst)
+{
+    sbufWriteU16(dst, cycleTime);
+#ifdef USE_I2C
+    sbufWriteU16(dst, i2cGetErrorCounter());
+#else
+    sbufWriteU16(dst, 0);
+#endif
+    sbufWriteU16(dst, sensors(SENSOR_ACC) | sensors(SENSOR_BARO) << 1 | sensors(SENSOR_MAG) << 2 | sensors(SENSOR_GPS) << 3 | sensors(SENSOR_SONAR) << 4);
+    sbufWriteU32(dst, packFlightModeFlags());
+    sbufWriteU8(dst, masterConfig.current_profile_index);
+}
+
+static mspResult_e mspStatus(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    serializeStatus(dst);
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspStatusEx(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    serializeStatus(dst);
+    sbufWriteU16(dst, averageSystemLoadPercent);
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspRawImu(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+
+    // Hack scale due to choice of units for sensor data in multiwii
+    const uint8_t scale = (acc.acc_1G > 1024) ? 8 : 1;
+
+    for (int i = 0; i < 3; i++)
+        sbufWriteU16(dst, accADC[i] / scale);
+    for (int i = 0; i < 3; i++)
+        sbufWriteU16(dst, gyroADC[i]);
+    for (int i = 0; i < 3; i++)
+        sbufWriteU16(dst, magADC[i]);
+    return MSP_RESULT_ACK;
+}
+
+#ifdef USE_SERVOS
+static mspResult_e mspServo(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    sbufWriteData(dst, &servo, MAX_SUPPORTED_SERVOS * 2);
+    return MSP_RESULT_ACK;
+}
+#endif
+
+static mspResult_e mspMotor(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    for (unsigned i = 0; i < 8; i++) {
+        sbufWriteU16(dst, i < MAX_SUPPORTED_MOTORS ? motor[i] : 0);
+    }
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspRc(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    for (int i = 0; i < rxRuntimeConfig.channelCount; i++)
+        sbufWriteU16(dst, rcData[i]);
+    return MSP_RESULT_ACK;
+}
+
+#ifdef GPS
+static mspResult_e mspRawGps(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    sbufWriteU8(dst, gpsSol.fixType);
+    sbufWriteU8(dst, gpsSol.numSat);
+    sbufWriteU32(dst, gpsSol.llh.lat);
+    sbufWriteU32(dst, gpsSol.llh.lon);
+    sbufWriteU16(dst, gpsSol.llh.alt/100); // meters
+    sbufWriteU16(dst, gpsSol.groundSpeed);
+    sbufWriteU16(dst, gpsSol.groundCourse);
+    sbufWriteU16(dst, gpsSol.hdop);
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspCompGps(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    sbufWriteU16(dst, GPS_distanceToHome);
+    sbufWriteU16(dst, GPS_directionToHome);
+    sbufWriteU8(dst, gpsSol.flags.gpsHeartbeat ? 1 : 0);
+    return MSP_RESULT_ACK;
+}
+#endif
+
+static mspResult_e mspAttitude(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    sbufWriteU16(dst, attitude.values.roll);
+    sbufWriteU16(dst, attitude.values.pitch);
+    sbufWriteU16(dst, DECIDEGREES_TO_DEGREES(attitude.values.yaw));
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspAltitude(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+#if defined(NAV)
+    sbufWriteU32(dst, (uint32_t)lrintf(getEstimatedActualPosition(Z)));
+    sbufWriteU16(dst, (uint32_t)lrintf(getEstimatedActualVelocity(Z)));
+#else
+    sbufWriteU32(dst, 0);
+    sbufWriteU16(dst, 0);
+#endif
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspAnalog(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    sbufWriteU8(dst, (uint8_t)constrain(vbat, 0, 255));
+    sbufWriteU16(dst, (uint16_t)constrain(mAhDrawn, 0, 0xFFFF)); // milliamp hours drawn from battery
+    sbufWriteU16(dst, rssi);
+    if(masterConfig.batteryConfig.multiwiiCurrentMeterOutput) {
+        sbufWriteU16(dst, (uint16_t)constrain(amperage * 10, 0, 0xFFFF)); // send amperage in 0.001 A steps. Negative range is truncated to zero
+    } else
+        sbufWriteU16(dst, (int16_t)constrain(amperage, -0x8000, 0x7FFF)); // send amperage in 0.01 A steps, range is -320A to 320A
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspRcTuning(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    sbufWriteU8(dst, 100); //rcRate8 kept for compatibity reasons, this setting is no longer used
+    sbufWriteU8(dst, currentControlRateProfile->rcExpo8);
+    for (int i = 0 ; i < 3; i++) {
+        sbufWriteU8(dst, currentControlRateProfile->rates[i]); // R,P,Y see flight_dynamics_index_t
+    }
+    sbufWriteU8(dst, currentControlRateProfile->dynThrPID);
+    sbufWriteU8(dst, currentControlRateProfile->thrMid8);
+    sbufWriteU8(dst, currentControlRateProfile->thrExpo8);
+    sbufWriteU16(dst, currentControlRateProfile->tpa_breakpoint);
+    sbufWriteU8(dst, currentControlRateProfile->rcYawExpo8);
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspPid(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    for (int i = 0; i < PID_ITEM_COUNT; i++) {
+        sbufWriteU8(dst, currentProfile->pidProfile.P8[i]);
+        sbufWriteU8(dst, currentProfile->pidProfile.I8[i]);
+        sbufWriteU8(dst, currentProfile->pidProfile.D8[i]);
+    }
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspMisc(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    sbufWriteU16(dst, masterConfig.rxConfig.midrc);
+
+    sbufWriteU16(dst, masterConfig.escAndServoConfig.minthrottle);
+    sbufWriteU16(dst, masterConfig.escAndServoConfig.maxthrottle);
+    sbufWriteU16(dst, masterConfig.escAndServoConfig.mincommand);
+
+    sbufWriteU16(dst, masterConfig.failsafeConfig.failsafe_throttle);
+
+#ifdef GPS
+    sbufWriteU8(dst, masterConfig.gpsConfig.provider); // gps_type
+    sbufWriteU8(dst, 0); // TODO gps_baudrate (an index, cleanflight uses a uint32_t
+    sbufWriteU8(dst, masterConfig.gpsConfig.sbasMode); // gps_ubx_sbas
+#else
+    sbufWriteU8(dst, 0); // gps_type
+    sbufWriteU8(dst, 0); // TODO gps_baudrate (an index, cleanflight uses a uint32_t
+    sbufWriteU8(dst, 0); // gps_ubx_sbas
+#endif
+    sbufWriteU8(dst, masterConfig.batteryConfig.multiwiiCurrentMeterOutput);
+    sbufWriteU8(dst, masterConfig.rxConfig.rssi_channel);
+    sbufWriteU8(dst, 0);
+
+    sbufWriteU16(dst, currentProfile->mag_declination / 10);
+
+    sbufWriteU8(dst, masterConfig.batteryConfig.vbatscale);
+    sbufWriteU8(dst, masterConfig.batteryConfig.vbatmincellvoltage);
+    sbufWriteU8(dst, masterConfig.batteryConfig.vbatmaxcellvoltage);
+    sbufWriteU8(dst, masterConfig.batteryConfig.vbatwarningcellvoltage);
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspMotorPins(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    // FIXME This is hardcoded and should not be.
+    for (int i = 0; i < 8; i++)
+        sbufWriteU8(dst, i + 1);
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspBoxNames(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    for (int i = 0; i < activeBoxIdCount; i++) {
+        const box_t *box = findBoxByActiveBoxId(activeBoxIds[i]);
+        if (box) {
+            sbufWriteString(dst, box->boxName);
+        }
+    }
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspPidNames(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    sbufWriteString(dst, pidnames);
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspBoxIds(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    for (int i = 0; i < activeBoxIdCount; i++) {
+        const box_t *box = findBoxByActiveBoxId(activeBoxIds[i]);
+        if (box) {
+            sbufWriteU8(dst, box->permanentId);
+        }
+    }
+    return MSP_RESULT_ACK;
+}
+
+#ifdef USE_SERVOS
+static mspResult_e mspServoConfigurations(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    for (int i = 0; i < MAX_SUPPORTED_SERVOS; i++) {
+        sbufWriteU16(dst, currentProfile->servoConf[i].min);
+        sbufWriteU16(dst, currentProfile->servoConf[i].max);
+        sbufWriteU16(dst, currentProfile->servoConf[i].middle);
+        sbufWriteU8(dst, currentProfile->servoConf[i].rate);
+        sbufWriteU8(dst, currentProfile->servoConf[i].angleAtMin);
+        sbufWriteU8(dst, currentProfile->servoConf[i].angleAtMax);
+        sbufWriteU8(dst, currentProfile->servoConf[i].forwardFromChannel);
+        sbufWriteU32(dst, currentProfile->servoConf[i].reversedSources);
+    }
+    return MSP_RESULT_ACK;
+}
+#endif
+
+#if defined(GPS) && defined(NAV)
+static mspResult_e mspWp(sbuf_t *src, sbuf_t *dst)
+{
+    navWaypoint_t msp_wp;
+    const int8_t msp_wp_no = sbufReadU8(src);    // get the wp number
+
+    getWaypoint(msp_wp_no, &msp_wp);
+    sbufWriteU8(dst, msp_wp_no);   // wp_no
+    sbufWriteU8(dst, msp_wp.action);  // action (WAYPOINT)
+    sbufWriteU32(dst, msp_wp.lat);    // lat
+    sbufWriteU32(dst, msp_wp.lon);    // lon
+    sbufWriteU32(dst, msp_wp.alt);    // altitude (cm)
+    sbufWriteU16(dst, msp_wp.p1);     // P1
+    sbufWriteU16(dst, msp_wp.p2);     // P2
+    sbufWriteU16(dst, msp_wp.p3);     // P3
+    sbufWriteU8(dst, msp_wp.flag);    // flags
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspNavStatus(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    sbufWriteU8(dst, NAV_Status.mode);
+    sbufWriteU8(dst, NAV_Status.state);
+    sbufWriteU8(dst, NAV_Status.activeWpAction);
+    sbufWriteU8(dst, MIN(NAV_Status.activeWpNumber, 255));   // legacy 8-bit field
+    sbufWriteU8(dst, NAV_Status.error);
+    //sbufWriteU16(dst, (int16_t)(target_bearing/100));
+    sbufWriteU16(dst, getMagHoldHeading());
+    return MSP_RESULT_ACK;
+}
+#endif
+
+static mspResult_e msp3D(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    sbufWriteU16(dst, masterConfig.flight3DConfig.deadband3d_low);
+    sbufWriteU16(dst, masterConfig.flight3DConfig.deadband3d_high);
+    sbufWriteU16(dst, masterConfig.flight3DConfig.neutral3d);
+    sbufWriteU16(dst, masterConfig.flight3DConfig.deadband3d_throttle);
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspRcDeadband(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    sbufWriteU8(dst, currentProfile->rcControlsConfig.deadband);
+    sbufWriteU8(dst, currentProfile->rcControlsConfig.yaw_deadband);
+    sbufWriteU8(dst, currentProfile->rcControlsConfig.alt_hold_deadband);
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspSensorAlignment(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    sbufWriteU8(dst, masterConfig.sensorAlignmentConfig.gyro_align);
+    sbufWriteU8(dst, masterConfig.sensorAlignmentConfig.acc_align);
+    sbufWriteU8(dst, masterConfig.sensorAlignmentConfig.mag_align);
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspUid(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    sbufWriteU32(dst, U_ID_0);
+    sbufWriteU32(dst, U_ID_1);
+    sbufWriteU32(dst, U_ID_2);
+    return MSP_RESULT_ACK;
+}
+
+#ifdef GPS
+static mspResult_e mspGpsSvInfo(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    /* Compatibility stub - return zero SVs */
+    sbufWriteU8(dst, 1);
+
+    // HDOP
+    sbufWriteU8(dst, 0);
+    sbufWriteU8(dst, 0);
+    sbufWriteU8(dst, gpsSol.hdop / 100);
+    sbufWriteU8(dst, gpsSol.hdop / 100);
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspGpsStatistics(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    sbufWriteU16(dst, gpsStats.lastMessageDt);
+    sbufWriteU32(dst, gpsStats.errors);
+    sbufWriteU32(dst, gpsStats.timeouts);
+    sbufWriteU32(dst, gpsStats.packetCount);
+    sbufWriteU16(dst, gpsSol.hdop);
+    sbufWriteU16(dst, gpsSol.eph);
+    sbufWriteU16(dst, gpsSol.epv);
+    return MSP_RESULT_ACK;
+}
+
+#ifdef NAV
+static mspResult_e mspWpBatch(sbuf_t *src, sbuf_t *dst)
+{
+    navWaypoint_t msp_wp;
+    const uint16_t firstWpNumber = sbufReadU16(src);
+    uint8_t wpCount = MIN(sbufReadU8(src), MSP_WP_BATCH_MAX_COUNT);
+
+    // Mission waypoints are numbered from 1, WP #0 (home) is only available through MSP_WP
+    if (firstWpNumber == 0) {
+        return MSP_RESULT_ERROR;
+    }
+
+    wpCount = constrain(getWaypointCount() - firstWpNumber + 1, 0, wpCount);
+
+    sbufWriteU16(dst, firstWpNumber);
+    sbufWriteU8(dst, wpCount);
+    sbufWriteU16(dst, getWaypointCount());
+    sbufWriteU8(dst, isWaypointListValid() ? 1 : 0);
+    for (int i = 0; i < wpCount; i++) {
+        getMissionWaypoint(firstWpNumber + i, &msp_wp);
+        sbufWriteU8(dst, msp_wp.action);
+        sbufWriteU32(dst, msp_wp.lat);
+        sbufWriteU32(dst, msp_wp.lon);
+        sbufWriteU32(dst, msp_wp.alt);
+        sbufWriteU16(dst, msp_wp.p1);
+        sbufWriteU16(dst, msp_wp.p2);
+        sbufWriteU16(dst, msp_wp.p3);
+        sbufWriteU8(dst, msp_wp.flag);
+    }
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspNavFsmTrace(sbuf_t *src, sbuf_t *dst)
+{
+    navFSMTransition_t transition;
+    const uint32_t transitionCount = navGetFSMTransitionCount();
+    uint32_t firstSequence = transitionCount - MIN(transitionCount, (uint32_t)NAV_FSM_TRACE_SIZE);
+
+    // Client may ask only for transitions it hasn't seen yet, older ones than the buffer keeps are lost.
+    // Sequence numbers are sent as their low 16 bits.
+    if (sbufBytesRemaining(src) >= 2) {
+        const uint16_t requestedAge = (uint16_t)transitionCount - sbufReadU16(src);
+        if (requestedAge <= transitionCount - firstSequence) {
+            firstSequence = transitionCount - requestedAge;
+        }
+    }
+
+    const uint8_t itemCount = transitionCount - firstSequence;
+
+    sbufWriteU16(dst, transitionCount);
+    sbufWriteU8(dst, itemCount);
+    for (int i = 0; i < itemCount; i++) {
+        navGetFSMTransition(firstSequence + i, &transition);
+        sbufWriteU32(dst, transition.timeMs);
+        sbufWriteU8(dst, transition.fromState);
+        sbufWriteU8(dst, transition.toState);
+        sbufWriteU8(dst, transition.event);
+    }
+    return MSP_RESULT_ACK;
+}
+#endif
+#endif
+
+#ifdef USE_CLI
+static mspResult_e mspSettings(sbuf_t *src, sbuf_t *dst)
+{
+    const uint16_t firstIndex = (sbufBytesRemaining(src) >= 2) ? sbufReadU16(src) : 0;
+
+    sbufWriteU16(dst, cliSettingsCount());
+    sbufWriteU16(dst, firstIndex);
+    uint8_t *nextIndexPtr = sbufPtr(dst);
+    sbufWriteU16(dst, 0);
+
+    // client continues from the next index until it reaches the count
+    const uint16_t nextIndex = cliSettingsExport(dst, firstIndex);
+    nextIndexPtr[0] = nextIndex & 0xFF;
+    nextIndexPtr[1] = nextIndex >> 8;
+    return MSP_RESULT_ACK;
+}
+#endif
+
+#ifdef USE_SERVOS
+static mspResult_e mspServoMixRules(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    for (int i = 0; i < MAX_SERVO_RULES; i++) {
+        sbufWriteU8(dst, masterConfig.customServoMixer[i].targetChannel);
+        sbufWriteU8(dst, masterConfig.customServoMixer[i].inputSource);
+        sbufWriteU8(dst, masterConfig.customServoMixer[i].rate);
+        sbufWriteU8(dst, masterConfig.customServoMixer[i].speed);
+        sbufWriteU8(dst, masterConfig.customServoMixer[i].min);
+        sbufWriteU8(dst, masterConfig.customServoMixer[i].max);
+        sbufWriteU8(dst, masterConfig.customServoMixer[i].box);
+    }
+    return MSP_RESULT_ACK;
+}
+#endif
+
+static mspResult_e mspDebug(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    // output some useful QA statistics
+    // debug[x] = ((hse_value / 1000000) * 1000) + (SystemCoreClock / 1000000);         // XX0YY [crystal clock : core clock]
+
+    for (int i = 0; i < DEBUG16_VALUE_COUNT; i++)
+        sbufWriteU16(dst, debug[i]);      // 4 variables are here for general monitoring purpose
+    return MSP_RESULT_ACK;
+}
+
+#ifdef HIL
+static mspResult_e mspHilState(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    sbufWriteU16(dst, hilToSIM.pidCommand[ROLL]);
+    sbufWriteU16(dst, hilToSIM.pidCommand[PITCH]);
+    sbufWriteU16(dst, hilToSIM.pidCommand[YAW]);
+    sbufWriteU16(dst, hilToSIM.pidCommand[THROTTLE]);
+    return MSP_RESULT_ACK;
+}
+#endif
+
+/*
+ * Incoming (write) commands
+ */
+
+static mspResult_e mspSetModeRange(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(dst);
+    const uint8_t index = sbufReadU8(src);
+    if (index >= MAX_MODE_ACTIVATION_CONDITION_COUNT) {
+        return MSP_RESULT_ERROR;
+    }
+
+    const box_t *box = findBoxByPermenantId(sbufReadU8(src));
+    if (!box) {
+        return MSP_RESULT_ERROR;
+    }
+
+    modeActivationCondition_t *mac = &currentProfile->modeActivationConditions[index];
+    mac->modeId = box->boxId;
+    mac->auxChannelIndex = sbufReadU8(src);
+    mac->range.startStep = sbufReadU8(src);
+    mac->range.endStep = sbufReadU8(src);
+
+    useRcControlsConfig(currentProfile->modeActivationConditions, &masterConfig.escAndServoConfig, &currentProfile->pidProfile);
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspSetFeature(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(dst);
+    featureClearAll();
+    featureSet(sbufReadU32(src)); // features bitmap
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspSetBoardAlignment(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(dst);
+    masterConfig.boardAlignment.rollDeciDegrees = sbufReadU16(src);
+    masterConfig.boardAlignment.pitchDeciDegrees = sbufReadU16(src);
+    masterConfig.boardAlignment.yawDeciDegrees = sbufReadU16(src);
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspSetCurrentMeterConfig(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(dst);
+    masterConfig.batteryConfig.currentMeterScale = sbufReadU16(src);
+    masterConfig.batteryConfig.currentMeterOffset = sbufReadU16(src);
+    masterConfig.batteryConfig.currentMeterType = sbufReadU8(src);
+    masterConfig.batteryConfig.batteryCapacity = sbufReadU16(src);
+    return MSP_RESULT_ACK;
+}
+
+#ifndef USE_QUAD_MIXER_ONLY
+static mspResult_e mspSetMixer(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(dst);
+    masterConfig.mixerMode = sbufReadU8(src);
+    return MSP_RESULT_ACK;
+}
+#endif
+
+static mspResult_e mspSetRxConfig(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(dst);
+    masterConfig.rxConfig.serialrx_provider = sbufReadU8(src);
+    masterConfig.rxConfig.nrf24rx_protocol = sbufReadU8(src);
+    masterConfig.rxConfig.maxcheck = sbufReadU16(src);
+    masterConfig.rxConfig.midrc = sbufReadU16(src);
+    masterConfig.rxConfig.mincheck = sbufReadU16(src);
+    masterConfig.rxConfig.spektrum_sat_bind = sbufReadU8(src);
+    if (sbufBytesRemaining(src) >= 4) {
+        masterConfig.rxConfig.rx_min_usec = sbufReadU16(src);
+        masterConfig.rxConfig.rx_max_usec = sbufReadU16(src);
+    }
+    return MSP_RESULT_ACK;
+}
+
+#ifdef LED_STRIP
+static mspResult_e mspSetLedColors(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(dst);
+    for (int i = 0; i < CONFIGURABLE_COLOR_COUNT; i++) {
+        hsvColor_t *color = &masterConfig.colors[i];
+        color->h = sbufReadU16(src);
+        color->s = sbufReadU8(src);
+        color->v = sbufReadU8(src);
+    }
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspSetLedStripConfig(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(dst);
+    const uint8_t index = sbufReadU8(src);
+    if (index >= MAX_LED_STRIP_LENGTH) {
+        return MSP_RESULT_ERROR;
+    }
+
+    ledConfig_t *ledConfig = &masterConfig.ledConfigs[index];
+    uint16_t mask;
+    // currently we're storing directions and functions in a uint16 (flags)
+    // the msp uses 2 x uint16_t to cater for future expansion
+    mask = sbufReadU16(src);
+    ledConfig->flags = (mask << LED_DIRECTION_BIT_OFFSET) & LED_DIRECTION_MASK;
+
+    mask = sbufReadU16(src);
+    ledConfig->flags |= (mask << LED_FUNCTION_BIT_OFFSET) & LED_FUNCTION_MASK;
+
+    mask = sbufReadU8(src);
+    ledConfig->xy = CALCULATE_LED_X(mask);
+
+    mask = sbufReadU8(src);
+    ledConfig->xy |= CALCULATE_LED_Y(mask);
+
+    ledConfig->color = sbufReadU8(src);
+
+    reevalulateLedConfig();
+    return MSP_RESULT_ACK;
+}
+#endif
+
+static mspResult_e mspSetRssiConfig(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(dst);
+    masterConfig.rxConfig.rssi_channel = sbufReadU8(src);
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspSetAdjustmentRange(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(dst);
+    const uint8_t index = sbufReadU8(src);
+    if (index >= MAX_ADJUSTMENT_RANGE_COUNT) {
+        return MSP_RESULT_ERROR;
+    }
+
+    const uint8_t adjustmentIndex = sbufReadU8(src);
+    if (adjustmentIndex >= MAX_SIMULTANEOUS_ADJUSTMENT_COUNT) {
+        return MSP_RESULT_ERROR;
+    }
+
+    adjustmentRange_t *adjRange = &currentProfile->adjustmentRanges[index];
+    adjRange->adjustmentIndex = adjustmentIndex;
+    adjRange->auxChannelIndex = sbufReadU8(src);
+    adjRange->range.startStep = sbufReadU8(src);
+    adjRange->range.endStep = sbufReadU8(src);
+    adjRange->adjustmentFunction = sbufReadU8(src);
+    adjRange->auxSwitchChannelIndex = sbufReadU8(src);
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspSetCfSerialConfig(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(dst);
+    const uint8_t portConfigSize = sizeof(uint8_t) + sizeof(uint16_t) + (sizeof(uint8_t) * 4);
+
+    if (sbufBytesRemaining(src) % portConfigSize != 0) {
+        return MSP_RESULT_ERROR;
+    }
+
+    while (sbufBytesRemaining(src) > 0) {
+        const uint8_t identifier = sbufReadU8(src);
+
+        serialPortConfig_t *portConfig = serialFindPortConfiguration(identifier);
+        if (!portConfig) {
+            return MSP_RESULT_ERROR;
+        }
+
+        portConfig->identifier = identifier;
+        portConfig->functionMask = sbufReadU16(src);
+        portConfig->msp_baudrateIndex = sbufReadU8(src);
+        portConfig->gps_baudrateIndex = sbufReadU8(src);
+        portConfig->telemetry_baudrateIndex = sbufReadU8(src);
+        portConfig->blackbox_baudrateIndex = sbufReadU8(src);
+    }
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspSetVoltageMeterConfig(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(dst);
+    masterConfig.batteryConfig.vbatscale = sbufReadU8(src);           // actual vbatscale as intended
+    masterConfig.batteryConfig.vbatmincellvoltage = sbufReadU8(src);  // vbatlevel_warn1 in MWC2.3 GUI
+    masterConfig.batteryConfig.vbatmaxcellvoltage = sbufReadU8(src);  // vbatlevel_warn2 in MWC2.3 GUI
+    masterConfig.batteryConfig.vbatwarningcellvoltage = sbufReadU8(src);  // vbatlevel when buzzer starts to alert
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspSetPidController(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    UNUSED(dst);
+    // FIXME: Do nothing
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspSetArmingConfig(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(dst);
+    masterConfig.auto_disarm_delay = sbufReadU8(src);
+    masterConfig.disarm_kill_switch = sbufReadU8(src);
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspSetRxMap(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(dst);
+    for (int i = 0; i < MAX_MAPPABLE_RX_INPUTS; i++) {
+        masterConfig.rxConfig.rcmap[i] = sbufReadU8(src);
+    }
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspSetBfConfig(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(dst);
+#ifdef USE_QUAD_MIXER_ONLY
+    sbufReadU8(src); // mixerMode ignored
+#else
+    masterConfig.mixerMode = sbufReadU8(src); // mixerMode
+#endif
+
+    featureClearAll();
+    featureSet(sbufReadU32(src)); // features bitmap
+
+    masterConfig.rxConfig.serialrx_provider = sbufReadU8(src); // serialrx_type
+
+    masterConfig.boardAlignment.rollDeciDegrees = sbufReadU16(src); // board_align_roll
+    masterConfig.boardAlignment.pitchDeciDegrees = sbufReadU16(src); // board_align_pitch
+    masterConfig.boardAlignment.yawDeciDegrees = sbufReadU16(src); // board_align_yaw
+
+    masterConfig.batteryConfig.currentMeterScale = sbufReadU16(src);
+    masterConfig.batteryConfig.currentMeterOffset = sbufReadU16(src);
+    return MSP_RESULT_ACK;
+}
+
+static void mspRebootFn(serialPort_t *port)
+{
+    waitForSerialPortToFinishTransmitting(port);
+    stopMotors();
+    handleOneshotFeatureChangeOnRestart();
+    systemReset();
+}
+
+static mspResult_e mspReboot(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    UNUSED(dst);
+    mspPostProcessFn = mspRebootFn;
+    return MSP_RESULT_ACK;
+}
+
+#ifdef USE_FLASHFS
+static mspResult_e mspDataflashErase(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    UNUSED(dst);
+    flashfsEraseCompletely();
+    return MSP_RESULT_ACK;
+}
+#endif
+
+static mspResult_e mspSetLoopTime(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(dst);
+    masterConfig.looptime = sbufReadU16(src);
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspSetFailsafeConfig(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(dst);
+    masterConfig.failsafeConfig.failsafe_delay = sbufReadU8(src);
+    masterConfig.failsafeConfig.failsafe_off_delay = sbufReadU8(src);
+    masterConfig.failsafeConfig.failsafe_throttle = sbufReadU16(src);
+    masterConfig.failsafeConfig.failsafe_kill_switch = sbufReadU8(src);
+    masterConfig.failsafeConfig.failsafe_throttle_low_delay = sbufReadU16(src);
+    masterConfig.failsafeConfig.failsafe_procedure = sbufReadU8(src);
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspSetRxFailConfig(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(dst);
+    const uint8_t channel = sbufReadU8(src);
+    if (channel >= MAX_SUPPORTED_RC_CHANNEL_COUNT) {
+        return MSP_RESULT_ERROR;
+    }
+
+    masterConfig.rxConfig.failsafe_channel_configurations[channel].mode = sbufReadU8(src);
+    masterConfig.rxConfig.failsafe_channel_configurations[channel].step = CHANNEL_VALUE_TO_RXFAIL_STEP(sbufReadU16(src));
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspSetRawRc(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(dst);
+#ifndef SKIP_RX_MSP
+    uint16_t frame[MAX_SUPPORTED_RC_CHANNEL_COUNT];
+    const uint8_t channelCount = sbufBytesRemaining(src) / sizeof(uint16_t);
+
+    for (int i = 0; i < channelCount; i++) {
+        frame[i] = sbufReadU16(src);
+    }
+
+    rxMspFrameReceive(frame, channelCount);
+#else
+    UNUSED(src);
+#endif
+    return MSP_RESULT_ACK;
+}
+
+#ifdef GPS
+static mspResult_e mspSetRawGps(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(dst);
+    if (sbufReadU8(src)) {
+        ENABLE_STATE(GPS_FIX);
+    } else {
+        DISABLE_STATE(GPS_FIX);
+    }
+    gpsSol.flags.validVelNE = 0;
+    gpsSol.flags.validVelD = 0;
+    gpsSol.flags.validEPE = 0;
+    gpsSol.numSat = sbufReadU8(src);
+    gpsSol.llh.lat = sbufReadU32(src);
+    gpsSol.llh.lon = sbufReadU32(src);
+    gpsSol.llh.alt = sbufReadU16(src);
+    gpsSol.groundSpeed = sbufReadU16(src);
+    gpsSol.velNED[X] = 0;
+    gpsSol.velNED[Y] = 0;
+    gpsSol.velNED[Z] = 0;
+    gpsSol.eph = 100;
+    gpsSol.epv = 100;
+    // Feed data to navigation
+    sensorsSet(SENSOR_GPS);
+    onNewGPSData();
+    return MSP_RESULT_ACK;
+}
+#endif
+
+static mspResult_e mspSetPid(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(dst);
+    for (int i = 0; i < PID_ITEM_COUNT; i++) {
+        currentProfile->pidProfile.P8[i] = sbufReadU8(src);
+        currentProfile->pidProfile.I8[i] = sbufReadU8(src);
+        currentProfile->pidProfile.D8[i] = sbufReadU8(src);
+    }
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspSetRcTuning(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(dst);
+    uint8_t rate;
+
+    sbufReadU8(src); //Read rcRate8, kept for protocol compatibility reasons
+    currentControlRateProfile->rcExpo8 = sbufReadU8(src);
+    for (int i = 0; i < 3; i++) {
+        rate = sbufReadU8(src);
+        if (i == FD_YAW) {
+            currentControlRateProfile->rates[i] = constrain(rate, CONTROL_RATE_CONFIG_YAW_RATE_MIN, CONTROL_RATE_CONFIG_YAW_RATE_MAX);
+        }
+        else {
+            currentControlRateProfile->rates[i] = constrain(rate, CONTROL_RATE_CONFIG_ROLL_PITCH_RATE_MIN, CONTROL_RATE_CONFIG_ROLL_PITCH_RATE_MAX);
+        }
+    }
+    rate = sbufReadU8(src);
+    currentControlRateProfile->dynThrPID = MIN(rate, CONTROL_RATE_CONFIG_TPA_MAX);
+    currentControlRateProfile->thrMid8 = sbufReadU8(src);
+    currentControlRateProfile->thrExpo8 = sbufReadU8(src);
+    currentControlRateProfile->tpa_breakpoint = sbufReadU16(src);
+    if (sbufBytesRemaining(src) >= 1) {
+        currentControlRateProfile->rcYawExpo8 = sbufReadU8(src);
+    }
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspAccCalibration(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    UNUSED(dst);
+    accSetCalibrationCycles(CALIBRATING_ACC_CYCLES);
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspMagCalibration(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    UNUSED(dst);
+    ENABLE_STATE(CALIBRATE_MAG);
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspSetMisc(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(dst);
+    const uint16_t midrc = sbufReadU16(src);
+    if (midrc < 1600 && midrc > 1400)
+        masterConfig.rxConfig.midrc = midrc;
+
+    masterConfig.escAndServoConfig.minthrottle = sbufReadU16(src);
+    masterConfig.escAndServoConfig.maxthrottle = sbufReadU16(src);
+    masterConfig.escAndServoConfig.mincommand = sbufReadU16(src);
+
+    masterConfig.failsafeConfig.failsafe_throttle = sbufReadU16(src);
+
+#ifdef GPS
+    masterConfig.gpsConfig.provider = sbufReadU8(src); // gps_type
+    sbufReadU8(src); // gps_baudrate
+    masterConfig.gpsConfig.sbasMode = sbufReadU8(src); // gps_ubx_sbas
+#else
+    sbufReadU8(src); // gps_type
+    sbufReadU8(src); // gps_baudrate
+    sbufReadU8(src); // gps_ubx_sbas
+#endif
+    masterConfig.batteryConfig.multiwiiCurrentMeterOutput = sbufReadU8(src);
+    masterConfig.rxConfig.rssi_channel = sbufReadU8(src);
+    sbufReadU8(src);
+
+    currentProfile->mag_declination = sbufReadU16(src) * 10;
+
+    masterConfig.batteryConfig.vbatscale = sbufReadU8(src);           // actual vbatscale as intended
+    masterConfig.batteryConfig.vbatmincellvoltage = sbufReadU8(src);  // vbatlevel_warn1 in MWC2.3 GUI
+    masterConfig.batteryConfig.vbatmaxcellvoltage = sbufReadU8(src);  // vbatlevel_warn2 in MWC2.3 GUI
+    masterConfig.batteryConfig.vbatwarningcellvoltage = sbufReadU8(src);  // vbatlevel when buzzer starts to alert
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspResetConf(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    UNUSED(dst);
+    resetEEPROM();
+    readEEPROM();
+    return MSP_RESULT_ACK;
+}
+
+#ifdef NAV
+static mspResult_e mspSetWp(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(dst);
+    navWaypoint_t msp_wp;
+    const uint8_t msp_wp_no = sbufReadU8(src);     // get the wp number
+
+    msp_wp.action = sbufReadU8(src);    // action
+    msp_wp.lat = sbufReadU32(src);      // lat
+    msp_wp.lon = sbufReadU32(src);      // lon
+    msp_wp.alt = sbufReadU32(src);      // to set altitude (cm)
+    msp_wp.p1 = sbufReadU16(src);       // P1
+    msp_wp.p2 = sbufReadU16(src);       // P2
+    msp_wp.p3 = sbufReadU16(src);       // P3
+    msp_wp.flag = sbufReadU8(src);      // future: to set nav flag
+    setWaypoint(msp_wp_no, &msp_wp);
+    return MSP_RESULT_ACK;
+}
+#endif
+
+static mspResult_e mspSelectSetting(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(dst);
+    masterConfig.current_profile_index = sbufReadU8(src);
+    if (masterConfig.current_profile_index > 2) {
+        masterConfig.current_profile_index = 0;
+    }
+    writeEEPROM();
+    readEEPROM();
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspSetHead(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(dst);
+    updateMagHoldHeading(sbufReadU16(src));
+    return MSP_RESULT_ACK;
+}
+
+#ifdef USE_SERVOS
+static mspResult_e mspSetServoConfiguration(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(dst);
+    const uint8_t index = sbufReadU8(src);
+    if (index >= MAX_SUPPORTED_SERVOS) {
+        return MSP_RESULT_ERROR;
+    }
+
+    currentProfile->servoConf[index].min = sbufReadU16(src);
+    currentProfile->servoConf[index].max = sbufReadU16(src);
+    currentProfile->servoConf[index].middle = sbufReadU16(src);
+    currentProfile->servoConf[index].rate = sbufReadU8(src);
+    currentProfile->servoConf[index].angleAtMin = sbufReadU8(src);
+    currentProfile->servoConf[index].angleAtMax = sbufReadU8(src);
+    currentProfile->servoConf[index].forwardFromChannel = sbufReadU8(src);
+    currentProfile->servoConf[index].reversedSources = sbufReadU32(src);
+    servoMixerUpdatePlan();
+    return MSP_RESULT_ACK;
+}
+#endif
+
+static mspResult_e mspSetMotor(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(dst);
+    for (int i = 0; i < 8; i++) {
+        const int16_t disarmed = sbufReadU16(src);
+        if (i < MAX_SUPPORTED_MOTORS) {
+            motor_disarmed[i] = disarmed;
+        }
+    }
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspSet3D(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(dst);
+    masterConfig.flight3DConfig.deadband3d_low = sbufReadU16(src);
+    masterConfig.flight3DConfig.deadband3d_high = sbufReadU16(src);
+    masterConfig.flight3DConfig.neutral3d = sbufReadU16(src);
+    masterConfig.flight3DConfig.deadband3d_throttle = sbufReadU16(src);
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspSetRcDeadband(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(dst);
+    currentProfile->rcControlsConfig.deadband = sbufReadU8(src);
+    currentProfile->rcControlsConfig.yaw_deadband = sbufReadU8(src);
+    currentProfile->rcControlsConfig.alt_hold_deadband = sbufReadU8(src);
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspSetResetCurrPid(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    UNUSED(dst);
+    resetPidProfile(&currentProfile->pidProfile);
+    return MSP_RESULT_ACK;
+}
+
+static mspResult_e mspSetSensorAlignment(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(dst);
+    masterConfig.sensorAlignmentConfig.gyro_align = sbufReadU8(src);
+    masterConfig.sensorAlignmentConfig.acc_align = sbufReadU8(src);
+    masterConfig.sensorAlignmentConfig.mag_align = sbufReadU8(src);
+    return MSP_RESULT_ACK;
+}
+
+#ifdef NAV
+static mspResult_e mspSetWpBatch(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(dst);
+    navWaypoint_t msp_wp;
+
+    if ((sbufBytesRemaining(src) - 2) % MSP_WP_BATCH_ITEM_SIZE != 0) {
+        return MSP_RESULT_ERROR;
+    }
+
+    uint16_t wpNumber = sbufReadU16(src);
+
+    while (sbufBytesRemaining(src) > 0) {
+        msp_wp.action = sbufReadU8(src);
+        msp_wp.lat = sbufReadU32(src);
+        msp_wp.lon = sbufReadU32(src);
+        msp_wp.alt = sbufReadU32(src);
+        msp_wp.p1 = sbufReadU16(src);
+        msp_wp.p2 = sbufReadU16(src);
+        msp_wp.p3 = sbufReadU16(src);
+        msp_wp.flag = sbufReadU8(src);
+
+        // Reject the rest of the batch if mission is full or out of order, GCS has to restart from WP #1
+        if (!setMissionWaypoint(wpNumber++, &msp_wp)) {
+            return MSP_RESULT_ERROR;
+        }
+    }
+    return MSP_RESULT_ACK;
+}
+#endif
+
+#ifdef USE_CLI
+static mspResult_e mspSetSettings(sbuf_t *src, sbuf_t *dst)
+{
+    const int appliedCount = cliSettingsImport(src);
+    if (appliedCount < 0) {
+        return MSP_RESULT_ERROR;
+    }
+
+    // settings not known to this firmware are skipped, client can tell from the count
+    sbufWriteU16(dst, appliedCount);
+    return MSP_RESULT_ACK;
+}
+#endif
+
+#ifdef USE_SERVOS
+static mspResult_e mspSetServoMixRule(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(dst);
+    const uint8_t index = sbufReadU8(src);
+    if (index >= MAX_SERVO_RULES) {
+        return MSP_RESULT_ERROR;
+    }
+
+    masterConfig.customServoMixer[index].targetChannel = sbufReadU8(src);
+    masterConfig.customServoMixer[index].inputSource = sbufReadU8(src);
+    masterConfig.customServoMixer[index].rate = sbufReadU8(src);
+    masterConfig.customServoMixer[index].speed = sbufReadU8(src);
+    masterConfig.customServoMixer[index].min = sbufReadU8(src);
+    masterConfig.customServoMixer[index].max = sbufReadU8(src);
+    masterConfig.customServoMixer[index].box = sbufReadU8(src);
+    loadCustomServoMixer();
+    return MSP_RESULT_ACK;
+}
+#endif
+
+#ifdef USE_SERIAL_4WAY_BLHELI_INTERFACE
+static void msp4WayIfFn(serialPort_t *port)
+{
+    // wait for all data to send
+    waitForSerialPortToFinishTransmitting(port);
+    // rem: App: Wait at least appx. 500 ms for BLHeli to jump into
+    // bootloader mode before try to connect any ESC
+    // Start to activate here
+    esc4wayProcess(port);
+    // former used MSP uart is still active
+    // proceed as usual with MSP commands
+}
+
+static mspResult_e mspSet4WayIf(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    // switch all motor lines HI
+    // reply the count of ESC found
+    sbufWriteU8(dst, esc4wayInit());
+    // because we do not come back after calling Process4WayInterface
+    // the reply is sent first and the port is taken over after that
+    mspPostProcessFn = msp4WayIfFn;
+    return MSP_RESULT_ACK;
+}
+#endif
+
+static mspResult_e mspEepromWrite(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(src);
+    UNUSED(dst);
+    writeEEPROM();
+    readEEPROM();
+    return MSP_RESULT_ACK;
+}
+
+#ifdef HIL
+static mspResult_e mspSetHilState(sbuf_t *src, sbuf_t *dst)
+{
+    UNUSED(dst);
+    hilToFC.rollAngle = sbufReadU16(src);
+    hilToFC.pitchAngle = sbufReadU16(src);
+    hilToFC.yawAngle = sbufReadU16(src);
+    hilToFC.baroAlt = sbufReadU32(src);
+    hilToFC.bodyAccel[0] = sbufReadU16(src);
+    hilToFC.bodyAccel[1] = sbufReadU16(src);
+    hilToFC.bodyAccel[2] = sbufReadU16(src);
+    hilActive = true;
+    return MSP_RESULT_ACK;
+}
+#endif
+
+static mspResult_e mspExecuteCommand(const mspCommandDescriptor_t *descriptor, sbuf_t *src, sbuf_t *dst);
+
+// Replies of the read-only commands listed in the request, each prefixed with its size.
+// Unknown or failed commands are reported with zero size, list is cut short when the reply buffer is full.
+static mspResult_e mspMultipleMsp(sbuf_t *src, sbuf_t *dst)
+{
+    sbuf_t emptySrc;
+    sbufInit(&emptySrc, NULL, NULL);
+
+    while (sbufBytesRemaining(src) > 0 && sbufBytesRemaining(dst) > 0) {
+        const mspCommandDescriptor_t *descriptor = mspFindCommand(sbufReadU8(src));
+        uint8_t *itemSizePtr = sbufPtr(dst);
+
+        sbufWriteU8(dst, 0);
+
+        if (!descriptor || !(descriptor->flags & MSP_FLAG_READ_ONLY)) {
+            continue;
+        }
+
+        sbuf_t itemDst;
+        sbufInit(&itemDst, sbufPtr(dst), sbufPtr(dst) + MIN(sbufBytesRemaining(dst), 255));
+
+        if (mspExecuteCommand(descriptor, &emptySrc, &itemDst) == MSP_RESULT_ACK) {
+            if (sbufBytesRemaining(&itemDst) == 0) {
+                // reply may have been truncated, drop it and everything after it
+                dst->ptr = itemSizePtr;
+                break;
+            }
+            *itemSizePtr = itemDst.ptr - sbufPtr(dst);
+            sbufAdvance(dst, *itemSizePtr);
+        }
+    }
+    return MSP_RESULT_ACK;
+}
+
+/*
+ * Command table, MUST be sorted by command id, it is searched with binary search.
+ * minSize/maxSize limit the request payload, handlers may rely on minSize bytes being available.
+ */
+STATIC_UNIT_TESTED const mspCommandDescriptor_t mspCommands[] = {
+    { MSP_API_VERSION,              0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspApiVersion },
+    { MSP_FC_VARIANT,               0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspFcVariant },
+    { MSP_FC_VERSION,               0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspFcVersion },
+    { MSP_BOARD_INFO,               0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspBoardInfo },
+    { MSP_BUILD_INFO,               0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspBuildInfo },
+    { MSP_MODE_RANGES,              0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspModeRanges },
+    { MSP_SET_MODE_RANGE,           5, MSP_SIZE_ANY, MSP_FLAG_NONE, mspSetModeRange },
+    { MSP_FEATURE,                  0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspFeature },
+    { MSP_SET_FEATURE,              4, MSP_SIZE_ANY, MSP_FLAG_NONE, mspSetFeature },
+    { MSP_BOARD_ALIGNMENT,          0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspBoardAlignment },
+    { MSP_SET_BOARD_ALIGNMENT,      6, MSP_SIZE_ANY, MSP_FLAG_NONE, mspSetBoardAlignment },
+    { MSP_CURRENT_METER_CONFIG,     0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspCurrentMeterConfig },
+    { MSP_SET_CURRENT_METER_CONFIG, 7, MSP_SIZE_ANY, MSP_FLAG_NONE, mspSetCurrentMeterConfig },
+    { MSP_MIXER,                    0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspMixer },
+#ifndef USE_QUAD_MIXER_ONLY
+    { MSP_SET_MIXER,                1, MSP_SIZE_ANY, MSP_FLAG_NONE, mspSetMixer },
+#endif
+    { MSP_RX_CONFIG,                0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspRxConfig },
+    { MSP_SET_RX_CONFIG,            8, MSP_SIZE_ANY, MSP_FLAG_NONE, mspSetRxConfig },
+#ifdef LED_STRIP
+    { MSP_LED_COLORS,               0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspLedColors },
+    { MSP_SET_LED_COLORS,           CONFIGURABLE_COLOR_COUNT * 4, MSP_SIZE_ANY, MSP_FLAG_NONE, mspSetLedColors },
+    { MSP_LED_STRIP_CONFIG,         0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspLedStripConfig },
+    { MSP_SET_LED_STRIP_CONFIG,     1 + 7, 1 + 7, MSP_FLAG_NONE, mspSetLedStripConfig },
+#endif
+    { MSP_RSSI_CONFIG,              0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspRssiConfig },
+    { MSP_SET_RSSI_CONFIG,          1, MSP_SIZE_ANY, MSP_FLAG_NONE, mspSetRssiConfig },
+    { MSP_ADJUSTMENT_RANGES,        0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspAdjustmentRanges },
+    { MSP_SET_ADJUSTMENT_RANGE,     6, MSP_SIZE_ANY, MSP_FLAG_NONE, mspSetAdjustmentRange },
+    { MSP_CF_SERIAL_CONFIG,         0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspCfSerialConfig },
+    { MSP_SET_CF_SERIAL_CONFIG,     0, MSP_SIZE_ANY, MSP_FLAG_NONE, mspSetCfSerialConfig },
+    { MSP_VOLTAGE_METER_CONFIG,     0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspVoltageMeterConfig },
+    { MSP_SET_VOLTAGE_METER_CONFIG, 4, MSP_SIZE_ANY, MSP_FLAG_NONE, mspSetVoltageMeterConfig },
+    { MSP_SONAR_ALTITUDE,           0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspSonarAltitude },
+    { MSP_PID_CONTROLLER,           0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspPidController },
+    { MSP_SET_PID_CONTROLLER,       0, MSP_SIZE_ANY, MSP_FLAG_NONE, mspSetPidController },
+    { MSP_ARMING_CONFIG,            0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspArmingConfig },
+    { MSP_SET_ARMING_CONFIG,        2, MSP_SIZE_ANY, MSP_FLAG_NONE, mspSetArmingConfig },
+    { MSP_RX_MAP,                   0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspRxMap },
+    { MSP_SET_RX_MAP,               MAX_MAPPABLE_RX_INPUTS, MSP_SIZE_ANY, MSP_FLAG_NONE, mspSetRxMap },
+    { MSP_BF_CONFIG,                0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspBfConfig },
+    { MSP_SET_BF_CONFIG,            16, MSP_SIZE_ANY, MSP_FLAG_NONE, mspSetBfConfig },
+    { MSP_REBOOT,                   0, MSP_SIZE_ANY, MSP_FLAG_NONE, mspReboot },
+    { MSP_BF_BUILD_INFO,            0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspBfBuildInfo },
+    { MSP_DATAFLASH_SUMMARY,        0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspDataflashSummary },
+#ifdef USE_FLASHFS
+    { MSP_DATAFLASH_READ,           4, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspDataflashRead },
+    { MSP_DATAFLASH_ERASE,          0, MSP_SIZE_ANY, MSP_FLAG_NONE, mspDataflashErase },
+#endif
+    { MSP_LOOP_TIME,                0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspLoopTime },
+    { MSP_SET_LOOP_TIME,            2, MSP_SIZE_ANY, MSP_FLAG_NONE, mspSetLoopTime },
+    { MSP_FAILSAFE_CONFIG,          0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspFailsafeConfig },
+    { MSP_SET_FAILSAFE_CONFIG,      8, MSP_SIZE_ANY, MSP_FLAG_NONE, mspSetFailsafeConfig },
+    { MSP_RXFAIL_CONFIG,            0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspRxFailConfig },
+    { MSP_SET_RXFAIL_CONFIG,        4, MSP_SIZE_ANY, MSP_FLAG_NONE, mspSetRxFailConfig },
+    { MSP_IDENT,                    0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspIdent },
+    { MSP_STATUS,                   0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspStatus },
+    { MSP_RAW_IMU,                  0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspRawImu },
+#ifdef USE_SERVOS
+    { MSP_SERVO,                    0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspServo },
+#endif
+    { MSP_MOTOR,                    0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspMotor },
+    { MSP_RC,                       0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspRc },
+#ifdef GPS
+    { MSP_RAW_GPS,                  0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspRawGps },
+    { MSP_COMP_GPS,                 0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspCompGps },
+#endif
+    { MSP_ATTITUDE,                 0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspAttitude },
+    { MSP_ALTITUDE,                 0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspAltitude },
+    { MSP_ANALOG,                   0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspAnalog },
+    { MSP_RC_TUNING,                0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspRcTuning },
+    { MSP_PID,                      0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspPid },
+    { MSP_MISC,                     0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspMisc },
+    { MSP_MOTOR_PINS,               0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspMotorPins },
+    { MSP_BOXNAMES,                 0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspBoxNames },
+    { MSP_PIDNAMES,                 0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspPidNames },
+#if defined(GPS) && defined(NAV)
+    { MSP_WP,                       1, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspWp },
+#endif
+    { MSP_BOXIDS,                   0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspBoxIds },
+#ifdef USE_SERVOS
+    { MSP_SERVO_CONFIGURATIONS,     0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspServoConfigurations },
+#endif
+#if defined(GPS) && defined(NAV)
+    { MSP_NAV_STATUS,               0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspNavStatus },
+#endif
+    { MSP_3D,                       0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, msp3D },
+    { MSP_RC_DEADBAND,              0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspRcDeadband },
+    { MSP_SENSOR_ALIGNMENT,         0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspSensorAlignment },
+    { MSP_STATUS_EX,                0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspStatusEx },
+    { MSP_UID,                      0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspUid },
+#ifdef GPS
+    { MSP_GPSSVINFO,                0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspGpsSvInfo },
+    { MSP_GPSSTATISTICS,            0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspGpsStatistics },
+#ifdef NAV
+    { MSP_WP_BATCH,                 3, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspWpBatch },
+    { MSP_NAV_FSM_TRACE,            0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspNavFsmTrace },
+#endif
+#endif
+#ifdef USE_CLI
+    { MSP_SETTINGS,                 0, 2, MSP_FLAG_READ_ONLY, mspSettings },
+#endif
+    { MSP_SET_RAW_RC,               0, MAX_SUPPORTED_RC_CHANNEL_COUNT * 2, MSP_FLAG_NONE, mspSetRawRc },
+#ifdef GPS
+    { MSP_SET_RAW_GPS,              14, MSP_SIZE_ANY, MSP_FLAG_NONE, mspSetRawGps },
+#endif
+    { MSP_SET_PID,                  3 * PID_ITEM_COUNT, MSP_SIZE_ANY, MSP_FLAG_NONE, mspSetPid },
+    { MSP_SET_RC_TUNING,            10, MSP_SIZE_ANY, MSP_FLAG_NONE, mspSetRcTuning },
+    { MSP_ACC_CALIBRATION,          0, MSP_SIZE_ANY, MSP_FLAG_DISARMED_ONLY, mspAccCalibration },
+    { MSP_MAG_CALIBRATION,          0, MSP_SIZE_ANY, MSP_FLAG_DISARMED_ONLY, mspMagCalibration },
+    { MSP_SET_MISC,                 22, MSP_SIZE_ANY, MSP_FLAG_NONE, mspSetMisc },
+    { MSP_RESET_CONF,               0, MSP_SIZE_ANY, MSP_FLAG_DISARMED_ONLY, mspResetConf },
+#ifdef NAV
+    { MSP_SET_WP,                   21, MSP_SIZE_ANY, MSP_FLAG_NONE, mspSetWp },
+#endif
+    { MSP_SELECT_SETTING,           1, MSP_SIZE_ANY, MSP_FLAG_DISARMED_ONLY, mspSelectSetting },
+    { MSP_SET_HEAD,                 2, MSP_SIZE_ANY, MSP_FLAG_NONE, mspSetHead },
+#ifdef USE_SERVOS
+    { MSP_SET_SERVO_CONFIGURATION,  1 + sizeof(servoParam_t), 1 + sizeof(servoParam_t), MSP_FLAG_NONE, mspSetServoConfiguration },
+#endif
+    { MSP_SET_MOTOR,                16, MSP_SIZE_ANY, MSP_FLAG_NONE, mspSetMotor },
+    { MSP_SET_3D,                   8, MSP_SIZE_ANY, MSP_FLAG_NONE, mspSet3D },
+    { MSP_SET_RC_DEADBAND,          3, MSP_SIZE_ANY, MSP_FLAG_NONE, mspSetRcDeadband },
+    { MSP_SET_RESET_CURR_PID,       0, MSP_SIZE_ANY, MSP_FLAG_NONE, mspSetResetCurrPid },
+    { MSP_SET_SENSOR_ALIGNMENT,     3, MSP_SIZE_ANY, MSP_FLAG_NONE, mspSetSensorAlignment },
+#ifdef NAV
+    { MSP_SET_WP_BATCH,             2 + MSP_WP_BATCH_ITEM_SIZE, MSP_SIZE_ANY, MSP_FLAG_NONE, mspSetWpBatch },
+#endif
+#ifdef USE_CLI
+    { MSP_SET_SETTINGS,             0, MSP_SIZE_ANY, MSP_FLAG_DISARMED_ONLY, mspSetSettings },
+#endif
+    { MSP_MULTIPLE_MSP,             0, MSP_SIZE_ANY, MSP_FLAG_NONE, mspMultipleMsp },
+#ifdef USE_SERVOS
+    { MSP_SERVO_MIX_RULES,          0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspServoMixRules },
+    { MSP_SET_SERVO_MIX_RULE,       8, MSP_SIZE_ANY, MSP_FLAG_NONE, mspSetServoMixRule },
+#endif
+#ifdef USE_SERIAL_4WAY_BLHELI_INTERFACE
+    { MSP_SET_4WAY_IF,              0, MSP_SIZE_ANY, MSP_FLAG_DISARMED_ONLY, mspSet4WayIf },
+#endif
+    { MSP_EEPROM_WRITE,             0, MSP_SIZE_ANY, MSP_FLAG_DISARMED_ONLY, mspEepromWrite },
+    { MSP_DEBUG,                    0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspDebug },
+#ifdef HIL
+    { MSP_HIL_STATE,                0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, mspHilState },
+    { MSP_SET_HIL_STATE,            16, MSP_SIZE_ANY, MSP_FLAG_NONE, mspSetHilState },
+#endif
+};
+
+STATIC_UNIT_TESTED const int mspCommandCount = ARRAYLEN(mspCommands);
+
+const mspCommandDescriptor_t *mspFindCommand(uint16_t cmd)
+{
+    int low = 0;
+    int high = mspCommandCount - 1;
+
+    while (low <= high) {
+        const int mid = (low + high) / 2;
+        if (mspCommands[mid].cmd < cmd) {
+            low = mid + 1;
+        } else if (mspCommands[mid].cmd > cmd) {
+            high = mid - 1;
+        } else {
+            return &mspCommands[mid];
+        }
+    }
+    return NULL;
+}
+
+static mspResult_e mspExecuteCommand(const mspCommandDescriptor_t *descriptor, sbuf_t *src, sbuf_t *dst)
+{
+    const int dataSize = sbufBytesRemaining(src);
+
+    if (dataSize < descriptor->minSize || dataSize > descriptor->maxSize) {
+        return MSP_RESULT_ERROR;
+    }
+
+    if ((descriptor->flags & MSP_FLAG_DISARMED_ONLY) && ARMING_FLAG(ARMED)) {
+        return MSP_RESULT_ERROR;
+    }
+
+    return descriptor->handler(src, dst);
+}
+
+/*
+ * Process a request, reply payload is written to reply->buf.
+ * On error reply->buf is left as it was, the transport discards whatever the handler may have written.
+ */
+mspResult_e mspProcessCommand(mspPacket_t *cmd, mspPacket_t *reply, mspPostProcessFnPtr *postProcessFn)
+{
+    const mspCommandDescriptor_t *descriptor = mspFindCommand(cmd->cmd);
+
+    mspPostProcessFn = NULL;
+    reply->cmd = cmd->cmd;
+    reply->result = descriptor ? mspExecuteCommand(descriptor, &cmd->buf, &reply->buf) : MSP_RESULT_ERROR;
+
+    *postProcessFn = (reply->result == MSP_RESULT_ACK) ? mspPostProcessFn : NULL;
+    return reply->result;
+}
@@ -0,0 +1,61 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "common/streambuf.h"
+
+// Transport independent MSP command processing. A transport (serial port, telemetry passthrough, ...) decodes the
+// request into a packet, calls mspProcessCommand() and encodes the reply packet in its own framing.
+
+typedef enum {
+    MSP_RESULT_ACK = 1,
+    MSP_RESULT_ERROR = -1
+} mspResult_e;
+
+typedef struct mspPacket_s {
+    sbuf_t buf;
+    uint16_t cmd;
+    int16_t result;
+} mspPacket_t;
+
+struct serialPort_s;
+// Called by the transport once the reply has been sent, used by commands which take over the port or reboot
+typedef void (*mspPostProcessFnPtr)(struct serialPort_s *port);
+
+// Handler reads request payload from src and writes reply payload to dst
+typedef mspResult_e (*mspCommandHandlerFnPtr)(sbuf_t *src, sbuf_t *dst);
+
+#define MSP_SIZE_ANY 0xFFFF
+
+typedef enum {
+    MSP_FLAG_NONE           = 0,
+    MSP_FLAG_DISARMED_ONLY  = 1 << 0,   // command is rejected while armed
+    MSP_FLAG_READ_ONLY      = 1 << 1,   // command only reports state, may be batched in MSP_MULTIPLE_MSP
+} mspCommandFlags_e;
+
+typedef struct mspCommandDescriptor_s {
+    uint16_t cmd;
+    uint16_t minSize;                   // allowed request payload size
+    uint16_t maxSize;
+    uint8_t flags;                      // see mspCommandFlags_e
+    mspCommandHandlerFnPtr handler;
+} mspCommandDescriptor_t;
+
+void mspCommandsInit(void);
+const mspCommandDescriptor_t *mspFindCommand(uint16_t cmd);
+mspResult_e mspProcessCommand(mspPacket_t *cmd, mspPacket_t *reply, mspPostProcessFnPtr *postProcessFn);
@@ -60,7 +60,7 @@
 #define MSP_PROTOCOL_VERSION                0
 
 #define API_VERSION_MAJOR                   1 // increment when major changes are made
-#define API_VERSION_MINOR                   17 // increment when any change is made, reset to zero when major changes are released after changing API_VERSION_MAJOR
+#define API_VERSION_MINOR                   22 // increment when any change is made, reset to zero when major changes are released after changing API_VERSION_MAJOR
 
 #define API_VERSION_LENGTH                  2
 
@@ -240,8 +240,15 @@
 #define MSP_UID                  160    //out message         Unique device ID
 #define MSP_GPSSVINFO            164    //out message         get Signal Strength (only U-Blox)
 #define MSP_GPSSTATISTICS        166    //out message         get GPS debugging data
+#define MSP_WP_BATCH             167    //out message         get a batch of consecutive mission waypoints, first WP# and count are in the payload
+#define MSP_NAV_FSM_TRACE        168    //out message         recent navigation state transitions, optional first sequence number in the payload
+#define MSP_SETTINGS             169    //out message         CLI settings in binary form, as many as fit the reply starting from the index in the payload
 #define MSP_ACC_TRIM             240    //out message         get acc angle trim values
 #define MSP_SET_ACC_TRIM         239    //in message          set acc angle trim values
 #define MSP_SERVO_MIX_RULES      241    //out message         Returns servo mixer configuration
 #define MSP_SET_SERVO_MIX_RULE   242    //in message          Sets servo mixer configuration
+#define MSP_SET_WP_BATCH         221    //in message          sets consecutive mission waypoints, first WP# is in the payload
+#define MSP_SET_SETTINGS         222    //in message          sets CLI settings in the MSP_SETTINGS format
 #define MSP_SET_4WAY_IF          245    //in message          Sets 4way interface
+#define MSP_MULTIPLE_MSP         230    //out message         replies of several read-only commands listed in the payload, each prefixed with its size
+#define MSP_SET_MSP_SUBSCRIPTION 231    //in message          rate (Hz) and list of read-only commands to be sent as MSP_MULTIPLE_MSP without polling
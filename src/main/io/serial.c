@@ -328,6 +328,7 @@ void closeSerialPort(serialPort_t *serialPort) {
     // TODO wait until data has been transmitted.
 
     serialPort->callback = NULL;
+    serialSetFrameCallback(serialPort, NULL);
 
     serialPortUsage->function = FUNCTION_NONE;
     serialPortUsage->serialPort = NULL;
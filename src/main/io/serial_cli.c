@@ -34,6 +34,7 @@
 #include "common/maths.h"
 #include "common/color.h"
 #include "common/typeconversion.h"
+#include "common/streambuf.h"
 
 #include "drivers/system.h"
 
@@ -46,6 +47,7 @@
 #include "drivers/gpio.h"
 #include "drivers/timer.h"
 #include "drivers/pwm_rx.h"
+#include "drivers/pwm_output.h"
 
 #include "drivers/buf_writer.h"
 
@@ -78,6 +80,8 @@
 #include "telemetry/telemetry.h"
 #include "telemetry/frsky.h"
 
+#include "blackbox/blackbox.h"
+
 #include "config/runtime_config.h"
 #include "config/config.h"
 #include "config/config_profile.h"
@@ -94,6 +98,7 @@ uint8_t cliMode = 0;
 #ifdef USE_CLI
 
 extern uint16_t cycleTime; // FIXME dependency on mw.c
+extern uint8_t motorCount;
 extern uint8_t detectedSensors[SENSOR_INDEX_COUNT];
 
 void gpsEnablePassthrough(serialPort_t *gpsPassthroughPort);
@@ -409,6 +414,16 @@ static const char * const lookupTableFailsafeProcedure[] = {
     "SET-THR", "DROP", "RTH"
 };
 
+static const char * const lookupTableMixerDesaturation[] = {
+    "UNIFORM", "PRIORITY"
+};
+
+#ifdef USE_DSHOT
+static const char * const lookupTableDshotProtocol[] = {
+    "OFF", "DSHOT150", "DSHOT300", "DSHOT600"
+};
+#endif
+
 #ifdef NAV
 static const char * const lookupTableNavControlMode[] = {
     "ATTI", "CRUISE"
@@ -417,6 +432,14 @@ static const char * const lookupTableNavControlMode[] = {
 static const char * const lookupTableNavRthAltMode[] = {
     "CURRENT", "EXTRA", "FIXED", "MAX", "AT_LEAST"
 };
+
+static const char * const lookupTableNavFwController[] = {
+    "HEADING", "L1"
+};
+
+static const char * const lookupTableNavFwAltController[] = {
+    "PITCH", "TECS"
+};
 #endif
 
 typedef struct lookupTableEntry_s {
@@ -447,9 +470,15 @@ typedef enum {
 #endif
     TABLE_GYRO_LPF,
     TABLE_FAILSAFE_PROCEDURE,
+    TABLE_MIXER_DESATURATION,
+#ifdef USE_DSHOT
+    TABLE_DSHOT_PROTOCOL,
+#endif
 #ifdef NAV
     TABLE_NAV_USER_CTL_MODE,
     TABLE_NAV_RTH_ALT_MODE,
+    TABLE_NAV_FW_CONTROLLER,
+    TABLE_NAV_FW_ALT_CONTROLLER,
 #endif
 } lookupTableIndex_e;
 
@@ -476,9 +505,15 @@ static const lookupTableEntry_t lookupTables[] = {
 #endif
      { lookupTableGyroLpf, sizeof(lookupTableGyroLpf) / sizeof(char *) },
     { lookupTableFailsafeProcedure, sizeof(lookupTableFailsafeProcedure) / sizeof(char *) },
+    { lookupTableMixerDesaturation, sizeof(lookupTableMixerDesaturation) / sizeof(char *) },
+#ifdef USE_DSHOT
+    { lookupTableDshotProtocol, sizeof(lookupTableDshotProtocol) / sizeof(char *) },
+#endif
 #ifdef NAV
     { lookupTableNavControlMode, sizeof(lookupTableNavControlMode) / sizeof(char *) },
     { lookupTableNavRthAltMode, sizeof(lookupTableNavRthAltMode) / sizeof(char *) },
+    { lookupTableNavFwController, sizeof(lookupTableNavFwController) / sizeof(char *) },
+    { lookupTableNavFwAltController, sizeof(lookupTableNavFwAltController) / sizeof(char *) },
 #endif
 };
 
@@ -559,6 +594,10 @@ const clivalue_t valueTable[] = {
     { "3d_deadband_throttle",       VAR_UINT16 | MASTER_VALUE,  &masterConfig.flight3DConfig.deadband3d_throttle, .config.minmax = { PWM_RANGE_ZERO,  PWM_RANGE_MAX }, 0 },
 
     { "motor_pwm_rate",             VAR_UINT16 | MASTER_VALUE,  &masterConfig.motor_pwm_rate, .config.minmax = { 50,  32000 }, 0 },
+#ifdef USE_DSHOT
+    { "dshot_protocol",             VAR_UINT8  | MASTER_VALUE | MODE_LOOKUP, &masterConfig.dshot_protocol, .config.lookup = { TABLE_DSHOT_PROTOCOL }, 0 },
+#endif
+    { "pwm_output_sync",            VAR_UINT8  | MASTER_VALUE | MODE_LOOKUP, &masterConfig.pwm_output_sync, .config.lookup = { TABLE_OFF_ON }, 0 },
     { "servo_pwm_rate",             VAR_UINT16 | MASTER_VALUE,  &masterConfig.servo_pwm_rate, .config.minmax = { 50,  498 }, 0 },
 
     { "disarm_kill_switch",         VAR_UINT8  | MASTER_VALUE | MODE_LOOKUP,  &masterConfig.disarm_kill_switch, .config.lookup = { TABLE_OFF_ON }, 0 },
@@ -601,6 +640,10 @@ const clivalue_t valueTable[] = {
     { "inav_accz_unarmedcal",       VAR_UINT8  | MASTER_VALUE | MODE_LOOKUP, &masterConfig.navConfig.inav.accz_unarmed_cal, .config.lookup = { TABLE_OFF_ON }, 0 },
     { "inav_use_gps_velned",        VAR_UINT8  | MASTER_VALUE | MODE_LOOKUP, &masterConfig.navConfig.inav.use_gps_velned, .config.lookup = { TABLE_OFF_ON }, 0 },
     { "inav_gps_delay",             VAR_UINT16 | MASTER_VALUE, &masterConfig.navConfig.inav.gps_delay_ms, .config.minmax = { 0,  500 }, 0 },
+    { "inav_baro_delay",            VAR_UINT16 | MASTER_VALUE, &masterConfig.navConfig.inav.baro_delay_ms, .config.minmax = { 0,  200 }, 0 },
+#if defined(NAV_POS_ESTIMATOR_EKF)
+    { "inav_use_ekf",               VAR_UINT8  | MASTER_VALUE | MODE_LOOKUP, &masterConfig.navConfig.inav.use_ekf, .config.lookup = { TABLE_OFF_ON }, 0 },
+#endif
     { "inav_gps_min_sats",          VAR_UINT8  | MASTER_VALUE, &masterConfig.navConfig.inav.gps_min_sats, .config.minmax = { 5,  10}, 0 },
 
     { "inav_w_z_baro_p",            VAR_FLOAT  | MASTER_VALUE, &masterConfig.navConfig.inav.w_z_baro_p, .config.minmax = { 0,  10 }, 0 },
@@ -636,6 +679,8 @@ const clivalue_t valueTable[] = {
     { "nav_mc_bank_angle",          VAR_UINT8  | MASTER_VALUE, &masterConfig.navConfig.mc_max_bank_angle, .config.minmax = { 15,  45 }, 0 },
     { "nav_mc_hover_thr",           VAR_UINT16 | MASTER_VALUE, &masterConfig.navConfig.mc_hover_throttle, .config.minmax = { 1000,  2000 }, 0 },
     { "nav_mc_min_fly_thr",         VAR_UINT16 | MASTER_VALUE, &masterConfig.navConfig.mc_min_fly_throttle, .config.minmax = { 1000,  2000 }, 0 },
+    { "nav_mc_traj_accel",          VAR_UINT16 | MASTER_VALUE, &masterConfig.navConfig.mc_traj_max_accel, .config.minmax = { 50,  980 }, 0 },
+    { "nav_mc_traj_jerk",           VAR_UINT16 | MASTER_VALUE, &masterConfig.navConfig.mc_traj_max_jerk, .config.minmax = { 0,  5000 }, 0 },
 
     { "nav_fw_cruise_thr",          VAR_UINT16 | MASTER_VALUE, &masterConfig.navConfig.fw_cruise_throttle, .config.minmax = { 1000,  2000 }, 0 },
     { "nav_fw_min_thr",             VAR_UINT16 | MASTER_VALUE, &masterConfig.navConfig.fw_min_throttle, .config.minmax = { 1000,  2000 }, 0 },
@@ -646,6 +691,13 @@ const clivalue_t valueTable[] = {
     { "nav_fw_pitch2thr",           VAR_UINT8  | MASTER_VALUE, &masterConfig.navConfig.fw_pitch_to_throttle, .config.minmax = { 0,  100 }, 0 },
     { "nav_fw_roll2pitch",          VAR_UINT8  | MASTER_VALUE, &masterConfig.navConfig.fw_roll_to_pitch, .config.minmax = { 0,  200 }, 0 },
     { "nav_fw_loiter_radius",       VAR_UINT16 | MASTER_VALUE, &masterConfig.navConfig.fw_loiter_radius, .config.minmax = { 0,  10000 }, 0 },
+    { "nav_fw_controller",          VAR_UINT8  | MASTER_VALUE | MODE_LOOKUP, &masterConfig.navConfig.fw_nav_controller, .config.lookup = { TABLE_NAV_FW_CONTROLLER }, 0 },
+    { "nav_fw_l1_period",           VAR_UINT8  | MASTER_VALUE, &masterConfig.navConfig.fw_l1_period, .config.minmax = { 5,  60 }, 0 },
+    { "nav_fw_l1_damping",          VAR_UINT8  | MASTER_VALUE, &masterConfig.navConfig.fw_l1_damping, .config.minmax = { 50,  100 }, 0 },
+    { "nav_fw_alt_controller",      VAR_UINT8  | MASTER_VALUE | MODE_LOOKUP, &masterConfig.navConfig.fw_alt_controller, .config.lookup = { TABLE_NAV_FW_ALT_CONTROLLER }, 0 },
+    { "nav_fw_cruise_speed",        VAR_UINT16 | MASTER_VALUE, &masterConfig.navConfig.fw_cruise_speed, .config.minmax = { 0,  5000 }, 0 },
+    { "nav_fw_tecs_time_const",     VAR_UINT8  | MASTER_VALUE, &masterConfig.navConfig.fw_tecs_time_const, .config.minmax = { 10,  200 }, 0 },
+    { "nav_fw_tecs_spd_weight",     VAR_UINT8  | MASTER_VALUE, &masterConfig.navConfig.fw_tecs_speed_weight, .config.minmax = { 0,  200 }, 0 },
 #endif
 
 #ifdef SERIAL_RX
@@ -700,6 +752,9 @@ const clivalue_t valueTable[] = {
 
     { "yaw_motor_direction",        VAR_INT8   | MASTER_VALUE, &masterConfig.mixerConfig.yaw_motor_direction, .config.minmax = { -1,  1 }, 0 },
     { "yaw_jump_prevention_limit",  VAR_UINT16 | MASTER_VALUE, &masterConfig.mixerConfig.yaw_jump_prevention_limit, .config.minmax = { YAW_JUMP_PREVENTION_LIMIT_LOW,  YAW_JUMP_PREVENTION_LIMIT_HIGH }, 0 },
+    { "mixer_desaturation",         VAR_UINT8  | MASTER_VALUE | MODE_LOOKUP, &masterConfig.mixerConfig.desaturation_mode, .config.lookup = { TABLE_MIXER_DESATURATION }, 0 },
+    { "thrust_linearization",       VAR_UINT8  | MASTER_VALUE, &masterConfig.mixerConfig.thrust_linearization, .config.minmax = { 0,  100 }, 0 },
+    { "vbat_motor_compensation",    VAR_UINT8  | MASTER_VALUE | MODE_LOOKUP, &masterConfig.mixerConfig.vbat_compensation, .config.lookup = { TABLE_OFF_ON }, 0 },
 
 #ifdef USE_SERVOS
     { "tri_unarmed_servo",          VAR_INT8   | MASTER_VALUE | MODE_LOOKUP, &masterConfig.mixerConfig.tri_unarmed_servo, .config.lookup = { TABLE_OFF_ON }, 0 },
@@ -740,7 +795,9 @@ const clivalue_t valueTable[] = {
 
     { "acc_hardware",               VAR_UINT8  | MASTER_VALUE,  &masterConfig.acc_hardware, .config.minmax = { 0,  ACC_MAX }, 0 },
 
-    { "baro_use_median_filter",     VAR_UINT8  | MASTER_VALUE | MODE_LOOKUP, &masterConfig.barometerConfig.use_median_filtering, .config.lookup = { TABLE_OFF_ON }, 0 },
+#ifdef BARO
+    { "baro_use_median_filter",     VAR_UINT8  | MASTER_VALUE | MODE_LOOKUP, &barometerConfig_System.use_median_filtering, .config.lookup = { TABLE_OFF_ON }, 0 },
+#endif
     { "baro_hardware",              VAR_UINT8  | MASTER_VALUE,  &masterConfig.baro_hardware, .config.minmax = { 0,  BARO_MAX }, 0 },
 
     { "mag_hardware",               VAR_UINT8  | MASTER_VALUE,  &masterConfig.mag_hardware, .config.minmax = { 0,  MAG_MAX }, 0 },
@@ -772,9 +829,9 @@ const clivalue_t valueTable[] = {
     { "yaw_p_limit",                VAR_UINT16 | PROFILE_VALUE,  &masterConfig.profile[0].pidProfile.yaw_p_limit, .config.minmax = { YAW_P_LIMIT_MIN,  YAW_P_LIMIT_MAX }, 0 },
 
 #ifdef BLACKBOX
-    { "blackbox_rate_num",          VAR_UINT8  | MASTER_VALUE,  &masterConfig.blackbox_rate_num, .config.minmax = { 1,  32 }, 0 },
-    { "blackbox_rate_denom",        VAR_UINT8  | MASTER_VALUE,  &masterConfig.blackbox_rate_denom, .config.minmax = { 1,  32 }, 0 },
-    { "blackbox_device",            VAR_UINT8  | MASTER_VALUE | MODE_LOOKUP,  &masterConfig.blackbox_device, .config.lookup = { TABLE_BLACKBOX_DEVICE }, 0 },
+    { "blackbox_rate_num",          VAR_UINT8  | MASTER_VALUE,  &blackboxConfig_System.rate_num, .config.minmax = { 1,  32 }, 0 },
+    { "blackbox_rate_denom",        VAR_UINT8  | MASTER_VALUE,  &blackboxConfig_System.rate_denom, .config.minmax = { 1,  32 }, 0 },
+    { "blackbox_device",            VAR_UINT8  | MASTER_VALUE | MODE_LOOKUP,  &blackboxConfig_System.device, .config.lookup = { TABLE_BLACKBOX_DEVICE }, 0 },
 #endif
 
     { "magzero_x",                  VAR_INT16  | MASTER_VALUE, &masterConfig.magZero.raw[X], .config.minmax = { -32768,  32767 }, FLAG_MAG_CALIBRATION_DONE },
@@ -792,6 +849,14 @@ const clivalue_t valueTable[] = {
 
 #define VALUE_COUNT (sizeof(valueTable) / sizeof(clivalue_t))
 
+#define STATIC_ASSERT(condition, name ) \
+    typedef char assert_failed_ ## name [(condition) ? 1 : -1 ]
+
+// valueTable is kept in dump order, lookup by name goes through this index sorted by name
+STATIC_ASSERT(VALUE_COUNT <= 256, value_index_too_small);
+STATIC_UNIT_TESTED uint8_t valueIndex[VALUE_COUNT];
+static bool valueIndexReady = false;
+
 
 typedef union {
     int32_t int_value;
@@ -1422,6 +1487,8 @@ static void cliServo(char *cmdline)
         servo->angleAtMax = arguments[5];
         servo->rate = arguments[6];
         servo->forwardFromChannel = arguments[7];
+
+        servoMixerUpdatePlan();
     }
 }
 #endif
@@ -1518,6 +1585,8 @@ static void cliServoMix(char *cmdline)
                 currentProfile->servoConf[args[SERVO]].reversedSources |= 1 << args[INPUT];
             else
                 currentProfile->servoConf[args[SERVO]].reversedSources &= ~(1 << args[INPUT]);
+
+            servoMixerUpdatePlan();
         } else
             cliShowParseError();
 
@@ -2296,18 +2365,24 @@ static void cliWrite(uint8_t ch)
     bufWriterAppend(cliWriter, ch);
 }
 
-static void cliPrintVar(const clivalue_t *var, uint32_t full)
+static void *cliGetVarPtr(const clivalue_t *var)
 {
-    int32_t value = 0;
-    char ftoaBuffer[FTOA_BUFFER_SIZE];
-
-    void *ptr = var->ptr;
+    uint8_t *ptr = var->ptr;
     if ((var->type & VALUE_SECTION_MASK) == PROFILE_VALUE) {
-        ptr = ((uint8_t *)ptr) + (sizeof(profile_t) * masterConfig.current_profile_index);
+        ptr += sizeof(profile_t) * masterConfig.current_profile_index;
     }
     if ((var->type & VALUE_SECTION_MASK) == CONTROL_RATE_VALUE) {
-        ptr = ((uint8_t *)ptr) + (sizeof(controlRateConfig_t) * getCurrentControlRateProfile());
+        ptr += sizeof(controlRateConfig_t) * getCurrentControlRateProfile();
     }
+    return ptr;
+}
+
+static void cliPrintVar(const clivalue_t *var, uint32_t full)
+{
+    int32_t value = 0;
+    char ftoaBuffer[FTOA_BUFFER_SIZE];
+
+    void *ptr = cliGetVarPtr(var);
 
     switch (var->type & VALUE_TYPE_MASK) {
         case VAR_UINT8:
@@ -2362,13 +2437,7 @@ static void cliPrintVar(const clivalue_t *var, uint32_t full)
 
 static void cliSetVar(const clivalue_t *var, const int_float_value_t value)
 {
-    void *ptr = var->ptr;
-    if ((var->type & VALUE_SECTION_MASK) == PROFILE_VALUE) {
-        ptr = ((uint8_t *)ptr) + (sizeof(profile_t) * masterConfig.current_profile_index);
-    }
-    if ((var->type & VALUE_SECTION_MASK) == CONTROL_RATE_VALUE) {
-        ptr = ((uint8_t *)ptr) + (sizeof(controlRateConfig_t) * getCurrentControlRateProfile());
-    }
+    void *ptr = cliGetVarPtr(var);
 
     switch (var->type & VALUE_TYPE_MASK) {
         case VAR_UINT8:
@@ -2395,6 +2464,47 @@ static void cliSetVar(const clivalue_t *var, const int_float_value_t value)
     }
 }
 
+STATIC_UNIT_TESTED void cliBuildVarIndex(void)
+{
+    // insertion sort, done once on first lookup so it doesn't delay boot
+    for (unsigned i = 0; i < VALUE_COUNT; i++) {
+        unsigned j = i;
+        while (j > 0 && strcasecmp(valueTable[valueIndex[j - 1]].name, valueTable[i].name) > 0) {
+            valueIndex[j] = valueIndex[j - 1];
+            j--;
+        }
+        valueIndex[j] = i;
+    }
+    valueIndexReady = true;
+}
+
+// Find the variable with exactly given name, name doesn't have to be null terminated
+STATIC_UNIT_TESTED const clivalue_t *cliFindVar(const char *name, unsigned nameLength)
+{
+    if (!valueIndexReady) {
+        cliBuildVarIndex();
+    }
+
+    int low = 0;
+    int high = VALUE_COUNT - 1;
+    while (low <= high) {
+        const int mid = (low + high) / 2;
+        const clivalue_t *var = &valueTable[valueIndex[mid]];
+        int cmp = strncasecmp(name, var->name, nameLength);
+        if (cmp == 0 && var->name[nameLength] != '\0') {
+            cmp = -1;   // name is a prefix of a longer variable name
+        }
+        if (cmp == 0) {
+            return var;
+        } else if (cmp < 0) {
+            high = mid - 1;
+        } else {
+            low = mid + 1;
+        }
+    }
+    return NULL;
+}
+
 static void cliSet(char *cmdline)
 {
     uint32_t i;
@@ -2427,64 +2537,61 @@ static void cliSet(char *cmdline)
             eqptr++;
         }
 
-        for (i = 0; i < VALUE_COUNT; i++) {
-            val = &valueTable[i];
-            // ensure exact match when setting to prevent setting variables with shorter names
-            if (strncasecmp(cmdline, valueTable[i].name, strlen(valueTable[i].name)) == 0 && variableNameLength == strlen(valueTable[i].name)) {
-
-                bool changeValue = false;
-                int_float_value_t tmp;
-                switch (valueTable[i].type & VALUE_MODE_MASK) {
-                    case MODE_DIRECT: {
-                            if(*eqptr != 0 && strspn(eqptr, "0123456789.+-") == strlen(eqptr)) {
-                                int32_t value = 0;
-                                float valuef = 0;
-
-                                value = atoi(eqptr);
-                                valuef = fastA2F(eqptr);
-
-                                if (valuef >= valueTable[i].config.minmax.min && valuef <= valueTable[i].config.minmax.max) { // note: compare float value
-
-                                    if ((valueTable[i].type & VALUE_TYPE_MASK) == VAR_FLOAT)
-                                        tmp.float_value = valuef;
-                                    else
-                                        tmp.int_value = value;
-
-                                    changeValue = true;
-                                }
-                            }
+        val = cliFindVar(cmdline, variableNameLength);
+        if (!val) {
+            cliPrint("Invalid name\r\n");
+            return;
+        }
+
+        bool changeValue = false;
+        int_float_value_t tmp;
+        switch (val->type & VALUE_MODE_MASK) {
+            case MODE_DIRECT: {
+                    if(*eqptr != 0 && strspn(eqptr, "0123456789.+-") == strlen(eqptr)) {
+                        int32_t value = 0;
+                        float valuef = 0;
+
+                        value = atoi(eqptr);
+                        valuef = fastA2F(eqptr);
+
+                        if (valuef >= val->config.minmax.min && valuef <= val->config.minmax.max) { // note: compare float value
+
+                            if ((val->type & VALUE_TYPE_MASK) == VAR_FLOAT)
+                                tmp.float_value = valuef;
+                            else
+                                tmp.int_value = value;
+
+                            changeValue = true;
                         }
-                        break;
-                    case MODE_LOOKUP: {
-                            const lookupTableEntry_t *tableEntry = &lookupTables[valueTable[i].config.lookup.tableIndex];
-                            bool matched = false;
-                            for (uint8_t tableValueIndex = 0; tableValueIndex < tableEntry->valueCount && !matched; tableValueIndex++) {
-                                matched = strcasecmp(tableEntry->values[tableValueIndex], eqptr) == 0;
-
-                                if (matched) {
-                                    tmp.int_value = tableValueIndex;
-                                    changeValue = true;
-                                }
-                            }
+                    }
+                }
+                break;
+            case MODE_LOOKUP: {
+                    const lookupTableEntry_t *tableEntry = &lookupTables[val->config.lookup.tableIndex];
+                    bool matched = false;
+                    for (uint8_t tableValueIndex = 0; tableValueIndex < tableEntry->valueCount && !matched; tableValueIndex++) {
+                        matched = strcasecmp(tableEntry->values[tableValueIndex], eqptr) == 0;
+
+                        if (matched) {
+                            tmp.int_value = tableValueIndex;
+                            changeValue = true;
                         }
-                        break;
+                    }
                 }
+                break;
+        }
 
-                if (changeValue) {
-                    cliSetVar(val, tmp);
-
-                    cliPrintf("%s set to ", valueTable[i].name);
-                    cliPrintVar(val, 0);
-                } else {
-                    cliPrint("Invalid value. Allowed values are: ");
-                    cliPrintVar(val, 1); // print out min/max/table values
-                    cliPrint("\r\n");
-                }
+        if (changeValue) {
+            cliSetVar(val, tmp);
 
-                return;
-            }
+            cliPrintf("%s set to ", val->name);
+            cliPrintVar(val, 0);
+        } else {
+            cliPrint("Invalid value. Allowed values are: ");
+            cliPrintVar(val, 1); // print out min/max/table values
+            cliPrint("\r\n");
         }
-        cliPrint("Invalid name\r\n");
+
     } else {
         // no equals, check for matching variables.
         cliGet(cmdline);
@@ -2552,6 +2659,18 @@ static void cliStatus(char *cmdline)
 #endif
 
     cliPrintf("Cycle Time: %d, I2C Errors: %d, config size: %d\r\n", cycleTime, i2cErrorCounter, sizeof(master_t));
+
+#ifdef USE_DSHOT
+    if (isDshotMotorMissing(motorCount)) {
+        cliPrint("DShot: motor output without free timer DMA, arming disabled\r\n");
+    }
+#endif
+
+#ifdef MAG
+    if (isCompassFailed()) {
+        cliPrint("Compass: detected but no data, disabled\r\n");
+    }
+#endif
 }
 
 #ifndef SKIP_TASK_STATISTICS
@@ -2704,6 +2823,122 @@ void cliProcess(void)
     }
 }
 
+static uint8_t cliVarTypeSize(uint8_t type)
+{
+    switch (type) {
+        case VAR_UINT8:
+        case VAR_INT8:
+            return 1;
+        case VAR_UINT16:
+        case VAR_INT16:
+            return 2;
+        default:
+            return 4;
+    }
+}
+
+// Binary settings transfer, each setting is: name (null terminated), type (VAR_*), value (little endian, size given by type).
+// Values are exchanged by name so a backup can be restored to a build with different set of settings.
+
+uint16_t cliSettingsCount(void)
+{
+    return VALUE_COUNT;
+}
+
+uint16_t cliSettingsExport(sbuf_t *dst, uint16_t firstIndex)
+{
+    uint16_t index;
+
+    for (index = firstIndex; index < VALUE_COUNT; index++) {
+        const clivalue_t *var = &valueTable[index];
+        const uint8_t *ptr = cliGetVarPtr(var);
+        const uint8_t size = cliVarTypeSize(var->type & VALUE_TYPE_MASK);
+        const int itemSize = strlen(var->name) + 1 + 1 + size;
+
+        if (sbufBytesRemaining(dst) < itemSize) {
+            break;
+        }
+
+        sbufWriteData(dst, var->name, strlen(var->name) + 1);
+        sbufWriteU8(dst, var->type & VALUE_TYPE_MASK);
+        sbufWriteData(dst, ptr, size);
+    }
+
+    return index;
+}
+
+static bool cliIsValidValue(const clivalue_t *var, const uint8_t *data)
+{
+    int32_t value;
+
+    switch (var->type & VALUE_TYPE_MASK) {
+        case VAR_UINT8:
+            value = *(uint8_t *)data;
+            break;
+        case VAR_INT8:
+            value = *(int8_t *)data;
+            break;
+        case VAR_UINT16:
+            value = data[0] | (data[1] << 8);
+            break;
+        case VAR_INT16:
+            value = (int16_t)(data[0] | (data[1] << 8));
+            break;
+        case VAR_UINT32:
+            value = data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+            break;
+        case VAR_FLOAT: {
+                float valuef;
+                memcpy(&valuef, data, sizeof(valuef));
+                return valuef >= var->config.minmax.min && valuef <= var->config.minmax.max;
+            }
+        default:
+            return false;
+    }
+
+    if ((var->type & VALUE_MODE_MASK) == MODE_LOOKUP) {
+        return value >= 0 && value < lookupTables[var->config.lookup.tableIndex].valueCount;
+    }
+
+    return value >= var->config.minmax.min && value <= var->config.minmax.max;
+}
+
+int cliSettingsImport(sbuf_t *src)
+{
+    int appliedCount = 0;
+
+    while (sbufBytesRemaining(src) > 0) {
+        const char *name = (const char *)sbufPtr(src);
+        const char *nameEnd = memchr(name, '\0', sbufBytesRemaining(src));
+        if (!nameEnd) {
+            return -1;
+        }
+        sbufAdvance(src, nameEnd - name + 1);
+
+        const uint8_t type = sbufReadU8(src);
+        const uint8_t size = cliVarTypeSize(type);
+        if (sbufBytesRemaining(src) < size) {
+            return -1;
+        }
+        const uint8_t *data = sbufPtr(src);
+        sbufAdvance(src, size);
+
+        // settings unknown to this build or changed in type or range are skipped, the rest is still applied
+        const clivalue_t *var = cliFindVar(name, nameEnd - name);
+        if (!var || (var->type & VALUE_TYPE_MASK) != type || !cliIsValidValue(var, data)) {
+            continue;
+        }
+
+        memcpy(cliGetVarPtr(var), data, size);
+        if (var->pflags_to_set) {
+            persistentFlagSet(var->pflags_to_set);
+        }
+        appliedCount++;
+    }
+
+    return appliedCount;
+}
+
 void cliInit(serialConfig_t *serialConfig)
 {
     UNUSED(serialConfig);
@@ -23,4 +23,9 @@ extern uint8_t cliMode;
 void cliProcess(void);
 bool cliIsActiveOnPort(serialPort_t *serialPort);
 
+struct sbuf_s;
+uint16_t cliSettingsExport(struct sbuf_s *dst, uint16_t firstIndex);
+int cliSettingsImport(struct sbuf_s *src);
+uint16_t cliSettingsCount(void);
+
 #endif /* CLI_H_ */
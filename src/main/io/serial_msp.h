@@ -30,20 +30,59 @@ typedef enum {
     HEADER_ARROW,
     HEADER_SIZE,
     HEADER_CMD,
+    HEADER_X,
+    HEADER_V2,
+    PAYLOAD_V2,
+    CHECKSUM_V2,
     COMMAND_RECEIVED
 } mspState_e;
 
+typedef enum {
+    MSP_V1 = 0,     // $M, 8-bit command and size, XOR checksum
+    MSP_V2 = 1      // $X, 16-bit command and size, CRC8-DVB-S2
+} mspVersion_e;
+
+#define MSP_V2_HEADER_SIZE 5        // flag, command (16-bit), size (16-bit)
+
+// Receive buffer size, can be overridden per target
+#ifndef MSP_PORT_INBUF_SIZE
+#if defined(NAV_MISSION_STORAGE) || defined(STM32F303xC)
+#define MSP_PORT_INBUF_SIZE 256     // MSP v2 payloads, batched mission upload
+#else
 #define MSP_PORT_INBUF_SIZE 64
+#endif
+#endif
+
+// Replies are built on the stack before they are framed, largest one is MSP_LED_STRIP_CONFIG or MSP_BOXNAMES
+#define MSP_PORT_OUTBUF_SIZE 256
+
+// Time spent processing commands received on a port in one pass, more commands are handled on next pass
+#define MSP_PORT_TIME_BUDGET_US 500
+// Don't start next command if reply might not fit into transmit buffer
+#define MSP_PORT_MIN_TX_FREE    64
+
+// Commands pushed to a port which subscribed for them with MSP_SET_MSP_SUBSCRIPTION
+#define MSP_SUBSCRIPTION_MAX_COUNT  8
+#define MSP_SUBSCRIPTION_MAX_RATE   50      // Hz
+
+typedef struct mspSubscription_s {
+    uint8_t cmds[MSP_SUBSCRIPTION_MAX_COUNT];
+    uint8_t count;                          // 0 when not subscribed
+    mspVersion_e version;                   // framing of the pushed replies, same as of the subscription request
+    uint16_t intervalMs;
+    uint32_t lastPushMs;
+} mspSubscription_t;
 
 typedef struct mspPort_s {
     serialPort_t *port; // null when port unused.
-    uint8_t offset;
-    uint8_t dataSize;
+    uint16_t offset;
+    uint16_t dataSize;
     uint8_t checksum;
-    uint8_t indRX;
     uint8_t inBuf[MSP_PORT_INBUF_SIZE];
     mspState_e c_state;
-    uint8_t cmdMSP;
+    mspVersion_e version;
+    uint16_t cmdMSP;
+    mspSubscription_t subscription;
 } mspPort_t;
 
 void mspInit(void);
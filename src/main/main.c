@@ -43,6 +43,7 @@
 #include "drivers/accgyro.h"
 #include "drivers/compass.h"
 #include "drivers/pwm_mapping.h"
+#include "drivers/pwm_output.h"
 #include "drivers/pwm_rx.h"
 #include "drivers/adc.h"
 #include "drivers/bus_i2c.h"
@@ -268,6 +269,11 @@ void init(void)
 #endif
 
     pwm_params.useOneshot = feature(FEATURE_ONESHOT125);
+#ifdef USE_DSHOT
+    pwm_params.dshotProtocol = masterConfig.dshot_protocol;
+    pwm_params.minThrottle = masterConfig.escAndServoConfig.minthrottle;
+    pwm_params.maxThrottle = masterConfig.escAndServoConfig.maxthrottle;
+#endif
     pwm_params.motorPwmRate = masterConfig.motor_pwm_rate;
     pwm_params.idlePulse = masterConfig.escAndServoConfig.mincommand;
     if (feature(FEATURE_3D))
@@ -289,6 +295,8 @@ void init(void)
 
     systemState |= SYSTEM_STATE_MOTORS_READY;
 
+    pwmSetOutputSync(masterConfig.pwm_output_sync);
+
 #ifdef BEEPER
     beeperConfig_t beeperConfig = {
         .gpioPeripheral = BEEP_PERIPHERAL,
@@ -402,6 +410,11 @@ void init(void)
         failureMode(FAILURE_MISSING_ACC);
     }
 
+    // store new hardware so that the next boot doesn't probe for sensors which are not there
+    if (isDetectedSensorsConfigChanged()) {
+        writeEEPROM();
+    }
+
     systemState |= SYSTEM_STATE_SENSORS_READY;
 
     LED1_ON;
@@ -524,7 +537,7 @@ void init(void)
 #ifdef SOFTSERIAL_LOOPBACK
 void processLoopback(void) {
     if (loopbackPort) {
-        uint8_t bytesWaiting;
+        uint32_t bytesWaiting;
         while ((bytesWaiting = serialRxBytesWaiting(loopbackPort))) {
             uint8_t b = serialRead(loopbackPort);
             serialWrite(loopbackPort, b);
@@ -562,6 +575,9 @@ int main(void) {
 #ifdef SONAR
     setTaskEnabled(TASK_SONAR, sensors(SENSOR_SONAR));
 #endif
+#ifdef NAV
+    setTaskEnabled(TASK_POSITION_ESTIMATOR, true);
+#endif
 #ifdef DISPLAY
     setTaskEnabled(TASK_DISPLAY, feature(FEATURE_DISPLAY));
 #endif
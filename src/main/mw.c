@@ -42,6 +42,7 @@
 #include "drivers/serial.h"
 #include "drivers/timer.h"
 #include "drivers/pwm_rx.h"
+#include "drivers/pwm_output.h"
 #include "drivers/gyro_sync.h"
 
 #include "sensors/sensors.h"
@@ -110,6 +111,7 @@ int16_t telemTemperature1;      // gyro sensor temperature
 static uint32_t disarmAt;     // Time of automatic disarm when "Don't spin the motors when armed" is enabled and auto_disarm_delay is nonzero
 
 extern uint32_t currentTime;
+extern uint8_t motorCount;
 
 static bool isRXDataNew;
 
@@ -121,6 +123,13 @@ bool isCalibrating(void)
     }
 #endif
 
+#ifdef MAG
+    // drivers which calibrate in the background (HMC5883 self test) have no data until they are done
+    if (sensors(SENSOR_MAG) && !isCompassReady()) {
+        return true;
+    }
+#endif
+
     // Note: compass calibration is handled completely differently, outside of the main loop, see f.CALIBRATE_MAG
 
     return (!isAccelerationCalibrationComplete() && sensors(SENSOR_ACC)) || (!isGyroCalibrationComplete());
@@ -192,6 +201,13 @@ void annexCode(void)
             DISABLE_ARMING_FLAG(OK_TO_ARM);
         }
 
+#ifdef USE_DSHOT
+        // a motor of the mixer has no DShot output, see pwmInit()
+        if (isDshotMotorMissing(motorCount)) {
+            DISABLE_ARMING_FLAG(OK_TO_ARM);
+        }
+#endif
+
 #if defined(NAV)
         if (naivationBlockArming()) {
             DISABLE_ARMING_FLAG(OK_TO_ARM);
@@ -533,6 +549,10 @@ void filterRc(bool isRXDataNew)
 
 void taskMainPidLoop(void)
 {
+    // Apply outputs computed in the previous cycle, this keeps a constant delay between gyro sample and actuation
+    // regardless of how long the rest of the loop takes. No-op unless pwm_output_sync is enabled.
+    pwmCommitOutputs();
+
     cycleTime = getTaskDeltaTime(TASK_SELF);
     dT = (float)cycleTime * 0.000001f;
 
@@ -554,7 +574,7 @@ void taskMainPidLoop(void)
     isRXDataNew = false;
 
 #if defined(NAV)
-    updatePositionEstimator();
+    updatePositionEstimator_AccelTopic(currentTime);
     applyWaypointNavigationAndAltitudeHold();
 #endif
 
@@ -728,9 +748,13 @@ void taskUpdateBaro(void)
     if (sensors(SENSOR_BARO)) {
         uint32_t newDeadline = baroUpdate();
         rescheduleTask(TASK_SELF, newDeadline);
-    }
 
-    //updatePositionEstimator_BaroTopic(currentTime);
+#if defined(NAV)
+        if (isBaroReady()) {
+            updatePositionEstimator_BaroTopic(currentTime);
+        }
+#endif
+    }
 }
 #endif
 
@@ -739,9 +763,23 @@ void taskUpdateSonar(void)
 {
     if (sensors(SENSOR_SONAR)) {
         rangefinderUpdate();
+
+#if defined(NAV)
+        updatePositionEstimator_SonarTopic(currentTime);
+#endif
     }
+}
+#endif
 
-    //updatePositionEstimator_SonarTopic(currentTime);
+#if defined(NAV)
+bool taskUpdatePositionEstimatorCheck(uint32_t currentDeltaTime)
+{
+    return isPositionEstimatorUpdateRequired(currentDeltaTime);
+}
+
+void taskUpdatePositionEstimator(void)
+{
+    updatePositionEstimator();
 }
 #endif
 
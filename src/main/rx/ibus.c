@@ -24,6 +24,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "platform.h"
 
@@ -48,6 +49,7 @@ static bool ibusFrameDone = false;
 static uint32_t ibusChannelData[IBUS_MAX_CHANNEL];
 
 static void ibusDataReceive(uint16_t c);
+static void ibusFrameReceive(const uint8_t *frame, uint32_t length, uint32_t frameEndAt);
 static uint16_t ibusReadRawRC(rxRuntimeConfig_t *rxRuntimeConfig, uint8_t chan);
 
 bool ibusInit(rxConfig_t *rxConfig, rxRuntimeConfig_t *rxRuntimeConfig, rcReadRawDataPtr *callback)
@@ -65,8 +67,13 @@ bool ibusInit(rxConfig_t *rxConfig, rxRuntimeConfig_t *rxRuntimeConfig, rcReadRa
     }
 
     serialPort_t *ibusPort = openSerialPort(portConfig->identifier, FUNCTION_RX_SERIAL, ibusDataReceive, IBUS_BAUDRATE, MODE_RX, SERIAL_NOT_INVERTED);
+    if (!ibusPort) {
+        return false;
+    }
+
+    serialSetFrameCallback(ibusPort, ibusFrameReceive);
 
-    return ibusPort != NULL;
+    return true;
 }
 
 static uint8_t ibus[IBUS_BUFFSIZE] = { 0, };
@@ -92,11 +99,24 @@ static void ibusDataReceive(uint16_t c)
 
     if (ibusFramePosition == IBUS_BUFFSIZE - 1) {
         ibusFrameDone = true;
+        serialRxFrameReceived(ibusTime);
     } else {
         ibusFramePosition++;
     }
 }
 
+// Receive ISR callback, frame delimited by idle line
+static void ibusFrameReceive(const uint8_t *frame, uint32_t length, uint32_t frameEndAt)
+{
+    if (length != IBUS_BUFFSIZE || frame[0] != IBUS_SYNCBYTE) {
+        return;
+    }
+
+    memcpy(ibus, frame, IBUS_BUFFSIZE);
+    ibusFrameDone = true;
+    serialRxFrameReceived(frameEndAt);
+}
+
 uint8_t ibusFrameStatus(void)
 {
     uint8_t i;
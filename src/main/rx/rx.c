@@ -74,6 +74,11 @@ static uint32_t needRxSignalBefore = 0;
 static uint32_t suspendRxSignalUntil = 0;
 static uint8_t  skipRxSamples = 0;
 
+#ifdef SERIAL_RX
+static volatile uint32_t serialRxFrameEndAt = 0;
+#endif
+static uint32_t rxFrameLatency = 0;
+
 int16_t rcRaw[MAX_SUPPORTED_RC_CHANNEL_COUNT];     // interval [1000;2000]
 int16_t rcData[MAX_SUPPORTED_RC_CHANNEL_COUNT];     // interval [1000;2000]
 uint32_t rcInvalidPulsPeriod[MAX_SUPPORTED_RC_CHANNEL_COUNT];
@@ -278,8 +283,20 @@ uint8_t serialRxFrameStatus(rxConfig_t *rxConfig)
     }
     return SERIAL_RX_FRAME_PENDING;
 }
+
+// Called by serial RX providers from the receive callback once a frame is complete, frameEndAt is micros() at its last byte
+void serialRxFrameReceived(uint32_t frameEndAt)
+{
+    serialRxFrameEndAt = frameEndAt;
+}
 #endif
 
+// Time from the end of the last serial RX frame on the wire until it was picked up by updateRx(), 0 if not known
+uint32_t rxGetFrameLatency(void)
+{
+    return rxFrameLatency;
+}
+
 uint8_t calculateChannelRemapping(uint8_t *channelMap, uint8_t channelMapEntryCount, uint8_t channelToRemap)
 {
     if (channelToRemap < channelMapEntryCount) {
@@ -345,6 +362,12 @@ void updateRx(uint32_t currentTime)
             rxIsInFailsafeMode = (frameStatus & SERIAL_RX_FRAME_FAILSAFE) != 0;
             rxSignalReceived = !rxIsInFailsafeMode;
             needRxSignalBefore = currentTime + DELAY_10_HZ;
+
+            rxFrameLatency = serialRxFrameEndAt ? currentTime - serialRxFrameEndAt : 0;
+            serialRxFrameEndAt = 0;
+#ifdef DEBUG_RX_LATENCY
+            debug[3] = rxFrameLatency;
+#endif
         }
     }
 #endif
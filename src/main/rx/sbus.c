@@ -18,6 +18,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "platform.h"
 
@@ -74,6 +75,7 @@ static uint16_t sbusStateFlags = 0;
 
 static bool sbusFrameDone = false;
 static void sbusDataReceive(uint16_t c);
+static void sbusFrameReceive(const uint8_t *frame, uint32_t length, uint32_t frameEndAt);
 static uint16_t sbusReadRawRC(rxRuntimeConfig_t *rxRuntimeConfig, uint8_t chan);
 
 static uint32_t sbusChannelData[SBUS_MAX_CHANNEL];
@@ -93,8 +95,14 @@ bool sbusInit(rxConfig_t *rxConfig, rxRuntimeConfig_t *rxRuntimeConfig, rcReadRa
     }
 
     serialPort_t *sBusPort = openSerialPort(portConfig->identifier, FUNCTION_RX_SERIAL, sbusDataReceive, SBUS_BAUDRATE, MODE_RX, SBUS_PORT_OPTIONS);
+    if (!sBusPort) {
+        return false;
+    }
 
-    return sBusPort != NULL;
+    // Whole frames where the port detects idle line, sbusDataReceive otherwise
+    serialSetFrameCallback(sBusPort, sbusFrameReceive);
+
+    return true;
 }
 
 #define SBUS_FLAG_CHANNEL_17        (1 << 0)
@@ -164,6 +172,7 @@ static void sbusDataReceive(uint16_t c)
         if (sbusFramePosition == SBUS_FRAME_SIZE) {
             // endByte currently ignored
             sbusFrameDone = true;
+            serialRxFrameReceived(now);
 #ifdef DEBUG_SBUS_PACKETS
             debug[2] = sbusFrameTime;
 #endif
@@ -173,6 +182,18 @@ static void sbusDataReceive(uint16_t c)
     }
 }
 
+// Receive ISR callback, frame delimited by idle line
+static void sbusFrameReceive(const uint8_t *frame, uint32_t length, uint32_t frameEndAt)
+{
+    if (length != SBUS_FRAME_SIZE || frame[0] != SBUS_FRAME_BEGIN_BYTE) {
+        return;
+    }
+
+    memcpy(sbusFrame.bytes, frame, SBUS_FRAME_SIZE);
+    sbusFrameDone = true;
+    serialRxFrameReceived(frameEndAt);
+}
+
 uint8_t sbusFrameStatus(void)
 {
     if (!sbusFrameDone) {
@@ -47,6 +47,7 @@ static uint16_t sumdChannels[SUMD_MAX_CHANNEL];
 static uint16_t crc;
 
 static void sumdDataReceive(uint16_t c);
+static void sumdFrameReceive(const uint8_t *frame, uint32_t length, uint32_t frameEndAt);
 static uint16_t sumdReadRawRC(rxRuntimeConfig_t *rxRuntimeConfig, uint8_t chan);
 
 bool sumdInit(rxConfig_t *rxConfig, rxRuntimeConfig_t *rxRuntimeConfig, rcReadRawDataPtr *callback)
@@ -64,8 +65,13 @@ bool sumdInit(rxConfig_t *rxConfig, rxRuntimeConfig_t *rxRuntimeConfig, rcReadRa
     }
 
     serialPort_t *sumdPort = openSerialPort(portConfig->identifier, FUNCTION_RX_SERIAL, sumdDataReceive, SUMD_BAUDRATE, MODE_RX, SERIAL_NOT_INVERTED);
+    if (!sumdPort) {
+        return false;
+    }
+
+    serialSetFrameCallback(sumdPort, sumdFrameReceive);
 
-    return sumdPort != NULL;
+    return true;
 }
 
 #define CRC_POLYNOME 0x1021
@@ -119,9 +125,29 @@ static void sumdDataReceive(uint16_t c)
         if (sumdIndex == sumdChannelCount * 2 + 5) {
             sumdIndex = 0;
             sumdFrameDone = true;
+            serialRxFrameReceived(sumdTime);
         }
 }
 
+// Receive ISR callback, frame delimited by idle line
+static void sumdFrameReceive(const uint8_t *frame, uint32_t length, uint32_t frameEndAt)
+{
+    // sync byte, status, channel count, 2 bytes per channel, CRC
+    if (length < 5 || length > SUMD_BUFFSIZE || frame[0] != SUMD_SYNCBYTE || length != frame[2] * 2u + 5) {
+        return;
+    }
+
+    crc = 0;
+    for (uint32_t i = 0; i < length; i++) {
+        sumd[i] = frame[i];
+        if (i < length - 2)
+            CRC16(frame[i]);
+    }
+    sumdChannelCount = frame[2];
+    sumdFrameDone = true;
+    serialRxFrameReceived(frameEndAt);
+}
+
 #define SUMD_OFFSET_CHANNEL_1_HIGH 3
 #define SUMD_OFFSET_CHANNEL_1_LOW 4
 #define SUMD_BYTES_PER_CHANNEL 2
@@ -59,6 +59,9 @@ typedef enum {
 #ifdef SONAR
     TASK_SONAR,
 #endif
+#ifdef NAV
+    TASK_POSITION_ESTIMATOR,
+#endif
 #ifdef DISPLAY
     TASK_DISPLAY,
 #endif
@@ -103,6 +103,16 @@ cfTask_t cfTasks[TASK_COUNT] = {
     },
 #endif
 
+#ifdef NAV
+    [TASK_POSITION_ESTIMATOR] = {
+        .taskName = "POSEST",
+        .checkFunc = taskUpdatePositionEstimatorCheck,
+        .taskFunc = taskUpdatePositionEstimator,
+        .desiredPeriod = 1000000 / 50,          // Runs on new GPS/baro/sonar data, fallback is 50 Hz
+        .staticPriority = TASK_PRIORITY_HIGH,
+    },
+#endif
+
 #ifdef DISPLAY
     [TASK_DISPLAY] = {
         .taskName = "DISPLAY",
@@ -29,6 +29,8 @@ void taskProcessGPS(void);
 void taskUpdateCompass(void);
 void taskUpdateBaro(void);
 void taskUpdateSonar(void);
+bool taskUpdatePositionEstimatorCheck(uint32_t currentDeltaTime);
+void taskUpdatePositionEstimator(void);
 void taskUpdateDisplay(void);
 void taskTelemetry(void);
 void taskLedStrip(void);
@@ -28,6 +28,8 @@
 #include "drivers/barometer.h"
 #include "drivers/system.h"
 #include "config/config.h"
+#include "config/parameter_group.h"
+#include "config/parameter_group_ids.h"
 
 #include "sensors/barometer.h"
 
@@ -44,11 +46,11 @@ int32_t BaroAlt = 0;
 static int32_t baroGroundAltitude = 0;
 static int32_t baroGroundPressure = 0;
 
-static barometerConfig_t *barometerConfig;
+PG_REGISTER_WITH_RESET_FN(barometerConfig_t, barometerConfig, PG_BAROMETER_CONFIG, 0);
 
-void useBarometerConfig(barometerConfig_t *barometerConfigToUse)
+void pgResetFn_barometerConfig(barometerConfig_t *instance)
 {
-    barometerConfig = barometerConfigToUse;
+    instance->use_median_filtering = 1;
 }
 
 bool isBaroCalibrationComplete(void)
@@ -105,6 +107,7 @@ uint32_t baroUpdate(void)
         case BAROMETER_NEEDS_SAMPLES:
             baro.get_ut();
             baro.start_up();
+            baroReady = false;
             state = BAROMETER_NEEDS_CALCULATION;
             return baro.up_delay;
         break;
@@ -113,9 +116,10 @@ uint32_t baroUpdate(void)
             baro.get_up();
             baro.start_ut();
             baro.calculate(&baroPressure, &baroTemperature);
-            if (barometerConfig->use_median_filtering) {
+            if (barometerConfig()->use_median_filtering) {
                 baroPressure = applyBarometerMedianFilter(baroPressure);
             }
+            baroReady = true;   // New pressure reading is available until next conversion is started
             state = BAROMETER_NEEDS_SAMPLES;
             return baro.ut_delay;
         break;
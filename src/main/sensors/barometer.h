@@ -17,6 +17,8 @@
 
 #pragma once
 
+#include "config/parameter_group.h"
+
 typedef enum {
     BARO_DEFAULT = 0,
     BARO_NONE = 1,
@@ -33,11 +35,12 @@ typedef struct barometerConfig_s {
     uint8_t use_median_filtering;       // Use 3-point median filtering
 } barometerConfig_t;
 
+PG_DECLARE(barometerConfig_t, barometerConfig);
+
 extern int32_t BaroAlt;
 extern int32_t baroTemperature;             // Use temperature for telemetry
 
 #ifdef BARO
-void useBarometerConfig(barometerConfig_t *barometerConfigToUse);
 bool isBaroCalibrationComplete(void);
 void baroSetCalibrationCycles(uint16_t calibrationCyclesRequired);
 uint32_t baroUpdate(void);
@@ -217,3 +217,14 @@ uint8_t calculateBatteryCapacityRemainingPercentage(void)
 
     return constrain((batteryCapacity - constrain(mAhDrawn, 0, 0xFFFF)) * 100.0f / batteryCapacity , 0, 100);
 }
+
+uint16_t calculateBatteryCompensationFactor(void)
+{
+    if (!feature(FEATURE_VBAT) || batteryState == BATTERY_NOT_PRESENT || vbat == 0) {
+        return 1000;
+    }
+
+    // Ratio of fully charged to present (filtered) voltage
+    const uint32_t vbatFull = batteryCellCount * batteryConfig->vbatmaxcellvoltage;
+    return constrain(vbatFull * 1000 / vbat, 1000, VBAT_COMPENSATION_MAX);
+}
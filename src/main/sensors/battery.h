@@ -25,6 +25,8 @@
 #define VBAT_SCALE_MIN 0
 #define VBAT_SCALE_MAX 255
 
+#define VBAT_COMPENSATION_MAX 1500          // max motor output boost from voltage compensation, 1000 == 1.0
+
 typedef enum {
     CURRENT_SENSOR_NONE = 0,
     CURRENT_SENSOR_ADC,
@@ -75,4 +77,5 @@ void updateCurrentMeter(int32_t lastUpdateAt, rxConfig_t *rxConfig, uint16_t dea
 int32_t currentMeterToCentiamps(uint16_t src);
 
 uint8_t calculateBatteryPercentage(void);
+uint16_t calculateBatteryCompensationFactor(void);
 uint8_t calculateBatteryCapacityRemainingPercentage(void);
@@ -25,6 +25,7 @@
 #include "common/maths.h"
 
 #include "drivers/sensor.h"
+#include "drivers/system.h"
 #include "drivers/compass.h"
 #include "drivers/compass_hmc5883l.h"
 #include "drivers/gpio.h"
@@ -49,16 +50,24 @@ int16_t magADCRaw[XYZ_AXIS_COUNT];
 int32_t magADC[XYZ_AXIS_COUNT];
 sensor_align_e magAlign = 0;
 #ifdef MAG
+// Driver self test takes about 2s, a compass without any data after this long is dropped instead of blocking arming
+#define COMPASS_READY_TIMEOUT_US 10000000
+
 static uint8_t magInit = 0;
 static uint8_t magUpdatedAtLeastOnce = 0;
+static uint32_t magInitAt = 0;
+static bool magFailed = false;
 
 void compassInit(void)
 {
-    // initialize and calibration. turn on led during mag calibration (calibration routine blinks it)
+    // initialize and calibration. turn on led during mag init, drivers may finish calibration later from updateCompass()
     LED1_ON;
     mag.init();
     LED1_OFF;
     magInit = 1;
+    magInitAt = micros();
+    magUpdatedAtLeastOnce = 0;
+    magFailed = false;
 }
 
 bool isCompassReady(void)
@@ -66,6 +75,12 @@ bool isCompassReady(void)
     return magUpdatedAtLeastOnce;
 }
 
+// Detected compass which never delivered data, SENSOR_MAG is cleared
+bool isCompassFailed(void)
+{
+    return magFailed;
+}
+
 static sensorCalibrationState_t calState;
 
 void updateCompass(flightDynamicsTrims_t *magZero)
@@ -74,7 +89,14 @@ void updateCompass(flightDynamicsTrims_t *magZero)
     static int16_t magPrev[XYZ_AXIS_COUNT];
     uint32_t axis;
 
-    mag.read(magADCRaw);
+    // drivers which calibrate in the background (HMC5883 self test) have no data until they are done
+    if (!mag.read(magADCRaw)) {
+        if (!magUpdatedAtLeastOnce && (currentTime - magInitAt) > COMPASS_READY_TIMEOUT_US) {
+            sensorsClear(SENSOR_MAG);
+            magFailed = true;
+        }
+        return;
+    }
     for (axis = 0; axis < XYZ_AXIS_COUNT; axis++) magADC[axis] = magADCRaw[axis];  // int32_t copy to work with
 
     if (STATE(CALIBRATE_MAG)) {
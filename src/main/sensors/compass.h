@@ -34,6 +34,7 @@ typedef enum {
 void compassInit(void);
 void updateCompass(flightDynamicsTrims_t *magZero);
 bool isCompassReady(void);
+bool isCompassFailed(void);
 #endif
 
 extern int32_t magADC[XYZ_AXIS_COUNT];
@@ -62,6 +62,8 @@
 
 #include "config/runtime_config.h"
 #include "config/config.h"
+#include "config/parameter_group.h"
+#include "config/parameter_group_ids.h"
 
 #include "sensors/sensors.h"
 #include "sensors/acceleration.h"
@@ -87,6 +89,18 @@ extern acc_t acc;
 
 uint8_t detectedSensors[SENSOR_INDEX_COUNT] = { GYRO_NONE, ACC_NONE, BARO_NONE, MAG_NONE, RANGEFINDER_NONE };
 
+PG_REGISTER_WITH_RESET_FN(detectedSensorsConfig_t, detectedSensorsConfig, PG_DETECTED_SENSORS_CONFIG, 0);
+
+void pgResetFn_detectedSensorsConfig(detectedSensorsConfig_t *instance)
+{
+    instance->gyro = GYRO_DEFAULT;
+    instance->acc = ACC_DEFAULT;
+    instance->baro = BARO_DEFAULT;
+    instance->mag = MAG_DEFAULT;
+}
+
+static bool detectedSensorsChanged = false;
+
 
 const extiConfig_t *selectMPUIntExtiConfig(void)
 {
@@ -270,20 +284,21 @@ static bool fakeMagDetect(mag_t *mag)
 }
 #endif
 
-bool detectGyro(void)
+static bool detectGyro(gyroSensor_e gyroHardwareToUse)
 {
-    gyroSensor_e gyroHardware = GYRO_DEFAULT;
+    gyroSensor_e gyroHardware;
 
+retry:
     gyroAlign = ALIGN_DEFAULT;
 
-    switch(gyroHardware) {
+    switch(gyroHardwareToUse) {
         case GYRO_DEFAULT:
             ; // fallthrough
         case GYRO_MPU6050:
 #ifdef USE_GYRO_MPU6050
             if (mpu6050GyroDetect(&gyro)) {
-#ifdef GYRO_MPU6050_ALIGN
                 gyroHardware = GYRO_MPU6050;
+#ifdef GYRO_MPU6050_ALIGN
                 gyroAlign = GYRO_MPU6050_ALIGN;
 #endif
                 break;
@@ -293,8 +308,8 @@ bool detectGyro(void)
         case GYRO_L3G4200D:
 #ifdef USE_GYRO_L3G4200D
             if (l3g4200dDetect(&gyro)) {
-#ifdef GYRO_L3G4200D_ALIGN
                 gyroHardware = GYRO_L3G4200D;
+#ifdef GYRO_L3G4200D_ALIGN
                 gyroAlign = GYRO_L3G4200D_ALIGN;
 #endif
                 break;
@@ -305,8 +320,8 @@ bool detectGyro(void)
         case GYRO_MPU3050:
 #ifdef USE_GYRO_MPU3050
             if (mpu3050Detect(&gyro)) {
-#ifdef GYRO_MPU3050_ALIGN
                 gyroHardware = GYRO_MPU3050;
+#ifdef GYRO_MPU3050_ALIGN
                 gyroAlign = GYRO_MPU3050_ALIGN;
 #endif
                 break;
@@ -317,8 +332,8 @@ bool detectGyro(void)
         case GYRO_L3GD20:
 #ifdef USE_GYRO_L3GD20
             if (l3gd20Detect(&gyro)) {
-#ifdef GYRO_L3GD20_ALIGN
                 gyroHardware = GYRO_L3GD20;
+#ifdef GYRO_L3GD20_ALIGN
                 gyroAlign = GYRO_L3GD20_ALIGN;
 #endif
                 break;
@@ -329,8 +344,8 @@ bool detectGyro(void)
         case GYRO_MPU6000:
 #ifdef USE_GYRO_SPI_MPU6000
             if (mpu6000SpiGyroDetect(&gyro)) {
-#ifdef GYRO_MPU6000_ALIGN
                 gyroHardware = GYRO_MPU6000;
+#ifdef GYRO_MPU6000_ALIGN
                 gyroAlign = GYRO_MPU6000_ALIGN;
 #endif
                 break;
@@ -368,6 +383,12 @@ bool detectGyro(void)
             gyroHardware = GYRO_NONE;
     }
 
+    if (gyroHardware == GYRO_NONE && gyroHardwareToUse != GYRO_DEFAULT) {
+        // Remembered sensor isn't present any more, probe all of them.
+        gyroHardwareToUse = GYRO_DEFAULT;
+        goto retry;
+    }
+
     if (gyroHardware == GYRO_NONE) {
         return false;
     }
@@ -522,7 +543,7 @@ static void detectBaro(baroSensor_e baroHardwareToUse)
 #else
     // Detect what pressure sensors are available. baro->update() is set to sensor-specific update function
 
-    baroSensor_e baroHardware = baroHardwareToUse;
+    baroSensor_e baroHardware;
 
 #ifdef USE_BARO_BMP085
 
@@ -547,7 +568,8 @@ static void detectBaro(baroSensor_e baroHardwareToUse)
 
 #endif
 
-    switch (baroHardware) {
+retry:
+    switch (baroHardwareToUse) {
         case BARO_DEFAULT:
             ; // fallthough
 
@@ -588,6 +610,12 @@ static void detectBaro(baroSensor_e baroHardwareToUse)
             break;
     }
 
+    if (baroHardware == BARO_NONE && baroHardwareToUse != BARO_DEFAULT && baroHardwareToUse != BARO_NONE) {
+        // Nothing was found and we have a forced or remembered sensor that isn't present.
+        baroHardwareToUse = BARO_DEFAULT;
+        goto retry;
+    }
+
     if (baroHardware == BARO_NONE) {
         return;
     }
@@ -757,6 +785,30 @@ static rangefinderType_e detectRangefinder(void)
 }
 #endif
 
+// Sensor found on the last boot is probed first, probes which failed on the last boot are skipped unless it is gone.
+// Sensor selected in the config always wins.
+static uint8_t firstSensorToProbe(uint8_t configuredHardware, uint8_t rememberedHardware, uint8_t defaultHardware, uint8_t noneHardware, uint8_t maxHardware)
+{
+    if (configuredHardware != defaultHardware || rememberedHardware == noneHardware || rememberedHardware > maxHardware) {
+        return configuredHardware;
+    }
+    return rememberedHardware;
+}
+
+static void rememberDetectedSensor(uint8_t *rememberedHardware, sensorIndex_e index, uint8_t noneHardware)
+{
+    // a sensor which wasn't found is kept, it costs a single failed probe on the next boot
+    if (detectedSensors[index] != noneHardware && detectedSensors[index] != *rememberedHardware) {
+        *rememberedHardware = detectedSensors[index];
+        detectedSensorsChanged = true;
+    }
+}
+
+bool isDetectedSensorsConfigChanged(void)
+{
+    return detectedSensorsChanged;
+}
+
 static void reconfigureAlignment(const sensorAlignmentConfig_t *sensorAlignmentConfig)
 {
     if (sensorAlignmentConfig->gyro_align != ALIGN_DEFAULT) {
@@ -781,11 +833,13 @@ bool sensorsAutodetect(sensorAlignmentConfig_t *sensorAlignmentConfig, uint8_t g
     detectMpu(mpuExtiConfig);
 #endif
 
-    if (!detectGyro()) {
+    const detectedSensorsConfig_t *remembered = detectedSensorsConfig();
+
+    if (!detectGyro(firstSensorToProbe(GYRO_DEFAULT, remembered->gyro, GYRO_DEFAULT, GYRO_NONE, GYRO_FAKE))) {
         return false;
     }
-    detectAcc(accHardwareToUse);
-    detectBaro(baroHardwareToUse);
+    detectAcc(firstSensorToProbe(accHardwareToUse, remembered->acc, ACC_DEFAULT, ACC_NONE, ACC_MAX));
+    detectBaro(firstSensorToProbe(baroHardwareToUse, remembered->baro, BARO_DEFAULT, BARO_NONE, BARO_MAX));
 
 
     // Now time to init things, acc first
@@ -795,7 +849,13 @@ bool sensorsAutodetect(sensorAlignmentConfig_t *sensorAlignmentConfig, uint8_t g
 
     gyro.init(gyroLpf);
 
-    detectMag(magHardwareToUse);
+    detectMag(firstSensorToProbe(magHardwareToUse, remembered->mag, MAG_DEFAULT, MAG_NONE, MAG_MAX));
+
+    detectedSensorsConfig_t *detected = detectedSensorsConfigMutable();
+    rememberDetectedSensor(&detected->gyro, SENSOR_INDEX_GYRO, GYRO_NONE);
+    rememberDetectedSensor(&detected->acc, SENSOR_INDEX_ACC, ACC_NONE);
+    rememberDetectedSensor(&detected->baro, SENSOR_INDEX_BARO, BARO_NONE);
+    rememberDetectedSensor(&detected->mag, SENSOR_INDEX_MAG, MAG_NONE);
 
     reconfigureAlignment(sensorAlignmentConfig);
 
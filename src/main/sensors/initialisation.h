@@ -17,6 +17,19 @@
 
 #pragma once
 
+#include "config/parameter_group.h"
+
+// Sensors found on the last boot, probed first on the next one
+typedef struct detectedSensorsConfig_s {
+    uint8_t gyro;                           // gyroSensor_e
+    uint8_t acc;                            // accelerationSensor_e
+    uint8_t baro;                           // baroSensor_e
+    uint8_t mag;                            // magSensor_e
+} detectedSensorsConfig_t;
+
+PG_DECLARE(detectedSensorsConfig_t, detectedSensorsConfig);
+
 bool sensorsAutodetect(sensorAlignmentConfig_t *sensorAlignmentConfig, uint8_t gyroLpf,
         uint8_t accHardwareToUse, uint8_t magHardwareToUse, uint8_t baroHardwareToUse,
         int16_t magDeclinationFromConfig);
+bool isDetectedSensorsConfigChanged(void);
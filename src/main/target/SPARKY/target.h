@@ -112,6 +112,8 @@
 #define NAV
 #define NAV_AUTO_MAG_DECLINATION
 #define NAV_GPS_GLITCH_DETECTION
+#define NAV_POS_ESTIMATOR_EKF
+#define NAV_MISSION_STORAGE    // flash is reserved by MISSION_STORAGE in target.mk
 
 #define SONAR
 #define SONAR_TRIGGER_PIN           Pin_2   // PWM6 (PA2) - only 3.3v ( add a 1K Ohms resistor )
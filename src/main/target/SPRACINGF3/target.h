@@ -169,6 +169,8 @@
 #define NAV
 #define NAV_AUTO_MAG_DECLINATION
 #define NAV_GPS_GLITCH_DETECTION
+#define NAV_POS_ESTIMATOR_EKF
+#define NAV_MISSION_STORAGE    // flash is reserved by MISSION_STORAGE in target.mk
 
 #define SPEKTRUM_BIND
 // USART3,
@@ -177,6 +179,9 @@
 
 #define USE_SERIAL_4WAY_BLHELI_INTERFACE
 
+// Motor timers TIM16, TIM17, TIM4 and TIM15 use DMA1 channels 3, 1, 7 and 5 for DShot, LED strip is on channel 2
+#define USE_DSHOT
+
 #define USED_TIMERS  (TIM_N(1) | TIM_N(2) | TIM_N(3) | TIM_N(4) | TIM_N(15) | TIM_N(16) |TIM_N(17))
 
 #define TIMER_APB1_PERIPHERALS (RCC_APB1Periph_TIM2 | RCC_APB1Periph_TIM3 | RCC_APB1Periph_TIM4)
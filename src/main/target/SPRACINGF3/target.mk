@@ -1,5 +1,5 @@
 F3_TARGETS  += $(TARGET)
-FEATURES    = VCP ONBOARDFLASH
+FEATURES    = VCP ONBOARDFLASH MISSION_STORAGE
 
 TARGET_SRC = \
             drivers/accgyro_mpu.c \
@@ -10,6 +10,7 @@ TARGET_SRC = \
             drivers/compass_ak8975.c \
             drivers/compass_hmc5883l.c \
             drivers/compass_mag3110.c \
+            drivers/dshot.c \
             drivers/light_ws2811strip.c \
             drivers/light_ws2811strip_stm32f30x.c \
             drivers/serial_softserial.c \
@@ -249,7 +249,7 @@ static void ltm_nframe(void)
     ltm_serialise_8(NAV_Status.mode);
     ltm_serialise_8(NAV_Status.state);
     ltm_serialise_8(NAV_Status.activeWpAction);
-    ltm_serialise_8(NAV_Status.activeWpNumber);
+    ltm_serialise_8(MIN(NAV_Status.activeWpNumber, 255));
     ltm_serialise_8(NAV_Status.error);
     ltm_serialise_8(NAV_Status.flags);
     ltm_finalise();
@@ -66,6 +66,9 @@
 #include "telemetry/telemetry.h"
 #include "telemetry/mavlink.h"
 
+// Only one link is used, avoid allocating receive buffers for unused channels
+#define MAVLINK_COMM_NUM_BUFFERS 1
+
 #include "mavlink/common/mavlink.h"
 
 #include "config/config.h"
@@ -82,7 +85,7 @@
 #include "mavlink/common/mavlink.h"
 #pragma GCC diagnostic pop
 
-#define TELEMETRY_MAVLINK_INITIAL_PORT_MODE MODE_TX
+#define TELEMETRY_MAVLINK_INITIAL_PORT_MODE MODE_RXTX
 #define TELEMETRY_MAVLINK_MAXRATE 50
 #define TELEMETRY_MAVLINK_DELAY ((1000 * 1000) / TELEMETRY_MAVLINK_MAXRATE)
 
@@ -110,6 +113,23 @@ static mavlink_message_t mavMsg;
 static uint8_t mavBuffer[MAVLINK_MAX_PACKET_LEN];
 static uint32_t lastMavlinkMessage = 0;
 
+#if defined(NAV)
+// SET_POSITION_TARGET_GLOBAL_INT type_mask bits
+#define MAVLINK_POSITION_TARGET_IGNORE_POSITION     0x0007
+#define MAVLINK_POSITION_TARGET_IGNORE_YAW          0x0400
+
+static mavlink_message_t mavRecvMsg;
+static mavlink_status_t mavRecvStatus;
+
+/* Mission upload state, seq == count means upload is complete */
+static uint16_t incomingMissionWpCount = 0;
+static uint16_t incomingMissionWpSequence = 0;
+
+/* COMMAND_LONG latched for navigation, acknowledged once the navigation pass applied it */
+static bool commandAckPending = false;
+static uint16_t commandAckCommand;
+#endif
+
 static int mavlinkStreamTrigger(enum MAV_DATA_STREAM streamNum)
 {
     uint8_t rate = (uint8_t) mavRates[streamNum];
@@ -501,6 +521,313 @@ void mavlinkSendHUDAndHeartbeat(void)
     mavlinkSerialWrite(mavBuffer, msgLength);
 }
 
+#if defined(NAV)
+static void mavlinkSendMissionAck(uint8_t type)
+{
+    uint16_t msgLength;
+    mavlink_msg_mission_ack_pack(0, 200, &mavMsg, mavRecvMsg.sysid, mavRecvMsg.compid, type);
+    msgLength = mavlink_msg_to_send_buffer(mavBuffer, &mavMsg);
+    mavlinkSerialWrite(mavBuffer, msgLength);
+}
+
+static void mavlinkSendMissionRequest(uint16_t seq)
+{
+    uint16_t msgLength;
+    mavlink_msg_mission_request_pack(0, 200, &mavMsg, mavRecvMsg.sysid, mavRecvMsg.compid, seq);
+    msgLength = mavlink_msg_to_send_buffer(mavBuffer, &mavMsg);
+    mavlinkSerialWrite(mavBuffer, msgLength);
+}
+
+static void mavlinkAbortMissionUpload(uint8_t ackType)
+{
+    incomingMissionWpCount = 0;
+    incomingMissionWpSequence = 0;
+    mavlinkSendMissionAck(ackType);
+}
+
+static void handleIncoming_MISSION_CLEAR_ALL(void)
+{
+    if (ARMING_FLAG(ARMED)) {
+        mavlinkSendMissionAck(MAV_MISSION_ERROR);
+        return;
+    }
+
+    resetWaypointList();
+    mavlinkAbortMissionUpload(MAV_MISSION_ACCEPTED);
+}
+
+static void handleIncoming_MISSION_COUNT(void)
+{
+    mavlink_mission_count_t msg;
+    mavlink_msg_mission_count_decode(&mavRecvMsg, &msg);
+
+    // Mission can only be replaced when disarmed
+    if (ARMING_FLAG(ARMED)) {
+        mavlinkAbortMissionUpload(MAV_MISSION_ERROR);
+        return;
+    }
+
+    if (msg.count > NAV_MAX_WAYPOINTS) {
+        mavlinkAbortMissionUpload(MAV_MISSION_NO_SPACE);
+        return;
+    }
+
+    if (msg.count == 0) {
+        resetWaypointList();
+        mavlinkAbortMissionUpload(MAV_MISSION_ACCEPTED);
+        return;
+    }
+
+    incomingMissionWpCount = msg.count;
+    incomingMissionWpSequence = 0;
+    mavlinkSendMissionRequest(incomingMissionWpSequence);
+}
+
+static void mavlinkHandleIncomingMissionItem(uint16_t seq, uint8_t frame, uint16_t command, int32_t lat, int32_t lon, float alt)
+{
+    if (incomingMissionWpCount == 0) {
+        mavlinkSendMissionAck(MAV_MISSION_ERROR);
+        return;
+    }
+
+    // Our request or ack got lost and GCS repeated the previous item - repeat the response
+    if (seq + 1 == incomingMissionWpSequence) {
+        if (incomingMissionWpSequence == incomingMissionWpCount) {
+            mavlinkSendMissionAck(MAV_MISSION_ACCEPTED);
+        }
+        else {
+            mavlinkSendMissionRequest(incomingMissionWpSequence);
+        }
+        return;
+    }
+
+    if (seq != incomingMissionWpSequence || ARMING_FLAG(ARMED)) {
+        mavlinkAbortMissionUpload(ARMING_FLAG(ARMED) ? MAV_MISSION_ERROR : MAV_MISSION_INVALID_SEQUENCE);
+        return;
+    }
+
+    navWaypoint_t wp;
+    memset(&wp, 0, sizeof(wp));
+
+    if (command == MAV_CMD_NAV_WAYPOINT) {
+        if (frame != MAV_FRAME_GLOBAL_RELATIVE_ALT && frame != MAV_FRAME_GLOBAL_RELATIVE_ALT_INT) {
+            mavlinkAbortMissionUpload(MAV_MISSION_UNSUPPORTED_FRAME);
+            return;
+        }
+
+        wp.action = NAV_WP_ACTION_WAYPOINT;
+        wp.lat = lat;
+        wp.lon = lon;
+        wp.alt = lrintf(alt * 100.0f);
+    }
+    else if (command == MAV_CMD_NAV_RETURN_TO_LAUNCH) {
+        wp.action = NAV_WP_ACTION_RTH;
+    }
+    else {
+        mavlinkAbortMissionUpload(MAV_MISSION_UNSUPPORTED);
+        return;
+    }
+
+    if (seq == incomingMissionWpCount - 1) {
+        wp.flag = NAV_WP_FLAG_LAST;
+    }
+
+    if (!setMissionWaypoint(seq + 1, &wp)) {
+        mavlinkAbortMissionUpload(MAV_MISSION_NO_SPACE);
+        return;
+    }
+
+    incomingMissionWpSequence++;
+
+    if (incomingMissionWpSequence == incomingMissionWpCount) {
+        mavlinkSendMissionAck(MAV_MISSION_ACCEPTED);
+    }
+    else {
+        mavlinkSendMissionRequest(incomingMissionWpSequence);
+    }
+}
+
+static void handleIncoming_MISSION_ITEM(void)
+{
+    mavlink_mission_item_t msg;
+    mavlink_msg_mission_item_decode(&mavRecvMsg, &msg);
+
+    mavlinkHandleIncomingMissionItem(msg.seq, msg.frame, msg.command, lrint((double)msg.x * 10000000), lrint((double)msg.y * 10000000), msg.z);
+}
+
+static void handleIncoming_MISSION_ITEM_INT(void)
+{
+    mavlink_mission_item_int_t msg;
+    mavlink_msg_mission_item_int_decode(&mavRecvMsg, &msg);
+
+    mavlinkHandleIncomingMissionItem(msg.seq, msg.frame, msg.command, msg.x, msg.y, msg.z);
+}
+
+static void handleIncoming_MISSION_REQUEST_LIST(void)
+{
+    uint16_t msgLength;
+    mavlink_msg_mission_count_pack(0, 200, &mavMsg, mavRecvMsg.sysid, mavRecvMsg.compid, isWaypointListValid() ? getWaypointCount() : 0);
+    msgLength = mavlink_msg_to_send_buffer(mavBuffer, &mavMsg);
+    mavlinkSerialWrite(mavBuffer, msgLength);
+}
+
+static void handleIncoming_MISSION_REQUEST(void)
+{
+    uint16_t msgLength;
+    mavlink_mission_request_t msg;
+    navWaypoint_t wp;
+
+    mavlink_msg_mission_request_decode(&mavRecvMsg, &msg);
+
+    if (!isWaypointListValid() || !getMissionWaypoint(msg.seq + 1, &wp)) {
+        mavlinkSendMissionAck(MAV_MISSION_INVALID_SEQUENCE);
+        return;
+    }
+
+    if (wp.action == NAV_WP_ACTION_RTH) {
+        mavlink_msg_mission_item_int_pack(0, 200, &mavMsg, mavRecvMsg.sysid, mavRecvMsg.compid,
+            msg.seq, MAV_FRAME_MISSION, MAV_CMD_NAV_RETURN_TO_LAUNCH, 0, 1, 0, 0, 0, 0, 0, 0, 0);
+    }
+    else {
+        mavlink_msg_mission_item_int_pack(0, 200, &mavMsg, mavRecvMsg.sysid, mavRecvMsg.compid,
+            msg.seq, MAV_FRAME_GLOBAL_RELATIVE_ALT_INT, MAV_CMD_NAV_WAYPOINT, 0, 1, 0, 0, 0, 0, wp.lat, wp.lon, wp.alt / 100.0f);
+    }
+    msgLength = mavlink_msg_to_send_buffer(mavBuffer, &mavMsg);
+    mavlinkSerialWrite(mavBuffer, msgLength);
+}
+
+static void mavlinkSendCommandAck(uint16_t command, uint8_t result)
+{
+    uint16_t msgLength;
+
+    mavlink_msg_command_ack_pack(0, 200, &mavMsg, command, result);
+    msgLength = mavlink_msg_to_send_buffer(mavBuffer, &mavMsg);
+    mavlinkSerialWrite(mavBuffer, msgLength);
+}
+
+static void mavlinkSendPendingCommandAck(void)
+{
+    if (!commandAckPending) {
+        return;
+    }
+
+    switch (navigationGetGCSCommandStatus()) {
+        case NAV_GCS_COMMAND_STATUS_PENDING:
+            return;
+        case NAV_GCS_COMMAND_STATUS_ACCEPTED:
+            mavlinkSendCommandAck(commandAckCommand, MAV_RESULT_ACCEPTED);
+            break;
+        default:
+            mavlinkSendCommandAck(commandAckCommand, MAV_RESULT_TEMPORARILY_REJECTED);
+            break;
+    }
+
+    commandAckPending = false;
+}
+
+static void handleIncoming_COMMAND_LONG(void)
+{
+    mavlink_command_long_t msg;
+    navGCSCommand_e command;
+
+    mavlink_msg_command_long_decode(&mavRecvMsg, &msg);
+
+    switch (msg.command) {
+        case MAV_CMD_NAV_RETURN_TO_LAUNCH:
+            command = NAV_GCS_COMMAND_RTH;
+            break;
+        case MAV_CMD_NAV_LAND:
+            command = NAV_GCS_COMMAND_LAND;
+            break;
+        case MAV_CMD_NAV_LOITER_UNLIM:
+            command = NAV_GCS_COMMAND_HOLD;
+            break;
+        default:
+            mavlinkSendCommandAck(msg.command, MAV_RESULT_UNSUPPORTED);
+            return;
+    }
+
+    // Navigation applies the command on its next pass, result is acknowledged from mavlinkSendPendingCommandAck()
+    if (commandAckPending || !navigationSetGCSCommand(command, NULL)) {
+        mavlinkSendCommandAck(msg.command, MAV_RESULT_TEMPORARILY_REJECTED);
+        return;
+    }
+
+    commandAckPending = true;
+    commandAckCommand = msg.command;
+}
+
+static void handleIncoming_SET_POSITION_TARGET_GLOBAL_INT(void)
+{
+    mavlink_set_position_target_global_int_t msg;
+    mavlink_msg_set_position_target_global_int_decode(&mavRecvMsg, &msg);
+
+    if (msg.coordinate_frame != MAV_FRAME_GLOBAL_RELATIVE_ALT_INT || (msg.type_mask & MAVLINK_POSITION_TARGET_IGNORE_POSITION)) {
+        return;
+    }
+
+    // Position target is followed in 3D position hold, same as WP #255 via MSP
+    navWaypoint_t wp;
+    memset(&wp, 0, sizeof(wp));
+    wp.action = NAV_WP_ACTION_WAYPOINT;
+    wp.lat = msg.lat_int;
+    wp.lon = msg.lon_int;
+    wp.alt = lrintf(msg.alt * 100.0f);
+
+    if (!(msg.type_mask & MAVLINK_POSITION_TARGET_IGNORE_YAW)) {
+        int16_t yaw = lrintf(RADIANS_TO_DEGREES(msg.yaw));
+        wp.p1 = (yaw + 360) % 360;
+    }
+
+    // Target is set by navigation once hold is engaged, no reply is expected by GCS
+    navigationSetGCSCommand(NAV_GCS_COMMAND_HOLD, &wp);
+}
+
+static void processMAVLinkIncomingMessage(void)
+{
+    switch (mavRecvMsg.msgid) {
+        case MAVLINK_MSG_ID_MISSION_CLEAR_ALL:
+            handleIncoming_MISSION_CLEAR_ALL();
+            break;
+        case MAVLINK_MSG_ID_MISSION_COUNT:
+            handleIncoming_MISSION_COUNT();
+            break;
+        case MAVLINK_MSG_ID_MISSION_ITEM:
+            handleIncoming_MISSION_ITEM();
+            break;
+        case MAVLINK_MSG_ID_MISSION_ITEM_INT:
+            handleIncoming_MISSION_ITEM_INT();
+            break;
+        case MAVLINK_MSG_ID_MISSION_REQUEST_LIST:
+            handleIncoming_MISSION_REQUEST_LIST();
+            break;
+        case MAVLINK_MSG_ID_MISSION_REQUEST:
+            handleIncoming_MISSION_REQUEST();
+            break;
+        case MAVLINK_MSG_ID_COMMAND_LONG:
+            handleIncoming_COMMAND_LONG();
+            break;
+        case MAVLINK_MSG_ID_SET_POSITION_TARGET_GLOBAL_INT:
+            handleIncoming_SET_POSITION_TARGET_GLOBAL_INT();
+            break;
+        default:
+            break;
+    }
+}
+
+static void processMAVLinkIncomingTelemetry(void)
+{
+    // Handle at most one message per call, every reply has to fit into serial TX buffer
+    while (serialRxBytesWaiting(mavlinkPort) > 0) {
+        uint8_t c = serialRead(mavlinkPort);
+        if (mavlink_parse_char(MAVLINK_COMM_0, c, &mavRecvMsg, &mavRecvStatus)) {
+            processMAVLinkIncomingMessage();
+            break;
+        }
+    }
+}
+#endif
+
 void processMAVLinkTelemetry(void)
 {
     // is executed @ TELEMETRY_MAVLINK_MAXRATE rate
@@ -537,6 +864,11 @@ void handleMAVLinkTelemetry(void)
         return;
     }
     
+#if defined(NAV)
+    mavlinkSendPendingCommandAck();
+    processMAVLinkIncomingTelemetry();
+#endif
+
     uint32_t now = micros();
     if ((now - lastMavlinkMessage) >= TELEMETRY_MAVLINK_DELAY) {
         processMAVLinkTelemetry();
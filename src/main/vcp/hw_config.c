@@ -36,10 +36,13 @@
 #include "usb_pwr.h"
 
 #include <stdbool.h>
+#include <string.h>
 #include "drivers/system.h"
 #include "drivers/nvic.h"
 
 #include "build_config.h"
+#include "common/atomic.h"
+#include "common/maths.h"
 
 
 /* Private typedef -----------------------------------------------------------*/
@@ -48,12 +51,22 @@
 /* Private variables ---------------------------------------------------------*/
 ErrorStatus HSEStartUpStatus;
 EXTI_InitTypeDef EXTI_InitStructure;
-__IO uint32_t packetSent;                                     // HJI
-extern __IO uint32_t receiveLength;                          // HJI
-
-uint8_t receiveBuffer[64];                                   // HJI
-uint32_t sendLength;                                          // HJI
 static void IntToUnicode(uint32_t value, uint8_t *pbuf, uint8_t len);
+
+// Data to the PC is queued in txBuffer and sent from the USB interrupt. ENDP1 is double buffered: the next packet is
+// copied into the buffer owned by software while the other one is sent, so the interrupt only has to hand it over.
+static uint8_t txBuffer[USB_TX_BUFFER_SIZE];
+static volatile uint16_t txHead;                // written by CDC_Send_DATA
+static volatile uint16_t txTail;                // written with USB interrupt masked
+static volatile bool txPacketQueued;            // packet handed over to USB peripheral, waiting for IN token
+static volatile int16_t txPreparedLength = -1;  // length of packet in the software owned buffer, -1 if none
+static bool txZeroLengthPacketNeeded;           // last packet was a full one, transfer must be terminated
+
+// Data from the PC, ENDP3 is left NAKing while there is no room for another packet
+static uint8_t rxBuffer[USB_RX_BUFFER_SIZE];
+static volatile uint16_t rxHead;                // written from USB interrupt
+static volatile uint16_t rxTail;                // written by CDC_Receive_Consume
+static volatile bool rxEndpointNak;
 /* Extern variables ----------------------------------------------------------*/
 
 /* Private function prototypes -----------------------------------------------*/
@@ -210,6 +223,10 @@ void USB_Interrupts_Config(void)
     NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
     NVIC_Init(&NVIC_InitStructure);
 
+    /* Correct transfers on double buffered bulk endpoints are signalled on the high priority interrupt */
+    NVIC_InitStructure.NVIC_IRQChannel = USB_HP_CAN1_TX_IRQn;
+    NVIC_Init(&NVIC_InitStructure);
+
     /* Enable the USB Wake-up interrupt */
     NVIC_InitStructure.NVIC_IRQChannel = USBWakeUp_IRQn;
     NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = NVIC_PRIORITY_BASE(NVIC_PRIO_USB_WUP);
@@ -275,36 +292,195 @@ static void IntToUnicode(uint32_t value, uint8_t *pbuf, uint8_t len)
     }
 }
 
+static uint32_t txBytesQueued(void)
+{
+    return (txHead - txTail) & (USB_TX_BUFFER_SIZE - 1);
+}
+
 /*******************************************************************************
- * Function Name  : Send DATA .
- * Description    : send the data received from the STM32 to the PC through USB  
+ * Function Name  : cdcTxPreparePacket.
+ * Description    : copy next packet from txBuffer into the software owned half of ENDP1.
+ *                  Called with USB interrupt masked.
+ * Input          : None.
+ * Output         : None.
+ * Return         : None.
+ *******************************************************************************/
+static void cdcTxPreparePacket(void)
+{
+    uint8_t packet[VIRTUAL_COM_PORT_DATA_SIZE];
+    const uint32_t length = MIN(txBytesQueued(), sizeof(packet));
+
+    if (length == 0 && !txZeroLengthPacketNeeded) {
+        return;
+    }
+
+    uint16_t tail = txTail;
+    for (uint32_t i = 0; i < length; i++) {
+        packet[i] = txBuffer[tail];
+        tail = (tail + 1) & (USB_TX_BUFFER_SIZE - 1);
+    }
+    txTail = tail;
+
+    // software owned buffer is selected by SW_BUF, which is the DTOG_RX bit of an IN endpoint
+    if (_GetENDPOINT(ENDP1) & EP_DTOG_RX) {
+        UserToPMABufferCopy(packet, ENDP1_BUF1ADDR, length);
+        SetEPDblBuf1Count(ENDP1, EP_DBUF_IN, length);
+    } else {
+        UserToPMABufferCopy(packet, ENDP1_BUF0ADDR, length);
+        SetEPDblBuf0Count(ENDP1, EP_DBUF_IN, length);
+    }
+
+    // host only completes a transfer on a short packet
+    txZeroLengthPacketNeeded = (length == sizeof(packet));
+    txPreparedLength = length;
+}
+
+/*******************************************************************************
+ * Function Name  : cdcTxService.
+ * Description    : hand prepared packet over to USB peripheral if it is idle and prepare the next one.
+ *                  Toggling SW_BUF while a packet is still queued would make the endpoint NAK, so only
+ *                  one packet is queued and the second one waits prepared in the software owned buffer.
+ *                  Called with USB interrupt masked.
  * Input          : None.
  * Output         : None.
  * Return         : None.
  *******************************************************************************/
-uint32_t CDC_Send_DATA(uint8_t *ptrBuffer, uint8_t sendLength)
+static void cdcTxService(void)
+{
+    if (!txPacketQueued) {
+        if (txPreparedLength < 0) {
+            cdcTxPreparePacket();
+        }
+        if (txPreparedLength < 0) {
+            return;
+        }
+        FreeUserBuffer(ENDP1, EP_DBUF_IN);
+        txPacketQueued = true;
+        txPreparedLength = -1;
+    }
+
+    if (txPreparedLength < 0) {
+        cdcTxPreparePacket();
+    }
+}
+
+/*******************************************************************************
+ * Function Name  : Send DATA .
+ * Description    : queue data to be sent from the STM32 to the PC through USB
+ * Input          : None.
+ * Output         : None.
+ * Return         : number of bytes queued, less than sendLength if the buffer is full.
+ *******************************************************************************/
+uint32_t CDC_Send_DATA(const uint8_t *ptrBuffer, uint32_t sendLength)
 {
-    /* Last transmission hasn't finished, abort */
-    if (packetSent) {
-        return 0;
+    const uint32_t free = CDC_Send_FreeBytes();
+
+    if (sendLength > free) {
+        sendLength = free;
     }
 
-    // We can only put 64 bytes in the buffer
-    if (sendLength > 64 / 2) {
-        sendLength = 64 / 2;
+    uint16_t head = txHead;
+    for (uint32_t i = 0; i < sendLength; i++) {
+        txBuffer[head] = ptrBuffer[i];
+        head = (head + 1) & (USB_TX_BUFFER_SIZE - 1);
     }
 
-    // Try to load some bytes if we can
-    if (sendLength) {
-        UserToPMABufferCopy(ptrBuffer, ENDP1_TXADDR, sendLength);
-        SetEPTxCount(ENDP1, sendLength);
-        packetSent += sendLength;
-        SetEPTxValid(ENDP1);
+    ATOMIC_BLOCK(NVIC_PRIO_USB) {
+        txHead = head;
+        cdcTxService();
     }
 
     return sendLength;
 }
 
+/*******************************************************************************
+ * Function Name  : CDC_Send_FreeBytes.
+ * Description    : room left in the transmit buffer.
+ * Input          : None.
+ * Output         : None.
+ * Return         : number of bytes CDC_Send_DATA will accept.
+ *******************************************************************************/
+uint32_t CDC_Send_FreeBytes(void)
+{
+    return USB_TX_BUFFER_SIZE - 1 - txBytesQueued();
+}
+
+/*******************************************************************************
+ * Function Name  : CDC_Send_Busy.
+ * Description    : check if data is still waiting to be sent.
+ * Input          : None.
+ * Output         : None.
+ * Return         : True until everything queued was sent to the PC.
+ *******************************************************************************/
+bool CDC_Send_Busy(void)
+{
+    return txBytesQueued() != 0 || txPacketQueued || txPreparedLength >= 0;
+}
+
+/*******************************************************************************
+ * Function Name  : CDC_Send_Complete.
+ * Description    : ENDP1 IN transfer complete, called from USB interrupt.
+ * Input          : None.
+ * Output         : None.
+ * Return         : None.
+ *******************************************************************************/
+void CDC_Send_Complete(void)
+{
+    txPacketQueued = false;
+    cdcTxService();
+}
+
+static uint32_t rxBytesFree(void)
+{
+    return USB_RX_BUFFER_SIZE - 1 - ((rxHead - rxTail) & (USB_RX_BUFFER_SIZE - 1));
+}
+
+/*******************************************************************************
+ * Function Name  : cdcRxResume.
+ * Description    : re-enable ENDP3 if there is room for another packet. Called with USB interrupt masked.
+ * Input          : None.
+ * Output         : None.
+ * Return         : None.
+ *******************************************************************************/
+static void cdcRxResume(void)
+{
+    if (rxBytesFree() < VIRTUAL_COM_PORT_DATA_SIZE) {
+        rxEndpointNak = true;
+        return;
+    }
+
+    rxEndpointNak = false;
+    SetEPRxCount(ENDP3, VIRTUAL_COM_PORT_DATA_SIZE);
+    SetEPRxStatus(ENDP3, EP_RX_VALID);
+}
+
+/*******************************************************************************
+ * Function Name  : CDC_Receive_Packet.
+ * Description    : ENDP3 OUT transfer complete, called from USB interrupt.
+ * Input          : None.
+ * Output         : None.
+ * Return         : None.
+ *******************************************************************************/
+void CDC_Receive_Packet(void)
+{
+    uint8_t packet[VIRTUAL_COM_PORT_DATA_SIZE];
+    uint32_t length = MIN(GetEPRxCount(ENDP3), sizeof(packet));
+
+    PMAToUserBufferCopy(packet, ENDP3_RXADDR, length);
+
+    // endpoint is only enabled with room for a full packet, except right after a bus reset
+    length = MIN(length, rxBytesFree());
+
+    uint16_t head = rxHead;
+    for (uint32_t i = 0; i < length; i++) {
+        rxBuffer[head] = packet[i];
+        head = (head + 1) & (USB_RX_BUFFER_SIZE - 1);
+    }
+    rxHead = head;
+
+    cdcRxResume();
+}
+
 /*******************************************************************************
  * Function Name  : Receive DATA .
  * Description    : receive the data from the PC to STM32 and send it through USB
@@ -314,28 +490,85 @@ uint32_t CDC_Send_DATA(uint8_t *ptrBuffer, uint8_t sendLength)
  *******************************************************************************/
 uint32_t CDC_Receive_DATA(uint8_t* recvBuf, uint32_t len)
 {
-    static uint8_t offset = 0;
-    uint8_t i;
+    uint32_t received = 0;
 
-    if (len > receiveLength) {
-        len = receiveLength;
-    }
+    // data may wrap around the end of the buffer
+    while (received < len) {
+        const uint8_t *data;
+        const uint32_t available = MIN(CDC_Receive_Span(&data), len - received);
 
-    for (i = 0; i < len; i++) {
-        recvBuf[i] = (uint8_t)(receiveBuffer[i + offset]);
+        if (available == 0) {
+            break;
+        }
+
+        memcpy(recvBuf + received, data, available);
+        CDC_Receive_Consume(available);
+        received += available;
     }
 
-    receiveLength -= len;
-    offset += len;
+    return received;
+}
 
-    /* re-enable the rx endpoint which we had set to receive 0 bytes */
-    if (receiveLength == 0) {
-        SetEPRxCount(ENDP3, 64);
-        SetEPRxStatus(ENDP3, EP_RX_VALID);
-        offset = 0;
+/*******************************************************************************
+ * Function Name  : CDC_Receive_BytesAvailable.
+ * Description    : number of received bytes not consumed yet.
+ * Input          : None.
+ * Output         : None.
+ * Return         : None.
+ *******************************************************************************/
+uint32_t CDC_Receive_BytesAvailable(void)
+{
+    return (rxHead - rxTail) & (USB_RX_BUFFER_SIZE - 1);
+}
+
+/*******************************************************************************
+ * Function Name  : CDC_Receive_Span.
+ * Description    : zero-copy access to the data received from the PC.
+ * Input          : None.
+ * Output         : data: start of the received data.
+ * Return         : number of contiguous bytes available at data.
+ *******************************************************************************/
+uint32_t CDC_Receive_Span(const uint8_t **data)
+{
+    const uint16_t head = rxHead;
+    const uint16_t tail = rxTail;
+
+    *data = &rxBuffer[tail];
+    return (head >= tail) ? head - tail : USB_RX_BUFFER_SIZE - tail;
+}
+
+/*******************************************************************************
+ * Function Name  : CDC_Receive_Consume.
+ * Description    : release received data, re-enable the rx endpoint once there is room for a packet.
+ * Input          : len: number of bytes to release.
+ * Output         : None.
+ * Return         : None.
+ *******************************************************************************/
+void CDC_Receive_Consume(uint32_t len)
+{
+    rxTail = (rxTail + len) & (USB_RX_BUFFER_SIZE - 1);
+
+    if (rxEndpointNak) {
+        ATOMIC_BLOCK(NVIC_PRIO_USB) {
+            cdcRxResume();
+        }
     }
+}
 
-    return len;
+/*******************************************************************************
+ * Function Name  : CDC_Reset.
+ * Description    : forget endpoint state on bus reset, called from USB interrupt. Data not sent yet is dropped.
+ * Input          : None.
+ * Output         : None.
+ * Return         : None.
+ *******************************************************************************/
+void CDC_Reset(void)
+{
+    txTail = txHead;
+    txPacketQueued = false;
+    txPreparedLength = -1;
+    txZeroLengthPacketNeeded = false;
+    rxEndpointNak = false;
 }
 
 /*******************************************************************************
@@ -31,6 +31,7 @@
 
 /* Includes ------------------------------------------------------------------*/
 //#include "platform_config.h"
+#include <stdbool.h>
 #include "usb_type.h"
 #ifdef STM32F303
 #include "stm32f30x.h"
@@ -47,6 +48,15 @@
 #define MASS_MEMORY_START     0x04002000
 #define BULK_MAX_PACKET_SIZE  0x00000040
 
+// Sizes of data buffers between USB interrupt and serial port, must be powers of 2
+#ifdef STM32F10X
+#define USB_TX_BUFFER_SIZE    256
+#define USB_RX_BUFFER_SIZE    128
+#else
+#define USB_TX_BUFFER_SIZE    1024
+#define USB_RX_BUFFER_SIZE    256
+#endif
+
 /* Exported functions ------------------------------------------------------- */
 void Set_System(void);
 void Set_USBClock(void);
@@ -55,15 +65,20 @@ void Leave_LowPowerMode(void);
 void USB_Interrupts_Config(void);
 void USB_Cable_Config(FunctionalState NewState);
 void Get_SerialNum(void);
-uint32_t CDC_Send_DATA(uint8_t *ptrBuffer, uint8_t sendLength);  // HJI
+uint32_t CDC_Send_DATA(const uint8_t *ptrBuffer, uint32_t sendLength);
+uint32_t CDC_Send_FreeBytes(void);
+bool CDC_Send_Busy(void);
+void CDC_Send_Complete(void);
+void CDC_Receive_Packet(void);
 uint32_t CDC_Receive_DATA(uint8_t* recvBuf, uint32_t len);       // HJI
+uint32_t CDC_Receive_BytesAvailable(void);
+uint32_t CDC_Receive_Span(const uint8_t **data);
+void CDC_Receive_Consume(uint32_t len);
+void CDC_Reset(void);
 uint8_t usbIsConfigured(void);  // HJI
 uint8_t usbIsConnected(void);   // HJI
 uint32_t CDC_BaudRate(void);
 /* External variables --------------------------------------------------------*/
 
-extern __IO uint32_t receiveLength;  // HJI
-extern __IO uint32_t packetSent;     // HJI
-
 #endif  /*__HW_CONFIG_H*/
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -149,6 +149,20 @@ void USB_LP_CAN1_RX0_IRQHandler(void)
     USB_Istr();
 }
 
+/*******************************************************************************
+ * Function Name  : USB_HP_CAN1_TX_IRQHandler
+ * Description    : This function handles USB High Priority interrupts
+ *                  requests. Same priority as the low priority one, so both
+ *                  are served by USB_Istr() and never preempt each other.
+ * Input          : None
+ * Output         : None
+ * Return         : None
+ *******************************************************************************/
+void USB_HP_CAN1_TX_IRQHandler(void)
+{
+    USB_Istr();
+}
+
 /*******************************************************************************
  * Function Name  : USB_FS_WKUP_IRQHandler
  * Description    : This function handles USB WakeUp interrupt request.
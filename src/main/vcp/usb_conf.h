@@ -56,10 +56,11 @@
 #define ENDP0_TXADDR        (0x80)
 
 /* EP1  */
-/* tx buffer base address */
-#define ENDP1_TXADDR        (0xC0)
-#define ENDP2_TXADDR        (0x100)
-#define ENDP3_RXADDR        (0x110)
+/* double buffered tx, two buffer base addresses */
+#define ENDP1_BUF0ADDR      (0xC0)
+#define ENDP1_BUF1ADDR      (0x100)
+#define ENDP2_TXADDR        (0x140)
+#define ENDP3_RXADDR        (0x150)
 
 /*-------------------------------------------------------------*/
 /* -------------------   ISTR events  -------------------------*/
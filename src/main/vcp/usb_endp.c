@@ -36,13 +36,8 @@
 /* Private typedef -----------------------------------------------------------*/
 /* Private define ------------------------------------------------------------*/
 
-/* Interval between sending IN packets in frame number (1 frame = 1ms) */
-#define VCOMPORT_IN_FRAME_INTERVAL             5
 /* Private macro -------------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
-extern __IO uint32_t packetSent;         // HJI
-extern __IO uint8_t receiveBuffer[64];  // HJI
-__IO uint32_t receiveLength;             // HJI
 /* Private function prototypes -----------------------------------------------*/
 /* Private functions ---------------------------------------------------------*/
 
@@ -56,7 +51,7 @@ __IO uint32_t receiveLength;             // HJI
 
 void EP1_IN_Callback(void)
 {
-    packetSent = 0;  // HJI
+    CDC_Send_Complete();
 }
 
 /*******************************************************************************
@@ -68,8 +63,7 @@ void EP1_IN_Callback(void)
  *******************************************************************************/
 void EP3_OUT_Callback(void)
 {
-    receiveLength = GetEPRxCount(ENDP3);                                              // HJI
-    PMAToUserBufferCopy((unsigned char*)receiveBuffer, ENDP3_RXADDR, receiveLength);  // HJI
+    CDC_Receive_Packet();
 }
 
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
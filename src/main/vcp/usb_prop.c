@@ -132,11 +132,16 @@ void Virtual_Com_Port_Reset(void)
     SetEPRxCount(ENDP0, Device_Property.MaxPacketSize);
     SetEPRxValid(ENDP0);
 
-    /* Initialize Endpoint 1 */
+    /* Initialize Endpoint 1, double buffered. Endpoint NAKs until a packet is released with FreeUserBuffer() */
     SetEPType(ENDP1, EP_BULK);
-    SetEPTxAddr(ENDP1, ENDP1_TXADDR);
-    SetEPTxStatus(ENDP1, EP_TX_NAK);
+    SetEPDoubleBuff(ENDP1);
+    SetEPDblBuffAddr(ENDP1, ENDP1_BUF0ADDR, ENDP1_BUF1ADDR);
+    SetEPDblBuffCount(ENDP1, EP_DBUF_IN, 0);
+    ClearDTOG_RX(ENDP1);
+    ClearDTOG_TX(ENDP1);
     SetEPRxStatus(ENDP1, EP_RX_DIS);
+    SetEPTxStatus(ENDP1, EP_TX_VALID);
+    CDC_Reset();
 
     /* Initialize Endpoint 2 */
     SetEPType(ENDP2, EP_INTERRUPT);
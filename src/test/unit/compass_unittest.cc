@@ -0,0 +1,172 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+extern "C" {
+    #include "platform.h"
+
+    #include "common/axis.h"
+    #include "common/maths.h"
+
+    #include "drivers/sensor.h"
+    #include "drivers/compass.h"
+
+    #include "sensors/sensors.h"
+    #include "sensors/compass.h"
+
+    #include "config/runtime_config.h"
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+extern "C" {
+    uint32_t currentTime;
+}
+
+static uint32_t testSensorsMask;
+static bool testMagReadSucceeds;
+static int testMagReadCount;
+static flightDynamicsTrims_t testMagZero;
+
+static void testMagInit(void)
+{
+}
+
+static bool testMagRead(int16_t *magData)
+{
+    testMagReadCount++;
+    if (!testMagReadSucceeds) {
+        return false;
+    }
+
+    magData[X] = 100;
+    magData[Y] = 200;
+    magData[Z] = 300;
+    return true;
+}
+
+// Compass task at 10Hz for the given time
+static void runCompassTask(uint32_t seconds)
+{
+    for (uint32_t i = 0; i < seconds * 10; i++) {
+        currentTime += 100000;
+        if (sensors(SENSOR_MAG)) {
+            updateCompass(&testMagZero);
+        }
+    }
+}
+
+class CompassTest : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        testSensorsMask = SENSOR_MAG;
+        testMagReadSucceeds = false;
+        testMagReadCount = 0;
+        mag.init = testMagInit;
+        mag.read = testMagRead;
+        currentTime = 1000000;
+        compassInit();
+    }
+};
+
+TEST_F(CompassTest, TestNotReadyUntilFirstRead)
+{
+    // when - driver self test still running
+    runCompassTask(3);
+
+    // then
+    EXPECT_FALSE(isCompassReady());
+    EXPECT_FALSE(isCompassFailed());
+    EXPECT_TRUE(sensors(SENSOR_MAG));
+
+    // when
+    testMagReadSucceeds = true;
+    runCompassTask(1);
+
+    // then
+    EXPECT_TRUE(isCompassReady());
+    EXPECT_FALSE(isCompassFailed());
+    EXPECT_EQ(100, magADC[X]);
+}
+
+TEST_F(CompassTest, TestSilentCompassIsDropped)
+{
+    // when
+    runCompassTask(9);
+
+    // then - still waiting
+    EXPECT_FALSE(isCompassFailed());
+    EXPECT_TRUE(sensors(SENSOR_MAG));
+
+    // when
+    runCompassTask(2);
+
+    // then - dropped, so it doesn't keep blocking arming
+    EXPECT_FALSE(isCompassReady());
+    EXPECT_TRUE(isCompassFailed());
+    EXPECT_FALSE(sensors(SENSOR_MAG));
+
+    // and - no longer polled
+    testMagReadCount = 0;
+    runCompassTask(1);
+    EXPECT_EQ(0, testMagReadCount);
+}
+
+TEST_F(CompassTest, TestLaterReadErrorsKeepCompass)
+{
+    // given
+    testMagReadSucceeds = true;
+    runCompassTask(1);
+
+    // when
+    testMagReadSucceeds = false;
+    runCompassTask(20);
+
+    // then
+    EXPECT_TRUE(isCompassReady());
+    EXPECT_FALSE(isCompassFailed());
+    EXPECT_TRUE(sensors(SENSOR_MAG));
+}
+
+// STUBS
+
+extern "C" {
+
+uint32_t micros(void) { return currentTime; }
+
+bool sensors(uint32_t mask) { return testSensorsMask & mask; }
+void sensorsClear(uint32_t mask) { testSensorsMask &= ~mask; }
+
+uint8_t stateFlags;
+void persistentFlagSet(uint8_t mask) { UNUSED(mask); }
+void saveConfigAndNotify(void) {}
+
+void alignSensors(int32_t *src, int32_t *dest, uint8_t rotation)
+{
+    UNUSED(rotation);
+    memmove(dest, src, sizeof(int32_t) * XYZ_AXIS_COUNT);
+}
+
+void sensorCalibrationResetState(sensorCalibrationState_t * state) { UNUSED(state); }
+void sensorCalibrationPushSampleForOffsetCalculation(sensorCalibrationState_t * state, int32_t sample[3]) { UNUSED(state); UNUSED(sample); }
+void sensorCalibrationSolveForOffset(sensorCalibrationState_t * state, float result[3]) { UNUSED(state); UNUSED(result); }
+
+}
@@ -0,0 +1,347 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <sys/mman.h>
+
+extern "C" {
+    #include "platform.h"
+
+    #include "config/config_eeprom.h"
+    #include "config/config_storage.h"
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+#define TEST_IMAGE_SIZE             700     // 11 chunks, the last one partial
+#define TEST_IMAGE_CHUNKS           ((TEST_IMAGE_SIZE + CONFIG_STORAGE_CHUNK_SIZE - 1) / CONFIG_STORAGE_CHUNK_SIZE)
+#define TEST_PROGRAM_UNLIMITED      -1
+
+// RAM backed flash, mapped at the address of the config area so config_storage.c can read it directly
+static uint8_t *testFlash;
+static int32_t testProgramWordsRemaining;   // power is lost while programming the next word when it reaches 0
+static bool testPowerLost;
+static int testProgramCount;
+static int testEraseCount;
+
+static uint8_t testImage[TEST_IMAGE_SIZE];
+
+static void testImageSource(uint32_t offset, void *dst, uint32_t size)
+{
+    memcpy(dst, testImage + offset, size);
+}
+
+static bool saveImage(void)
+{
+    return configStorageWrite(testImageSource, sizeof(testImage));
+}
+
+static void powerCycle(void)
+{
+    testPowerLost = false;
+    testProgramWordsRemaining = TEST_PROGRAM_UNLIMITED;
+    configStorageInit();
+}
+
+static bool storedImageEquals(const uint8_t *image)
+{
+    uint8_t stored[TEST_IMAGE_SIZE];
+
+    return configStorageRead(0, stored, sizeof(stored)) && memcmp(stored, image, sizeof(stored)) == 0;
+}
+
+static void changeChunk(uint8_t chunk)
+{
+    testImage[chunk * CONFIG_STORAGE_CHUNK_SIZE]++;
+}
+
+class ConfigStorageTest : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        if (!testFlash) {
+            void *area = mmap((void *)(uintptr_t)CONFIG_START_FLASH_ADDRESS, FLASH_TO_RESERVE_FOR_CONFIG,
+                PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            ASSERT_EQ((void *)(uintptr_t)CONFIG_START_FLASH_ADDRESS, area);
+            testFlash = (uint8_t *)area;
+        }
+
+        memset(testFlash, 0xFF, FLASH_TO_RESERVE_FOR_CONFIG);
+        testProgramCount = 0;
+        testEraseCount = 0;
+
+        for (int i = 0; i < TEST_IMAGE_SIZE; i++) {
+            testImage[i] = i * 7;
+        }
+
+        powerCycle();
+    }
+};
+
+TEST_F(ConfigStorageTest, TestNothingStoredReadFails)
+{
+    // given
+    uint8_t data;
+
+    // expect
+    EXPECT_FALSE(configStorageRead(0, &data, sizeof(data)));
+}
+
+TEST_F(ConfigStorageTest, TestImageIsReadBack)
+{
+    // when
+    EXPECT_TRUE(saveImage());
+    powerCycle();
+
+    // then
+    EXPECT_TRUE(storedImageEquals(testImage));
+
+    // and
+    uint8_t data[4];
+    EXPECT_TRUE(configStorageRead(CONFIG_STORAGE_CHUNK_SIZE - 2, data, sizeof(data)));
+    EXPECT_EQ(0, memcmp(testImage + CONFIG_STORAGE_CHUNK_SIZE - 2, data, sizeof(data)));
+}
+
+TEST_F(ConfigStorageTest, TestUnchangedImageIsNotProgrammed)
+{
+    // given
+    EXPECT_TRUE(saveImage());
+    testProgramCount = 0;
+    testEraseCount = 0;
+
+    // when
+    EXPECT_TRUE(saveImage());
+
+    // then
+    EXPECT_EQ(0, testProgramCount);
+    EXPECT_EQ(0, testEraseCount);
+}
+
+TEST_F(ConfigStorageTest, TestChangedChunkIsAppendedWithCommit)
+{
+    // given
+    EXPECT_TRUE(saveImage());
+    testProgramCount = 0;
+    testEraseCount = 0;
+
+    // when
+    changeChunk(3);
+    EXPECT_TRUE(saveImage());
+
+    // then
+    EXPECT_EQ(0, testEraseCount);
+    EXPECT_EQ((8 + CONFIG_STORAGE_CHUNK_SIZE + 8) / 4, testProgramCount);   // record and commit
+
+    // and
+    powerCycle();
+    EXPECT_TRUE(storedImageEquals(testImage));
+}
+
+TEST_F(ConfigStorageTest, TestFullBankIsWrittenToOtherBank)
+{
+    // given
+    EXPECT_TRUE(saveImage());
+    testEraseCount = 0;
+
+    // when
+    int saveCount = 0;
+    while (testEraseCount == 0 && saveCount < 100) {
+        changeChunk(saveCount % TEST_IMAGE_CHUNKS);
+        EXPECT_TRUE(saveImage());
+        saveCount++;
+
+        powerCycle();
+        EXPECT_TRUE(storedImageEquals(testImage));
+    }
+
+    // then
+    EXPECT_GT(saveCount, 1);
+    EXPECT_LT(saveCount, 100);
+    EXPECT_EQ(FLASH_TO_RESERVE_FOR_CONFIG / 2 / FLASH_PAGE_SIZE, testEraseCount);   // only the other bank
+
+    // and
+    testEraseCount = 0;
+    changeChunk(0);
+    EXPECT_TRUE(saveImage());
+    EXPECT_EQ(0, testEraseCount);
+
+    powerCycle();
+    EXPECT_TRUE(storedImageEquals(testImage));
+}
+
+TEST_F(ConfigStorageTest, TestInterruptedAppendKeepsPreviousImage)
+{
+    uint8_t previousImage[TEST_IMAGE_SIZE];
+    bool saved = false;
+
+    for (int32_t cut = 0; !saved && cut < 100; cut++) {
+        // given
+        SetUp();
+        EXPECT_TRUE(saveImage());
+        memcpy(previousImage, testImage, sizeof(previousImage));
+
+        // when
+        changeChunk(1);
+        changeChunk(2);
+        testProgramWordsRemaining = cut;
+        saved = saveImage();
+        powerCycle();
+
+        // then
+        if (saved) {
+            EXPECT_EQ(2 * (8 + CONFIG_STORAGE_CHUNK_SIZE) / 4 + 8 / 4, cut);
+            EXPECT_TRUE(storedImageEquals(testImage));
+        } else {
+            EXPECT_TRUE(storedImageEquals(previousImage));
+        }
+    }
+
+    EXPECT_TRUE(saved);
+}
+
+TEST_F(ConfigStorageTest, TestUncommittedRecordsAreNotAppliedByLaterSave)
+{
+    // given
+    EXPECT_TRUE(saveImage());
+    uint8_t previousImage[TEST_IMAGE_SIZE];
+    memcpy(previousImage, testImage, sizeof(previousImage));
+
+    // and: both records of a save programmed, power lost while programming its commit
+    changeChunk(1);
+    changeChunk(2);
+    testProgramWordsRemaining = 2 * (8 + CONFIG_STORAGE_CHUNK_SIZE) / 4;
+    EXPECT_FALSE(saveImage());
+    powerCycle();
+    EXPECT_TRUE(storedImageEquals(previousImage));
+
+    // when
+    memcpy(testImage, previousImage, sizeof(testImage));
+    changeChunk(5);
+    EXPECT_TRUE(saveImage());
+    powerCycle();
+
+    // then
+    EXPECT_TRUE(storedImageEquals(testImage));
+}
+
+TEST_F(ConfigStorageTest, TestInterruptedBankSwitchKeepsPreviousImage)
+{
+    // given
+    EXPECT_TRUE(saveImage());
+    testEraseCount = 0;
+
+    int saveCount = 0;
+    while (testEraseCount == 0 && saveCount < 100) {
+        for (int chunk = 0; chunk < TEST_IMAGE_CHUNKS; chunk++) {
+            changeChunk(chunk);
+        }
+        EXPECT_TRUE(saveImage());
+        saveCount++;
+    }
+    EXPECT_LT(saveCount, 100);
+
+    const int32_t bankWriteWords = 1 + TEST_IMAGE_CHUNKS * (8 + CONFIG_STORAGE_CHUNK_SIZE) / 4 + 8 / 4 + 2;  // magic, records, commit, sequence and check
+    uint8_t previousImage[TEST_IMAGE_SIZE];
+    bool saved = false;
+
+    for (int32_t cut = 0; !saved && cut < 1000; cut++) {
+        SetUp();
+        EXPECT_TRUE(saveImage());
+        for (int save = 0; save < saveCount; save++) {
+            memcpy(previousImage, testImage, sizeof(previousImage));
+            for (int chunk = 0; chunk < TEST_IMAGE_CHUNKS; chunk++) {
+                changeChunk(chunk);
+            }
+            if (save == saveCount - 1) {
+                testProgramWordsRemaining = cut;
+            }
+            saved = saveImage();
+        }
+
+        // when
+        powerCycle();
+
+        // then
+        if (saved) {
+            EXPECT_EQ(bankWriteWords, cut);
+            EXPECT_TRUE(storedImageEquals(testImage));
+        } else if (cut < bankWriteWords - 1) {
+            EXPECT_TRUE(storedImageEquals(previousImage));
+        } else {
+            // the torn half of the check word may already hold its final value
+            EXPECT_TRUE(storedImageEquals(previousImage) || storedImageEquals(testImage));
+        }
+    }
+
+    EXPECT_TRUE(saved);
+}
+
+// STUBS
+
+extern "C" {
+
+// from flash driver, programs and erases testFlash
+void FLASH_Unlock(void) {}
+void FLASH_Lock(void) {}
+void FLASH_ClearFlag(uint32_t flags) { UNUSED(flags); }
+
+FLASH_Status FLASH_ErasePage(uint32_t address)
+{
+    if (testPowerLost) {
+        return FLASH_TIMEOUT;
+    }
+    if (address < CONFIG_START_FLASH_ADDRESS || address >= CONFIG_START_FLASH_ADDRESS + FLASH_TO_RESERVE_FOR_CONFIG || address % FLASH_PAGE_SIZE) {
+        return FLASH_ERROR_PROGRAM;
+    }
+
+    memset((uint8_t *)(uintptr_t)address, 0xFF, FLASH_PAGE_SIZE);
+    testEraseCount++;
+    return FLASH_COMPLETE;
+}
+
+FLASH_Status FLASH_ProgramWord(uint32_t address, uint32_t data)
+{
+    if (address < CONFIG_START_FLASH_ADDRESS || address >= CONFIG_START_FLASH_ADDRESS + FLASH_TO_RESERVE_FOR_CONFIG || address % 4) {
+        return FLASH_ERROR_PROGRAM;
+    }
+
+    uint32_t *word = (uint32_t *)(uintptr_t)address;
+
+    if (testPowerLost) {
+        return FLASH_TIMEOUT;
+    }
+    if (testProgramWordsRemaining == 0) {
+        // only the first half word is programmed before power is lost
+        testPowerLost = true;
+        *word &= data | 0xFFFF0000;
+        return FLASH_TIMEOUT;
+    }
+    if (testProgramWordsRemaining > 0) {
+        testProgramWordsRemaining--;
+    }
+    if (*word != 0xFFFFFFFF) {
+        return FLASH_ERROR_PROGRAM;
+    }
+
+    *word = data;
+    testProgramCount++;
+    return FLASH_COMPLETE;
+}
+
+}
@@ -0,0 +1,64 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdint.h>
+
+extern "C" {
+    #include "common/crc.h"
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+TEST(CrcTest, Crc8DvbS2CheckValue)
+{
+    // given
+    const char data[] = "123456789";
+
+    // when
+    uint8_t crc = crc8_dvb_s2_update(0, data, sizeof(data) - 1);
+
+    // then
+    EXPECT_EQ(0xBC, crc);
+}
+
+TEST(CrcTest, Crc8DvbS2Incremental)
+{
+    // given
+    const uint8_t data[] = { 0x00, 0x64, 0x00, 0x00, 0x00 };   // MSP v2 header of MSP_IDENT request
+    uint8_t crc = 0;
+
+    // when
+    for (unsigned ii = 0; ii < sizeof(data); ii++) {
+        crc = crc8_dvb_s2(crc, data[ii]);
+    }
+
+    // then
+    EXPECT_EQ(crc8_dvb_s2_update(0, data, sizeof(data)), crc);
+    EXPECT_EQ(0, crc8_dvb_s2_update(0, NULL, 0));
+}
+
+TEST(CrcTest, Crc16CcittCheckValue)
+{
+    // given
+    const char data[] = "123456789";
+
+    // when
+    uint16_t crc = crc16_ccitt_update(0xFFFF, data, sizeof(data) - 1);
+
+    // then
+    EXPECT_EQ(0x29B1, crc);
+}
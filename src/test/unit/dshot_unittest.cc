@@ -0,0 +1,123 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+extern "C" {
+    #include "drivers/dshot.h"
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+TEST(DshotTest, TestChecksum)
+{
+    // throttle 1046 without telemetry: 0x416 << 1 = 0x82C, 0x8 ^ 0x2 ^ 0xC = 0x6
+    EXPECT_EQ(0x82C6, dshotEncodeFrame(1046, false));
+
+    // telemetry request bit is included in the checksum
+    EXPECT_EQ(0x82D7, dshotEncodeFrame(1046, true));
+
+    // disarm command
+    EXPECT_EQ(0x0000, dshotEncodeFrame(0, false));
+}
+
+TEST(DshotTest, TestChecksumOfAllValues)
+{
+    for (uint16_t value = 0; value <= DSHOT_MAX_THROTTLE; value++) {
+        uint16_t frame = dshotEncodeFrame(value, value & 1);
+
+        EXPECT_EQ(value, frame >> 5);
+        EXPECT_EQ(value & 1, (frame >> 4) & 1);
+        EXPECT_EQ(0, ((frame >> 12) ^ (frame >> 8) ^ (frame >> 4) ^ frame) & 0x0F);
+    }
+}
+
+TEST(DshotTest, TestPulseToValue)
+{
+    // given: default minthrottle and maxthrottle
+    const uint16_t minThrottle = 1150;
+    const uint16_t maxThrottle = 1850;
+
+    // expect: mincommand and anything below minthrottle disarm
+    EXPECT_EQ(DSHOT_DISARM_COMMAND, dshotPulseToValue(900, minThrottle, maxThrottle));
+    EXPECT_EQ(DSHOT_DISARM_COMMAND, dshotPulseToValue(1000, minThrottle, maxThrottle));
+    EXPECT_EQ(DSHOT_DISARM_COMMAND, dshotPulseToValue(minThrottle - 1, minThrottle, maxThrottle));
+
+    // and: minthrottle idles, maxthrottle is full throttle
+    EXPECT_EQ(DSHOT_MIN_THROTTLE, dshotPulseToValue(minThrottle, minThrottle, maxThrottle));
+    EXPECT_EQ(DSHOT_MAX_THROTTLE, dshotPulseToValue(maxThrottle, minThrottle, maxThrottle));
+    EXPECT_EQ(DSHOT_MAX_THROTTLE, dshotPulseToValue(2000, minThrottle, maxThrottle));
+
+    // and: linear in between
+    EXPECT_EQ((DSHOT_MIN_THROTTLE + DSHOT_MAX_THROTTLE) / 2, dshotPulseToValue(1500, minThrottle, maxThrottle));
+    EXPECT_LT(dshotPulseToValue(maxThrottle - 1, minThrottle, maxThrottle), DSHOT_MAX_THROTTLE);
+    EXPECT_GT(dshotPulseToValue(minThrottle + 1, minThrottle, maxThrottle), DSHOT_MIN_THROTTLE);
+}
+
+TEST(DshotTest, TestPulseToValueFullRange)
+{
+    // expect
+    EXPECT_EQ(DSHOT_DISARM_COMMAND, dshotPulseToValue(999, 1000, 2000));
+    EXPECT_EQ(DSHOT_MIN_THROTTLE, dshotPulseToValue(1000, 1000, 2000));
+    EXPECT_EQ(DSHOT_MAX_THROTTLE, dshotPulseToValue(2000, 1000, 2000));
+}
+
+TEST(DshotTest, TestBitPeriod)
+{
+    EXPECT_EQ(160, dshotGetBitPeriod(DSHOT_150));
+    EXPECT_EQ(80, dshotGetBitPeriod(DSHOT_300));
+    EXPECT_EQ(40, dshotGetBitPeriod(DSHOT_600));
+    EXPECT_EQ(0, dshotGetBitPeriod(DSHOT_DISABLED));
+}
+
+TEST(DshotTest, TestDmaBufferLayout)
+{
+    uint32_t buffer[DSHOT_DMA_BUFFER_SLOTS * 3];
+    const uint16_t bitPeriod = dshotGetBitPeriod(DSHOT_600);
+
+    memset(buffer, 0xFF, sizeof(buffer));
+
+    // given
+    dshotLoadDmaBuffer(buffer, 0, 3, 0x8001, bitPeriod);
+    dshotLoadDmaBuffer(buffer, 2, 3, 0x0000, bitPeriod);
+
+    // then - first channel has MSB and LSB set
+    EXPECT_EQ(30u, buffer[0]);
+    for (int i = 1; i < DSHOT_FRAME_BITS - 1; i++) {
+        EXPECT_EQ(15u, buffer[i * 3]);
+    }
+    EXPECT_EQ(30u, buffer[(DSHOT_FRAME_BITS - 1) * 3]);
+
+    // and - third channel is all zero bits
+    for (int i = 0; i < DSHOT_FRAME_BITS; i++) {
+        EXPECT_EQ(15u, buffer[i * 3 + 2]);
+    }
+
+    // and - the tail keeps both lines low after the frame
+    for (int i = DSHOT_FRAME_BITS; i < DSHOT_DMA_BUFFER_SLOTS; i++) {
+        EXPECT_EQ(0u, buffer[i * 3]);
+        EXPECT_EQ(0u, buffer[i * 3 + 2]);
+    }
+
+    // and - slots of the channel in between are untouched
+    for (int i = 0; i < DSHOT_DMA_BUFFER_SLOTS; i++) {
+        EXPECT_EQ(0xFFFFFFFFu, buffer[i * 3 + 1]);
+    }
+}
@@ -19,6 +19,10 @@
 #include <stdbool.h>
 
 #include <limits.h>
+#include <math.h>
+#ifdef BENCHMARK
+#include <chrono>
+#endif
 
 extern "C" {
     #include "debug.h"
@@ -39,7 +43,6 @@ extern "C" {
     #include "flight/pid.h"
     #include "flight/imu.h"
     #include "flight/mixer.h"
-    #include "flight/lowpass.h"
 
     #include "io/escservo.h"
     #include "io/gimbal.h"
@@ -48,7 +51,12 @@ extern "C" {
     void forwardAuxChannelsToServos(uint8_t firstServoIndex);
 
     void mixerInit(mixerMode_e mixerMode, motorMixer_t *initialCustomMixers, servoMixer_t *initialCustomServoMixers);
-    void mixerUsePWMOutputConfiguration(pwmOutputConfiguration_t *pwmOutputConfiguration);
+    void mixerUsePWMIOConfiguration(void);
+
+    bool mixerDesaturateByPriority(const int32_t *rpMix, const int32_t *yawMix, int16_t *rpyMix, uint8_t count, int16_t throttleRange, int16_t *mixMin, int16_t *mixMax);
+    void computeThrustLinearizationCurve(uint8_t thrustLinearization, uint16_t *curve);
+    int16_t applyMotorOutputCompensation(const uint16_t *curve, int16_t value, int16_t minValue, int16_t maxValue, uint16_t vbatCompensation);
+    int scaleRange(int x, int srcMin, int srcMax, int destMin, int destMax);
 }
 
 #include "unittest_macros.h"
@@ -75,6 +83,7 @@ servo_t servos[MAX_SUPPORTED_SERVOS];
 uint8_t lastOneShotUpdateMotorCount;
 
 uint32_t testFeatureMask = 0;
+uint16_t testBatteryCompensationFactor = 1000;
 
 int updatedServoCount;
 int updatedMotorCount;
@@ -157,7 +166,7 @@ protected:
     };
 
     motorMixer_t customMotorMixer[MAX_SUPPORTED_MOTORS];
-    servoMixer_t customServoMixer[MAX_SUPPORTED_SERVOS];
+    servoMixer_t customServoMixer[MAX_SERVO_RULES];
 
     virtual void SetUp() {
         updatedServoCount = 0;
@@ -170,7 +179,7 @@ protected:
 
         memset(rcData, 0, sizeof(rcData));
         memset(rcCommand, 0, sizeof(rcCommand));
-        memset(axisPID, 0, sizeof(axisPID));
+        memset(axisPID, 0, sizeof(int16_t) * XYZ_AXIS_COUNT);
 
         memset(&customMotorMixer, 0, sizeof(customMotorMixer));
     }
@@ -190,7 +199,6 @@ protected:
             NULL,
             &escAndServoConfig,
             &mixerConfig,
-            NULL,
             &rxConfig
         );
     }
@@ -217,12 +225,7 @@ TEST_F(BasicMixerIntegrationTest, TestTricopterServo)
     mixerInit(MIXER_TRI, customMotorMixer, customServoMixer);
 
     // and
-    pwmOutputConfiguration_t pwmOutputConfiguration = {
-            .servoCount = 1,
-            .motorCount = 3
-    };
-
-    mixerUsePWMOutputConfiguration(&pwmOutputConfiguration);
+    mixerUsePWMIOConfiguration();
 
     // and
     axisPID[YAW] = 0;
@@ -246,18 +249,13 @@ TEST_F(BasicMixerIntegrationTest, TestQuadMotors)
     mixerInit(MIXER_QUADX, customMotorMixer, customServoMixer);
 
     // and
-    pwmOutputConfiguration_t pwmOutputConfiguration = {
-            .servoCount = 0,
-            .motorCount = 4
-    };
-
-    mixerUsePWMOutputConfiguration(&pwmOutputConfiguration);
+    mixerUsePWMIOConfiguration();
 
     // and
     memset(rcCommand, 0, sizeof(rcCommand));
 
     // and
-    memset(axisPID, 0, sizeof(axisPID));
+    memset(axisPID, 0, sizeof(int16_t) * XYZ_AXIS_COUNT);
     axisPID[YAW] = 0;
 
 
@@ -328,12 +326,7 @@ TEST_F(CustomMixerIntegrationTest, TestCustomMixer)
 
     mixerInit(MIXER_CUSTOM_AIRPLANE, customMotorMixer, customServoMixer);
 
-    pwmOutputConfiguration_t pwmOutputConfiguration = {
-            .servoCount = 6,
-            .motorCount = 2
-    };
-
-    mixerUsePWMOutputConfiguration(&pwmOutputConfiguration);
+    mixerUsePWMIOConfiguration();
 
     // and
     rcCommand[THROTTLE] = 1000;
@@ -342,12 +335,13 @@ TEST_F(CustomMixerIntegrationTest, TestCustomMixer)
     rcData[AUX1] = 2000;
 
     // and
-    memset(axisPID, 0, sizeof(axisPID));
+    memset(axisPID, 0, sizeof(int16_t) * XYZ_AXIS_COUNT);
     axisPID[YAW] = 0;
 
 
     // when
     mixTable();
+    servoMixer();
     writeMotors();
     writeServos();
 
@@ -368,6 +362,508 @@ TEST_F(CustomMixerIntegrationTest, TestCustomMixer)
 
 }
 
+TEST(MixerDesaturationTest, TestNoSaturationKeepsAllAxis)
+{
+    // given
+    const int32_t rpMix[4] = { 100, -100, 100, -100 };
+    const int32_t yawMix[4] = { 50, -50, -50, 50 };
+    int16_t rpyMix[4];
+    int16_t mixMin, mixMax;
+
+    // when
+    bool limited = mixerDesaturateByPriority(rpMix, yawMix, rpyMix, 4, 800, &mixMin, &mixMax);
+
+    // then
+    EXPECT_FALSE(limited);
+    EXPECT_EQ(150, rpyMix[0]);
+    EXPECT_EQ(-150, rpyMix[1]);
+    EXPECT_EQ(50, rpyMix[2]);
+    EXPECT_EQ(-50, rpyMix[3]);
+    EXPECT_EQ(-150, mixMin);
+    EXPECT_EQ(150, mixMax);
+}
+
+TEST(MixerDesaturationTest, TestYawIsSacrificedBeforeRollPitch)
+{
+    // given
+    const int32_t rpMix[4] = { 100, -100, 100, -100 };
+    const int32_t yawMix[4] = { 300, -300, -300, 300 };
+    int16_t rpyMix[4];
+    int16_t mixMin, mixMax;
+
+    // when
+    bool limited = mixerDesaturateByPriority(rpMix, yawMix, rpyMix, 4, 400, &mixMin, &mixMax);
+
+    // then
+    EXPECT_TRUE(limited);
+    EXPECT_LE(mixMax - mixMin, 400);
+
+    // roll/pitch difference between motors is preserved, yaw only reduced to 1/3
+    EXPECT_EQ(200, rpyMix[0]);
+    EXPECT_EQ(-200, rpyMix[1]);
+    EXPECT_EQ(0, rpyMix[2]);
+    EXPECT_EQ(0, rpyMix[3]);
+}
+
+TEST(MixerDesaturationTest, TestRollPitchScaledWhenExceedingThrottleRange)
+{
+    // given
+    const int32_t rpMix[4] = { 500, -500, 500, -500 };
+    const int32_t yawMix[4] = { 100, -100, -100, 100 };
+    int16_t rpyMix[4];
+    int16_t mixMin, mixMax;
+
+    // when
+    bool limited = mixerDesaturateByPriority(rpMix, yawMix, rpyMix, 4, 400, &mixMin, &mixMax);
+
+    // then yaw is dropped completely, roll/pitch fills whole range
+    EXPECT_TRUE(limited);
+    EXPECT_EQ(200, rpyMix[0]);
+    EXPECT_EQ(-200, rpyMix[1]);
+    EXPECT_EQ(200, rpyMix[2]);
+    EXPECT_EQ(-200, rpyMix[3]);
+    EXPECT_EQ(-200, mixMin);
+    EXPECT_EQ(200, mixMax);
+}
+
+TEST(MixerDesaturationTest, TestZeroThrottleRange)
+{
+    // given
+    const int32_t rpMix[4] = { 10, -10, 10, -10 };
+    const int32_t yawMix[4] = { 10, -10, -10, 10 };
+    int16_t rpyMix[4];
+    int16_t mixMin, mixMax;
+
+    // when
+    bool limited = mixerDesaturateByPriority(rpMix, yawMix, rpyMix, 4, 0, &mixMin, &mixMax);
+
+    // then
+    EXPECT_TRUE(limited);
+    for (int i = 0; i < 4; i++) {
+        EXPECT_EQ(0, rpyMix[i]);
+    }
+}
+
+TEST(MixerDesaturationTest, TestAsymmetricYawOnlySaturation)
+{
+    // given - no roll/pitch demand at all
+    const int32_t rpMix[4] = { 0, 0, 0, 0 };
+    const int32_t yawMix[4] = { 700, -700, -700, 700 };
+    int16_t rpyMix[4];
+    int16_t mixMin, mixMax;
+
+    // when
+    bool limited = mixerDesaturateByPriority(rpMix, yawMix, rpyMix, 4, 700, &mixMin, &mixMax);
+
+    // then
+    EXPECT_TRUE(limited);
+    EXPECT_EQ(350, rpyMix[0]);
+    EXPECT_EQ(-350, rpyMix[1]);
+    EXPECT_EQ(700, mixMax - mixMin);
+}
+
+TEST(MixerDesaturationTest, TestMixAlwaysFitsThrottleRange)
+{
+    int32_t rpMix[MAX_SUPPORTED_MOTORS];
+    int32_t yawMix[MAX_SUPPORTED_MOTORS];
+    int16_t rpyMix[MAX_SUPPORTED_MOTORS];
+    int16_t mixMin, mixMax;
+
+    for (int n = 0; n < 20000; n++) {
+        // given
+        const int16_t throttleRange = 1 + (n * 7) % 900;
+        const uint8_t count = 3 + n % (MAX_SUPPORTED_MOTORS - 2);
+        for (int i = 0; i < count; i++) {
+            rpMix[i] = ((n * 13 + i * 211) % 1001) - 500;
+            yawMix[i] = ((n * 29 + i * 97) % 701) - 350;
+        }
+
+        // when
+        mixerDesaturateByPriority(rpMix, yawMix, rpyMix, count, throttleRange, &mixMin, &mixMax);
+
+        // then
+        int16_t actualMin = 0, actualMax = 0;
+        for (int i = 0; i < count; i++) {
+            actualMin = MIN(actualMin, rpyMix[i]);
+            actualMax = MAX(actualMax, rpyMix[i]);
+        }
+        ASSERT_LE(mixMax - mixMin, throttleRange) << "iteration " << n;
+        ASSERT_LE(actualMax - actualMin, throttleRange) << "iteration " << n;
+        ASSERT_GE(mixMax, actualMax);
+        ASSERT_LE(mixMin, actualMin);
+    }
+}
+
+TEST(MixerThrustLinearizationTest, TestDisabledCurveIsLinear)
+{
+    // given
+    uint16_t curve[THRUST_LINEARIZATION_SEGMENTS + 1];
+
+    // when
+    computeThrustLinearizationCurve(0, curve);
+
+    // then
+    for (int value = 1150; value <= 1850; value += 10) {
+        EXPECT_NEAR(value, applyMotorOutputCompensation(curve, value, 1150, 1850, 1000), 1);
+    }
+}
+
+TEST(MixerThrustLinearizationTest, TestQuadraticCurve)
+{
+    // given
+    uint16_t curve[THRUST_LINEARIZATION_SEGMENTS + 1];
+
+    // when
+    computeThrustLinearizationCurve(100, curve);
+
+    // then endpoints are kept, half thrust needs sqrt(0.5) of command range
+    EXPECT_EQ(0, curve[0]);
+    EXPECT_EQ(MIXER_MATRIX_SCALE, curve[THRUST_LINEARIZATION_SEGMENTS]);
+    EXPECT_EQ(1000, applyMotorOutputCompensation(curve, 1000, 1000, 2000, 1000));
+    EXPECT_EQ(2000, applyMotorOutputCompensation(curve, 2000, 1000, 2000, 1000));
+    EXPECT_NEAR(1707, applyMotorOutputCompensation(curve, 1500, 1000, 2000, 1000), 2);
+
+    for (int i = 1; i <= THRUST_LINEARIZATION_SEGMENTS; i++) {
+        EXPECT_GT(curve[i], curve[i - 1]);
+    }
+}
+
+class MixerVoltageSagTest : public BasicMixerIntegrationTest {
+protected:
+    // Quad X roll arm of each motor, independent of the mixer tables
+    const float rollArm[4] = { -1.0f, -1.0f, 1.0f, 1.0f };
+
+    virtual void SetUp() {
+        BasicMixerIntegrationTest::SetUp();
+
+        escAndServoConfig.mincommand = 1000;
+        escAndServoConfig.minthrottle = 1000;
+        escAndServoConfig.maxthrottle = 2000;
+        withDefaultRxConfig();
+
+        mixerConfig.yaw_motor_direction = 1;
+        mixerConfig.yaw_jump_prevention_limit = YAW_JUMP_PREVENTION_LIMIT_HIGH;
+        mixerConfig.desaturation_mode = MIXER_DESAT_PRIORITY;
+        mixerConfig.thrust_linearization = 100;
+        mixerConfig.vbat_compensation = 1;
+
+        testFeatureMask = 0;
+        testBatteryCompensationFactor = 1000;
+        armingFlags = ARMED;
+
+        configureMixer();
+        mixerInit(MIXER_QUADX, customMotorMixer, customServoMixer);
+        mixerUsePWMIOConfiguration();
+    }
+
+    virtual void TearDown() {
+        armingFlags = 0;
+        testBatteryCompensationFactor = 1000;
+    }
+
+    // Propeller model: thrust is quadratic in command and proportional to battery voltage
+    static float motorThrust(int16_t motorValue, float voltageRatio) {
+        const float command = (motorValue - 1000) / 1000.0f;
+        return voltageRatio * command * command;
+    }
+
+    void runMixer(int16_t throttle, int16_t roll, float voltageRatio, float *collective, float *rollTorque) {
+        testBatteryCompensationFactor = lrintf(1000 / voltageRatio);
+        rcCommand[THROTTLE] = throttle;
+        axisPID[ROLL] = roll;
+
+        mixTable();
+
+        *collective = 0;
+        *rollTorque = 0;
+        for (int i = 0; i < 4; i++) {
+            const float thrust = motorThrust(motor[i], voltageRatio);
+            *collective += thrust / 4;
+            *rollTorque += rollArm[i] * thrust;
+        }
+    }
+};
+
+TEST_F(MixerVoltageSagTest, TestThrustIsKeptDuringVoltageSag)
+{
+    // given
+    float expectedCollective, expectedTorque;
+    runMixer(1400, 100, 1.0f, &expectedCollective, &expectedTorque);
+
+    // when - battery sags from 16.8V to 13.2V
+    for (float voltageRatio = 1.0f; voltageRatio >= 0.78f; voltageRatio -= 0.02f) {
+        float collective, rollTorque;
+        runMixer(1400, 100, voltageRatio, &collective, &rollTorque);
+
+        // then - produced thrust and roll torque are unchanged
+        EXPECT_NEAR(expectedCollective, collective, 0.01f) << "voltage ratio " << voltageRatio;
+        EXPECT_NEAR(expectedTorque, rollTorque, 0.01f) << "voltage ratio " << voltageRatio;
+    }
+}
+
+TEST_F(MixerVoltageSagTest, TestRollAuthorityIsKeptAtHighThrottleDuringVoltageSag)
+{
+    // given - roll torque demanded in the middle of the range with a full battery
+    float expectedCollective, expectedTorque;
+    runMixer(1500, 150, 1.0f, &expectedCollective, &expectedTorque);
+
+    // when - near full throttle on a battery sagged to 80%
+    float collective, rollTorque;
+    runMixer(1950, 150, 0.8f, &collective, &rollTorque);
+
+    // then - throttle gives way, roll torque does not
+    EXPECT_NEAR(expectedTorque, rollTorque, 0.01f);
+    EXPECT_LT(collective, 0.8f);
+    for (int i = 0; i < 4; i++) {
+        EXPECT_LE(motor[i], 2000);
+        EXPECT_GE(motor[i], 1000);
+    }
+}
+
+TEST(MixerThrustLinearizationTest, TestVoltageCompensationIsLimitedToMotorRange)
+{
+    // given
+    uint16_t curve[THRUST_LINEARIZATION_SEGMENTS + 1];
+    computeThrustLinearizationCurve(0, curve);
+
+    // when - compensation would push output above max
+    int16_t motorOutput = applyMotorOutputCompensation(curve, 1900, 1000, 2000, 1500);
+
+    // then
+    EXPECT_EQ(2000, motorOutput);
+
+    // and - min throttle is never boosted
+    EXPECT_EQ(1000, applyMotorOutputCompensation(curve, 1000, 1000, 2000, 1500));
+}
+
+#ifdef BENCHMARK
+// Built into flight_mixer_benchmark only (make benchmark), timings are printed, not checked
+TEST(MixerBenchmarkTest, TestPriorityDesaturationCost)
+{
+    // given
+    int32_t rpMix[MAX_SUPPORTED_MOTORS];
+    int32_t yawMix[MAX_SUPPORTED_MOTORS];
+    int16_t rpyMix[MAX_SUPPORTED_MOTORS];
+    int16_t mixMin, mixMax;
+    uint16_t curve[THRUST_LINEARIZATION_SEGMENTS + 1];
+    const int iterations = 100000;
+    int32_t checksum = 0;
+
+    computeThrustLinearizationCurve(50, curve);
+
+    // when
+    auto start = std::chrono::steady_clock::now();
+    for (int n = 0; n < iterations; n++) {
+        for (int i = 0; i < MAX_SUPPORTED_MOTORS; i++) {
+            rpMix[i] = ((n + i * 37) % 800) - 400;
+            yawMix[i] = ((n * 3 + i * 91) % 600) - 300;
+        }
+
+        mixerDesaturateByPriority(rpMix, yawMix, rpyMix, MAX_SUPPORTED_MOTORS, 700, &mixMin, &mixMax);
+
+        for (int i = 0; i < MAX_SUPPORTED_MOTORS; i++) {
+            checksum += applyMotorOutputCompensation(curve, 1500 + rpyMix[i], 1150, 1850, 1100);
+        }
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+    // then
+    printf("Priority desaturation + linearization, %d motors: %lld ns per mixer update\n",
+           MAX_SUPPORTED_MOTORS, (long long)(elapsed / iterations));
+    EXPECT_LE(mixMax - mixMin, 700);
+    EXPECT_NE(0, checksum);
+}
+#endif
+
+// Flying wing with flaps, reflex, coupled rudder, camera gimbal and a box switched elevator - uses all MAX_SERVO_RULES
+static const servoMixer_t flyingWingServoMixer[] = {
+    { SERVO_FLAPPERON_1, INPUT_STABILIZED_ROLL,      100,  0,  0, 100, 0 },
+    { SERVO_FLAPPERON_1, INPUT_STABILIZED_PITCH,     100,  0,  0, 100, 0 },
+    { SERVO_FLAPPERON_2, INPUT_STABILIZED_ROLL,     -100,  0,  0, 100, 0 },
+    { SERVO_FLAPPERON_2, INPUT_STABILIZED_PITCH,     100,  0,  0, 100, 0 },
+    { SERVO_FLAPPERON_1, INPUT_RC_AUX1,               30, 10,  0, 100, 0 },
+    { SERVO_FLAPPERON_2, INPUT_RC_AUX1,               30, 10,  0, 100, 0 },
+    { SERVO_FLAPPERON_1, INPUT_RC_AUX3,               25,  0, 20,  80, 0 },
+    { SERVO_FLAPPERON_2, INPUT_RC_AUX3,              -25,  0, 20,  80, 0 },
+    { SERVO_RUDDER,      INPUT_STABILIZED_YAW,       100,  0,  0, 100, 0 },
+    { SERVO_RUDDER,      INPUT_STABILIZED_ROLL,       20,  0,  0, 100, 0 },
+    { SERVO_RUDDER,      INPUT_RC_YAW,                50,  0,  0, 100, 2 },
+    { SERVO_ELEVATOR,    INPUT_STABILIZED_PITCH,      50,  0,  0, 100, 1 },
+    { SERVO_THROTTLE,    INPUT_STABILIZED_THROTTLE,  100,  0,  0, 100, 0 },
+    { SERVO_FLAPS,       INPUT_RC_AUX2,              100,  5, 10,  90, 0 },
+    { SERVO_GIMBAL_PITCH, INPUT_GIMBAL_PITCH,        100,  0,  0, 100, 0 },
+    { SERVO_GIMBAL_ROLL, INPUT_GIMBAL_ROLL,          100,  0,  0, 100, 0 },
+};
+
+// Rule interpreter servoMixer() used before the rules were compiled, used as a reference
+static void referenceServoMixer(const servoMixer_t *rules, uint8_t ruleCount, const servoParam_t *conf, int16_t *currentOutput, int16_t *output)
+{
+    int16_t input[INPUT_SOURCE_COUNT];
+
+    input[INPUT_STABILIZED_ROLL] = axisPID[ROLL];
+    input[INPUT_STABILIZED_PITCH] = axisPID[PITCH];
+    input[INPUT_STABILIZED_YAW] = axisPID[YAW];
+    input[INPUT_GIMBAL_PITCH] = scaleRange(attitude.values.pitch, -1800, 1800, -500, +500);
+    input[INPUT_GIMBAL_ROLL] = scaleRange(attitude.values.roll, -1800, 1800, -500, +500);
+    input[INPUT_STABILIZED_THROTTLE] = motor[0] - 1000 - 500;
+    input[INPUT_RC_ROLL] = rcData[ROLL] - TEST_RC_MID;
+    input[INPUT_RC_PITCH] = rcData[PITCH] - TEST_RC_MID;
+    input[INPUT_RC_YAW] = rcData[YAW] - TEST_RC_MID;
+    input[INPUT_RC_THROTTLE] = rcData[THROTTLE] - TEST_RC_MID;
+    input[INPUT_RC_AUX1] = rcData[AUX1] - TEST_RC_MID;
+    input[INPUT_RC_AUX2] = rcData[AUX2] - TEST_RC_MID;
+    input[INPUT_RC_AUX3] = rcData[AUX3] - TEST_RC_MID;
+    input[INPUT_RC_AUX4] = rcData[AUX4] - TEST_RC_MID;
+
+    for (int i = 0; i < MAX_SUPPORTED_SERVOS; i++)
+        output[i] = 0;
+
+    for (int i = 0; i < ruleCount; i++) {
+        if (rules[i].box == 0 || IS_RC_MODE_ACTIVE(BOXSERVO1 + rules[i].box - 1)) {
+            uint8_t target = rules[i].targetChannel;
+            uint8_t from = rules[i].inputSource;
+            uint16_t servo_width = conf[target].max - conf[target].min;
+            int16_t min = rules[i].min * servo_width / 100 - servo_width / 2;
+            int16_t max = rules[i].max * servo_width / 100 - servo_width / 2;
+            int direction = (conf[target].reversedSources & (1 << from)) ? -1 : 1;
+
+            if (rules[i].speed == 0)
+                currentOutput[i] = input[from];
+            else {
+                if (currentOutput[i] < input[from])
+                    currentOutput[i] = constrain(currentOutput[i] + rules[i].speed, currentOutput[i], input[from]);
+                else if (currentOutput[i] > input[from])
+                    currentOutput[i] = constrain(currentOutput[i] - rules[i].speed, input[from], currentOutput[i]);
+            }
+
+            output[target] += direction * constrain(((int32_t)currentOutput[i] * rules[i].rate) / 100, min, max);
+        } else {
+            currentOutput[i] = 0;
+        }
+    }
+
+    for (int i = 0; i < MAX_SUPPORTED_SERVOS; i++) {
+        output[i] = ((int32_t)conf[i].rate * output[i]) / 100L + conf[i].middle;
+    }
+}
+
+static void simulateServoMixerInputs(int n)
+{
+    axisPID[ROLL] = ((n * 7) % 1000) - 500;
+    axisPID[PITCH] = ((n * 13) % 1000) - 500;
+    axisPID[YAW] = ((n * 3) % 600) - 300;
+    attitude.values.roll = ((n * 11) % 3600) - 1800;
+    attitude.values.pitch = ((n * 5) % 1800) - 900;
+    motor[0] = 1000 + (n % 1000);
+    rcData[YAW] = 1000 + ((n * 17) % 1000);
+    rcData[AUX1] = (n / 200) % 2 ? 2000 : 1000;
+    rcData[AUX2] = 1000 + ((n * 19) % 1000);
+    rcData[AUX3] = 1000 + ((n * 23) % 1000);
+    rcModeActivationMask = ((n / 300) % 2) ? (1 << BOXSERVO1) : (1 << BOXSERVO2);
+}
+
+class ServoMixerPlanTest : public CustomMixerIntegrationTest {
+protected:
+    enum { RULE_COUNT = sizeof(flyingWingServoMixer) / sizeof(flyingWingServoMixer[0]) };
+
+    int16_t referenceOutput[MAX_SUPPORTED_SERVOS];
+    int16_t referenceState[MAX_SERVO_RULES];
+
+    virtual void SetUp() {
+        CustomMixerIntegrationTest::SetUp();
+
+        flightModeFlags = 0;
+        testFeatureMask = 0;
+        memset(referenceState, 0, sizeof(referenceState));
+
+        servoConf[SERVO_FLAPPERON_2].reversedSources = (1 << INPUT_STABILIZED_PITCH) | (1 << INPUT_RC_AUX1);
+        servoConf[SERVO_RUDDER].rate = -80;
+        servoConf[SERVO_FLAPS].min = 1200;
+
+        memcpy(customServoMixer, flyingWingServoMixer, sizeof(flyingWingServoMixer));
+        configureMixer();
+        mixerInit(MIXER_CUSTOM_AIRPLANE, customMotorMixer, customServoMixer);
+    }
+};
+
+TEST_F(ServoMixerPlanTest, TestPlanMatchesRuleInterpreter)
+{
+    for (int n = 0; n < 2000; n++) {
+        // given
+        simulateServoMixerInputs(n);
+
+        // when
+        servoMixer();
+        referenceServoMixer(flyingWingServoMixer, RULE_COUNT, servoConf, referenceState, referenceOutput);
+
+        // then
+        for (int i = 0; i < MAX_SUPPORTED_SERVOS; i++) {
+            ASSERT_EQ(referenceOutput[i], servo[i]) << "servo " << i << " iteration " << n;
+        }
+    }
+}
+
+TEST_F(ServoMixerPlanTest, TestServoConfigChangeUpdatesPlan)
+{
+    // given
+    simulateServoMixerInputs(10);
+    servoMixer();
+    int16_t rudder = servo[SERVO_RUDDER];
+
+    // when
+    servoConf[SERVO_RUDDER].reversedSources = (1 << INPUT_STABILIZED_YAW);
+    servoMixerUpdatePlan();
+    servoMixer();
+    referenceServoMixer(flyingWingServoMixer, RULE_COUNT, servoConf, referenceState, referenceOutput);
+
+    // then
+    EXPECT_NE(rudder, servo[SERVO_RUDDER]);
+    EXPECT_EQ(referenceOutput[SERVO_RUDDER], servo[SERVO_RUDDER]);
+}
+
+#ifdef BENCHMARK
+TEST_F(ServoMixerPlanTest, TestServoMixerBenchmark)
+{
+    const int iterations = 100000;
+    const int runs = 5;
+    long long planBest = LLONG_MAX;
+    long long referenceBest = LLONG_MAX;
+    int32_t planChecksum = 0;
+    int32_t referenceChecksum = 0;
+
+    // when - runs alternate between both implementations, the fastest run of each is reported
+    for (int run = 0; run < runs; run++) {
+        planChecksum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int n = 0; n < iterations; n++) {
+            simulateServoMixerInputs(n);
+            servoMixer();
+            filterServos();
+            planChecksum += servo[SERVO_FLAPPERON_1] + servo[SERVO_RUDDER];
+        }
+        planBest = MIN(planBest, (long long)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+
+        referenceChecksum = 0;
+        start = std::chrono::steady_clock::now();
+        for (int n = 0; n < iterations; n++) {
+            simulateServoMixerInputs(n);
+            referenceServoMixer(flyingWingServoMixer, RULE_COUNT, servoConf, referenceState, referenceOutput);
+            for (int i = 0; i < MAX_SUPPORTED_SERVOS; i++) {
+                referenceOutput[i] = constrain(referenceOutput[i], servoConf[i].min, servoConf[i].max);
+            }
+            referenceChecksum += referenceOutput[SERVO_FLAPPERON_1] + referenceOutput[SERVO_RUDDER];
+        }
+        referenceBest = MIN(referenceBest, (long long)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    // then
+    printf("Servo mixer, %d rules: compiled plan %lld ns, rule interpreter %lld ns per update (best of %d runs)\n",
+           RULE_COUNT, planBest / iterations, referenceBest / iterations, runs);
+    EXPECT_EQ(referenceChecksum, planChecksum);
+    EXPECT_LE(planBest, referenceBest);
+}
+#endif
+
 // STUBS
 
 extern "C" {
@@ -381,6 +877,7 @@ int16_t rcData[MAX_SUPPORTED_RC_CHANNEL_COUNT];
 uint32_t rcModeActivationMask;
 int16_t debug[DEBUG16_VALUE_COUNT];
 
+uint32_t targetLooptime;
 uint8_t stateFlags;
 uint16_t flightModeFlags;
 uint8_t armingFlags;
@@ -391,10 +888,6 @@ bool feature(uint32_t mask) {
     return (mask & testFeatureMask);
 }
 
-int32_t lowpassFixed(lowpass_t *, int32_t, int16_t) {
-    return 0;
-}
-
 void pwmWriteMotor(uint8_t index, uint16_t value) {
     motors[index].value = value;
     updatedMotorCount++;
@@ -413,6 +906,8 @@ void pwmCompleteOneshotMotorUpdate(uint8_t motorCount) {
     lastOneShotUpdateMotorCount = motorCount;
 }
 
+void pwmCommitOutputs(void) {}
+
 void pwmWriteServo(uint8_t index, uint16_t value) {
     // FIXME logic in test, mimic's production code.
     // Perhaps the solution is to remove the logic from the production code version and assume that
@@ -428,4 +923,8 @@ bool failsafeIsActive(void) {
     return false;
 }
 
+uint16_t calculateBatteryCompensationFactor(void) {
+    return testBatteryCompensationFactor;
+}
+
 }
@@ -68,6 +68,9 @@ bool isSerialTransmitBufferEmpty(serialPort_t *) {
     return true;
 }
 void mspProcess(void) {}
+bool serialSetFrameCallback(serialPort_t *, serialFrameCallbackPtr) {
+    return false;
+}
 void systemResetToBootloader(void) {}
 
 }
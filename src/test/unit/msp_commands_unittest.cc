@@ -0,0 +1,399 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+extern "C" {
+    #include "platform.h"
+    #include "build_config.h"
+    #include "version.h"
+    #include "debug.h"
+
+    #include "common/axis.h"
+    #include "common/color.h"
+    #include "common/maths.h"
+    #include "common/streambuf.h"
+    #include "common/utils.h"
+
+    #include "drivers/system.h"
+    #include "drivers/sensor.h"
+    #include "drivers/accgyro.h"
+    #include "drivers/compass.h"
+    #include "drivers/serial.h"
+    #include "drivers/gpio.h"
+    #include "drivers/timer.h"
+    #include "drivers/pwm_rx.h"
+
+    #include "rx/rx.h"
+
+    #include "io/escservo.h"
+    #include "io/rc_controls.h"
+    #include "io/gps.h"
+    #include "io/gimbal.h"
+    #include "io/serial.h"
+    #include "io/ledstrip.h"
+    #include "io/msp_protocol.h"
+    #include "io/msp_commands.h"
+    #include "io/serial_msp.h"
+
+    #include "telemetry/telemetry.h"
+
+    #include "sensors/sensors.h"
+    #include "sensors/boardalignment.h"
+    #include "sensors/battery.h"
+    #include "sensors/acceleration.h"
+    #include "sensors/barometer.h"
+    #include "sensors/compass.h"
+    #include "sensors/gyro.h"
+
+    #include "flight/mixer.h"
+    #include "flight/pid.h"
+    #include "flight/imu.h"
+    #include "flight/failsafe.h"
+    #include "flight/navigation_rewrite.h"
+
+    #include "config/runtime_config.h"
+    #include "config/config.h"
+    #include "config/config_profile.h"
+    #include "config/config_master.h"
+
+    extern const mspCommandDescriptor_t mspCommands[];
+    extern const int mspCommandCount;
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+static profile_t profile;
+
+#define TEST_REPLY_BUFFER_SIZE MSP_PORT_OUTBUF_SIZE
+
+static uint8_t requestBuf[TEST_REPLY_BUFFER_SIZE];
+static uint8_t replyBuf[TEST_REPLY_BUFFER_SIZE];
+
+// Runs a request the way a transport does, reply payload is left readable in reply->buf
+static mspResult_e processRequestWithReplyLimit(uint16_t cmd, const uint8_t *payload, int size, mspPacket_t *reply, int replyLimit)
+{
+    memcpy(requestBuf, payload, size);
+    mspPacket_t request = {
+        .buf = { .ptr = requestBuf, .end = requestBuf + size },
+        .cmd = cmd,
+        .result = 0,
+    };
+    reply->buf.ptr = replyBuf;
+    reply->buf.end = replyBuf + replyLimit;
+
+    mspPostProcessFnPtr postProcessFn;
+    const mspResult_e result = mspProcessCommand(&request, reply, &postProcessFn);
+
+    sbufSwitchToReader(&reply->buf, replyBuf);
+    return result;
+}
+
+static mspResult_e processRequest(uint16_t cmd, const uint8_t *payload, int size, mspPacket_t *reply)
+{
+    return processRequestWithReplyLimit(cmd, payload, size, reply, sizeof(replyBuf));
+}
+
+class MspCommandsTest : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        memset(&masterConfig, 0, sizeof(masterConfig));
+        memset(&profile, 0, sizeof(profile));
+        currentProfile = &profile;
+        armingFlags = 0;
+
+        mspCommandsInit();
+    }
+};
+
+TEST_F(MspCommandsTest, TestCommandTableIsSorted)
+{
+    for (int i = 1; i < mspCommandCount; i++) {
+        EXPECT_LT(mspCommands[i - 1].cmd, mspCommands[i].cmd) << "at index " << i;
+    }
+}
+
+TEST_F(MspCommandsTest, TestEveryCommandIsFound)
+{
+    for (int i = 0; i < mspCommandCount; i++) {
+        EXPECT_EQ(&mspCommands[i], mspFindCommand(mspCommands[i].cmd)) << "command " << mspCommands[i].cmd;
+    }
+}
+
+TEST_F(MspCommandsTest, TestLookupReturnsOnlyMatchingCommand)
+{
+    int found = 0;
+
+    for (uint32_t cmd = 0; cmd <= 0xFFFF; cmd++) {
+        const mspCommandDescriptor_t *descriptor = mspFindCommand(cmd);
+        if (descriptor) {
+            EXPECT_EQ(cmd, descriptor->cmd);
+            found++;
+        }
+    }
+
+    EXPECT_EQ(mspCommandCount, found);
+}
+
+TEST_F(MspCommandsTest, TestUnknownCommandIsRejected)
+{
+    // given
+    const uint16_t unknownCmd = 0;
+    EXPECT_EQ(NULL, mspFindCommand(unknownCmd));
+
+    // when
+    mspPacket_t reply;
+    const mspResult_e result = processRequest(unknownCmd, NULL, 0, &reply);
+
+    // then
+    EXPECT_EQ(MSP_RESULT_ERROR, result);
+    EXPECT_EQ(MSP_RESULT_ERROR, reply.result);
+    EXPECT_EQ(unknownCmd, reply.cmd);
+}
+
+TEST_F(MspCommandsTest, TestPidIsRead)
+{
+    // given
+    for (int i = 0; i < PID_ITEM_COUNT; i++) {
+        profile.pidProfile.P8[i] = 10 + i;
+        profile.pidProfile.I8[i] = 40 + i;
+        profile.pidProfile.D8[i] = 70 + i;
+    }
+
+    // when
+    mspPacket_t reply;
+    const mspResult_e result = processRequest(MSP_PID, NULL, 0, &reply);
+
+    // then
+    EXPECT_EQ(MSP_RESULT_ACK, result);
+    EXPECT_EQ(MSP_PID, reply.cmd);
+    EXPECT_EQ(3 * PID_ITEM_COUNT, sbufBytesRemaining(&reply.buf));
+
+    // and
+    for (int i = 0; i < PID_ITEM_COUNT; i++) {
+        EXPECT_EQ(10 + i, sbufReadU8(&reply.buf));
+        EXPECT_EQ(40 + i, sbufReadU8(&reply.buf));
+        EXPECT_EQ(70 + i, sbufReadU8(&reply.buf));
+    }
+}
+
+TEST_F(MspCommandsTest, TestPidIsWritten)
+{
+    // given
+    uint8_t payload[3 * PID_ITEM_COUNT];
+    for (int i = 0; i < PID_ITEM_COUNT; i++) {
+        payload[3 * i] = 20 + i;
+        payload[3 * i + 1] = 50 + i;
+        payload[3 * i + 2] = 80 + i;
+    }
+
+    // when
+    mspPacket_t reply;
+    const mspResult_e result = processRequest(MSP_SET_PID, payload, sizeof(payload), &reply);
+
+    // then
+    EXPECT_EQ(MSP_RESULT_ACK, result);
+    EXPECT_EQ(0, sbufBytesRemaining(&reply.buf));
+
+    // and
+    for (int i = 0; i < PID_ITEM_COUNT; i++) {
+        EXPECT_EQ(20 + i, profile.pidProfile.P8[i]);
+        EXPECT_EQ(50 + i, profile.pidProfile.I8[i]);
+        EXPECT_EQ(80 + i, profile.pidProfile.D8[i]);
+    }
+
+    // and
+    // what is written is read back
+    processRequest(MSP_PID, NULL, 0, &reply);
+    EXPECT_EQ(0, memcmp(payload, sbufPtr(&reply.buf), sizeof(payload)));
+}
+
+TEST_F(MspCommandsTest, TestShortRequestIsRejectedBeforeHandler)
+{
+    // given
+    uint8_t payload[3 * PID_ITEM_COUNT - 1];
+    memset(payload, 0x55, sizeof(payload));
+
+    // when
+    mspPacket_t reply;
+    const mspResult_e result = processRequest(MSP_SET_PID, payload, sizeof(payload), &reply);
+
+    // then
+    EXPECT_EQ(MSP_RESULT_ERROR, result);
+    for (int i = 0; i < PID_ITEM_COUNT; i++) {
+        EXPECT_EQ(0, profile.pidProfile.P8[i]);
+    }
+}
+
+TEST_F(MspCommandsTest, TestDisarmedOnlyCommandIsRejectedWhenArmed)
+{
+    // given
+    ENABLE_ARMING_FLAG(ARMED);
+    const uint8_t payload[] = { 1 };
+
+    // when
+    mspPacket_t reply;
+    const mspResult_e result = processRequest(MSP_SELECT_SETTING, payload, sizeof(payload), &reply);
+
+    // then
+    EXPECT_EQ(MSP_RESULT_ERROR, result);
+    EXPECT_EQ(0, masterConfig.current_profile_index);
+}
+
+TEST_F(MspCommandsTest, TestMultipleMspRepliesAreSizePrefixed)
+{
+    // given
+    profile.pidProfile.P8[0] = 42;
+    // MSP_SET_PID is not read only, so it gets an empty item
+    const uint8_t payload[] = { MSP_PID, MSP_SET_PID, MSP_PID };
+
+    // when
+    mspPacket_t reply;
+    const mspResult_e result = processRequest(MSP_MULTIPLE_MSP, payload, sizeof(payload), &reply);
+
+    // then
+    EXPECT_EQ(MSP_RESULT_ACK, result);
+    EXPECT_EQ(2 * (1 + 3 * PID_ITEM_COUNT) + 1, sbufBytesRemaining(&reply.buf));
+
+    // and
+    EXPECT_EQ(3 * PID_ITEM_COUNT, sbufReadU8(&reply.buf));
+    EXPECT_EQ(42, sbufReadU8(&reply.buf));
+    sbufAdvance(&reply.buf, 3 * PID_ITEM_COUNT - 1);
+    EXPECT_EQ(0, sbufReadU8(&reply.buf));
+    EXPECT_EQ(3 * PID_ITEM_COUNT, sbufReadU8(&reply.buf));
+    EXPECT_EQ(42, sbufReadU8(&reply.buf));
+}
+
+TEST_F(MspCommandsTest, TestMultipleMspReplyIsTruncatedToWholeItems)
+{
+    // given
+    // more items than fit into a reply, MSP v1 replies are limited to 255 bytes, v2 to the output buffer
+    const int itemSize = 1 + 3 * PID_ITEM_COUNT;
+    uint8_t payload[2 * MSP_PORT_OUTBUF_SIZE / itemSize];
+    memset(payload, MSP_PID, sizeof(payload));
+
+    const int replyLimits[] = { 255, MSP_PORT_OUTBUF_SIZE };
+
+    for (unsigned limitIndex = 0; limitIndex < ARRAYLEN(replyLimits); limitIndex++) {
+        const int replyLimit = replyLimits[limitIndex];
+
+        // when
+        mspPacket_t reply;
+        const mspResult_e result = processRequestWithReplyLimit(MSP_MULTIPLE_MSP, payload, sizeof(payload), &reply, replyLimit);
+
+        // then
+        // item which would fill the reply up to its last byte might have been truncated, it is dropped too
+        const int expectedItemCount = (replyLimit - 1) / itemSize;
+        EXPECT_EQ(MSP_RESULT_ACK, result);
+        EXPECT_EQ(expectedItemCount * itemSize, sbufBytesRemaining(&reply.buf)) << "reply limit " << replyLimit;
+        EXPECT_LE(sbufBytesRemaining(&reply.buf), replyLimit);
+
+        // and
+        for (int i = 0; i < expectedItemCount; i++) {
+            EXPECT_EQ(3 * PID_ITEM_COUNT, sbufReadU8(&reply.buf));
+            sbufAdvance(&reply.buf, 3 * PID_ITEM_COUNT);
+        }
+    }
+}
+
+// STUBS
+
+extern "C" {
+// from acceleration.c
+acc_t acc;
+int32_t accADC[XYZ_AXIS_COUNT];
+void accSetCalibrationCycles(uint16_t calibrationCyclesRequired) { UNUSED(calibrationCyclesRequired); }
+// from battery.c
+uint16_t vbat;
+int32_t amperage;
+int32_t mAhDrawn;
+// from compass.c
+int32_t magADC[XYZ_AXIS_COUNT];
+// from config.c
+master_t masterConfig;
+profile_t *currentProfile;
+controlRateConfig_t *currentControlRateProfile;
+void resetPidProfile(pidProfile_t *pidProfile) { UNUSED(pidProfile); }
+void handleOneshotFeatureChangeOnRestart(void) {}
+void readEEPROM(void) {}
+void resetEEPROM(void) {}
+void writeEEPROM(void) {}
+bool feature(uint32_t mask) { UNUSED(mask); return false; }
+void featureSet(uint32_t mask) { UNUSED(mask); }
+void featureClearAll(void) {}
+uint32_t featureMask(void) { return 0; }
+// from debug.c
+int16_t debug[DEBUG16_VALUE_COUNT];
+// from gps.c
+gpsSolutionData_t gpsSol;
+gpsStatistics_t gpsStats;
+void onNewGPSData(void) {}
+// from gyro.c
+int32_t gyroADC[XYZ_AXIS_COUNT];
+// from imu.c
+attitudeEulerAngles_t attitude;
+// from ledstrip.c
+void reevalulateLedConfig(void) {}
+// from mixer.c
+int16_t motor[MAX_SUPPORTED_MOTORS];
+int16_t motor_disarmed[MAX_SUPPORTED_MOTORS];
+int16_t servo[MAX_SUPPORTED_SERVOS];
+void stopMotors(void) {}
+void loadCustomServoMixer(void) {}
+void servoMixerUpdatePlan(void) {}
+// from msp.c
+void rxMspFrameReceive(uint16_t *frame, int channelCount) { UNUSED(frame); UNUSED(channelCount); }
+// from mw.c
+uint16_t cycleTime;
+uint16_t rssi;
+void updateMagHoldHeading(int16_t heading) { UNUSED(heading); }
+// from navigation_rewrite.c
+uint16_t GPS_distanceToHome;
+int16_t GPS_directionToHome;
+// from rc_controls.c
+uint32_t rcModeActivationMask;
+void useRcControlsConfig(modeActivationCondition_t *modeActivationConditions, escAndServoConfig_t *escAndServoConfigToUse, pidProfile_t *pidProfileToUse)
+{
+    UNUSED(modeActivationConditions);
+    UNUSED(escAndServoConfigToUse);
+    UNUSED(pidProfileToUse);
+}
+// from runtime_config.c
+uint8_t armingFlags;
+uint8_t stateFlags;
+uint16_t flightModeFlags;
+// from rx.c
+int16_t rcData[MAX_SUPPORTED_RC_CHANNEL_COUNT];
+rxRuntimeConfig_t rxRuntimeConfig;
+// from scheduler.c
+uint16_t averageSystemLoadPercent;
+// from sensors.c
+bool sensors(uint32_t mask) { UNUSED(mask); return false; }
+void sensorsSet(uint32_t mask) { UNUSED(mask); }
+// from serial.c
+bool serialIsPortAvailable(serialPortIdentifier_e identifier) { UNUSED(identifier); return false; }
+serialPortConfig_t *serialFindPortConfiguration(serialPortIdentifier_e identifier) { UNUSED(identifier); return NULL; }
+void waitForSerialPortToFinishTransmitting(serialPort_t *serialPort) { UNUSED(serialPort); }
+// from system_stm32fN0x.c
+void systemReset(void) {}
+// from version.c
+const char * const buildDate = "Jan  1 2016";
+const char * const buildTime = "00:00:00";
+const char * const shortGitRevision = "MASTER";
+}
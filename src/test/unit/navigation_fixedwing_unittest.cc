@@ -0,0 +1,427 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#define NAV
+
+extern "C" {
+    #include "build_config.h"
+    #include "platform.h"
+
+    #include "common/axis.h"
+    #include "common/maths.h"
+    #include "common/filter.h"
+
+    #include "io/gps.h"
+    #include "io/rc_controls.h"
+
+    #include "flight/pid.h"
+    #include "flight/imu.h"
+    #include "flight/navigation_rewrite.h"
+    #include "flight/navigation_rewrite_private.h"
+
+    void applyFixedWingPositionController(uint32_t currentTime);
+    void applyFixedWingAltitudeController(uint32_t currentTime);
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+#define SIM_STEP_US             10000   // 100Hz aircraft dynamics
+#define SIM_GPS_PERIOD_US       100000  // 10Hz position updates
+#define SIM_AIRSPEED            1500.0f // cm/s
+#define SIM_BANK_TIME_CONSTANT  0.3f    // s, roll response of the airframe
+#define SIM_ALT_PERIOD_US       40000   // 25Hz altitude updates
+#define SIM_MAX_THRUST          500.0f  // cm/s^2, thrust acceleration at full throttle
+#define SIM_PATH_TIME_CONSTANT  0.5f    // s, flight path angle response to pitch
+
+extern "C" {
+    // simulation state shared with stubs
+    uint32_t simTime;
+    bool simApproachingLastWaypoint;
+    navigationFSMStateFlags_t simStateFlags;
+}
+
+static navConfig_t navConfig;
+static rcControlsConfig_t rcControlsConfig;
+
+static float simPosX, simPosY;
+static float simHeading;                // rad
+static float simBank;                   // rad
+static float simWindX, simWindY;        // cm/s
+
+static void simInit(float posX, float posY, float headingDeg)
+{
+    memset(&posControl, 0, sizeof(posControl));
+    memset(&navConfig, 0, sizeof(navConfig));
+    memset(&rcControlsConfig, 0, sizeof(rcControlsConfig));
+
+    navConfig.fw_max_bank_angle = 35;
+    navConfig.fw_loiter_radius = 5000;
+    navConfig.fw_nav_controller = NAV_FW_CONTROLLER_L1;
+    navConfig.fw_l1_period = 20;
+    navConfig.fw_l1_damping = 75;
+
+    posControl.navConfig = &navConfig;
+    posControl.rcControlsConfig = &rcControlsConfig;
+    posControl.flags.hasValidPositionSensor = true;
+
+    simTime = 0;
+    simPosX = posX;
+    simPosY = posY;
+    simHeading = DEGREES_TO_RADIANS(headingDeg);
+    simBank = 0;
+    simWindX = 0;
+    simWindY = 0;
+}
+
+static void simUpdateActualState(void)
+{
+    posControl.actualState.pos.V.X = simPosX;
+    posControl.actualState.pos.V.Y = simPosY;
+    posControl.actualState.vel.V.X = SIM_AIRSPEED * cosf(simHeading) + simWindX;
+    posControl.actualState.vel.V.Y = SIM_AIRSPEED * sinf(simHeading) + simWindY;
+    posControl.actualState.yaw = wrap_36000(lrintf(RADIANS_TO_CENTIDEGREES(simHeading)));
+    posControl.actualState.cosYaw = cosf(simHeading);
+    posControl.actualState.sinYaw = sinf(simHeading);
+}
+
+/*
+ * Fly for given time, calls back with position after every position update
+ */
+template <typename F>
+static void simFly(float seconds, F onPositionUpdate)
+{
+    for (uint32_t end = simTime + seconds * 1e6f; simTime < end; ) {
+        simTime += SIM_STEP_US;
+
+        if ((simTime % SIM_GPS_PERIOD_US) == 0) {
+            simUpdateActualState();
+            posControl.flags.horizontalPositionNewData = true;
+            applyFixedWingPositionController(simTime);
+            onPositionUpdate();
+        }
+
+        // Coordinated turn with bank angle following the command with some lag
+        float bankCommand = DECIDEGREES_TO_RADIANS(posControl.rcAdjustment[ROLL]);
+        simBank += (bankCommand - simBank) * (US2S(SIM_STEP_US) / SIM_BANK_TIME_CONSTANT);
+        simHeading += GRAVITY_CMSS * tanf(simBank) / SIM_AIRSPEED * US2S(SIM_STEP_US);
+
+        simPosX += (SIM_AIRSPEED * cosf(simHeading) + simWindX) * US2S(SIM_STEP_US);
+        simPosY += (SIM_AIRSPEED * sinf(simHeading) + simWindY) * US2S(SIM_STEP_US);
+    }
+}
+
+/*
+ * Point mass aircraft in the vertical plane, no wind. Thrust is proportional to throttle, drag to speed squared,
+ * flight path angle follows pitch command with some lag. Trimmed for level flight at 15m/s on cruise throttle.
+ */
+static float simAltitude;
+static float simSpeed;                  // cm/s
+static float simFlightPath;             // rad
+static float simDragCoefficient;
+
+static void simInitLongitudinal(void)
+{
+    simInit(0, 0, 0);
+
+    navConfig.fw_alt_controller = NAV_FW_ALT_CONTROLLER_TECS;
+    navConfig.fw_cruise_throttle = 1400;
+    navConfig.fw_min_throttle = 1100;
+    navConfig.fw_max_throttle = 1800;
+    navConfig.fw_max_climb_angle = 10;
+    navConfig.fw_max_dive_angle = 10;
+    navConfig.fw_cruise_speed = SIM_AIRSPEED;
+    navConfig.fw_tecs_time_const = 50;
+    navConfig.fw_tecs_speed_weight = 100;
+
+    simAltitude = 10000;
+    simSpeed = SIM_AIRSPEED;
+    simFlightPath = 0;
+    simDragCoefficient = (SIM_MAX_THRUST * 0.4f) / sq(SIM_AIRSPEED);
+
+    posControl.desiredState.pos.V.Z = simAltitude;
+    posControl.rcAdjustment[THROTTLE] = navConfig.fw_cruise_throttle;
+}
+
+static float simThrustFromThrottle(void)
+{
+    return SIM_MAX_THRUST * (posControl.rcAdjustment[THROTTLE] - 1000) / 1000.0f;
+}
+
+/*
+ * Fly for given time, calls back after every altitude update
+ */
+template <typename F>
+static void simFlyLongitudinal(float seconds, F onAltitudeUpdate)
+{
+    for (uint32_t end = simTime + seconds * 1e6f; simTime < end; ) {
+        simTime += SIM_STEP_US;
+
+        posControl.actualState.pos.V.Z = simAltitude;
+        posControl.actualState.vel.V.X = simSpeed * cosf(simFlightPath);
+        posControl.actualState.vel.V.Y = 0;
+        posControl.actualState.vel.V.Z = simSpeed * sinf(simFlightPath);
+
+        if ((simTime % SIM_ALT_PERIOD_US) == 0) {
+            posControl.flags.verticalPositionNewData = true;
+        }
+
+        applyFixedWingAltitudeController(simTime);
+
+        if ((simTime % SIM_ALT_PERIOD_US) == 0) {
+            onAltitudeUpdate();
+        }
+
+        float pitchCommand = DECIDEGREES_TO_RADIANS(posControl.rcAdjustment[PITCH]);
+        simFlightPath += (pitchCommand - simFlightPath) * (US2S(SIM_STEP_US) / SIM_PATH_TIME_CONSTANT);
+        simSpeed += (simThrustFromThrottle() - simDragCoefficient * sq(simSpeed) - GRAVITY_CMSS * sinf(simFlightPath)) * US2S(SIM_STEP_US);
+        simAltitude += simSpeed * sinf(simFlightPath) * US2S(SIM_STEP_US);
+    }
+}
+
+TEST(NavigationFixedWingTest, TestTecsClimbHoldsSpeed)
+{
+    // given
+    simInitLongitudinal();
+    simFlyLongitudinal(5, [](){});
+
+    // when - climb 20m
+    posControl.desiredState.pos.V.Z = simAltitude + 2000;
+
+    float minSpeed = simSpeed, maxSpeed = simSpeed;
+    int maxThrottle = 0;
+    simFlyLongitudinal(60, [&](){
+        minSpeed = MIN(minSpeed, simSpeed);
+        maxSpeed = MAX(maxSpeed, simSpeed);
+        maxThrottle = MAX(maxThrottle, posControl.rcAdjustment[THROTTLE]);
+    });
+
+    // then - energy for the climb comes from throttle, not from speed
+    EXPECT_NEAR(posControl.desiredState.pos.V.Z, simAltitude, 100.0f);
+    EXPECT_GT(minSpeed, SIM_AIRSPEED - 150.0f);
+    EXPECT_LT(maxSpeed, SIM_AIRSPEED + 150.0f);
+    EXPECT_GT(maxThrottle, navConfig.fw_cruise_throttle + 100);
+
+    // then - back to cruise throttle once level
+    EXPECT_NEAR(navConfig.fw_cruise_throttle, posControl.rcAdjustment[THROTTLE], 20);
+}
+
+TEST(NavigationFixedWingTest, TestTecsDescentReducesThrottle)
+{
+    // given
+    simInitLongitudinal();
+    simFlyLongitudinal(5, [](){});
+
+    // when - descend 20m
+    posControl.desiredState.pos.V.Z = simAltitude - 2000;
+
+    float maxSpeed = simSpeed;
+    int minThrottle = 2000;
+    simFlyLongitudinal(60, [&](){
+        maxSpeed = MAX(maxSpeed, simSpeed);
+        minThrottle = MIN(minThrottle, posControl.rcAdjustment[THROTTLE]);
+    });
+
+    // then - potential energy is not wasted into speed, throttle is reduced instead
+    EXPECT_NEAR(posControl.desiredState.pos.V.Z, simAltitude, 100.0f);
+    EXPECT_LT(maxSpeed, SIM_AIRSPEED + 150.0f);
+    EXPECT_LT(minThrottle, navConfig.fw_cruise_throttle - 100);
+}
+
+TEST(NavigationFixedWingTest, TestTecsSpeedChangeHoldsAltitude)
+{
+    // given
+    simInitLongitudinal();
+    simFlyLongitudinal(5, [](){});
+    float initialAltitude = simAltitude;
+
+    // when - accelerate by 3m/s
+    navConfig.fw_cruise_speed = SIM_AIRSPEED + 300;
+
+    float maxAltitudeError = 0;
+    simFlyLongitudinal(60, [&](){ maxAltitudeError = MAX(maxAltitudeError, fabsf(simAltitude - initialAltitude)); });
+
+    // then
+    EXPECT_NEAR(navConfig.fw_cruise_speed, simSpeed, 30.0f);
+    EXPECT_LT(maxAltitudeError, 200.0f);
+}
+
+TEST(NavigationFixedWingTest, TestTecsWithoutCruiseSpeed)
+{
+    // given - speed is not controlled
+    simInitLongitudinal();
+    navConfig.fw_cruise_speed = 0;
+    simFlyLongitudinal(5, [](){});
+
+    // when
+    posControl.desiredState.pos.V.Z = simAltitude + 2000;
+    simFlyLongitudinal(60, [](){});
+
+    // then
+    EXPECT_NEAR(posControl.desiredState.pos.V.Z, simAltitude, 100.0f);
+    EXPECT_NEAR(SIM_AIRSPEED, simSpeed, 150.0f);
+}
+
+TEST(NavigationFixedWingTest, TestTrackFollowingInCrosswind)
+{
+    // given - 2km track due north, aircraft starts 100m to the left of it, 5m/s wind from the west
+    simInit(0, -10000, 0);
+    simWindY = 500;
+
+    simApproachingLastWaypoint = false;
+    simStateFlags = (navigationFSMStateFlags_t)(NAV_CTL_POS | NAV_AUTO_WP);
+    posControl.activeWaypointTrackStart.V.X = 0;
+    posControl.activeWaypointTrackStart.V.Y = 0;
+    posControl.desiredState.pos.V.X = 200000;
+    posControl.desiredState.pos.V.Y = 0;
+
+    // when - settle on the track
+    simFly(40, [](){});
+
+    // then - aircraft stays on track despite crosswind, no overshoot to the other side
+    float maxCrossTrackError = 0;
+    simFly(40, [&](){ maxCrossTrackError = MAX(maxCrossTrackError, fabsf(simPosY)); });
+
+    EXPECT_LT(maxCrossTrackError, 200.0f);
+    EXPECT_LT(simPosX, 200000.0f);
+}
+
+TEST(NavigationFixedWingTest, TestTrackInterceptAngleIsLimited)
+{
+    // given - aircraft far off to the left of the track, flying parallel to it
+    simInit(0, -50000, 0);
+
+    simApproachingLastWaypoint = false;
+    simStateFlags = (navigationFSMStateFlags_t)(NAV_CTL_POS | NAV_AUTO_WP);
+    posControl.activeWaypointTrackStart.V.X = 0;
+    posControl.activeWaypointTrackStart.V.Y = 0;
+    posControl.desiredState.pos.V.X = 500000;
+    posControl.desiredState.pos.V.Y = 0;
+
+    // when
+    float maxInterceptAngle = 0;
+    simFly(20, [&](){ maxInterceptAngle = MAX(maxInterceptAngle, fabsf(RADIANS_TO_DEGREES(simHeading))); });
+
+    // then - track is joined at 45 degrees, aircraft does not turn perpendicular to it
+    EXPECT_GT(maxInterceptAngle, 40.0f);
+    EXPECT_LT(maxInterceptAngle, 55.0f);
+}
+
+TEST(NavigationFixedWingTest, TestLoiterCircleRadius)
+{
+    // given - position hold 300m to the north, aircraft heading away from it
+    simInit(-30000, 0, 180);
+
+    simApproachingLastWaypoint = true;
+    simStateFlags = NAV_CTL_POS;
+    posControl.desiredState.pos.V.X = 0;
+    posControl.desiredState.pos.V.Y = 0;
+
+    // when - turn around and capture the circle
+    simFly(90, [](){});
+
+    // then - aircraft stays on the circle, flying clockwise
+    float minRadius = 1e9f, maxRadius = 0;
+    float headingChange = 0, lastHeading = simHeading;
+    simFly(60, [&](){
+        float radius = sqrtf(sq(simPosX) + sq(simPosY));
+        minRadius = MIN(minRadius, radius);
+        maxRadius = MAX(maxRadius, radius);
+        headingChange += simHeading - lastHeading;
+        lastHeading = simHeading;
+    });
+
+    EXPECT_GT(minRadius, navConfig.fw_loiter_radius - 500.0f);
+    EXPECT_LT(maxRadius, navConfig.fw_loiter_radius + 500.0f);
+    EXPECT_GT(headingChange, 0.0f);
+}
+
+TEST(NavigationFixedWingTest, TestTurnAnticipationDistance)
+{
+    // given
+    simInit(0, 0, 0);
+    simUpdateActualState();
+
+    // Turn radius at max bank: V^2 / (g * tan(bank))
+    float turnRadius = sq(SIM_AIRSPEED) / (GRAVITY_CMSS * tanf(DEGREES_TO_RADIANS(navConfig.fw_max_bank_angle)));
+    float l1Distance = 0.75f * 20 * SIM_AIRSPEED / M_PIf;
+
+    // then - turn is tangent to both tracks
+    EXPECT_EQ(0u, calculateFixedWingTurnAnticipationDistance(0));
+    EXPECT_NEAR(turnRadius * tanf(DEGREES_TO_RADIANS(22.5f)), calculateFixedWingTurnAnticipationDistance(4500), 10.0f);
+    EXPECT_NEAR(turnRadius, calculateFixedWingTurnAnticipationDistance(9000), 10.0f);
+
+    // then - sharp turns start at L1 distance
+    EXPECT_NEAR(l1Distance, calculateFixedWingTurnAnticipationDistance(18000), 1.0f);
+
+    // then - heading controller does not anticipate turns
+    navConfig.fw_nav_controller = NAV_FW_CONTROLLER_HEADING;
+    EXPECT_EQ(0u, calculateFixedWingTurnAnticipationDistance(9000));
+}
+
+// STUBS
+
+extern "C" {
+
+navigationPosControl_t posControl;
+int16_t rcCommand[4];
+uint32_t targetLooptime;
+
+uint32_t micros(void) { return simTime; }
+
+bool isApproachingLastWaypoint(void) { return simApproachingLastWaypoint; }
+navigationFSMStateFlags_t navGetCurrentStateFlags(void) { return simStateFlags; }
+
+uint32_t calculateDistanceToDestination(t_fp_vector * destinationPos)
+{
+    return sqrtf(sq(destinationPos->V.X - posControl.actualState.pos.V.X) + sq(destinationPos->V.Y - posControl.actualState.pos.V.Y));
+}
+
+int32_t calculateBearingToDestination(t_fp_vector * destinationPos)
+{
+    return wrap_36000(RADIANS_TO_CENTIDEGREES(atan2f(destinationPos->V.Y - posControl.actualState.pos.V.Y, destinationPos->V.X - posControl.actualState.pos.V.X)));
+}
+
+float navPidApply2(float setpoint, float measurement, float dt, pidController_t *pid, float outMin, float outMax, bool dTermErrorTracking)
+{
+    UNUSED(setpoint);
+    UNUSED(measurement);
+    UNUSED(dt);
+    UNUSED(pid);
+    UNUSED(outMin);
+    UNUSED(outMax);
+    UNUSED(dTermErrorTracking);
+    return 0;
+}
+
+void navPidReset(pidController_t *pid) { UNUSED(pid); }
+
+void updateAltitudeTargetFromClimbRate(float climbRate, navUpdateAltitudeFromRateMode_e mode)
+{
+    UNUSED(climbRate);
+    UNUSED(mode);
+}
+
+int16_t pidAngleToRcCommand(float angleDeciDegrees) { return angleDeciDegrees; }
+void updateMagHoldHeading(int16_t heading) { UNUSED(heading); }
+
+}
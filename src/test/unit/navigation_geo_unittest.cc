@@ -0,0 +1,246 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#define NAV
+
+extern "C" {
+    #include "build_config.h"
+    #include "platform.h"
+
+    #include "common/axis.h"
+    #include "common/maths.h"
+    #include "common/utils.h"
+
+    #include "io/gps.h"
+
+    #include "flight/navigation_rewrite.h"
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+/*
+ * Double precision WGS84 reference: geodetic -> ECEF -> local tangent plane (North, East) at the origin.
+ * Horizontal position is evaluated at origin altitude, altitude is kept as a separate vertical coordinate.
+ */
+static void referenceGeodeticToLocal(const gpsLocation_t * origin, int32_t lat, int32_t lon, double * north, double * east)
+{
+    const double a = 637813700.0;   // cm
+    const double e2 = 6.69437999014e-3;
+    const double deg = M_PI / 180.0 * 1e-7;
+    double ecef[2][3];
+    int32_t llh[2][2] = { { origin->lat, origin->lon }, { lat, lon } };
+
+    for (int i = 0; i < 2; i++) {
+        double phi = llh[i][0] * deg;
+        double lambda = llh[i][1] * deg;
+        double N = a / sqrt(1.0 - e2 * sin(phi) * sin(phi));
+
+        ecef[i][0] = (N + origin->alt) * cos(phi) * cos(lambda);
+        ecef[i][1] = (N + origin->alt) * cos(phi) * sin(lambda);
+        ecef[i][2] = (N * (1.0 - e2) + origin->alt) * sin(phi);
+    }
+
+    double phi0 = origin->lat * deg;
+    double lambda0 = origin->lon * deg;
+    double dx = ecef[1][0] - ecef[0][0];
+    double dy = ecef[1][1] - ecef[0][1];
+    double dz = ecef[1][2] - ecef[0][2];
+
+    *north = -sin(phi0) * cos(lambda0) * dx - sin(phi0) * sin(lambda0) * dy + cos(phi0) * dz;
+    *east = -sin(lambda0) * dx + cos(lambda0) * dy;
+}
+
+/*
+ * Destination at given distance and bearing on a sphere, only used to place test points.
+ */
+static void offsetLocation(const gpsLocation_t * origin, float distanceCm, float bearingDeg, gpsLocation_t * llh)
+{
+    const double R = 637100880.0;
+    const double deg = M_PI / 180.0 * 1e-7;
+    double phi0 = origin->lat * deg;
+    double lambda0 = origin->lon * deg;
+    double delta = distanceCm / R;
+    double theta = bearingDeg * M_PI / 180.0;
+
+    double phi = asin(sin(phi0) * cos(delta) + cos(phi0) * sin(delta) * cos(theta));
+    double lambda = lambda0 + atan2(sin(theta) * sin(delta) * cos(phi0), cos(delta) - sin(phi0) * sin(phi));
+
+    llh->lat = lrint(phi / deg);
+    llh->lon = lrint(lambda / deg);
+    llh->alt = origin->alt;
+}
+
+static const gpsLocation_t testOrigins[] = {
+    { 505498090, 1370165690, 15000 },
+    { 0, 0, 0 },
+    { -338688000, 1512093000, 5000 },
+    { 651000000, -182000000, 100000 },
+};
+
+static const float testBearings[] = { 0, 45, 90, 135, 180, 225, 270, 315 };
+
+/*
+ * Fly outbound along each bearing and return max horizontal error found at the given distance.
+ * Aircraft moves in 100m steps, so projection expansion point follows it as it would in flight.
+ */
+static float maxErrorAtDistance(float distanceCm)
+{
+    float maxError = 0;
+
+    for (unsigned i = 0; i < ARRAYLEN(testOrigins); i++) {
+        for (unsigned j = 0; j < ARRAYLEN(testBearings); j++) {
+            gpsOrigin_s origin;
+            gpsLocation_t llh = testOrigins[i];
+            t_fp_vector pos;
+
+            memset(&origin, 0, sizeof(origin));
+            geoConvertGeodeticToLocal(&origin, &llh, &pos, GEO_ALT_ABSOLUTE);
+
+            for (float d = 10000.0f; d <= distanceCm; d += 10000.0f) {
+                offsetLocation(&testOrigins[i], d, testBearings[j], &llh);
+                geoUpdateProjectionAnchor(&origin, &llh);
+                geoConvertGeodeticToLocal(&origin, &llh, &pos, GEO_ALT_ABSOLUTE);
+            }
+
+            double north, east;
+            referenceGeodeticToLocal(&testOrigins[i], llh.lat, llh.lon, &north, &east);
+            maxError = MAX(maxError, sqrtf(sq(pos.V.X - north) + sq(pos.V.Y - east)));
+        }
+    }
+
+    return maxError;
+}
+
+TEST(NavigationGeoTest, TestOriginIsZero)
+{
+    // given
+    gpsOrigin_s origin;
+    gpsLocation_t llh = testOrigins[0];
+    t_fp_vector pos;
+    origin.valid = false;
+
+    // when
+    geoConvertGeodeticToLocal(&origin, &llh, &pos, GEO_ALT_ABSOLUTE);
+
+    // then
+    EXPECT_TRUE(origin.valid);
+    EXPECT_FLOAT_EQ(0.0f, pos.V.X);
+    EXPECT_FLOAT_EQ(0.0f, pos.V.Y);
+    EXPECT_FLOAT_EQ(0.0f, pos.V.Z);
+}
+
+TEST(NavigationGeoTest, TestAccuracyAt1km)
+{
+    EXPECT_LT(maxErrorAtDistance(100000.0f), 1.0f);     // cm
+}
+
+TEST(NavigationGeoTest, TestAccuracyAt10km)
+{
+    EXPECT_LT(maxErrorAtDistance(1000000.0f), 1.0f);    // cm
+}
+
+TEST(NavigationGeoTest, TestAccuracyAt50km)
+{
+    EXPECT_LT(maxErrorAtDistance(5000000.0f), 2.0f);    // cm
+}
+
+TEST(NavigationGeoTest, TestFarPointWithoutTrackingIsAccurate)
+{
+    // given - origin is set, then a far waypoint is converted directly
+    gpsOrigin_s origin;
+    gpsLocation_t llh = testOrigins[0];
+    t_fp_vector pos;
+    double north, east;
+    origin.valid = false;
+    geoConvertGeodeticToLocal(&origin, &llh, &pos, GEO_ALT_ABSOLUTE);
+
+    // when
+    offsetLocation(&testOrigins[0], 5000000.0f, 45.0f, &llh);
+    geoConvertGeodeticToLocal(&origin, &llh, &pos, GEO_ALT_ABSOLUTE);
+
+    // then
+    referenceGeodeticToLocal(&testOrigins[0], llh.lat, llh.lon, &north, &east);
+    EXPECT_NEAR(north, pos.V.X, 2.0f);
+    EXPECT_NEAR(east, pos.V.Y, 2.0f);
+    EXPECT_FLOAT_EQ(0.0f, pos.V.Z);
+}
+
+TEST(NavigationGeoTest, TestWaypointConversionKeepsAircraftAnchor)
+{
+    // given - aircraft is tracked 20km away from origin
+    gpsOrigin_s origin;
+    gpsLocation_t aircraft = testOrigins[0];
+    gpsLocation_t waypoint;
+    t_fp_vector pos;
+    double north, east;
+    origin.valid = false;
+    geoConvertGeodeticToLocal(&origin, &aircraft, &pos, GEO_ALT_ABSOLUTE);
+
+    offsetLocation(&testOrigins[0], 2000000.0f, 90.0f, &aircraft);
+    geoUpdateProjectionAnchor(&origin, &aircraft);
+    gpsProjectionAnchor_t aircraftAnchor = origin.anchor;
+
+    for (unsigned j = 0; j < ARRAYLEN(testBearings); j++) {
+        // when - waypoints far from the aircraft are converted
+        offsetLocation(&testOrigins[0], 3000000.0f, testBearings[j], &waypoint);
+        geoConvertGeodeticToLocal(&origin, &waypoint, &pos, GEO_ALT_RELATIVE);
+
+        // then - conversion is accurate and the shared anchor stays with the aircraft
+        referenceGeodeticToLocal(&testOrigins[0], waypoint.lat, waypoint.lon, &north, &east);
+        EXPECT_NEAR(north, pos.V.X, 2.0f);
+        EXPECT_NEAR(east, pos.V.Y, 2.0f);
+        EXPECT_EQ(0, memcmp(&aircraftAnchor, &origin.anchor, sizeof(aircraftAnchor)));
+    }
+}
+
+TEST(NavigationGeoTest, TestLocalToGeodeticRoundTrip)
+{
+    // given
+    gpsOrigin_s origin;
+    gpsLocation_t llh = testOrigins[0];
+    t_fp_vector pos;
+    origin.valid = false;
+    geoConvertGeodeticToLocal(&origin, &llh, &pos, GEO_ALT_ABSOLUTE);
+
+    for (unsigned j = 0; j < ARRAYLEN(testBearings); j++) {
+        for (float d = 1000.0f; d <= 5000000.0f; d *= 10.0f) {
+            gpsLocation_t target, result;
+            offsetLocation(&testOrigins[0], d, testBearings[j], &target);
+            target.alt = 1000;
+
+            // when
+            geoConvertGeodeticToLocal(&origin, &target, &pos, GEO_ALT_RELATIVE);
+            geoConvertLocalToGeodetic(&origin, &pos, &result);
+
+            // then - within 1e-7 deg, which is about 1cm
+            EXPECT_NEAR(target.lat, result.lat, 1);
+            EXPECT_NEAR(target.lon, result.lon, 1);
+            EXPECT_EQ(testOrigins[0].alt + target.alt, result.alt);
+        }
+    }
+}
+
+// STUBS
+
+extern "C" {
+}
@@ -0,0 +1,199 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define NAV
+
+extern "C" {
+    #include "build_config.h"
+    #include "platform.h"
+
+    #include "common/axis.h"
+    #include "common/maths.h"
+
+    #include "io/gps.h"
+
+    #include "flight/navigation_rewrite.h"
+    #include "flight/navigation_rewrite_private.h"
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+/*
+ * Lawnmower survey pattern: 50m legs spaced 10m apart, constant altitude and speed.
+ */
+static void surveyWaypoint(int index, int count, navWaypoint_t * wp)
+{
+    wp->action = NAV_WP_ACTION_WAYPOINT;
+    wp->lat = 505498090 + (index / 2) * 900;
+    wp->lon = 1370165690 + (((index + 1) / 2) % 2) * 7070;
+    wp->alt = 5000;
+    wp->p1 = 500;
+    wp->p2 = 0;
+    wp->p3 = 0;
+    wp->flag = (index == count - 1) ? NAV_WP_FLAG_LAST : 0;
+}
+
+static void expectWaypointEq(const navWaypoint_t * expected, const navWaypoint_t * actual)
+{
+    EXPECT_EQ(expected->action, actual->action);
+    EXPECT_EQ(expected->lat, actual->lat);
+    EXPECT_EQ(expected->lon, actual->lon);
+    EXPECT_EQ(expected->alt, actual->alt);
+    EXPECT_EQ(expected->p1, actual->p1);
+    EXPECT_EQ(expected->p2, actual->p2);
+    EXPECT_EQ(expected->p3, actual->p3);
+    EXPECT_EQ(expected->flag, actual->flag);
+}
+
+TEST(NavigationMissionTest, TestSurveyMissionRoundTrip)
+{
+    // given
+    navWaypoint_t wp, stored;
+    missionReset();
+
+    // when
+    for (int i = 0; i < NAV_MAX_WAYPOINTS; i++) {
+        surveyWaypoint(i, NAV_MAX_WAYPOINTS, &wp);
+        EXPECT_TRUE(missionAppendWaypoint(&wp));
+    }
+
+    // then - all waypoints fit into storage sized for 15 uncompressed ones
+    EXPECT_TRUE(missionIsValid());
+    EXPECT_EQ(NAV_MAX_WAYPOINTS, missionGetWaypointCount());
+
+    // then - paged in from any block, in any order
+    for (int i = NAV_MAX_WAYPOINTS - 1; i >= 0; i--) {
+        surveyWaypoint(i, NAV_MAX_WAYPOINTS, &wp);
+        EXPECT_TRUE(missionGetWaypoint(i, &stored));
+        expectWaypointEq(&wp, &stored);
+    }
+
+    EXPECT_FALSE(missionGetWaypoint(NAV_MAX_WAYPOINTS, &stored));
+    EXPECT_FALSE(missionGetWaypoint(-1, &stored));
+}
+
+TEST(NavigationMissionTest, TestWorstCaseWaypointsRoundTrip)
+{
+    // given - every field changes by the largest possible amount
+    navWaypoint_t wp[15], stored;
+    missionReset();
+
+    for (int i = 0; i < 15; i++) {
+        wp[i].action = (i % 2) ? NAV_WP_ACTION_RTH : NAV_WP_ACTION_WAYPOINT;
+        wp[i].lat = (i % 2) ? INT32_MIN : INT32_MAX;
+        wp[i].lon = (i % 2) ? INT32_MAX : INT32_MIN;
+        wp[i].alt = (i % 2) ? -900000000 : 900000000;
+        wp[i].p1 = (i % 2) ? INT16_MIN : INT16_MAX;
+        wp[i].p2 = (i % 2) ? INT16_MAX : INT16_MIN;
+        wp[i].p3 = (i % 2) ? INT16_MIN : INT16_MAX;
+        wp[i].flag = (i == 14) ? NAV_WP_FLAG_LAST : 0;
+    }
+
+    // when
+    for (int i = 0; i < 15; i++) {
+        EXPECT_TRUE(missionAppendWaypoint(&wp[i]));
+    }
+
+    // then
+    EXPECT_TRUE(missionIsValid());
+    for (int i = 0; i < 15; i++) {
+        EXPECT_TRUE(missionGetWaypoint(i, &stored));
+        expectWaypointEq(&wp[i], &stored);
+    }
+}
+
+TEST(NavigationMissionTest, TestFullStorageRejectsWaypoint)
+{
+    // given
+    navWaypoint_t wp;
+    memset(&wp, 0, sizeof(wp));
+    missionReset();
+
+    // when - mission does not compress at all
+    int accepted = 0;
+    for (int i = 0; i < NAV_MAX_WAYPOINTS; i++) {
+        wp.action = NAV_WP_ACTION_WAYPOINT;
+        wp.lat = (i % 2) ? INT32_MIN : INT32_MAX;
+        wp.lon = wp.lat;
+        wp.alt = wp.lat;
+        wp.p1 = (i % 2) ? INT16_MIN : INT16_MAX;
+        wp.p2 = wp.p1;
+        wp.p3 = wp.p1;
+        if (missionAppendWaypoint(&wp)) {
+            accepted++;
+        }
+    }
+
+    // then - upload is never completed, worst case capacity is kept
+    EXPECT_GE(accepted, 15);
+    EXPECT_EQ(accepted, missionGetWaypointCount());
+    EXPECT_FALSE(missionIsValid());
+}
+
+TEST(NavigationMissionTest, TestCommittedMissionIsLoadedOnInit)
+{
+    // given
+    navWaypoint_t wp, stored;
+    missionReset();
+    for (int i = 0; i < 20; i++) {
+        surveyWaypoint(i, 20, &wp);
+        missionAppendWaypoint(&wp);
+    }
+
+    // when
+    missionInit();
+
+    // then
+    EXPECT_TRUE(missionIsValid());
+    EXPECT_EQ(20, missionGetWaypointCount());
+    surveyWaypoint(19, 20, &wp);
+    EXPECT_TRUE(missionGetWaypoint(19, &stored));
+    expectWaypointEq(&wp, &stored);
+
+    // then - committed mission can not be extended, upload has to start over
+    EXPECT_FALSE(missionAppendWaypoint(&wp));
+}
+
+TEST(NavigationMissionTest, TestIncompleteMissionIsDroppedOnInit)
+{
+    // given - upload interrupted before the last waypoint
+    navWaypoint_t wp;
+    missionReset();
+    for (int i = 0; i < 10; i++) {
+        surveyWaypoint(i, 20, &wp);
+        missionAppendWaypoint(&wp);
+    }
+    EXPECT_EQ(10, missionGetWaypointCount());
+    EXPECT_FALSE(missionIsValid());
+
+    // when
+    missionInit();
+
+    // then
+    EXPECT_FALSE(missionIsValid());
+    EXPECT_EQ(0, missionGetWaypointCount());
+}
+
+// STUBS
+
+extern "C" {
+}
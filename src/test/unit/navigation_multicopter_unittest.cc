@@ -0,0 +1,390 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#define NAV
+
+extern "C" {
+    #include "build_config.h"
+    #include "platform.h"
+
+    #include "common/axis.h"
+    #include "common/maths.h"
+    #include "common/filter.h"
+
+    #include "io/gps.h"
+    #include "io/rc_controls.h"
+    #include "io/escservo.h"
+    #include "io/rc_curves.h"
+
+    #include "flight/pid.h"
+    #include "flight/imu.h"
+    #include "flight/failsafe.h"
+    #include "flight/navigation_rewrite.h"
+    #include "flight/navigation_rewrite_private.h"
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+#define SIM_STEP_US             5000    // 200Hz aircraft dynamics
+#define SIM_POS_PERIOD_US       20000   // 50Hz position estimate updates
+#define SIM_TILT_TIME_CONSTANT  0.1f    // s, attitude response of the airframe
+
+extern "C" {
+    // simulation state shared with stubs
+    uint32_t simTime;
+    bool simApproachingLastWaypoint;
+    navigationFSMStateFlags_t simStateFlags;
+}
+
+static navConfig_t navConfig;
+static rcControlsConfig_t rcControlsConfig;
+
+static float simPos[2], simVel[2], simAccel[2];
+static float simTilt[2];                // rad, pitch (X) and roll (Y)
+
+// Flight statistics
+static float simMaxTilt;                // deg
+static float simMaxTiltRate;            // deg/s, of commanded tilt
+static float simMaxAccel;               // cm/s^2
+static float simMinSpeed;               // cm/s
+
+static void simInit(uint16_t maxJerk)
+{
+    memset(&posControl, 0, sizeof(posControl));
+    memset(&navConfig, 0, sizeof(navConfig));
+    memset(&rcControlsConfig, 0, sizeof(rcControlsConfig));
+
+    navConfig.max_speed = 300;
+    navConfig.mc_max_bank_angle = 30;
+    navConfig.waypoint_radius = 100;
+    navConfig.mc_traj_max_accel = 250;
+    navConfig.mc_traj_max_jerk = maxJerk;
+
+    posControl.navConfig = &navConfig;
+    posControl.rcControlsConfig = &rcControlsConfig;
+
+    // Default POS and POSR PIDs
+    for (int axis = 0; axis < 2; axis++) {
+        posControl.pids.pos[axis].param.kP = 0.65f;
+        posControl.pids.vel[axis].param.kP = 1.8f;
+        posControl.pids.vel[axis].param.kI = 0.15f;
+        posControl.pids.vel[axis].param.kD = 1.0f;
+        posControl.pids.vel[axis].param.kT = 2.0f / (1.8f / 0.15f + 1.0f / 1.8f);
+    }
+    posControl.posDecelerationTime = 1.2f;
+    posControl.posResponseExpo = 0.1f;
+
+    posControl.flags.hasValidPositionSensor = 1;
+    posControl.actualState.cosYaw = 1.0f;
+    posControl.actualState.sinYaw = 0.0f;
+
+    memset(simPos, 0, sizeof(simPos));
+    memset(simVel, 0, sizeof(simVel));
+    memset(simAccel, 0, sizeof(simAccel));
+    memset(simTilt, 0, sizeof(simTilt));
+
+    simTime = 100000;
+    simApproachingLastWaypoint = true;
+    simStateFlags = NAV_CTL_POS;
+
+    simMaxTilt = 0;
+    simMaxTiltRate = 0;
+    simMaxAccel = 0;
+    simMinSpeed = 1e6f;
+}
+
+static void simSetTarget(float x, float y)
+{
+    posControl.desiredState.pos.V.X = x;
+    posControl.desiredState.pos.V.Y = y;
+}
+
+static void simRun(float seconds)
+{
+    uint32_t endTime = simTime + seconds * 1e6f;
+    float dt = US2S(SIM_STEP_US);
+
+    while (simTime < endTime) {
+        simTime += SIM_STEP_US;
+
+        // Point mass with first order attitude response, thrust is adjusted to keep altitude
+        for (int axis = 0; axis < 2; axis++) {
+            float tiltTarget = DECIDEGREES_TO_RADIANS(posControl.rcAdjustment[axis == X ? PITCH : ROLL]);
+            simTilt[axis] += (tiltTarget - simTilt[axis]) * dt / SIM_TILT_TIME_CONSTANT;
+            simAccel[axis] = GRAVITY_CMSS * tanf(simTilt[axis]);
+            simPos[axis] += (simVel[axis] + simAccel[axis] * dt / 2) * dt;
+            simVel[axis] += simAccel[axis] * dt;
+
+            simMaxTilt = MAX(simMaxTilt, fabsf(simTilt[axis]) * 180.0f / M_PIf);
+        }
+
+        simMaxAccel = MAX(simMaxAccel, sqrtf(sq(simAccel[X]) + sq(simAccel[Y])));
+        simMinSpeed = MIN(simMinSpeed, sqrtf(sq(simVel[X]) + sq(simVel[Y])));
+
+        // Navigation
+        if ((simTime % SIM_POS_PERIOD_US) == 0) {
+            int16_t lastRcAdjustment[2] = { posControl.rcAdjustment[PITCH], posControl.rcAdjustment[ROLL] };
+
+            for (int axis = 0; axis < 2; axis++) {
+                posControl.actualState.pos.A[axis] = simPos[axis];
+                posControl.actualState.vel.A[axis] = simVel[axis];
+            }
+            posControl.flags.horizontalPositionNewData = 1;
+
+            applyMulticopterNavigationController(simStateFlags, simTime);
+
+            // Rate of commanded tilt, spikes here saturate motors
+            simMaxTiltRate = MAX(simMaxTiltRate, fabsf(posControl.rcAdjustment[PITCH] - lastRcAdjustment[0]) / 10.0f / US2S(SIM_POS_PERIOD_US));
+            simMaxTiltRate = MAX(simMaxTiltRate, fabsf(posControl.rcAdjustment[ROLL] - lastRcAdjustment[1]) / 10.0f / US2S(SIM_POS_PERIOD_US));
+        }
+        else {
+            applyMulticopterNavigationController(simStateFlags, simTime);
+        }
+    }
+}
+
+static float simDistanceTo(float x, float y)
+{
+    return sqrtf(sq(x - simPos[X]) + sq(y - simPos[Y]));
+}
+
+/*
+ * Step of the hold position by 20m. Tilt rate is limited by trajectory jerk, acceleration by
+ * trajectory acceleration, copter settles without overshoot.
+ */
+TEST(NavigationMulticopterTest, TestPositionStepIsJerkLimited)
+{
+    float legacyMaxTiltRate;
+
+    // given - legacy controller
+    simInit(0);
+    simRun(1.0f);
+    simSetTarget(2000, 0);
+
+    // when
+    simRun(20.0f);
+
+    // then
+    EXPECT_LT(simDistanceTo(2000, 0), 50);
+    legacyMaxTiltRate = simMaxTiltRate;
+
+    // given - trajectory generator
+    simInit(500);
+    simRun(1.0f);
+    simSetTarget(2000, 0);
+
+    // when
+    float maxX = 0;
+    for (int i = 0; i < 200; i++) {
+        simRun(0.1f);
+        maxX = MAX(maxX, simPos[X]);
+    }
+
+    // then
+    EXPECT_LT(simDistanceTo(2000, 0), 20);
+    EXPECT_LT(maxX - 2000, 30);
+    EXPECT_LE(simMaxTiltRate, legacyMaxTiltRate * 0.6f);
+    EXPECT_LT(simMaxAccel, navConfig.mc_traj_max_accel * 1.2f);
+}
+
+/*
+ * Position hold engaged while flying at max speed. Copter stops at the hold position
+ * instead of overshooting and drifting back.
+ */
+TEST(NavigationMulticopterTest, TestPositionHoldFromCruiseDoesNotOvershoot)
+{
+    float legacyMaxTiltRate, legacyOvershoot;
+    t_fp_vector holdPosition;
+
+    // given - legacy controller
+    simInit(0);
+    simVel[X] = 300;
+    posControl.actualState.vel.V.X = 300;
+    calculateMulticopterInitialHoldPosition(&holdPosition);
+    simSetTarget(holdPosition.V.X, holdPosition.V.Y);
+
+    // when
+    float maxX = 0;
+    for (int i = 0; i < 100; i++) {
+        simRun(0.1f);
+        maxX = MAX(maxX, simPos[X]);
+    }
+
+    // then
+    legacyMaxTiltRate = simMaxTiltRate;
+    legacyOvershoot = maxX - holdPosition.V.X;
+
+    // given - trajectory generator
+    simInit(500);
+    simVel[X] = 300;
+    posControl.actualState.vel.V.X = 300;
+    calculateMulticopterInitialHoldPosition(&holdPosition);
+    simSetTarget(holdPosition.V.X, holdPosition.V.Y);
+
+    // when
+    maxX = 0;
+    for (int i = 0; i < 50; i++) {
+        simRun(0.1f);
+        maxX = MAX(maxX, simPos[X]);
+    }
+
+    // then - settled within 5s
+    EXPECT_LT(simDistanceTo(holdPosition.V.X, holdPosition.V.Y), 10);
+    EXPECT_LT(maxX - holdPosition.V.X, 20);
+    EXPECT_LT(maxX - holdPosition.V.X, legacyOvershoot / 2);
+    EXPECT_LE(simMaxTiltRate, legacyMaxTiltRate);
+}
+
+/*
+ * Mission with 90 deg turn. Copter keeps moving through the intermediate waypoint
+ * and never exceeds trajectory acceleration by much.
+ */
+TEST(NavigationMulticopterTest, TestWaypointCorneringKeepsSpeed)
+{
+    // given
+    simInit(500);
+    simStateFlags = (navigationFSMStateFlags_t)(NAV_CTL_POS | NAV_AUTO_WP);
+    simApproachingLastWaypoint = false;
+    posControl.activeWaypointTurnAngle = 9000;
+    simSetTarget(3000, 0);
+
+    // when - fly to the corner
+    while (simDistanceTo(3000, 0) > navConfig.waypoint_radius && simTime < 30000000) {
+        simRun(0.02f);
+    }
+    EXPECT_LT(simTime, 30000000u);
+
+    // when - next leg
+    simApproachingLastWaypoint = true;
+    posControl.activeWaypointTurnAngle = 0;
+    simSetTarget(3000, 3000);
+    simMinSpeed = 1e6f;
+    simRun(3.0f);
+
+    // then - no stop at the corner
+    EXPECT_GT(simMinSpeed, 50);
+    EXPECT_LT(simMaxAccel, navConfig.mc_traj_max_accel * 1.5f);
+
+    // then - reaches the last waypoint
+    simRun(20.0f);
+    EXPECT_LT(simDistanceTo(3000, 3000), 30);
+}
+
+/*
+ * Position P set to zero with trajectory generator enabled. Leash and stopping distance
+ * can't be derived from it, copter holds its velocity instead of getting NaN commands.
+ */
+TEST(NavigationMulticopterTest, TestZeroPositionPHoldsVelocity)
+{
+    // given
+    simInit(500);
+    for (int axis = 0; axis < 2; axis++) {
+        posControl.pids.pos[axis].param.kP = 0.0f;
+    }
+    simRun(1.0f);
+    simSetTarget(2000, 0);
+
+    // when
+    simRun(5.0f);
+
+    // then
+    EXPECT_FALSE(isnan(simPos[X]) || isnan(simPos[Y]));
+    EXPECT_LT(simDistanceTo(0, 0), 50);
+    EXPECT_LT(simMaxTilt, 5);
+}
+
+// STUBS
+
+extern "C" {
+
+navigationPosControl_t posControl;
+int16_t rcCommand[4];
+uint32_t targetLooptime;
+
+uint32_t micros(void) { return simTime; }
+
+bool isApproachingLastWaypoint(void) { return simApproachingLastWaypoint; }
+navigationFSMStateFlags_t navGetCurrentStateFlags(void) { return simStateFlags; }
+float getActiveWaypointSpeed(void) { return posControl.navConfig->max_speed; }
+
+float navPidApply2(float setpoint, float measurement, float dt, pidController_t *pid, float outMin, float outMax, bool dTermErrorTracking)
+{
+    float newProportional, newDerivative;
+    float error = setpoint - measurement;
+
+    newProportional = error * pid->param.kP;
+
+    if (dTermErrorTracking) {
+        newDerivative = (error - pid->last_input) / dt;
+        pid->last_input = error;
+    }
+    else {
+        newDerivative = -(measurement - pid->last_input) / dt;
+        pid->last_input = measurement;
+    }
+
+    newDerivative = pid->param.kD * filterApplyPt1(newDerivative, &pid->dterm_filter_state, NAV_DTERM_CUT_HZ, dt);
+
+    float outVal = newProportional + pid->integrator + newDerivative;
+    float outValConstrained = constrainf(outVal, outMin, outMax);
+
+    pid->integrator += (error * pid->param.kI * dt) + ((outValConstrained - outVal) * pid->param.kT * dt);
+
+    return outValConstrained;
+}
+
+void navPidReset(pidController_t *pid)
+{
+    pid->integrator = 0.0f;
+    pid->last_input = 0.0f;
+    pid->dterm_filter_state.state = 0.0f;
+    pid->dterm_filter_state.RC = 0.0f;
+}
+
+void setDesiredPosition(t_fp_vector * pos, int32_t yaw, navSetWaypointFlags_t useMask)
+{
+    UNUSED(yaw);
+    UNUSED(useMask);
+    simSetTarget(pos->V.X, pos->V.Y);
+}
+
+void updateAltitudeTargetFromClimbRate(float climbRate, navUpdateAltitudeFromRateMode_e mode)
+{
+    UNUSED(climbRate);
+    UNUSED(mode);
+}
+
+int16_t pidAngleToRcCommand(float angleDeciDegrees) { return angleDeciDegrees; }
+void updateMagHoldHeading(int16_t heading) { UNUSED(heading); }
+failsafeConfig_t * getActiveFailsafeConfig(void) { return NULL; }
+
+throttleStatus_e calculateThrottleStatus(rxConfig_t *rxConfig, uint16_t deadband3d_throttle)
+{
+    UNUSED(rxConfig);
+    UNUSED(deadband3d_throttle);
+    return THROTTLE_HIGH;
+}
+
+int16_t rcLookupThrottleMid(void) { return 1500; }
+
+}
@@ -0,0 +1,442 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#ifdef BENCHMARK
+#include <chrono>
+#endif
+
+#define NAV
+#define NAV_POS_ESTIMATOR_EKF
+
+extern "C" {
+    #include "build_config.h"
+    #include "platform.h"
+
+    #include "common/axis.h"
+    #include "common/maths.h"
+
+    #include "drivers/sensor.h"
+
+    #include "sensors/sensors.h"
+
+    #include "io/gps.h"
+
+    #include "flight/imu.h"
+    #include "flight/navigation_rewrite.h"
+    #include "flight/navigation_rewrite_private.h"
+
+    #include "config/runtime_config.h"
+
+    void initializePositionEstimator(void);
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+#define SIM_LOOP_TIME_US        1000    // 1kHz loop
+#define SIM_GPS_PERIOD_US       200000  // 5Hz GPS
+#define SIM_BARO_PERIOD_US      25000   // 40Hz baro conversions
+#define SIM_DURATION_US         20000000
+#define SIM_SETTLE_TIME_US      5000000
+
+extern "C" {
+    // simulation state shared with stubs
+    uint32_t simTime = 0;
+    uint32_t simSensors = 0;
+    t_fp_vector simGpsPos;
+    float simBaroAlt;
+
+    bool simEstPosValid;
+    float simEstPosX;
+    float simEstPosY;
+    float simEstAlt;
+}
+
+static navConfig_t navConfig;
+
+/*
+ * Synthetic trajectory: circle in XY with 10m radius, slow climb and descent in Z starting at rest.
+ * Peak horizontal speed is 10m/s, so an uncompensated 200ms GPS delay gives up to 2m error.
+ *
+ * All tests here run on synthetic sensor data. The EKF is not validated against recorded flight logs yet,
+ * sensor noise, vibration and GPS glitches of real flights are not covered.
+ */
+static void simTrajectory(uint32_t t, t_fp_vector * pos, t_fp_vector * vel, t_fp_vector * acc)
+{
+    float s = US2S(t);
+
+    pos->V.X = 1000.0f * sinf(s);
+    pos->V.Y = 1000.0f * cosf(s);
+    pos->V.Z = 500.0f * (1.0f - cosf(0.5f * s));
+
+    vel->V.X = 1000.0f * cosf(s);
+    vel->V.Y = -1000.0f * sinf(s);
+    vel->V.Z = 250.0f * sinf(0.5f * s);
+
+    acc->V.X = -1000.0f * sinf(s);
+    acc->V.Y = -1000.0f * cosf(s);
+    acc->V.Z = 125.0f * cosf(0.5f * s);
+}
+
+class PositionEstimatorTest : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        memset(&navConfig, 0, sizeof(navConfig));
+        navConfig.inav.gps_min_sats = 6;
+        navConfig.inav.use_gps_velned = 1;
+        navConfig.inav.w_z_baro_p = 0.35f;
+        navConfig.inav.w_xy_gps_p = 1.0f;
+        navConfig.inav.w_xy_gps_v = 2.0f;
+        navConfig.inav.w_z_res_v = 0.5f;
+        navConfig.inav.w_xy_res_v = 0.5f;
+        navConfig.inav.max_eph_epv = 1000.0f;
+        navConfig.inav.baro_epv = 100.0f;
+
+        memset(&posControl, 0, sizeof(posControl));
+        posControl.navConfig = &navConfig;
+        posControl.gpsOrigin.valid = true;
+
+        stateFlags = GPS_FIX;
+        armingFlags = ARMED;
+        gpsSol.numSat = 10;
+        gpsSol.flags.validVelNE = 1;
+        gpsSol.flags.validVelD = 1;
+
+        // keep sensor timeouts of a previous test from leaking into this one
+        simTime += 10000000;
+
+        initializePositionEstimator();
+
+        // sync estimator clock to simulation start, vehicle is at rest and no sensors are read yet
+        simSensors = 0;
+        imuAccelInBodyFrame.V.X = 0;
+        imuAccelInBodyFrame.V.Y = 0;
+        imuAccelInBodyFrame.V.Z = GRAVITY_CMSS;
+        updatePositionEstimator_AccelTopic(simTime);
+        updatePositionEstimator();
+        lastEstimatorTime = simTime;
+        nextBaroTime = simTime;
+        estimatorRunCount = 0;
+    }
+
+    /*
+     * One scheduler cycle: accelerometer is integrated by the PID loop, baro task publishes finished
+     * conversions and the position estimator task only runs when its check function asks for it.
+     */
+    void schedulerLoop(void) {
+        updatePositionEstimator_AccelTopic(simTime);
+
+        if ((simSensors & SENSOR_BARO) && simTime >= nextBaroTime) {
+            updatePositionEstimator_BaroTopic(simTime);
+            nextBaroTime += SIM_BARO_PERIOD_US;
+        }
+
+        if (isPositionEstimatorUpdateRequired(simTime - lastEstimatorTime)) {
+            updatePositionEstimator();
+            lastEstimatorTime = simTime;
+            estimatorRunCount++;
+        }
+    }
+
+    uint32_t lastEstimatorTime;
+    uint32_t nextBaroTime;
+    int estimatorRunCount;
+
+    /*
+     * Run the estimator against the synthetic trajectory with sensors delayed by the given amount.
+     * Returns RMS error of the published estimate after the settle time.
+     */
+    float simulate(uint32_t gpsDelayUs, uint32_t baroDelayUs, bool checkAltitude, float accelBiasZ = 0) {
+        uint32_t startTime = simTime;
+        uint32_t nextGpsTime = startTime;
+        float errorSum = 0;
+        int errorCount = 0;
+
+        for (uint32_t t = 0; t < SIM_DURATION_US; t += SIM_LOOP_TIME_US) {
+            t_fp_vector pos, vel, acc;
+
+            simTime = startTime + t;
+
+            // perfect IMU in NEU frame, body frame is aligned with earth frame in this test
+            simTrajectory(t, &pos, &vel, &acc);
+            imuAccelInBodyFrame.V.X = acc.V.X;
+            imuAccelInBodyFrame.V.Y = acc.V.Y;
+            imuAccelInBodyFrame.V.Z = acc.V.Z + GRAVITY_CMSS + accelBiasZ;
+
+            // baro reports altitude as it was baroDelayUs ago
+            simTrajectory(t - MIN(t, baroDelayUs), &pos, &vel, &acc);
+            simBaroAlt = pos.V.Z;
+
+            // GPS reports position and velocity as they were gpsDelayUs ago
+            if (simTime >= nextGpsTime) {
+                simTrajectory(t - MIN(t, gpsDelayUs), &pos, &vel, &acc);
+                simGpsPos = pos;
+                gpsSol.velNED[0] = lrintf(vel.V.X);
+                gpsSol.velNED[1] = lrintf(vel.V.Y);
+                gpsSol.velNED[2] = lrintf(-vel.V.Z);
+                onNewGPSData();
+                nextGpsTime += SIM_GPS_PERIOD_US;
+            }
+
+            schedulerLoop();
+
+            // compare last published estimate to the true trajectory at the moment it was published
+            if (t >= SIM_SETTLE_TIME_US && (t % 20000) == 0) {
+                simTrajectory(t, &pos, &vel, &acc);
+                if (checkAltitude) {
+                    errorSum += sq(simEstAlt - pos.V.Z);
+                }
+                else {
+                    errorSum += sq(simEstPosX - pos.V.X) + sq(simEstPosY - pos.V.Y);
+                }
+                errorCount++;
+            }
+        }
+
+        return sqrtf(errorSum / errorCount);
+    }
+};
+
+TEST_F(PositionEstimatorTest, TestDelayedGpsIsFusedAgainstHistory)
+{
+    // given
+    simSensors = SENSOR_GPS;
+    navConfig.inav.gps_delay_ms = 200;
+
+    // when
+    float compensatedError = simulate(200000, 0, false);
+
+    // then
+    EXPECT_LT(compensatedError, 10.0f);     // cm
+}
+
+TEST_F(PositionEstimatorTest, TestGpsDelayCompensationReducesError)
+{
+    // given
+    simSensors = SENSOR_GPS;
+
+    // when
+    navConfig.inav.gps_delay_ms = 0;
+    float uncompensatedError = simulate(200000, 0, false);
+
+    SetUp();
+    simSensors = SENSOR_GPS;
+    navConfig.inav.gps_delay_ms = 200;
+    float compensatedError = simulate(200000, 0, false);
+
+    // then
+    EXPECT_LT(compensatedError * 10, uncompensatedError);
+}
+
+TEST_F(PositionEstimatorTest, TestDelayedBaroIsFusedAgainstHistory)
+{
+    // given
+    simSensors = SENSOR_BARO;
+
+    // when
+    navConfig.inav.baro_delay_ms = 0;
+    float uncompensatedError = simulate(0, 100000, true);
+
+    SetUp();
+    simSensors = SENSOR_BARO;
+    navConfig.inav.baro_delay_ms = 100;
+    float compensatedError = simulate(0, 100000, true);
+
+    // then
+    EXPECT_LT(compensatedError, 5.0f);      // cm
+    EXPECT_LT(compensatedError * 4, uncompensatedError);
+}
+
+TEST_F(PositionEstimatorTest, TestEkfTracksDelayedGps)
+{
+    // given
+    simSensors = SENSOR_GPS;
+    navConfig.inav.use_ekf = 1;
+    navConfig.inav.gps_delay_ms = 200;
+
+    // when
+    float error = simulate(200000, 0, false);
+
+    // then
+    EXPECT_LT(error, 10.0f);                // cm
+}
+
+TEST_F(PositionEstimatorTest, TestEkfEstimatesAccelerometerBias)
+{
+    // given
+    simSensors = SENSOR_BARO;
+    navConfig.inav.use_ekf = 1;
+    navConfig.inav.baro_delay_ms = 100;
+
+    // when - 0.05G accelerometer bias on Z axis
+    float error = simulate(0, 100000, true, 50.0f);
+
+    // then
+    EXPECT_LT(error, 5.0f);                 // cm
+}
+
+TEST_F(PositionEstimatorTest, TestEkfCovarianceDrivesEph)
+{
+    // given
+    simSensors = SENSOR_GPS;
+    navConfig.inav.use_ekf = 1;
+    navConfig.inav.gps_delay_ms = 200;
+    simulate(200000, 0, false);
+
+    // then - estimate is published as valid while GPS is fused
+    EXPECT_TRUE(simEstPosValid);
+
+    // when - GPS lost, position uncertainty grows until estimate is no longer trusted
+    simSensors = 0;
+    for (int i = 0; i < 30000 && simEstPosValid; i++) {
+        simTime += SIM_LOOP_TIME_US;
+        schedulerLoop();
+    }
+
+    // then
+    EXPECT_FALSE(simEstPosValid);
+}
+
+TEST_F(PositionEstimatorTest, TestEstimatorRunsOnSensorEvents)
+{
+    // given - no sensor data, estimator falls back to fixed publish rate
+    for (int i = 0; i < 1000; i++) {
+        simTime += SIM_LOOP_TIME_US;
+        schedulerLoop();
+    }
+
+    // then
+    EXPECT_NEAR(50, estimatorRunCount, 1);
+
+    // when - baro conversions and GPS frames arrive
+    estimatorRunCount = 0;
+    simSensors = SENSOR_GPS | SENSOR_BARO;
+    nextBaroTime = simTime;
+    for (int i = 0; i < 1000; i++) {
+        simTime += SIM_LOOP_TIME_US;
+        if ((i % 200) == 0) {
+            onNewGPSData();
+        }
+        schedulerLoop();
+    }
+
+    // then - one update per sensor event, plus publish rate fallback in between, never per loop
+    EXPECT_GE(estimatorRunCount, 45);
+    EXPECT_LE(estimatorRunCount, 50 + 40 + 5);
+}
+
+#ifdef BENCHMARK
+// Built into navigation_pos_estimator_benchmark only (make benchmark), timings are printed, not checked
+TEST_F(PositionEstimatorTest, TestEkfBenchmark)
+{
+    const int iterations = 100000;
+    long long elapsed[2];
+
+    simSensors = SENSOR_GPS | SENSOR_BARO;
+    navConfig.inav.gps_delay_ms = 200;
+
+    for (int useEkf = 0; useEkf < 2; useEkf++) {
+        SetUp();
+        simSensors = SENSOR_GPS | SENSOR_BARO;
+        navConfig.inav.use_ekf = useEkf;
+        simulate(200000, 30000, false);
+
+        auto start = std::chrono::steady_clock::now();
+        for (int n = 0; n < iterations; n++) {
+            simTime += SIM_LOOP_TIME_US;
+            if ((n % 200) == 0) {
+                onNewGPSData();
+            }
+            schedulerLoop();
+        }
+        elapsed[useEkf] = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    printf("Position estimator update: complementary %lld ns, EKF %lld ns\n", elapsed[0] / iterations, elapsed[1] / iterations);
+    EXPECT_TRUE(simEstPosValid);
+}
+#endif
+
+// STUBS
+
+extern "C" {
+
+navigationPosControl_t posControl;
+gpsSolutionData_t gpsSol;
+attitudeEulerAngles_t attitude;
+t_fp_vector imuAccelInBodyFrame;
+
+uint8_t stateFlags;
+uint8_t armingFlags;
+
+uint32_t micros(void) { return simTime; }
+
+bool sensors(uint32_t mask) { return simSensors & mask; }
+
+bool isImuReady(void) { return true; }
+bool isImuHeadingValid(void) { return true; }
+
+void imuTransformVectorBodyToEarth(t_fp_vector * v) { UNUSED(v); }
+void imuTransformVectorEarthToBody(t_fp_vector * v) { UNUSED(v); }
+
+void geoUpdateProjectionAnchor(gpsOrigin_s * origin, gpsLocation_t * llh)
+{
+    UNUSED(origin);
+    UNUSED(llh);
+}
+
+void geoConvertGeodeticToLocal(gpsOrigin_s * origin, gpsLocation_t * llh, t_fp_vector * pos, geoAltitudeConversionMode_e altConv)
+{
+    UNUSED(origin);
+    UNUSED(llh);
+    UNUSED(altConv);
+    *pos = simGpsPos;
+}
+
+bool isBaroCalibrationComplete(void) { return true; }
+int32_t baroCalculateAltitude(void) { return lrintf(simBaroAlt); }
+
+void updateActualHeading(int32_t newHeading) { UNUSED(newHeading); }
+
+void updateActualHorizontalPositionAndVelocity(bool hasValidSensor, float newX, float newY, float newVelX, float newVelY)
+{
+    UNUSED(newVelX);
+    UNUSED(newVelY);
+    simEstPosValid = hasValidSensor;
+    simEstPosX = newX;
+    simEstPosY = newY;
+}
+
+void updateActualAltitudeAndClimbRate(bool hasValidSensor, float newAltitude, float newVelocity)
+{
+    UNUSED(hasValidSensor);
+    UNUSED(newVelocity);
+    simEstAlt = newAltitude;
+}
+
+void updateActualSurfaceDistance(bool hasValidSensor, float surfaceDistance, float surfaceVelocity)
+{
+    UNUSED(hasValidSensor);
+    UNUSED(surfaceDistance);
+    UNUSED(surfaceVelocity);
+}
+
+}
@@ -0,0 +1,99 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdint.h>
+#include <string.h>
+
+extern "C" {
+    #include "config/parameter_group.h"
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+typedef struct motorConfig_s {
+    uint16_t minthrottle;
+    uint16_t maxthrottle;
+    uint8_t useUnsyncedPwm;
+} motorConfig_t;
+
+typedef struct zeroConfig_s {
+    uint32_t value;
+} zeroConfig_t;
+
+#define PG_TEST_MOTOR_CONFIG    100
+#define PG_TEST_ZERO_CONFIG     101
+
+extern "C" {
+PG_DECLARE(motorConfig_t, motorConfig);
+PG_DECLARE(zeroConfig_t, zeroConfig);
+
+PG_REGISTER_WITH_RESET_FN(motorConfig_t, motorConfig, PG_TEST_MOTOR_CONFIG, 1);
+PG_REGISTER(zeroConfig_t, zeroConfig, PG_TEST_ZERO_CONFIG, 0);
+
+void pgResetFn_motorConfig(motorConfig_t *instance)
+{
+    instance->minthrottle = 1150;
+    instance->maxthrottle = 1850;
+}
+}
+
+TEST(ParameterGroupTest, FindRegisteredGroups)
+{
+    // when
+    const pgRegistry_t *reg = pgFind(PG_TEST_MOTOR_CONFIG);
+
+    // then
+    ASSERT_TRUE(reg != NULL);
+    EXPECT_EQ(PG_TEST_MOTOR_CONFIG, reg->pgn);
+    EXPECT_EQ(1, reg->version);
+    EXPECT_EQ(sizeof(motorConfig_t), reg->size);
+    EXPECT_EQ((uint8_t *)motorConfigMutable(), reg->address);
+
+    EXPECT_TRUE(pgFind(PG_TEST_ZERO_CONFIG) != NULL);
+    EXPECT_TRUE(pgFind(0) == NULL);
+}
+
+TEST(ParameterGroupTest, ResetAppliesDefaults)
+{
+    // given
+    memset(motorConfigMutable(), 0xAA, sizeof(motorConfig_t));
+    zeroConfigMutable()->value = 42;
+
+    // when
+    pgResetAll();
+
+    // then
+    EXPECT_EQ(1150, motorConfig()->minthrottle);
+    EXPECT_EQ(1850, motorConfig()->maxthrottle);
+    EXPECT_EQ(0, motorConfig()->useUnsyncedPwm);     // not set by reset function, cleared
+    EXPECT_EQ(0, zeroConfig()->value);
+}
+
+TEST(ParameterGroupTest, ResetOneGroup)
+{
+    // given
+    pgResetAll();
+    motorConfigMutable()->minthrottle = 1000;
+    zeroConfigMutable()->value = 42;
+
+    // when
+    pgReset(pgFind(PG_TEST_MOTOR_CONFIG));
+
+    // then
+    EXPECT_EQ(1150, motorConfig()->minthrottle);
+    EXPECT_EQ(42, zeroConfig()->value);
+}
@@ -27,6 +27,12 @@
 
 #define SERIAL_PORT_COUNT 4
 
+#define U_ID_0 0
+#define U_ID_1 1
+#define U_ID_2 2
+
+extern uint32_t SystemCoreClock;
+
 #define MAX_SIMULTANEOUS_ADJUSTMENT_COUNT 6
 
 typedef enum
@@ -45,6 +51,11 @@ typedef struct
     void* test;
 } TIM_TypeDef;
 
+typedef struct
+{
+    void* test;
+} USART_TypeDef;
+
 typedef enum {DISABLE = 0, ENABLE = !DISABLE} FunctionalState;
 
 typedef enum {TEST_IRQ = 0 } IRQn_Type;
@@ -57,6 +68,24 @@ uint8_t DMA_GetFlagStatus(uint32_t);
 void DMA_Cmd(DMA_Channel_TypeDef*, FunctionalState );
 void DMA_ClearFlag(uint32_t);
 
+typedef enum {
+    FLASH_BUSY = 1,
+    FLASH_ERROR_WRP,
+    FLASH_ERROR_PROGRAM,
+    FLASH_COMPLETE,
+    FLASH_TIMEOUT
+} FLASH_Status;
+
+#define FLASH_FLAG_EOP 0x20
+#define FLASH_FLAG_PGERR 0x04
+#define FLASH_FLAG_WRPERR 0x10
+
+void FLASH_Unlock(void);
+void FLASH_Lock(void);
+void FLASH_ClearFlag(uint32_t);
+FLASH_Status FLASH_ErasePage(uint32_t);
+FLASH_Status FLASH_ProgramWord(uint32_t, uint32_t);
+
 #define WS2811_DMA_TC_FLAG 1
 #define WS2811_DMA_HANDLER_IDENTIFER 0
 
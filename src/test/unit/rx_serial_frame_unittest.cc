@@ -0,0 +1,318 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+extern "C" {
+    #include "platform.h"
+
+    #include "drivers/serial.h"
+    #include "io/serial.h"
+
+    #include "rx/rx.h"
+    #include "rx/sbus.h"
+    #include "rx/sumd.h"
+    #include "rx/ibus.h"
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+#define TEST_FRAME_END_AT   123456
+#define TEST_MICROS_NOW     200000      // later than the frame end, the frame timestamp must be used
+
+#define SBUS_FRAME_SIZE     25
+#define SUMD_CHANNEL_COUNT  8
+#define SUMD_FRAME_SIZE     (SUMD_CHANNEL_COUNT * 2 + 5)
+#define IBUS_FRAME_SIZE     32
+
+static serialFrameCallbackPtr frameCallback;
+static bool frameReceived;
+static uint32_t frameReceivedEndAt;
+
+static rxConfig_t rxConfig;
+static rxRuntimeConfig_t testRxRuntimeConfig;
+static rcReadRawDataPtr readRawRC;
+
+static void receiveFrame(const uint8_t *frame, uint32_t length)
+{
+    frameCallback(frame, length, TEST_FRAME_END_AT);
+}
+
+static void buildSbusFrame(uint8_t *frame)
+{
+    memset(frame, 0, SBUS_FRAME_SIZE);
+    frame[0] = 0x0F;
+    // channel 1 is the low 11 bits of the channel data, 992 is the center
+    frame[1] = 992 & 0xFF;
+    frame[2] = 992 >> 8;
+}
+
+static void buildSumdFrame(uint8_t *frame)
+{
+    uint16_t crc = 0;
+
+    memset(frame, 0, SUMD_FRAME_SIZE);
+    frame[0] = 0xA8;
+    frame[1] = 0x01;
+    frame[2] = SUMD_CHANNEL_COUNT;
+    for (int i = 0; i < SUMD_CHANNEL_COUNT; i++) {
+        frame[3 + i * 2] = 12000 >> 8;
+        frame[4 + i * 2] = 12000 & 0xFF;
+    }
+    for (int i = 0; i < SUMD_FRAME_SIZE - 2; i++) {
+        crc ^= frame[i] << 8;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+        }
+    }
+    frame[SUMD_FRAME_SIZE - 2] = crc >> 8;
+    frame[SUMD_FRAME_SIZE - 1] = crc & 0xFF;
+}
+
+static void buildIbusFrame(uint8_t *frame)
+{
+    uint16_t checksum = 0xFFFF;
+
+    memset(frame, 0, IBUS_FRAME_SIZE);
+    frame[0] = 0x20;
+    frame[1] = 0x40;
+    for (int i = 0; i < 10; i++) {
+        frame[2 + i * 2] = 1500 & 0xFF;
+        frame[3 + i * 2] = 1500 >> 8;
+    }
+    for (int i = 0; i < IBUS_FRAME_SIZE - 2; i++) {
+        checksum -= frame[i];
+    }
+    frame[IBUS_FRAME_SIZE - 2] = checksum & 0xFF;
+    frame[IBUS_FRAME_SIZE - 1] = checksum >> 8;
+}
+
+class RxSerialFrameTest : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        frameCallback = NULL;
+        frameReceived = false;
+        frameReceivedEndAt = 0;
+        readRawRC = NULL;
+
+        memset(&rxConfig, 0, sizeof(rxConfig));
+        rxConfig.midrc = 1500;
+        memset(&testRxRuntimeConfig, 0, sizeof(testRxRuntimeConfig));
+    }
+};
+
+TEST_F(RxSerialFrameTest, TestSbusFrameAccepted)
+{
+    // given
+    EXPECT_TRUE(sbusInit(&rxConfig, &testRxRuntimeConfig, &readRawRC));
+    ASSERT_TRUE(frameCallback != NULL);
+
+    uint8_t frame[SBUS_FRAME_SIZE];
+    buildSbusFrame(frame);
+
+    // when
+    receiveFrame(frame, sizeof(frame));
+
+    // then
+    EXPECT_TRUE(frameReceived);
+    EXPECT_EQ(TEST_FRAME_END_AT, frameReceivedEndAt);
+
+    // and
+    EXPECT_EQ(SERIAL_RX_FRAME_COMPLETE, sbusFrameStatus());
+    EXPECT_EQ(1500, readRawRC(&testRxRuntimeConfig, 0));
+    EXPECT_EQ(SERIAL_RX_FRAME_PENDING, sbusFrameStatus());
+}
+
+TEST_F(RxSerialFrameTest, TestSbusFrameWithWrongLengthRejected)
+{
+    // given
+    EXPECT_TRUE(sbusInit(&rxConfig, &testRxRuntimeConfig, &readRawRC));
+
+    uint8_t frames[SBUS_FRAME_SIZE * 2];
+    buildSbusFrame(frames);
+    buildSbusFrame(frames + SBUS_FRAME_SIZE);
+
+    // when
+    receiveFrame(frames, SBUS_FRAME_SIZE - 1);
+    receiveFrame(frames, SBUS_FRAME_SIZE + 1);
+    receiveFrame(frames, sizeof(frames));       // two frames merged by a missed idle line
+
+    // then
+    EXPECT_FALSE(frameReceived);
+    EXPECT_EQ(SERIAL_RX_FRAME_PENDING, sbusFrameStatus());
+}
+
+TEST_F(RxSerialFrameTest, TestSbusFrameWithoutSyncByteRejected)
+{
+    // given
+    EXPECT_TRUE(sbusInit(&rxConfig, &testRxRuntimeConfig, &readRawRC));
+
+    uint8_t frame[SBUS_FRAME_SIZE];
+    buildSbusFrame(frame);
+    frame[0] = 0x00;
+
+    // when
+    receiveFrame(frame, sizeof(frame));
+
+    // then
+    EXPECT_FALSE(frameReceived);
+    EXPECT_EQ(SERIAL_RX_FRAME_PENDING, sbusFrameStatus());
+}
+
+TEST_F(RxSerialFrameTest, TestSumdFrameAccepted)
+{
+    // given
+    EXPECT_TRUE(sumdInit(&rxConfig, &testRxRuntimeConfig, &readRawRC));
+    ASSERT_TRUE(frameCallback != NULL);
+
+    uint8_t frame[SUMD_FRAME_SIZE];
+    buildSumdFrame(frame);
+
+    // when
+    receiveFrame(frame, sizeof(frame));
+
+    // then
+    EXPECT_TRUE(frameReceived);
+    EXPECT_EQ(TEST_FRAME_END_AT, frameReceivedEndAt);
+
+    // and
+    EXPECT_EQ(SERIAL_RX_FRAME_COMPLETE, sumdFrameStatus());
+    EXPECT_EQ(1500, readRawRC(&testRxRuntimeConfig, 0));
+    EXPECT_EQ(1500, readRawRC(&testRxRuntimeConfig, SUMD_CHANNEL_COUNT - 1));
+}
+
+TEST_F(RxSerialFrameTest, TestSumdFrameNotMatchingChannelCountRejected)
+{
+    // given
+    EXPECT_TRUE(sumdInit(&rxConfig, &testRxRuntimeConfig, &readRawRC));
+
+    uint8_t frames[SUMD_FRAME_SIZE * 2];
+    buildSumdFrame(frames);
+    buildSumdFrame(frames + SUMD_FRAME_SIZE);
+
+    // when
+    receiveFrame(frames, SUMD_FRAME_SIZE - 2);
+    receiveFrame(frames, SUMD_FRAME_SIZE + 2);
+    receiveFrame(frames, sizeof(frames));
+    receiveFrame(frames, 4);
+
+    // then
+    EXPECT_FALSE(frameReceived);
+    EXPECT_EQ(SERIAL_RX_FRAME_PENDING, sumdFrameStatus());
+}
+
+TEST_F(RxSerialFrameTest, TestSumdFrameWithBadCrcNotComplete)
+{
+    // given
+    EXPECT_TRUE(sumdInit(&rxConfig, &testRxRuntimeConfig, &readRawRC));
+
+    uint8_t frame[SUMD_FRAME_SIZE];
+    buildSumdFrame(frame);
+    frame[3] ^= 0x01;
+
+    // when
+    receiveFrame(frame, sizeof(frame));
+
+    // then
+    EXPECT_EQ(SERIAL_RX_FRAME_PENDING, sumdFrameStatus());
+}
+
+TEST_F(RxSerialFrameTest, TestIbusFrameAccepted)
+{
+    // given
+    EXPECT_TRUE(ibusInit(&rxConfig, &testRxRuntimeConfig, &readRawRC));
+    ASSERT_TRUE(frameCallback != NULL);
+
+    uint8_t frame[IBUS_FRAME_SIZE];
+    buildIbusFrame(frame);
+
+    // when
+    receiveFrame(frame, sizeof(frame));
+
+    // then
+    EXPECT_TRUE(frameReceived);
+    EXPECT_EQ(TEST_FRAME_END_AT, frameReceivedEndAt);
+
+    // and
+    EXPECT_EQ(SERIAL_RX_FRAME_COMPLETE, ibusFrameStatus());
+    EXPECT_EQ(1500, readRawRC(&testRxRuntimeConfig, 0));
+    EXPECT_EQ(1500, readRawRC(&testRxRuntimeConfig, 9));
+}
+
+TEST_F(RxSerialFrameTest, TestIbusFrameWithWrongLengthRejected)
+{
+    // given
+    EXPECT_TRUE(ibusInit(&rxConfig, &testRxRuntimeConfig, &readRawRC));
+
+    uint8_t frames[IBUS_FRAME_SIZE * 2];
+    buildIbusFrame(frames);
+    buildIbusFrame(frames + IBUS_FRAME_SIZE);
+
+    // when
+    receiveFrame(frames, IBUS_FRAME_SIZE - 1);
+    receiveFrame(frames, IBUS_FRAME_SIZE + 1);
+    receiveFrame(frames, sizeof(frames));
+
+    // then
+    EXPECT_FALSE(frameReceived);
+    EXPECT_EQ(SERIAL_RX_FRAME_PENDING, ibusFrameStatus());
+}
+
+// STUBS
+
+extern "C" {
+
+static serialPortConfig_t testPortConfig;
+static serialPort_t testPort;
+
+uint32_t micros(void) { return TEST_MICROS_NOW; }
+
+serialPortConfig_t *findSerialPortConfig(serialPortFunction_e function)
+{
+    UNUSED(function);
+    return &testPortConfig;
+}
+
+serialPort_t *openSerialPort(serialPortIdentifier_e identifier, serialPortFunction_e function,
+    serialReceiveCallbackPtr callback, uint32_t baudrate, portMode_t mode, portOptions_t options)
+{
+    UNUSED(identifier);
+    UNUSED(function);
+    UNUSED(callback);
+    UNUSED(baudrate);
+    UNUSED(mode);
+    UNUSED(options);
+    return &testPort;
+}
+
+bool serialSetFrameCallback(serialPort_t *instance, serialFrameCallbackPtr callback)
+{
+    UNUSED(instance);
+    frameCallback = callback;
+    return true;
+}
+
+void serialRxFrameReceived(uint32_t frameEndAt)
+{
+    frameReceived = true;
+    frameReceivedEndAt = frameEndAt;
+}
+
+}
@@ -0,0 +1,407 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+extern "C" {
+    #include "platform.h"
+    #include "build_config.h"
+    #include "version.h"
+
+    #include "scheduler/scheduler.h"
+
+    #include "common/axis.h"
+    #include "common/color.h"
+    #include "common/maths.h"
+    #include "common/streambuf.h"
+
+    #include "drivers/system.h"
+    #include "drivers/sensor.h"
+    #include "drivers/accgyro.h"
+    #include "drivers/compass.h"
+    #include "drivers/serial.h"
+    #include "drivers/gpio.h"
+    #include "drivers/timer.h"
+    #include "drivers/pwm_rx.h"
+    #include "drivers/buf_writer.h"
+
+    #include "rx/rx.h"
+
+    #include "io/escservo.h"
+    #include "io/gps.h"
+    #include "io/gimbal.h"
+    #include "io/rc_controls.h"
+    #include "io/serial.h"
+    #include "io/ledstrip.h"
+    #include "io/serial_cli.h"
+
+    #include "sensors/sensors.h"
+    #include "sensors/boardalignment.h"
+    #include "sensors/battery.h"
+    #include "sensors/acceleration.h"
+    #include "sensors/barometer.h"
+    #include "sensors/compass.h"
+    #include "sensors/gyro.h"
+
+    #include "flight/mixer.h"
+    #include "flight/pid.h"
+    #include "flight/imu.h"
+    #include "flight/failsafe.h"
+    #include "flight/navigation_rewrite.h"
+
+    #include "telemetry/telemetry.h"
+
+    #include "config/runtime_config.h"
+    #include "config/config.h"
+    #include "config/config_profile.h"
+    #include "config/config_master.h"
+
+    // clivalue_t is private to serial_cli.c, tests only need the name which is its first member
+    typedef struct cliValueName_s {
+        const char *name;
+    } cliValueName_t;
+
+    extern uint8_t valueIndex[];
+    void cliBuildVarIndex(void);
+    const cliValueName_t *cliFindVar(const char *name, unsigned nameLength);
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+#define TEST_EXPORT_BUFFER_SIZE 16384
+#define TEST_MAX_NAME_LENGTH 64
+
+static uint8_t exportBuf[TEST_EXPORT_BUFFER_SIZE];
+static const char *varNames[256];
+
+// Settings export is in valueTable order, it gives the name of every variable by its table index
+static int exportSettings(uint8_t *buf, int bufSize)
+{
+    sbuf_t dst;
+    sbufInit(&dst, buf, buf + bufSize);
+    EXPECT_EQ(cliSettingsCount(), cliSettingsExport(&dst, 0));
+    return dst.ptr - buf;
+}
+
+static void collectVarNames(void)
+{
+    const int exportSize = exportSettings(exportBuf, sizeof(exportBuf));
+    sbuf_t src;
+    sbufInit(&src, exportBuf, exportBuf + exportSize);
+
+    for (int i = 0; i < cliSettingsCount(); i++) {
+        varNames[i] = (const char *)sbufPtr(&src);
+        sbufAdvance(&src, strlen(varNames[i]) + 1);
+        switch (sbufReadU8(&src)) {
+        case 0:
+        case 1:
+            sbufAdvance(&src, 1);
+            break;
+        case 2:
+        case 3:
+            sbufAdvance(&src, 2);
+            break;
+        default:
+            sbufAdvance(&src, 4);
+            break;
+        }
+    }
+    EXPECT_EQ(0, sbufBytesRemaining(&src));
+}
+
+class SerialCliTest : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        memset(&masterConfig, 0, sizeof(masterConfig));
+        collectVarNames();
+        cliBuildVarIndex();
+    }
+};
+
+TEST_F(SerialCliTest, TestVarIndexIsSortedByName)
+{
+    bool seen[256] = { false };
+
+    for (int i = 0; i < cliSettingsCount(); i++) {
+        EXPECT_LT(valueIndex[i], cliSettingsCount());
+        EXPECT_FALSE(seen[valueIndex[i]]);
+        seen[valueIndex[i]] = true;
+
+        if (i > 0) {
+            EXPECT_LT(strcasecmp(varNames[valueIndex[i - 1]], varNames[valueIndex[i]]), 0)
+                << varNames[valueIndex[i - 1]] << " before " << varNames[valueIndex[i]];
+        }
+    }
+}
+
+TEST_F(SerialCliTest, TestEveryVarIsFoundByName)
+{
+    for (int i = 0; i < cliSettingsCount(); i++) {
+        const cliValueName_t *var = cliFindVar(varNames[i], strlen(varNames[i]));
+        ASSERT_TRUE(var != NULL) << varNames[i];
+        EXPECT_STREQ(varNames[i], var->name);
+    }
+}
+
+TEST_F(SerialCliTest, TestLookupIsCaseInsensitive)
+{
+    char name[TEST_MAX_NAME_LENGTH];
+
+    for (int i = 0; i < cliSettingsCount(); i++) {
+        const int nameLength = strlen(varNames[i]);
+        ASSERT_LT(nameLength, TEST_MAX_NAME_LENGTH);
+        for (int j = 0; j <= nameLength; j++) {
+            name[j] = toupper(varNames[i][j]);
+        }
+
+        const cliValueName_t *var = cliFindVar(name, nameLength);
+        ASSERT_TRUE(var != NULL) << name;
+        EXPECT_STREQ(varNames[i], var->name);
+    }
+}
+
+TEST_F(SerialCliTest, TestLookupUsesOnlyGivenLength)
+{
+    // name in the CLI buffer is followed by the rest of the command line
+    const char *cmdline = "looptime = 2000";
+
+    const cliValueName_t *var = cliFindVar(cmdline, strlen("looptime"));
+
+    ASSERT_TRUE(var != NULL);
+    EXPECT_STREQ("looptime", var->name);
+}
+
+TEST_F(SerialCliTest, TestPrefixOrExtensionOfNameIsNotFound)
+{
+    char name[TEST_MAX_NAME_LENGTH + 1];
+
+    for (int i = 0; i < cliSettingsCount(); i++) {
+        const int nameLength = strlen(varNames[i]);
+
+        // a prefix only matches a variable with exactly that name
+        const cliValueName_t *var = cliFindVar(varNames[i], nameLength - 1);
+        if (var) {
+            EXPECT_EQ(nameLength - 1, (int)strlen(var->name)) << varNames[i];
+            EXPECT_EQ(0, strncasecmp(varNames[i], var->name, nameLength - 1));
+        }
+
+        // same for the name followed by something
+        strcpy(name, varNames[i]);
+        strcat(name, "x");
+        var = cliFindVar(name, nameLength + 1);
+        if (var) {
+            EXPECT_STREQ(name, var->name);
+        }
+    }
+
+    EXPECT_EQ(NULL, cliFindVar("looptim", strlen("looptim")));
+    EXPECT_EQ(NULL, cliFindVar("looptimex", strlen("looptimex")));
+    EXPECT_EQ(NULL, cliFindVar("", 0));
+}
+
+TEST_F(SerialCliTest, TestExportInChunksMatchesSingleExport)
+{
+    // given
+    static uint8_t chunkedBuf[TEST_EXPORT_BUFFER_SIZE];
+    const int exportSize = exportSettings(exportBuf, sizeof(exportBuf));
+
+    // when
+    // settings don't fit into one MSP reply, they are transferred in several starting at the index returned by the previous one
+    int chunkedSize = 0;
+    uint16_t index = 0;
+    while (index < cliSettingsCount()) {
+        sbuf_t dst;
+        sbufInit(&dst, &chunkedBuf[chunkedSize], &chunkedBuf[chunkedSize] + 64);
+        const uint16_t nextIndex = cliSettingsExport(&dst, index);
+        ASSERT_GT(nextIndex, index);
+        chunkedSize += dst.ptr - &chunkedBuf[chunkedSize];
+        index = nextIndex;
+    }
+
+    // then
+    EXPECT_EQ(exportSize, chunkedSize);
+    EXPECT_EQ(0, memcmp(exportBuf, chunkedBuf, exportSize));
+}
+
+TEST_F(SerialCliTest, TestExportImportRoundTrip)
+{
+    // given
+    masterConfig.looptime = 1234;
+    masterConfig.gyro_lpf = 1;
+    masterConfig.telemetryConfig.gpsNoFixLatitude = 47.5f;
+    masterConfig.profile[0].pidProfile.P8[PITCH] = 77;
+    masterConfig.controlRateProfiles[0].rcExpo8 = 42;
+
+    static master_t savedConfig;
+    memcpy(&savedConfig, &masterConfig, sizeof(masterConfig));
+    const int exportSize = exportSettings(exportBuf, sizeof(exportBuf));
+
+    // and
+    masterConfig.looptime = 0;
+    masterConfig.gyro_lpf = 0;
+    masterConfig.telemetryConfig.gpsNoFixLatitude = 0;
+    masterConfig.profile[0].pidProfile.P8[PITCH] = 0;
+    masterConfig.controlRateProfiles[0].rcExpo8 = 0;
+
+    // when
+    sbuf_t src;
+    sbufInit(&src, exportBuf, exportBuf + exportSize);
+    const int appliedCount = cliSettingsImport(&src);
+
+    // then
+    // zero is out of range for some settings, those are skipped
+    EXPECT_GE(appliedCount, 5);
+    EXPECT_LE(appliedCount, cliSettingsCount());
+    EXPECT_EQ(0, memcmp(&savedConfig, &masterConfig, sizeof(masterConfig)));
+}
+
+TEST_F(SerialCliTest, TestImportSkipsUnknownAndInvalidSettings)
+{
+    // given
+    masterConfig.looptime = 1000;
+    const uint8_t data[] = {
+        'n', 'o', '_', 's', 'u', 'c', 'h', '_', 'v', 'a', 'r', 0, 2, 0x34, 0x12,
+        'l', 'o', 'o', 'p', 't', 'i', 'm', 'e', 0, 0, 0x12,                         // wrong type
+        'l', 'o', 'o', 'p', 't', 'i', 'm', 'e', 0, 2, 0x10, 0x27,                   // 10000, out of range
+        'L', 'O', 'O', 'P', 'T', 'I', 'M', 'E', 0, 2, 0xD0, 0x07,                   // 2000
+    };
+
+    // when
+    sbuf_t src;
+    sbufInit(&src, (uint8_t *)data, (uint8_t *)data + sizeof(data));
+    const int appliedCount = cliSettingsImport(&src);
+
+    // then
+    EXPECT_EQ(1, appliedCount);
+    EXPECT_EQ(2000, masterConfig.looptime);
+}
+
+TEST_F(SerialCliTest, TestTruncatedImportIsRejected)
+{
+    // given
+    const uint8_t data[] = { 'l', 'o', 'o', 'p', 't', 'i', 'm', 'e', 0, 2, 0xD0 };
+
+    // when
+    sbuf_t src;
+    sbufInit(&src, (uint8_t *)data, (uint8_t *)data + sizeof(data));
+
+    // then
+    EXPECT_EQ(-1, cliSettingsImport(&src));
+}
+
+// STUBS
+
+extern "C" {
+uint32_t SystemCoreClock;
+// from barometer.c
+barometerConfig_t barometerConfig_System;
+// from battery.c
+uint16_t vbat;
+uint8_t batteryCellCount;
+const char *getBatteryStateString(void) { return "OK"; }
+// from buf_writer.c
+bufWriter_t *bufWriterInit(uint8_t *b, int total_size, bufWrite_t writer, void *p)
+{
+    UNUSED(total_size);
+    UNUSED(writer);
+    UNUSED(p);
+    return (bufWriter_t *)b;
+}
+void bufWriterAppend(bufWriter_t *b, uint8_t ch) { UNUSED(b); UNUSED(ch); }
+void bufWriterFlush(bufWriter_t *b) { UNUSED(b); }
+// from compass.c
+bool isCompassFailed(void) { return false; }
+// from config.c
+master_t masterConfig;
+profile_t *currentProfile;
+void changeControlRateProfile(uint8_t profileIndex) { UNUSED(profileIndex); }
+uint8_t getCurrentProfile(void) { return 0; }
+uint8_t getCurrentControlRateProfile(void) { return 0; }
+void handleOneshotFeatureChangeOnRestart(void) {}
+void readEEPROM(void) {}
+void resetEEPROM(void) {}
+void writeEEPROM(void) {}
+void featureSet(uint32_t mask) { UNUSED(mask); }
+void featureClear(uint32_t mask) { UNUSED(mask); }
+uint32_t featureMask(void) { return 0; }
+void persistentFlagSet(uint8_t mask) { UNUSED(mask); }
+// from gps.c
+void gpsEnablePassthrough(serialPort_t *gpsPassthroughPort) { UNUSED(gpsPassthroughPort); }
+// from ledstrip.c
+void generateLedConfig(uint8_t ledIndex, char *ledConfigBuffer, size_t bufferSize)
+{
+    UNUSED(ledIndex);
+    UNUSED(ledConfigBuffer);
+    UNUSED(bufferSize);
+}
+bool parseLedStripConfig(uint8_t ledIndex, const char *config) { UNUSED(ledIndex); UNUSED(config); return false; }
+bool parseColor(uint8_t index, const char *colorConfig) { UNUSED(index); UNUSED(colorConfig); return false; }
+// from mixer.c
+int16_t motor_disarmed[MAX_SUPPORTED_MOTORS];
+void mixerLoadMix(int index, motorMixer_t *customMixers) { UNUSED(index); UNUSED(customMixers); }
+void mixerResetDisarmedMotors(void) {}
+void servoMixerLoadMix(int index, servoMixer_t *customServoMixers) { UNUSED(index); UNUSED(customServoMixers); }
+void servoMixerUpdatePlan(void) {}
+int servoDirection(int servoIndex, int fromChannel) { UNUSED(servoIndex); UNUSED(fromChannel); return 1; }
+void stopMotors(void) {}
+// from mw.c
+uint16_t cycleTime;
+// from printf.c
+void setPrintfSerialPort(serialPort_t *serialPort) { UNUSED(serialPort); }
+int tfp_format(void *putp, void (*putf) (void *, char), const char *fmt, va_list va)
+{
+    UNUSED(putp);
+    UNUSED(putf);
+    UNUSED(fmt);
+    UNUSED(va);
+    return 0;
+}
+// from runtime_config.c
+uint8_t armingFlags;
+// from rx.c
+const char rcChannelLetters[] = "AERT12345678abcdefgh";
+void parseRcChannels(const char *input, rxConfig_t *rxConfig) { UNUSED(input); UNUSED(rxConfig); }
+void resetAllRxChannelRangeConfigurations(rxChannelRangeConfiguration_t *rxChannelRangeConfiguration) { UNUSED(rxChannelRangeConfiguration); }
+// from scheduler.c
+uint16_t averageSystemLoadPercent;
+void getTaskInfo(cfTaskId_e taskId, cfTaskInfo_t *taskInfo) { UNUSED(taskId); UNUSED(taskInfo); }
+// from serial.c
+const uint32_t baudRates[] = { 0, 9600, 19200, 38400, 57600, 115200, 230400, 250000 };
+baudRate_e lookupBaudRateIndex(uint32_t baudRate) { UNUSED(baudRate); return BAUD_AUTO; }
+bool serialIsPortAvailable(serialPortIdentifier_e identifier) { UNUSED(identifier); return false; }
+serialPortConfig_t *serialFindPortConfiguration(serialPortIdentifier_e identifier) { UNUSED(identifier); return NULL; }
+void waitForSerialPortToFinishTransmitting(serialPort_t *serialPort) { UNUSED(serialPort); }
+uint8_t serialRead(serialPort_t *instance) { UNUSED(instance); return 0; }
+uint32_t serialRxBytesWaiting(serialPort_t *instance) { UNUSED(instance); return 0; }
+void serialWriteBufShim(void *instance, uint8_t *data, int count) { UNUSED(instance); UNUSED(data); UNUSED(count); }
+// from system.c
+uint32_t millis(void) { return 0; }
+void systemReset(void) {}
+// from typeconversion.c
+char *itoa(int i, char *a, int r) { UNUSED(i); UNUSED(r); return a; }
+char *ftoa(float x, char *floatString) { UNUSED(x); return floatString; }
+float fastA2F(const char *p) { UNUSED(p); return 0; }
+// from version.c
+const char * const targetName = "TEST";
+const char * const buildDate = "Jan  1 2016";
+const char * const buildTime = "00:00:00";
+const char * const shortGitRevision = "MASTER";
+}
@@ -16,564 +16,698 @@
  */
 
 #include <stdint.h>
+#include <stdbool.h>
 #include <string.h>
-#include <math.h>
 
 extern "C" {
-    #include <platform.h>
-    #include "build_config.h"
-    #include "version.h"
-    #include "debug.h"
-    #include "common/axis.h"
-    #include "common/color.h"
-    #include "common/maths.h"
-
-    #include "drivers/system.h"
-    #include "drivers/sensor.h"
-    #include "drivers/accgyro.h"
-    #include "drivers/compass.h"
+    #include "platform.h"
+
+    #include "common/crc.h"
+    #include "common/streambuf.h"
+    #include "common/utils.h"
+
     #include "drivers/serial.h"
-    #include "drivers/bus_i2c.h"
-    #include "drivers/gpio.h"
-    #include "drivers/timer.h"
-    #include "drivers/pwm_rx.h"
-    #include "drivers/buf_writer.h"
-
-    #include "rx/rx.h"
-
-    #include "io/rc_controls.h"
-    #include "io/gps.h"
-    #include "io/gimbal.h"
-    #include "io/ledstrip.h"
+
+    #include "io/serial.h"
+    #include "io/msp_commands.h"
+    #include "io/msp_protocol.h"
     #include "io/serial_msp.h"
-    #include "io/escservo.h"
-
-    #include "telemetry/telemetry.h"
-
-    #include "sensors/sensors.h"
-    #include "sensors/boardalignment.h"
-    #include "sensors/sensors.h"
-    #include "sensors/battery.h"
-    #include "sensors/sonar.h"
-    #include "sensors/acceleration.h"
-    #include "sensors/barometer.h"
-    #include "sensors/compass.h"
-    #include "sensors/gyro.h"
-
-    #include "flight/mixer.h"
-    #include "flight/pid.h"
-    #include "flight/navigation.h"
-    #include "flight/imu.h"
-    #include "flight/failsafe.h"
 
     #include "config/runtime_config.h"
-    #include "config/config.h"
-    #include "config/config_profile.h"
-    #include "config/config_master.h"
 }
 
 #include "unittest_macros.h"
 #include "gtest/gtest.h"
 
+/*
+ * Fake serial port, received bytes are kept in a small ring so requests can wrap around its end
+ * and have to be read in two spans, transmitted bytes are appended to a flat buffer.
+ */
+#define TEST_RX_BUFFER_SIZE 64
+#define TEST_TX_BUFFER_SIZE 1024
 
-extern "C" {
-    void setCurrentPort(mspPort_t *port);
-    void mspProcessReceivedCommand();
-    extern mspPort_t *currentPort;
-    extern bufWriter_t *writer;
-    extern mspPort_t mspPorts[];
-    profile_t *currentProfile;
-}
-
-profile_t profile;
-
-typedef struct mspHeader_s {
-    uint8_t dollar;
-    uint8_t m;
-    uint8_t direction;
-    uint8_t size;
-    uint8_t type;
-} mspHeader_t;
-
-typedef struct mspResonse_s {
-    mspHeader_t header;
-    uint8_t payload[];
-} mspResponse_t;
-
-#define SERIAL_BUFFER_SIZE 256
-typedef union mspBuffer_u {
-    mspResponse_t mspResponse;
-    uint8_t buf[SERIAL_BUFFER_SIZE];
-} mspBuffer_t;
-
-static mspBuffer_t serialBuffer;
-
-static int serialWritePos = 0;
-static int serialReadPos = 0;
+static uint8_t rxRing[TEST_RX_BUFFER_SIZE];
+static uint32_t rxHead;
+static uint32_t rxTail;
+static uint8_t txData[TEST_TX_BUFFER_SIZE];
+static uint32_t txCount;
+static uint32_t testTxBytesFree;
 
-uint8_t buf[sizeof(bufWriter_t) + SERIAL_BUFFER_SIZE];
+static uint32_t testPortTotalRxWaiting(serialPort_t *instance)
+{
+    UNUSED(instance);
+    return (rxHead - rxTail + TEST_RX_BUFFER_SIZE) % TEST_RX_BUFFER_SIZE;
+}
 
-void serialWrite(serialPort_t *instance, uint8_t ch)
+static uint32_t testPortTotalTxFree(serialPort_t *instance)
 {
     UNUSED(instance);
-    serialBuffer.buf[serialWritePos] = ch;
-    ++serialWritePos;
+    return testTxBytesFree;
 }
 
-void serialWriteBufShim(void *instance, uint8_t *data, int count)
+static uint8_t testPortRead(serialPort_t *instance)
 {
-    for (uint8_t *p = data; count > 0; count--, p++) {
-        serialWrite((serialPort_t *)instance, *p);
-    }
+    UNUSED(instance);
+    const uint8_t ch = rxRing[rxTail];
+    rxTail = (rxTail + 1) % TEST_RX_BUFFER_SIZE;
+    return ch;
 }
 
-void serialBeginWrite(serialPort_t *instance)
+static uint32_t testPortGetRxSpan(serialPort_t *instance, const uint8_t **data)
 {
     UNUSED(instance);
+    *data = &rxRing[rxTail];
+    return (rxHead >= rxTail) ? rxHead - rxTail : TEST_RX_BUFFER_SIZE - rxTail;
 }
 
-void serialEndWrite(serialPort_t *instance)
+static void testPortConsumeRx(serialPort_t *instance, uint32_t count)
 {
     UNUSED(instance);
+    rxTail = (rxTail + count) % TEST_RX_BUFFER_SIZE;
 }
 
-uint8_t serialRxBytesWaiting(serialPort_t *instance)
+static void testPortWrite(serialPort_t *instance, uint8_t ch)
 {
     UNUSED(instance);
-    if (serialWritePos > serialReadPos) {
-        return serialWritePos - serialReadPos;
-    } else {
-        return 0;
+    if (txCount < TEST_TX_BUFFER_SIZE) {
+        txData[txCount++] = ch;
     }
 }
 
-uint8_t serialRead(serialPort_t *instance)
+static void testPortWriteBuf(serialPort_t *instance, void *data, int count)
 {
-    UNUSED(instance);
-    const uint8_t ch = serialBuffer.buf[serialReadPos];
-    ++serialReadPos;
-    if (currentPort->indRX == MSP_PORT_INBUF_SIZE) {
-        currentPort->indRX = 0;
+    const uint8_t *p = (const uint8_t *)data;
+    while (count-- > 0) {
+        testPortWrite(instance, *p++);
     }
-    currentPort->inBuf[currentPort->indRX] = ch;
-    ++currentPort->indRX;
-    return ch;
 }
 
-bool isSerialTransmitBufferEmpty(serialPort_t *instance)
+static const struct serialPortVTable testPortVTable = {
+    testPortWrite,
+    testPortTotalRxWaiting,
+    testPortTotalTxFree,
+    testPortRead,
+    testPortGetRxSpan,
+    testPortConsumeRx,
+    NULL,
+    NULL,
+    NULL,
+    testPortWriteBuf,
+    NULL,
+    NULL,
+    NULL,
+};
+
+static serialPort_t testPort;
+
+static void testPortReceive(const uint8_t *data, int count)
 {
-    UNUSED(instance);
-    return true;
+    while (count-- > 0) {
+        rxRing[rxHead] = *data++;
+        rxHead = (rxHead + 1) % TEST_RX_BUFFER_SIZE;
+    }
+}
+
+// v1 request, payload may be empty
+static int buildMspV1Request(uint8_t *frame, uint8_t cmd, const uint8_t *payload, uint8_t size)
+{
+    int len = 0;
+    uint8_t checksum = size ^ cmd;
+
+    frame[len++] = '$';
+    frame[len++] = 'M';
+    frame[len++] = '<';
+    frame[len++] = size;
+    frame[len++] = cmd;
+    for (int i = 0; i < size; i++) {
+        frame[len++] = payload[i];
+        checksum ^= payload[i];
+    }
+    frame[len++] = checksum;
+    return len;
+}
+
+// v2 request, flag is always 0
+static int buildMspV2Request(uint8_t *frame, uint16_t cmd, const uint8_t *payload, uint16_t size)
+{
+    int len = 0;
+
+    frame[len++] = '$';
+    frame[len++] = 'X';
+    frame[len++] = '<';
+    frame[len++] = 0;
+    frame[len++] = cmd & 0xFF;
+    frame[len++] = cmd >> 8;
+    frame[len++] = size & 0xFF;
+    frame[len++] = size >> 8;
+    for (int i = 0; i < size; i++) {
+        frame[len++] = payload[i];
+    }
+    frame[len] = crc8_dvb_s2_update(0, &frame[3], len - 3);
+    len++;
+    return len;
 }
 
-class SerialMspUnitTest : public ::testing::Test {
+/*
+ * Commands seen by the MSP core, the stub echoes the request payload back
+ */
+#define TEST_MSP_ERROR_CMD  MSP_SET_PID
+
+static int mspProcessCommandCallCount;
+static uint16_t lastCommand;
+static uint8_t lastCommandPayload[MSP_PORT_INBUF_SIZE];
+static int lastCommandSize;
+static int evaluateOtherDataCallCount;
+static uint32_t testMillis;
+
+class SerialMspTest : public ::testing::Test {
 protected:
     virtual void SetUp() {
-        memset(serialBuffer.buf, 0, sizeof(serialBuffer));
-        setCurrentPort(&mspPorts[0]);
-        writer = bufWriterInit(buf, sizeof(buf), (bufWrite_t)serialWriteBufShim, &mspPorts[0]);
+        memset(rxRing, 0, sizeof(rxRing));
+        rxHead = 0;
+        rxTail = 0;
+        memset(txData, 0, sizeof(txData));
+        txCount = 0;
+        testTxBytesFree = 256;
+
+        memset(&testPort, 0, sizeof(testPort));
+        testPort.vTable = &testPortVTable;
+
+        mspProcessCommandCallCount = 0;
+        lastCommand = 0;
+        lastCommandSize = 0;
+        evaluateOtherDataCallCount = 0;
+        armingFlags = 0;
+        testMillis = 1000;
+
+        mspInit();
     }
 };
 
+TEST_F(SerialMspTest, TestV1RequestIsAnswered)
+{
+    // given
+    const uint8_t payload[] = { 0x11, 0x22, 0x33 };
+    uint8_t frame[16];
+    const int frameLen = buildMspV1Request(frame, MSP_IDENT, payload, sizeof(payload));
+    testPortReceive(frame, frameLen);
+
+    // when
+    mspProcess();
+
+    // then
+    EXPECT_EQ(1, mspProcessCommandCallCount);
+    EXPECT_EQ(MSP_IDENT, lastCommand);
+    EXPECT_EQ(3, lastCommandSize);
+    EXPECT_EQ(0, memcmp(payload, lastCommandPayload, sizeof(payload)));
+
+    // and
+    const uint8_t expected[] = { '$', 'M', '>', 3, MSP_IDENT, 0x11, 0x22, 0x33, 3 ^ MSP_IDENT ^ 0x11 ^ 0x22 ^ 0x33 };
+    EXPECT_EQ(sizeof(expected), txCount);
+    EXPECT_EQ(0, memcmp(expected, txData, sizeof(expected)));
+
+    // and
+    EXPECT_EQ(0, testPortTotalRxWaiting(&testPort));
+}
+
+TEST_F(SerialMspTest, TestErrorReplyHasNoPayload)
+{
+    // given
+    const uint8_t payload[] = { 0x11, 0x22 };
+    uint8_t frame[16];
+    const int frameLen = buildMspV1Request(frame, TEST_MSP_ERROR_CMD, payload, sizeof(payload));
+    testPortReceive(frame, frameLen);
+
+    // when
+    mspProcess();
+
+    // then
+    const uint8_t expected[] = { '$', 'M', '!', 0, TEST_MSP_ERROR_CMD, TEST_MSP_ERROR_CMD };
+    EXPECT_EQ(sizeof(expected), txCount);
+    EXPECT_EQ(0, memcmp(expected, txData, sizeof(expected)));
+}
+
+TEST_F(SerialMspTest, TestRequestWrappingAroundReceiveBufferIsAnswered)
+{
+    // given
+    // request starts a few bytes before the end of the receive ring, so the parser gets it in two spans
+    rxHead = rxTail = TEST_RX_BUFFER_SIZE - 4;
+
+    const uint8_t payload[] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+    uint8_t frame[24];
+    const int frameLen = buildMspV1Request(frame, MSP_STATUS, payload, sizeof(payload));
+    testPortReceive(frame, frameLen);
+
+    const uint8_t *span;
+    EXPECT_LT(testPortGetRxSpan(&testPort, &span), (uint32_t)frameLen);
+
+    // when
+    mspProcess();
+
+    // then
+    EXPECT_EQ(1, mspProcessCommandCallCount);
+    EXPECT_EQ(MSP_STATUS, lastCommand);
+    EXPECT_EQ((int)sizeof(payload), lastCommandSize);
+    EXPECT_EQ(0, memcmp(payload, lastCommandPayload, sizeof(payload)));
+    EXPECT_EQ(0, testPortTotalRxWaiting(&testPort));
+}
+
+TEST_F(SerialMspTest, TestSeveralRequestsAreAnsweredInOnePass)
+{
+    // given
+    uint8_t frame[16];
+    int frameLen = buildMspV1Request(frame, MSP_STATUS, NULL, 0);
+    testPortReceive(frame, frameLen);
+    frameLen = buildMspV1Request(frame, MSP_ATTITUDE, NULL, 0);
+    testPortReceive(frame, frameLen);
+
+    // when
+    mspProcess();
+
+    // then
+    EXPECT_EQ(2, mspProcessCommandCallCount);
+    EXPECT_EQ(MSP_ATTITUDE, lastCommand);
+    EXPECT_EQ(12, txCount);
+}
+
+TEST_F(SerialMspTest, TestNextRequestWaitsForTransmitBuffer)
+{
+    // given
+    testTxBytesFree = MSP_PORT_MIN_TX_FREE - 1;
+
+    uint8_t frame[16];
+    int frameLen = buildMspV1Request(frame, MSP_STATUS, NULL, 0);
+    testPortReceive(frame, frameLen);
+    frameLen = buildMspV1Request(frame, MSP_ATTITUDE, NULL, 0);
+    testPortReceive(frame, frameLen);
+
+    // when
+    mspProcess();
+
+    // then
+    EXPECT_EQ(1, mspProcessCommandCallCount);
+    EXPECT_EQ(MSP_STATUS, lastCommand);
+
+    // when
+    testTxBytesFree = 256;
+    mspProcess();
+
+    // then
+    EXPECT_EQ(2, mspProcessCommandCallCount);
+    EXPECT_EQ(MSP_ATTITUDE, lastCommand);
+}
+
+TEST_F(SerialMspTest, TestBadChecksumIsIgnored)
+{
+    // given
+    uint8_t frame[16];
+    const int frameLen = buildMspV1Request(frame, MSP_STATUS, NULL, 0);
+    frame[frameLen - 1] ^= 0xFF;
+    testPortReceive(frame, frameLen);
+
+    // when
+    mspProcess();
+
+    // then
+    EXPECT_EQ(0, mspProcessCommandCallCount);
+    EXPECT_EQ(0, txCount);
+}
+
+TEST_F(SerialMspTest, TestV2RequestIsAnswered)
+{
+    // given
+    // command number doesn't fit into v1
+    const uint16_t cmd = 0x1F01;
+    const uint8_t payload[] = { 0x11, 0x22, 0x33 };
+    uint8_t frame[16];
+    const int frameLen = buildMspV2Request(frame, cmd, payload, sizeof(payload));
+    testPortReceive(frame, frameLen);
+
+    // when
+    mspProcess();
+
+    // then
+    EXPECT_EQ(1, mspProcessCommandCallCount);
+    EXPECT_EQ(cmd, lastCommand);
+    EXPECT_EQ(3, lastCommandSize);
+    EXPECT_EQ(0, memcmp(payload, lastCommandPayload, sizeof(payload)));
+
+    // and
+    // reply is framed the same way as request, only with direction flipped
+    frame[2] = '>';
+    EXPECT_EQ((uint32_t)frameLen, txCount);
+    EXPECT_EQ(0, memcmp(frame, txData, frameLen));
+}
+
+TEST_F(SerialMspTest, TestV2RequestWithBadCrcIsIgnored)
+{
+    // given
+    const uint8_t payload[] = { 0x11, 0x22, 0x33 };
+    uint8_t frame[16];
+    const int frameLen = buildMspV2Request(frame, MSP_STATUS, payload, sizeof(payload));
+    frame[frameLen - 1] ^= 0x01;
+    testPortReceive(frame, frameLen);
+
+    // when
+    mspProcess();
+
+    // then
+    EXPECT_EQ(0, mspProcessCommandCallCount);
+    EXPECT_EQ(0, txCount);
+
+    // and
+    // parser is back in sync for next request
+    const int nextFrameLen = buildMspV2Request(frame, MSP_STATUS, payload, sizeof(payload));
+    testPortReceive(frame, nextFrameLen);
+    mspProcess();
+    EXPECT_EQ(1, mspProcessCommandCallCount);
+}
+
+TEST_F(SerialMspTest, TestV2RequestLargerThanReceiveBufferIsDropped)
+{
+    // given
+    // header announces a payload which doesn't fit into inBuf, only part of it is sent
+    uint8_t frame[16];
+    buildMspV2Request(frame, MSP_STATUS, NULL, 0);
+    frame[6] = (MSP_PORT_INBUF_SIZE + 1) & 0xFF;
+    frame[7] = (MSP_PORT_INBUF_SIZE + 1) >> 8;
+    testPortReceive(frame, 8);
+
+    const uint8_t partialPayload[20] = { 0 };
+    testPortReceive(partialPayload, sizeof(partialPayload));
+
+    // and
+    const int nextFrameLen = buildMspV1Request(frame, MSP_ATTITUDE, NULL, 0);
+    testPortReceive(frame, nextFrameLen);
+
+    // when
+    mspProcess();
+
+    // then
+    EXPECT_EQ(1, mspProcessCommandCallCount);
+    EXPECT_EQ(MSP_ATTITUDE, lastCommand);
+}
+
+TEST_F(SerialMspTest, TestV1AndV2RequestsAreAnsweredInTheirOwnFraming)
+{
+    // given
+    const uint8_t payload[] = { 0x42 };
+    uint8_t v1Frame[16];
+    uint8_t v2Frame[16];
+    const int v1FrameLen = buildMspV1Request(v1Frame, MSP_STATUS, payload, sizeof(payload));
+    const int v2FrameLen = buildMspV2Request(v2Frame, MSP_ATTITUDE, payload, sizeof(payload));
+
+    testPortReceive(v1Frame, v1FrameLen);
+    testPortReceive(v2Frame, v2FrameLen);
+    testPortReceive(v1Frame, v1FrameLen);
+
+    // when
+    mspProcess();
+
+    // then
+    EXPECT_EQ(3, mspProcessCommandCallCount);
+
+    // and
+    v1Frame[2] = '>';
+    v2Frame[2] = '>';
+    EXPECT_EQ((uint32_t)(2 * v1FrameLen + v2FrameLen), txCount);
+    EXPECT_EQ(0, memcmp(v1Frame, &txData[0], v1FrameLen));
+    EXPECT_EQ(0, memcmp(v2Frame, &txData[v1FrameLen], v2FrameLen));
+    EXPECT_EQ(0, memcmp(v1Frame, &txData[v1FrameLen + v2FrameLen], v1FrameLen));
+}
+
+static void subscribe(uint8_t rate, const uint8_t *cmds, uint8_t count)
+{
+    uint8_t payload[1 + MSP_SUBSCRIPTION_MAX_COUNT + 1];
+    payload[0] = rate;
+    for (int i = 0; i < count; i++) {
+        payload[1 + i] = cmds[i];
+    }
+
+    uint8_t frame[32];
+    const int frameLen = buildMspV1Request(frame, MSP_SET_MSP_SUBSCRIPTION, payload, 1 + count);
+    testPortReceive(frame, frameLen);
+
+    txCount = 0;
+    mspProcess();
+}
 
-TEST_F(SerialMspUnitTest, TestMspProcessReceivedCommand)
-{
-    // check the MSP_API_VERSION is written out correctly
-    serialWritePos = 0;
-    serialReadPos = 0;
-    currentPort->cmdMSP = MSP_API_VERSION;
-    mspProcessReceivedCommand();
-
-    EXPECT_EQ('$', serialBuffer.mspResponse.header.dollar);
-    EXPECT_EQ('M', serialBuffer.mspResponse.header.m);
-    EXPECT_EQ('>', serialBuffer.mspResponse.header.direction);
-    EXPECT_EQ(3, serialBuffer.mspResponse.header.size);
-    EXPECT_EQ(MSP_API_VERSION, serialBuffer.mspResponse.header.type);
-    EXPECT_EQ(MSP_PROTOCOL_VERSION, serialBuffer.mspResponse.payload[0]);
-    EXPECT_EQ(API_VERSION_MAJOR, serialBuffer.mspResponse.payload[1]);
-    EXPECT_EQ(API_VERSION_MINOR, serialBuffer.mspResponse.payload[2]);
-    int checksum = 3 ^ MSP_API_VERSION;
-    checksum ^= MSP_PROTOCOL_VERSION ^ API_VERSION_MAJOR ^ API_VERSION_MINOR;
-    EXPECT_EQ(checksum, serialBuffer.mspResponse.payload[3]);// checksum
-
-    // check the MSP_FC_VARIANT is written out correctly
-    serialWritePos = 0;
-    serialReadPos = 0;
-    currentPort->cmdMSP = MSP_FC_VARIANT;
-    mspProcessReceivedCommand();
-
-    EXPECT_EQ('$', serialBuffer.mspResponse.header.dollar);
-    EXPECT_EQ('M', serialBuffer.mspResponse.header.m);
-    EXPECT_EQ('>', serialBuffer.mspResponse.header.direction);
-    EXPECT_EQ(FLIGHT_CONTROLLER_IDENTIFIER_LENGTH, serialBuffer.mspResponse.header.size);
-    EXPECT_EQ(MSP_FC_VARIANT, serialBuffer.mspResponse.header.type);
-    EXPECT_EQ('C', serialBuffer.mspResponse.payload[0]);
-    EXPECT_EQ('L', serialBuffer.mspResponse.payload[1]);
-    EXPECT_EQ('F', serialBuffer.mspResponse.payload[2]);
-    EXPECT_EQ('L', serialBuffer.mspResponse.payload[3]);
-    checksum = FLIGHT_CONTROLLER_IDENTIFIER_LENGTH ^ MSP_FC_VARIANT;
-    checksum ^= 'C'^ 'L' ^ 'F' ^ 'L';
-    EXPECT_EQ(checksum, serialBuffer.mspResponse.payload[4]);
-
-    // check the MSP_FC_VERSION is written out correctly
-    serialWritePos = 0;
-    serialReadPos = 0;
-    currentPort->cmdMSP = MSP_FC_VERSION;
-    mspProcessReceivedCommand();
-    EXPECT_EQ('$', serialBuffer.mspResponse.header.dollar);
-    EXPECT_EQ('M', serialBuffer.mspResponse.header.m);
-    EXPECT_EQ('>', serialBuffer.mspResponse.header.direction);
-    EXPECT_EQ(FLIGHT_CONTROLLER_VERSION_LENGTH, serialBuffer.mspResponse.header.size);
-    EXPECT_EQ(MSP_FC_VERSION, serialBuffer.mspResponse.header.type);
-    EXPECT_EQ(FC_VERSION_MAJOR, serialBuffer.mspResponse.payload[0]);
-    EXPECT_EQ(FC_VERSION_MINOR, serialBuffer.mspResponse.payload[1]);
-    EXPECT_EQ(FC_VERSION_PATCH_LEVEL, serialBuffer.mspResponse.payload[2]);
-    checksum = FLIGHT_CONTROLLER_VERSION_LENGTH ^ MSP_FC_VERSION;
-    checksum ^= FC_VERSION_MAJOR ^ FC_VERSION_MINOR ^ FC_VERSION_PATCH_LEVEL;
-    EXPECT_EQ(checksum, serialBuffer.mspResponse.payload[3]);
-
-    // check the MSP_PID_CONTROLLER is written out correctly
-    serialWritePos = 0;
-    serialReadPos = 0;
-    currentProfile = &profile;
-    currentProfile->pidProfile.pidController = PID_CONTROLLER_MWREWRITE;
-    currentPort->cmdMSP = MSP_PID_CONTROLLER;
-    mspProcessReceivedCommand();
-    EXPECT_EQ('$', serialBuffer.mspResponse.header.dollar);
-    EXPECT_EQ('M', serialBuffer.mspResponse.header.m);
-    EXPECT_EQ('>', serialBuffer.mspResponse.header.direction);
-    EXPECT_EQ(1, serialBuffer.mspResponse.header.size);
-    EXPECT_EQ(MSP_PID_CONTROLLER, serialBuffer.mspResponse.header.type);
-    EXPECT_EQ(PID_CONTROLLER_MWREWRITE, serialBuffer.mspResponse.payload[0]);
-    checksum = 1 ^ MSP_PID_CONTROLLER ^ PID_CONTROLLER_MWREWRITE;
-    EXPECT_EQ(checksum, serialBuffer.mspResponse.payload[1]);
-}
-
-TEST_F(SerialMspUnitTest, Test_PID_CONTROLLER)
-{
-    // Use the MSP to write out the PID values
-    currentProfile = &profile;
-    currentProfile->pidProfile.pidController = PID_CONTROLLER_MWREWRITE;
-    serialWritePos = 0;
-    serialReadPos = 0;
-    currentPort->cmdMSP = MSP_PID_CONTROLLER;
-    mspProcessReceivedCommand();
-    EXPECT_EQ(PID_CONTROLLER_MWREWRITE, serialBuffer.mspResponse.payload[0]);
-
-    // set the pidController to a different value so we can check if it gets read back properly
-    currentProfile->pidProfile.pidController = PID_CONTROLLER_LUX_FLOAT;
-
-    // Now use the MSP to read back the picController and check if it is the same
-    // spoof a change from the written MSP_PID_CONTROLLER to the readable MSP_SET_PID_CONTROLLER
-    currentPort->cmdMSP = MSP_SET_PID_CONTROLLER;
-    serialBuffer.mspResponse.header.direction = '<';
-    serialBuffer.mspResponse.header.type = currentPort->cmdMSP;
-    // force the checksum
-    serialBuffer.mspResponse.payload[1] ^= MSP_PID_CONTROLLER;
-    serialBuffer.mspResponse.payload[1] ^= MSP_SET_PID_CONTROLLER;
-    // copy the command data into the current port inBuf so it can be processed
-    memcpy(currentPort->inBuf, serialBuffer.buf, MSP_PORT_INBUF_SIZE);
-
-    // set the offset into the payload
-    currentPort->indRX = offsetof(struct mspResonse_s, payload);
-    mspProcessReceivedCommand();
-
-    // check the pidController value has been read correctly
-    EXPECT_EQ(PID_CONTROLLER_MWREWRITE, currentProfile->pidProfile.pidController);
-}
-
-TEST_F(SerialMspUnitTest, Test_PIDValuesInt)
-{
-    // check the buffer is big enough for the data to read in
-    EXPECT_LE(sizeof(mspHeader_t) + 3 * PID_ITEM_COUNT + 1, MSP_PORT_INBUF_SIZE); // +1 for checksum
-    // set up some test data
-    const int P8_ROLL = 40;
-    const int I8_ROLL = 30;
-    const int D8_ROLL = 23;
-    const int P8_PITCH = 41;
-    const int I8_PITCH = 31;
-    const int D8_PITCH = 24;
-    const int P8_YAW = 85;
-    const int I8_YAW = 45;
-    const int D8_YAW = 1;
-    const int P8_PIDALT = 50;
-    const int I8_PIDALT = 2;
-    const int D8_PIDALT = 3;
-    const int P8_PIDPOS = 15; // POSHOLD_P * 100;
-    const int I8_PIDPOS = 4; // POSHOLD_I * 100;
-    const int D8_PIDPOS = 5;
-    const int P8_PIDPOSR = 34; // POSHOLD_RATE_P * 10;
-    const int I8_PIDPOSR = 14; // POSHOLD_RATE_I * 100;
-    const int D8_PIDPOSR = 53; // POSHOLD_RATE_D * 1000;
-    const int P8_PIDNAVR = 25; // NAV_P * 10;
-    const int I8_PIDNAVR = 33; // NAV_I * 100;
-    const int D8_PIDNAVR = 83; // NAV_D * 1000;
-    const int P8_PIDLEVEL = 90;
-    const int I8_PIDLEVEL = 10;
-    const int D8_PIDLEVEL = 100;
-    const int P8_PIDMAG = 40;
-    const int P8_PIDVEL = 120;
-    const int I8_PIDVEL = 45;
-    const int D8_PIDVEL = 7;
-
-    currentProfile = &profile;
-    currentProfile->pidProfile.pidController = PID_CONTROLLER_MWREWRITE;
-    currentProfile->pidProfile.P8[PIDROLL] = P8_ROLL;
-    currentProfile->pidProfile.I8[PIDROLL] = I8_ROLL;
-    currentProfile->pidProfile.D8[PIDROLL] = D8_ROLL;
-    currentProfile->pidProfile.P8[PIDPITCH] = P8_PITCH;
-    currentProfile->pidProfile.I8[PIDPITCH] = I8_PITCH;
-    currentProfile->pidProfile.D8[PIDPITCH] = D8_PITCH;
-    currentProfile->pidProfile.P8[PIDYAW] = P8_YAW;
-    currentProfile->pidProfile.I8[PIDYAW] = I8_YAW;
-    currentProfile->pidProfile.D8[PIDYAW] = D8_YAW;
-    currentProfile->pidProfile.P8[PIDALT] = P8_PIDALT;
-    currentProfile->pidProfile.I8[PIDALT] = I8_PIDALT;
-    currentProfile->pidProfile.D8[PIDALT] = D8_PIDALT;
-    currentProfile->pidProfile.P8[PIDPOS] = P8_PIDPOS;
-    currentProfile->pidProfile.I8[PIDPOS] = I8_PIDPOS;
-    currentProfile->pidProfile.D8[PIDPOS] = D8_PIDPOS;
-    currentProfile->pidProfile.P8[PIDPOSR] = P8_PIDPOSR;
-    currentProfile->pidProfile.I8[PIDPOSR] = I8_PIDPOSR;
-    currentProfile->pidProfile.D8[PIDPOSR] = D8_PIDPOSR;
-    currentProfile->pidProfile.P8[PIDNAVR] = P8_PIDNAVR;
-    currentProfile->pidProfile.I8[PIDNAVR] = I8_PIDNAVR;
-    currentProfile->pidProfile.D8[PIDNAVR] = D8_PIDNAVR;
-    currentProfile->pidProfile.P8[PIDLEVEL] = P8_PIDLEVEL;
-    currentProfile->pidProfile.I8[PIDLEVEL] = I8_PIDLEVEL;
-    currentProfile->pidProfile.D8[PIDLEVEL] = D8_PIDLEVEL;
-    currentProfile->pidProfile.P8[PIDMAG] = P8_PIDMAG;
-    currentProfile->pidProfile.P8[PIDVEL] = P8_PIDVEL;
-    currentProfile->pidProfile.I8[PIDVEL] = I8_PIDVEL;
-    currentProfile->pidProfile.D8[PIDVEL] = D8_PIDVEL;
-
-    // use the MSP to write out the PID values
-    serialWritePos = 0;
-    serialReadPos = 0;
-    currentPort->cmdMSP = MSP_PID;
-    mspProcessReceivedCommand();
-    EXPECT_EQ(3 * PID_ITEM_COUNT, serialBuffer.mspResponse.header.size);
-    // check few values, just to make sure they have been written correctly
-    EXPECT_EQ(P8_YAW, serialBuffer.mspResponse.payload[6]);
-    EXPECT_EQ(I8_YAW, serialBuffer.mspResponse.payload[7]);
-    EXPECT_EQ(D8_YAW, serialBuffer.mspResponse.payload[8]);
-
-    // reset test values to zero, so we can check if they get read properly
-    memset(&currentProfile->pidProfile, 0, sizeof(currentProfile->pidProfile));
-
-    // now use the MSP to read back the PID values and check they are the same as written
-    // spoof a change from the written MSP_PID to the readable MSP_SET_PID
-    currentPort->cmdMSP = MSP_SET_PID;
-    serialBuffer.mspResponse.header.direction = '<';
-    serialBuffer.mspResponse.header.type = currentPort->cmdMSP;
-    // force the checksum
-    serialBuffer.mspResponse.payload[3 * PID_ITEM_COUNT] ^= MSP_PID;
-    serialBuffer.mspResponse.payload[3 * PID_ITEM_COUNT] ^= MSP_SET_PID;
-    // copy the command data into the current port inBuf so it can be processed
-    memcpy(currentPort->inBuf, serialBuffer.buf, MSP_PORT_INBUF_SIZE);
-
-    // set the offset into the payload
-    currentPort->indRX = offsetof(struct mspResonse_s, payload);
-    mspProcessReceivedCommand();
-
-    // check the values are as expected
-    EXPECT_EQ(P8_ROLL, currentProfile->pidProfile.P8[PIDROLL]);
-    EXPECT_EQ(I8_ROLL, currentProfile->pidProfile.I8[PIDROLL]);
-    EXPECT_EQ(D8_ROLL, currentProfile->pidProfile.D8[PIDROLL]);
-    EXPECT_EQ(P8_PITCH, currentProfile->pidProfile.P8[PIDPITCH]);
-    EXPECT_EQ(I8_PITCH, currentProfile->pidProfile.I8[PIDPITCH]);
-    EXPECT_EQ(D8_PITCH, currentProfile->pidProfile.D8[PIDPITCH]);
-    EXPECT_EQ(P8_YAW, currentProfile->pidProfile.P8[PIDYAW]);
-    EXPECT_EQ(I8_YAW, currentProfile->pidProfile.I8[PIDYAW]);
-    EXPECT_EQ(D8_YAW, currentProfile->pidProfile.D8[PIDYAW]);
-    EXPECT_EQ(P8_PIDALT, currentProfile->pidProfile.P8[PIDALT]);
-    EXPECT_EQ(I8_PIDALT, currentProfile->pidProfile.I8[PIDALT]);
-    EXPECT_EQ(D8_PIDALT, currentProfile->pidProfile.D8[PIDALT]);
-    EXPECT_EQ(P8_PIDPOS, currentProfile->pidProfile.P8[PIDPOS]);
-    EXPECT_EQ(I8_PIDPOS, currentProfile->pidProfile.I8[PIDPOS]);
-    EXPECT_EQ(D8_PIDPOS, currentProfile->pidProfile.D8[PIDPOS]);
-    EXPECT_EQ(P8_PIDPOSR, currentProfile->pidProfile.P8[PIDPOSR]);
-    EXPECT_EQ(I8_PIDPOSR, currentProfile->pidProfile.I8[PIDPOSR]);
-    EXPECT_EQ(D8_PIDPOSR, currentProfile->pidProfile.D8[PIDPOSR]);
-    EXPECT_EQ(P8_PIDNAVR, currentProfile->pidProfile.P8[PIDNAVR]);
-    EXPECT_EQ(I8_PIDNAVR, currentProfile->pidProfile.I8[PIDNAVR]);
-    EXPECT_EQ(D8_PIDNAVR, currentProfile->pidProfile.D8[PIDNAVR]);
-    EXPECT_EQ(P8_PIDLEVEL, currentProfile->pidProfile.P8[PIDLEVEL]);
-    EXPECT_EQ(I8_PIDLEVEL, currentProfile->pidProfile.I8[PIDLEVEL]);
-    EXPECT_EQ(D8_PIDLEVEL, currentProfile->pidProfile.D8[PIDLEVEL]);
-    EXPECT_EQ(P8_PIDMAG, currentProfile->pidProfile.P8[PIDMAG]);
-    EXPECT_EQ(P8_PIDVEL, currentProfile->pidProfile.P8[PIDVEL]);
-    EXPECT_EQ(I8_PIDVEL, currentProfile->pidProfile.I8[PIDVEL]);
-    EXPECT_EQ(D8_PIDVEL, currentProfile->pidProfile.D8[PIDVEL]);
-}
-
-TEST_F(SerialMspUnitTest, Test_PIDValuesFloat)
-{
-    // check the buffer is big enough for the data to read in
-    EXPECT_LE(sizeof(mspHeader_t) + 3 * PID_ITEM_COUNT + 1, MSP_PORT_INBUF_SIZE); // +1 for checksum
-
-    // set up some test data
-    // use test values close to default, but make sure they are all different
-    const float Pf_ROLL = 1.4f;
-    const float If_ROLL = 0.4f;
-    const float Df_ROLL = 0.03f;
-    const float Pf_PITCH = 1.5f; // default 1.4
-    const float If_PITCH = 0.5f; // default 0.4
-    const float Df_PITCH = 0.02f; // default 0.03
-    const float Pf_YAW = 3.5f;
-    const float If_YAW = 0.6f; // default 0.4
-    const float Df_YAW = 0.01;
-    const float A_level = 5.0f;
-    const float H_level = 3.0f;
-    const uint8_t H_sensitivity = 75;
-    currentProfile = &profile;
-    currentProfile->pidProfile.pidController = PID_CONTROLLER_LUX_FLOAT;
-    currentProfile->pidProfile.P_f[PIDROLL] = Pf_ROLL;
-    currentProfile->pidProfile.I_f[PIDROLL] = If_ROLL;
-    currentProfile->pidProfile.D_f[PIDROLL] = Df_ROLL;
-    currentProfile->pidProfile.P_f[PIDPITCH] = Pf_PITCH;
-    currentProfile->pidProfile.I_f[PIDPITCH] = If_PITCH;
-    currentProfile->pidProfile.D_f[PIDPITCH] = Df_PITCH;
-    currentProfile->pidProfile.P_f[PIDYAW] = Pf_YAW;
-    currentProfile->pidProfile.I_f[PIDYAW] = If_YAW;
-    currentProfile->pidProfile.D_f[PIDYAW] = Df_YAW;
-    currentProfile->pidProfile.A_level = A_level;
-    currentProfile->pidProfile.H_level = H_level;
-    currentProfile->pidProfile.H_sensitivity = H_sensitivity;
-
-    // use the MSP to write out the PID values
-    serialWritePos = 0;
-    serialReadPos = 0;
-    currentPort->cmdMSP = MSP_PID;
-    mspProcessReceivedCommand();
-    EXPECT_EQ(3 * PID_ITEM_COUNT, serialBuffer.mspResponse.header.size);
-
-    // reset test values to zero, so we can check if they get read properly
-    memset(&currentProfile->pidProfile, 0, sizeof(currentProfile->pidProfile));
-
-    // now use the MSP to read back the PID values and check they are the same
-    // spoof a change from the written MSP_PID to the readable MSP_SET_PID
-    currentPort->cmdMSP = MSP_SET_PID;
-    serialBuffer.mspResponse.header.direction = '<';
-    serialBuffer.mspResponse.header.type = currentPort->cmdMSP;
-    // force the checksum
-    serialBuffer.mspResponse.payload[3 * PID_ITEM_COUNT] ^= MSP_PID;
-    serialBuffer.mspResponse.payload[3 * PID_ITEM_COUNT] ^= MSP_SET_PID;
-    // copy the command data into the current port inBuf so it can be processed
-    memcpy(currentPort->inBuf, serialBuffer.buf, MSP_PORT_INBUF_SIZE);
-
-    // need to reset the controller for values to be read back correctly
-    currentProfile->pidProfile.pidController = PID_CONTROLLER_LUX_FLOAT;
-
-    // set the offset into the payload
-    currentPort->indRX = offsetof(struct mspResonse_s, payload);
-    mspProcessReceivedCommand();
-
-    // check the values are as expected
-    EXPECT_FLOAT_EQ(Pf_ROLL, currentProfile->pidProfile.P_f[PIDROLL]);
-    EXPECT_FLOAT_EQ(If_ROLL, currentProfile->pidProfile.I_f[PIDROLL]);
-    EXPECT_FLOAT_EQ(Df_ROLL, currentProfile->pidProfile.D_f[PIDROLL]);
-    EXPECT_FLOAT_EQ(Pf_PITCH, currentProfile->pidProfile.P_f[PIDPITCH]);
-    EXPECT_FLOAT_EQ(If_PITCH, currentProfile->pidProfile.I_f[PIDPITCH]);
-    EXPECT_FLOAT_EQ(Df_PITCH, currentProfile->pidProfile.D_f[PIDPITCH]);
-    EXPECT_FLOAT_EQ(Pf_YAW, currentProfile->pidProfile.P_f[PIDYAW]);
-    EXPECT_FLOAT_EQ(If_YAW, currentProfile->pidProfile.I_f[PIDYAW]);
-    EXPECT_FLOAT_EQ(Df_YAW, currentProfile->pidProfile.D_f[PIDYAW]);
-    EXPECT_FLOAT_EQ(A_level, currentProfile->pidProfile.A_level);
-    EXPECT_FLOAT_EQ(H_level, currentProfile->pidProfile.H_level);
-    EXPECT_EQ(H_sensitivity, currentProfile->pidProfile.H_sensitivity);
+TEST_F(SerialMspTest, TestSubscriptionIsPushedAtRequestedPeriod)
+{
+    // given
+    const uint8_t cmds[] = { MSP_STATUS, MSP_ATTITUDE };
+    subscribe(10, cmds, sizeof(cmds));
+
+    // then
+    const uint8_t ack[] = { '$', 'M', '>', 0, MSP_SET_MSP_SUBSCRIPTION, MSP_SET_MSP_SUBSCRIPTION };
+    EXPECT_EQ(sizeof(ack), txCount);
+    EXPECT_EQ(0, memcmp(ack, txData, sizeof(ack)));
+    EXPECT_EQ(0, mspProcessCommandCallCount);
+
+    // when
+    // 10Hz, nothing is pushed before 100ms elapsed
+    txCount = 0;
+    testMillis += 99;
+    mspProcess();
+
+    // then
+    EXPECT_EQ(0, mspProcessCommandCallCount);
+    EXPECT_EQ(0, txCount);
+
+    // when
+    testMillis += 1;
+    mspProcess();
+
+    // then
+    EXPECT_EQ(1, mspProcessCommandCallCount);
+    EXPECT_EQ(MSP_MULTIPLE_MSP, lastCommand);
+    EXPECT_EQ((int)sizeof(cmds), lastCommandSize);
+    EXPECT_EQ(0, memcmp(cmds, lastCommandPayload, sizeof(cmds)));
+    EXPECT_EQ('M', txData[1]);
+    EXPECT_EQ(MSP_MULTIPLE_MSP, txData[4]);
+
+    // when
+    // polling more often doesn't push more often
+    for (int i = 0; i < 10; i++) {
+        testMillis += 10;
+        mspProcess();
+    }
+
+    // then
+    EXPECT_EQ(2, mspProcessCommandCallCount);
 }
 
+TEST_F(SerialMspTest, TestSubscriptionPushIsSkippedWhenTransmitBufferIsFull)
+{
+    // given
+    const uint8_t cmds[] = { MSP_STATUS };
+    subscribe(MSP_SUBSCRIPTION_MAX_RATE, cmds, sizeof(cmds));
+
+    // when
+    testTxBytesFree = MSP_PORT_MIN_TX_FREE - 1;
+    testMillis += 1000 / MSP_SUBSCRIPTION_MAX_RATE;
+    mspProcess();
+
+    // then
+    EXPECT_EQ(0, mspProcessCommandCallCount);
+
+    // when
+    testTxBytesFree = 256;
+    mspProcess();
+
+    // then
+    EXPECT_EQ(1, mspProcessCommandCallCount);
+}
+
+TEST_F(SerialMspTest, TestInvalidSubscriptionIsRejected)
+{
+    // given
+    const uint8_t writeCmd[] = { MSP_SET_PID };
+    const uint8_t readCmd[] = { MSP_STATUS };
+    const uint8_t tooManyCmds[MSP_SUBSCRIPTION_MAX_COUNT + 1] = { MSP_STATUS };
+
+    // rate too high, command which is not read only, too many commands, rate without commands
+    subscribe(MSP_SUBSCRIPTION_MAX_RATE + 1, readCmd, sizeof(readCmd));
+    EXPECT_EQ('!', txData[2]);
+    subscribe(10, writeCmd, sizeof(writeCmd));
+    EXPECT_EQ('!', txData[2]);
+    subscribe(10, tooManyCmds, sizeof(tooManyCmds));
+    EXPECT_EQ('!', txData[2]);
+    subscribe(10, NULL, 0);
+    EXPECT_EQ('!', txData[2]);
+
+    // when
+    testMillis += 1000;
+    mspProcess();
+
+    // then
+    EXPECT_EQ(0, mspProcessCommandCallCount);
+}
+
+TEST_F(SerialMspTest, TestSubscriptionIsCancelledWithZeroRate)
+{
+    // given
+    const uint8_t cmds[] = { MSP_STATUS };
+    subscribe(10, cmds, sizeof(cmds));
+    subscribe(0, NULL, 0);
+    EXPECT_EQ('>', txData[2]);
+
+    // when
+    testMillis += 1000;
+    mspProcess();
+
+    // then
+    EXPECT_EQ(0, mspProcessCommandCallCount);
+}
+
+TEST_F(SerialMspTest, TestSubscriptionIsPushedInFramingOfRequest)
+{
+    // given
+    const uint8_t payload[] = { 10, MSP_STATUS };
+    uint8_t frame[16];
+    const int frameLen = buildMspV2Request(frame, MSP_SET_MSP_SUBSCRIPTION, payload, sizeof(payload));
+    testPortReceive(frame, frameLen);
+    mspProcess();
+
+    // when
+    txCount = 0;
+    testMillis += 100;
+    mspProcess();
+
+    // then
+    EXPECT_EQ(1, mspProcessCommandCallCount);
+    EXPECT_EQ('X', txData[1]);
+    EXPECT_EQ(MSP_MULTIPLE_MSP, txData[4] | (txData[5] << 8));
+}
+
+TEST_F(SerialMspTest, TestOtherDataIsPassedOnWhenDisarmed)
+{
+    // given
+    const uint8_t data[] = { 'R', '#' };
+    testPortReceive(data, sizeof(data));
+
+    // when
+    mspProcess();
+
+    // then
+    EXPECT_EQ(2, evaluateOtherDataCallCount);
+
+    // given
+    ENABLE_ARMING_FLAG(ARMED);
+    testPortReceive(data, sizeof(data));
+
+    // when
+    mspProcess();
+
+    // then
+    EXPECT_EQ(2, evaluateOtherDataCallCount);
+}
+
+TEST_F(SerialMspTest, TestSerialReadBufCopiesAcrossBufferWrap)
+{
+    // given
+    rxHead = rxTail = TEST_RX_BUFFER_SIZE - 3;
+    const uint8_t data[] = { 1, 2, 3, 4, 5, 6, 7 };
+    testPortReceive(data, sizeof(data));
+
+    // when
+    uint8_t readData[16];
+    const uint32_t count = serialReadBuf(&testPort, readData, 5);
+
+    // then
+    EXPECT_EQ(5, count);
+    EXPECT_EQ(0, memcmp(data, readData, 5));
+    EXPECT_EQ(2, testPortTotalRxWaiting(&testPort));
+
+    // when
+    EXPECT_EQ(2, serialReadBuf(&testPort, readData, sizeof(readData)));
+
+    // then
+    EXPECT_EQ(6, readData[0]);
+    EXPECT_EQ(7, readData[1]);
+}
 
 // STUBS
+
 extern "C" {
-// from acceleration.c
-uint16_t acc_1G = 256;          // this is the 1G measured acceleration.
-void accSetCalibrationCycles(uint16_t calibrationCyclesRequired) {UNUSED(calibrationCyclesRequired);}
-// from altitudehold.c
-int32_t AltHold;
-int32_t vario = 0;                      // variometer in cm/s
-int32_t altitudeHoldGetEstimatedAltitude(void) {return 0;}
-// from battery.c
-uint16_t vbat = 0;                   // battery voltage in 0.1V steps (filtered)
-int32_t amperage = 0;               // amperage read by current sensor in centiampere (1/100th A)
-int32_t mAhDrawn = 0;               // milliampere hours drawn from the battery since start
-// from compass.c
-int32_t magADC[XYZ_AXIS_COUNT];
-// from config.c
-master_t masterConfig;
-controlRateConfig_t *currentControlRateProfile;
-void resetPidProfile(pidProfile_t *pidProfile) {UNUSED(pidProfile);}
-void handleOneshotFeatureChangeOnRestart(void) {}
-void readEEPROM(void) {}
-void resetEEPROM(void) {}
-void writeEEPROM(void) {}
-bool feature(uint32_t mask) {UNUSED(mask);return false;}
-void featureSet(uint32_t mask) {UNUSED(mask);}
-void featureClearAll() {}
-uint32_t featureMask(void) {return 0;}
-// from debug.c
-int16_t debug[DEBUG16_VALUE_COUNT];
-// from gps.c
-#define GPS_SV_MAXSATS   16
-int32_t GPS_coord[2];               // LAT/LON
-uint8_t GPS_numSat;
-uint8_t GPS_update = 0;             // it's a binary toggle to distinct a GPS position update
-uint16_t GPS_altitude;              // altitude in 0.1m
-uint16_t GPS_speed;                 // speed in 0.1m/s
-uint16_t GPS_ground_course = 0;     // degrees * 10
-uint8_t GPS_numCh;                          // Number of channels
-uint8_t GPS_svinfo_chn[GPS_SV_MAXSATS];     // Channel number
-uint8_t GPS_svinfo_svid[GPS_SV_MAXSATS];    // Satellite ID
-uint8_t GPS_svinfo_quality[GPS_SV_MAXSATS]; // Bitfield Qualtity
-uint8_t GPS_svinfo_cno[GPS_SV_MAXSATS];     // Carrier to Noise Ratio (Signal Strength)
-// from gyro.c
-int32_t gyroADC[XYZ_AXIS_COUNT];
-// form imu.c
-attitudeEulerAngles_t attitude = { { 0, 0, 0 } };     // absolute angle inclination in multiple of 0.1 degree    180 deg = 1800
-int16_t accSmooth[XYZ_AXIS_COUNT];
-// from ledstrip.c
-void reevalulateLedConfig(void) {}
-// from mixer.c
-int16_t motor[MAX_SUPPORTED_MOTORS];
-int16_t motor_disarmed[MAX_SUPPORTED_MOTORS];
-int16_t servo[MAX_SUPPORTED_SERVOS];
-void stopMotors(void) {}
-void loadCustomServoMixer(void) {}
-// from msp.c
-void rxMspFrameReceive(uint16_t *frame, int channelCount) {UNUSED(frame);UNUSED(channelCount);}
-// from mw.c
-uint16_t cycleTime = 0;         // this is the number in micro second to achieve a full loop, it can differ a little and is taken into account in the PID loop
-// from navigation.c
-int32_t GPS_home[2];
-int32_t GPS_hold[2];
-uint16_t GPS_distanceToHome;        // distance to home point in meters
-int16_t GPS_directionToHome;        // direction to home or hol point in degrees
-navigationMode_e nav_mode = NAV_MODE_NONE;    // Navigation mode
-void GPS_set_next_wp(int32_t *lat, int32_t *lon) {UNUSED(lat);UNUSED(lon);}
-// from pid.c
-void pidSetController(pidControllerType_e type) {UNUSED(type);}
-// from rc_controls.c
-uint32_t rcModeActivationMask; // one bit per mode defined in boxId_e
-void useRcControlsConfig(void *modeActivationConditions, void *escAndServoConfigToUse, void *pidProfileToUse) {
-    UNUSED(modeActivationConditions);UNUSED(escAndServoConfigToUse);UNUSED(pidProfileToUse);}
-// from runtime_config.c
-uint8_t armingFlags = 0;
-uint8_t stateFlags = 0;
-uint16_t flightModeFlags = 0;
-uint16_t disableFlightMode(flightModeFlags_e mask) {UNUSED(mask);return 0;}
-bool sensors(uint32_t mask) {UNUSED(mask);return 0;}
-// from rx.c
-uint16_t rssi = 0;                  // range: [0;1023]
-int16_t rcData[MAX_SUPPORTED_RC_CHANNEL_COUNT];     // interval [1000;2000]
-rxRuntimeConfig_t rxRuntimeConfig;
-// from system.c
-void delay(uint32_t ms) {UNUSED(ms);}
-// from system_stm32fN0x.c
-void systemReset(void) {}
-void systemResetToBootloader(void) {}
-// from scheduler.c
-uint16_t averageSystemLoadPercent = 0;
-// from transponder_ir.c
-void transponderUpdateData(uint8_t*) {}
+uint8_t armingFlags;
+
+uint32_t millis(void) { return testMillis; }
+uint32_t micros(void) { return testMillis * 1000; }
+
+const uint32_t baudRates[] = { 0, 9600, 19200, 38400, 57600, 115200, 230400, 250000 };
+
+static serialPortConfig_t testPortConfig = { SERIAL_PORT_USART1, FUNCTION_MSP, BAUD_115200, 0, 0, 0 };
+
+serialPortConfig_t *findSerialPortConfig(serialPortFunction_e function)
+{
+    UNUSED(function);
+    return &testPortConfig;
+}
+
+serialPortConfig_t *findNextSerialPortConfig(serialPortFunction_e function)
+{
+    UNUSED(function);
+    return NULL;
+}
+
+serialPort_t *openSerialPort(serialPortIdentifier_e identifier, serialPortFunction_e function, serialReceiveCallbackPtr callback,
+    uint32_t baudrate, portMode_t mode, portOptions_t options)
+{
+    UNUSED(identifier);
+    UNUSED(function);
+    UNUSED(callback);
+    UNUSED(baudrate);
+    UNUSED(mode);
+    UNUSED(options);
+    return &testPort;
+}
+
+void closeSerialPort(serialPort_t *serialPort) { UNUSED(serialPort); }
+
+void evaluateOtherData(serialPort_t *serialPort, uint8_t receivedChar)
+{
+    UNUSED(serialPort);
+    UNUSED(receivedChar);
+    evaluateOtherDataCallCount++;
+}
+
+void mspCommandsInit(void) {}
+
+static const mspCommandDescriptor_t testCommands[] = {
+    { MSP_STATUS,   0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, NULL },
+    { MSP_ATTITUDE, 0, MSP_SIZE_ANY, MSP_FLAG_READ_ONLY, NULL },
+    { MSP_SET_PID,  0, MSP_SIZE_ANY, MSP_FLAG_NONE, NULL },
+};
+
+const mspCommandDescriptor_t *mspFindCommand(uint16_t cmd)
+{
+    for (unsigned i = 0; i < ARRAYLEN(testCommands); i++) {
+        if (testCommands[i].cmd == cmd) {
+            return &testCommands[i];
+        }
+    }
+    return NULL;
+}
+
+mspResult_e mspProcessCommand(mspPacket_t *cmd, mspPacket_t *reply, mspPostProcessFnPtr *postProcessFn)
+{
+    mspProcessCommandCallCount++;
+    lastCommand = cmd->cmd;
+    lastCommandSize = sbufBytesRemaining(&cmd->buf);
+    memcpy(lastCommandPayload, sbufPtr(&cmd->buf), lastCommandSize);
+
+    reply->cmd = cmd->cmd;
+    if (cmd->cmd == TEST_MSP_ERROR_CMD) {
+        // transport has to drop whatever the handler has written
+        sbufWriteU8(&reply->buf, 0xEE);
+        reply->result = MSP_RESULT_ERROR;
+    } else {
+        sbufWriteData(&reply->buf, sbufPtr(&cmd->buf), lastCommandSize);
+        reply->result = MSP_RESULT_ACK;
+    }
+
+    *postProcessFn = NULL;
+    return (mspResult_e)reply->result;
+}
 }
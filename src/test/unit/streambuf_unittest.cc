@@ -0,0 +1,84 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdint.h>
+#include <string.h>
+
+extern "C" {
+    #include "common/streambuf.h"
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+TEST(StreamBufferTest, WriteThenRead)
+{
+    // given
+    uint8_t buf[16];
+    sbuf_t sbuf;
+    sbufInit(&sbuf, buf, buf + sizeof(buf));
+
+    // when
+    sbufWriteU8(&sbuf, 0x12);
+    sbufWriteU16(&sbuf, 0x3456);
+    sbufWriteU32(&sbuf, 0x789ABCDE);
+    sbufSwitchToReader(&sbuf, buf);
+
+    // then
+    EXPECT_EQ(7, sbufBytesRemaining(&sbuf));
+    EXPECT_EQ(0x56, buf[1]);    // little endian
+    EXPECT_EQ(0x12, sbufReadU8(&sbuf));
+    EXPECT_EQ(0x3456, sbufReadU16(&sbuf));
+    EXPECT_EQ(0x789ABCDE, sbufReadU32(&sbuf));
+    EXPECT_EQ(0, sbufBytesRemaining(&sbuf));
+}
+
+TEST(StreamBufferTest, WritePastEndIsDropped)
+{
+    // given
+    uint8_t buf[8];
+    memset(buf, 0xAA, sizeof(buf));
+    sbuf_t sbuf;
+    sbufInit(&sbuf, buf, buf + 4);
+
+    // when
+    sbufWriteU16(&sbuf, 0x1111);
+    sbufWriteU32(&sbuf, 0x22222222);
+    sbufWriteString(&sbuf, "overflow");
+
+    // then
+    EXPECT_EQ(0, sbufBytesRemaining(&sbuf));
+    EXPECT_EQ(0x22, buf[3]);
+    EXPECT_EQ(0xAA, buf[4]);
+}
+
+TEST(StreamBufferTest, ReadPastEndReturnsZero)
+{
+    // given
+    uint8_t buf[] = { 0x01, 0x02, 0x03 };
+    sbuf_t sbuf;
+    sbufInit(&sbuf, buf, buf + sizeof(buf));
+
+    // when
+    uint16_t first = sbufReadU16(&sbuf);
+    uint32_t second = sbufReadU32(&sbuf);
+
+    // then
+    EXPECT_EQ(0x0201, first);
+    EXPECT_EQ(0x03, second);
+    EXPECT_EQ(0, sbufReadU8(&sbuf));
+    EXPECT_EQ(0, sbufBytesRemaining(&sbuf));
+}
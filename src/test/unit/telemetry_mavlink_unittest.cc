@@ -0,0 +1,734 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define NAV
+#define TELEMETRY_MAVLINK
+
+extern "C" {
+    #include "build_config.h"
+    #include "debug.h"
+
+    #include "platform.h"
+
+    #include "common/maths.h"
+    #include "common/axis.h"
+    #include "common/color.h"
+
+    #include "drivers/system.h"
+    #include "drivers/sensor.h"
+    #include "drivers/accgyro.h"
+    #include "drivers/serial.h"
+    #include "drivers/timer.h"
+    #include "drivers/pwm_rx.h"
+
+    #include "io/serial.h"
+    #include "io/rc_controls.h"
+    #include "io/gimbal.h"
+    #include "io/gps.h"
+    #include "io/ledstrip.h"
+
+    #include "sensors/sensors.h"
+    #include "sensors/acceleration.h"
+    #include "sensors/gyro.h"
+    #include "sensors/barometer.h"
+    #include "sensors/boardalignment.h"
+    #include "sensors/battery.h"
+
+    #include "rx/rx.h"
+
+    #include "flight/mixer.h"
+    #include "flight/pid.h"
+    #include "flight/imu.h"
+    #include "flight/failsafe.h"
+    #include "flight/navigation_rewrite.h"
+
+    #include "telemetry/telemetry.h"
+    #include "telemetry/mavlink.h"
+
+    #include "config/config.h"
+    #include "config/runtime_config.h"
+    #include "config/config_profile.h"
+    #include "config/config_master.h"
+
+    #include "mavlink/common/mavlink.h"
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+#define TEST_MISSION_SIZE   30
+
+static serialPort_t testSerialPort;
+static serialPortConfig_t testSerialPortConfig;
+
+static uint8_t serialRxBuffer[512];
+static int serialRxLength;
+static int serialRxPosition;
+
+static uint8_t serialTxBuffer[1024];
+static int serialTxLength;
+
+static navWaypoint_t testMission[TEST_MISSION_SIZE];
+static int testMissionCount;
+static bool testMissionUploadRejected;
+
+static navGCSCommand_e lastGCSCommand;
+static bool gcsCommandLatched;
+static navGCSCommandStatus_e gcsCommandStatus;
+static int gcsTargetCount;
+static navWaypoint_t lastGCSTarget;
+
+/*
+ * Byte stream recorded from a ground station uploading a mission of two waypoints and RTH
+ */
+static const uint8_t recordedMissionUpload[] = {
+    // MISSION_COUNT, 3 items
+    0xFE, 0x04, 0x00, 0xFF, 0xBE, 0x2C, 0x03, 0x00, 0x00, 0xC8, 0x1E, 0xA8,
+    // MISSION_ITEM_INT #0, NAV_WAYPOINT 50.5498090 137.0165690 50m
+    0xFE, 0x25, 0x01, 0xFF, 0xBE, 0x49, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xEA, 0x49, 0x21, 0x1E, 0xBA, 0x11, 0xAB, 0x51, 0x00, 0x00,
+    0x48, 0x42, 0x00, 0x00, 0x10, 0x00, 0x00, 0xC8, 0x06, 0x00, 0x01, 0x38, 0xB9,
+    // MISSION_ITEM_INT #1, NAV_WAYPOINT 50.5499090 137.0175690 25m
+    0xFE, 0x25, 0x02, 0xFF, 0xBE, 0x49, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xD2, 0x4D, 0x21, 0x1E, 0xCA, 0x38, 0xAB, 0x51, 0x00, 0x00,
+    0xC8, 0x41, 0x01, 0x00, 0x10, 0x00, 0x00, 0xC8, 0x06, 0x00, 0x01, 0x21, 0x82,
+    // MISSION_ITEM_INT #2, NAV_RETURN_TO_LAUNCH
+    0xFE, 0x25, 0x03, 0xFF, 0xBE, 0x49, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x02, 0x00, 0x14, 0x00, 0x00, 0xC8, 0x02, 0x00, 0x01, 0x39, 0x64,
+};
+
+/*
+ * Byte stream recorded from a ground station sending COMMAND_LONG NAV_RETURN_TO_LAUNCH
+ */
+static const uint8_t recordedCommandRTH[] = {
+    0xFE, 0x21, 0x04, 0xFF, 0xBE, 0x4C, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x14, 0x00, 0x00, 0xC8, 0x00, 0x28, 0x41,
+};
+
+class TelemetryMavlinkTest : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        serialRxLength = 0;
+        serialRxPosition = 0;
+        serialTxLength = 0;
+
+        memset(testMission, 0, sizeof(testMission));
+        testMissionCount = 0;
+        testMissionUploadRejected = false;
+
+        lastGCSCommand = NAV_GCS_COMMAND_NONE;
+        gcsCommandLatched = true;
+        gcsCommandStatus = NAV_GCS_COMMAND_STATUS_NONE;
+        gcsTargetCount = 0;
+
+        armingFlags = 0;
+
+        initMAVLinkTelemetry();
+        checkMAVLinkTelemetryState();
+    }
+
+    virtual void TearDown() {
+        freeMAVLinkTelemetryPort();
+    }
+
+    void receiveBytes(const uint8_t * data, int length) {
+        memcpy(&serialRxBuffer[serialRxLength], data, length);
+        serialRxLength += length;
+
+        // Telemetry handler consumes at most one message per call
+        while (serialRxPosition < serialRxLength) {
+            handleMAVLinkTelemetry();
+        }
+    }
+
+    void receiveMessage(mavlink_message_t * msg) {
+        uint8_t buf[MAVLINK_MAX_PACKET_LEN];
+        int length = mavlink_msg_to_send_buffer(buf, msg);
+        receiveBytes(buf, length);
+    }
+
+    // Navigation pass applying the latched GCS command, followed by a telemetry pass
+    void navigationPass(navGCSCommandStatus_e status) {
+        gcsCommandStatus = status;
+        handleMAVLinkTelemetry();
+    }
+
+    // Decode all messages sent by the firmware, return number of decoded messages
+    int decodeSentMessages(mavlink_message_t * messages, int maxCount) {
+        mavlink_status_t status;
+        int count = 0;
+
+        for (int i = 0; i < serialTxLength && count < maxCount; i++) {
+            if (mavlink_parse_char(MAVLINK_COMM_1, serialTxBuffer[i], &messages[count], &status)) {
+                count++;
+            }
+        }
+
+        serialTxLength = 0;
+        return count;
+    }
+};
+
+TEST_F(TelemetryMavlinkTest, TestRecordedMissionUpload)
+{
+    // when
+    receiveBytes(recordedMissionUpload, sizeof(recordedMissionUpload));
+
+    // then - every item is requested in order, then the mission is acknowledged
+    mavlink_message_t sent[8];
+    ASSERT_EQ(4, decodeSentMessages(sent, 8));
+
+    for (int i = 0; i < 3; i++) {
+        EXPECT_EQ(MAVLINK_MSG_ID_MISSION_REQUEST, sent[i].msgid);
+        EXPECT_EQ(i, mavlink_msg_mission_request_get_seq(&sent[i]));
+        EXPECT_EQ(255, mavlink_msg_mission_request_get_target_system(&sent[i]));
+        EXPECT_EQ(190, mavlink_msg_mission_request_get_target_component(&sent[i]));
+    }
+
+    EXPECT_EQ(MAVLINK_MSG_ID_MISSION_ACK, sent[3].msgid);
+    EXPECT_EQ(MAV_MISSION_ACCEPTED, mavlink_msg_mission_ack_get_type(&sent[3]));
+
+    // then - mission is stored with relative altitude in cm
+    ASSERT_EQ(3, testMissionCount);
+    EXPECT_EQ(NAV_WP_ACTION_WAYPOINT, testMission[0].action);
+    EXPECT_EQ(505498090, testMission[0].lat);
+    EXPECT_EQ(1370165690, testMission[0].lon);
+    EXPECT_EQ(5000, testMission[0].alt);
+    EXPECT_EQ(0, testMission[0].flag);
+
+    EXPECT_EQ(NAV_WP_ACTION_WAYPOINT, testMission[1].action);
+    EXPECT_EQ(505499090, testMission[1].lat);
+    EXPECT_EQ(1370175690, testMission[1].lon);
+    EXPECT_EQ(2500, testMission[1].alt);
+
+    EXPECT_EQ(NAV_WP_ACTION_RTH, testMission[2].action);
+    EXPECT_EQ(NAV_WP_FLAG_LAST, testMission[2].flag);
+}
+
+TEST_F(TelemetryMavlinkTest, TestCorruptedFrameIsIgnored)
+{
+    // given
+    uint8_t corrupted[sizeof(recordedCommandRTH)];
+    memcpy(corrupted, recordedCommandRTH, sizeof(corrupted));
+    corrupted[20] ^= 0x01;
+
+    // when
+    receiveBytes(corrupted, sizeof(corrupted));
+
+    // then
+    mavlink_message_t sent[2];
+    EXPECT_EQ(0, decodeSentMessages(sent, 2));
+    EXPECT_EQ(NAV_GCS_COMMAND_NONE, lastGCSCommand);
+}
+
+TEST_F(TelemetryMavlinkTest, TestRecordedCommandRTH)
+{
+    // when
+    receiveBytes(recordedCommandRTH, sizeof(recordedCommandRTH));
+
+    // then - command is latched, not acknowledged before navigation applied it
+    mavlink_message_t sent[2];
+    EXPECT_EQ(0, decodeSentMessages(sent, 2));
+    EXPECT_EQ(NAV_GCS_COMMAND_RTH, lastGCSCommand);
+
+    // when
+    handleMAVLinkTelemetry();
+
+    // then
+    EXPECT_EQ(0, decodeSentMessages(sent, 2));
+
+    // when
+    navigationPass(NAV_GCS_COMMAND_STATUS_ACCEPTED);
+
+    // then
+    ASSERT_EQ(1, decodeSentMessages(sent, 2));
+    EXPECT_EQ(MAVLINK_MSG_ID_COMMAND_ACK, sent[0].msgid);
+    EXPECT_EQ(MAV_CMD_NAV_RETURN_TO_LAUNCH, mavlink_msg_command_ack_get_command(&sent[0]));
+    EXPECT_EQ(MAV_RESULT_ACCEPTED, mavlink_msg_command_ack_get_result(&sent[0]));
+}
+
+TEST_F(TelemetryMavlinkTest, TestCommandLandAndHold)
+{
+    mavlink_message_t msg, sent[2];
+
+    // when
+    mavlink_msg_command_long_pack(255, 190, &msg, 0, 200, MAV_CMD_NAV_LAND, 0, 0, 0, 0, 0, 0, 0, 0);
+    receiveMessage(&msg);
+    navigationPass(NAV_GCS_COMMAND_STATUS_ACCEPTED);
+
+    // then
+    ASSERT_EQ(1, decodeSentMessages(sent, 2));
+    EXPECT_EQ(NAV_GCS_COMMAND_LAND, lastGCSCommand);
+    EXPECT_EQ(MAV_CMD_NAV_LAND, mavlink_msg_command_ack_get_command(&sent[0]));
+    EXPECT_EQ(MAV_RESULT_ACCEPTED, mavlink_msg_command_ack_get_result(&sent[0]));
+
+    // when - navigation can not switch to requested mode
+    mavlink_msg_command_long_pack(255, 190, &msg, 0, 200, MAV_CMD_NAV_LOITER_UNLIM, 0, 0, 0, 0, 0, 0, 0, 0);
+    receiveMessage(&msg);
+    navigationPass(NAV_GCS_COMMAND_STATUS_REJECTED);
+
+    // then
+    ASSERT_EQ(1, decodeSentMessages(sent, 2));
+    EXPECT_EQ(NAV_GCS_COMMAND_HOLD, lastGCSCommand);
+    EXPECT_EQ(MAV_CMD_NAV_LOITER_UNLIM, mavlink_msg_command_ack_get_command(&sent[0]));
+    EXPECT_EQ(MAV_RESULT_TEMPORARILY_REJECTED, mavlink_msg_command_ack_get_result(&sent[0]));
+}
+
+TEST_F(TelemetryMavlinkTest, TestCommandNotLatched)
+{
+    mavlink_message_t msg, sent[2];
+
+    // given - disarmed or GCS navigation disabled
+    gcsCommandLatched = false;
+
+    // when
+    mavlink_msg_command_long_pack(255, 190, &msg, 0, 200, MAV_CMD_NAV_LAND, 0, 0, 0, 0, 0, 0, 0, 0);
+    receiveMessage(&msg);
+
+    // then - rejected right away
+    ASSERT_EQ(1, decodeSentMessages(sent, 2));
+    EXPECT_EQ(MAV_CMD_NAV_LAND, mavlink_msg_command_ack_get_command(&sent[0]));
+    EXPECT_EQ(MAV_RESULT_TEMPORARILY_REJECTED, mavlink_msg_command_ack_get_result(&sent[0]));
+}
+
+TEST_F(TelemetryMavlinkTest, TestCommandWhileAckPending)
+{
+    mavlink_message_t msg, sent[2];
+
+    // given
+    mavlink_msg_command_long_pack(255, 190, &msg, 0, 200, MAV_CMD_NAV_LAND, 0, 0, 0, 0, 0, 0, 0, 0);
+    receiveMessage(&msg);
+
+    // when
+    mavlink_msg_command_long_pack(255, 190, &msg, 0, 200, MAV_CMD_NAV_RETURN_TO_LAUNCH, 0, 0, 0, 0, 0, 0, 0, 0);
+    receiveMessage(&msg);
+
+    // then - second command is rejected, first one stays latched
+    ASSERT_EQ(1, decodeSentMessages(sent, 2));
+    EXPECT_EQ(MAV_CMD_NAV_RETURN_TO_LAUNCH, mavlink_msg_command_ack_get_command(&sent[0]));
+    EXPECT_EQ(MAV_RESULT_TEMPORARILY_REJECTED, mavlink_msg_command_ack_get_result(&sent[0]));
+    EXPECT_EQ(NAV_GCS_COMMAND_LAND, lastGCSCommand);
+
+    // when
+    navigationPass(NAV_GCS_COMMAND_STATUS_ACCEPTED);
+
+    // then
+    ASSERT_EQ(1, decodeSentMessages(sent, 2));
+    EXPECT_EQ(MAV_CMD_NAV_LAND, mavlink_msg_command_ack_get_command(&sent[0]));
+    EXPECT_EQ(MAV_RESULT_ACCEPTED, mavlink_msg_command_ack_get_result(&sent[0]));
+}
+
+TEST_F(TelemetryMavlinkTest, TestUnsupportedCommand)
+{
+    mavlink_message_t msg, sent[2];
+
+    // when
+    mavlink_msg_command_long_pack(255, 190, &msg, 0, 200, MAV_CMD_NAV_TAKEOFF, 0, 0, 0, 0, 0, 0, 0, 0);
+    receiveMessage(&msg);
+
+    // then
+    ASSERT_EQ(1, decodeSentMessages(sent, 2));
+    EXPECT_EQ(NAV_GCS_COMMAND_NONE, lastGCSCommand);
+    EXPECT_EQ(MAV_RESULT_UNSUPPORTED, mavlink_msg_command_ack_get_result(&sent[0]));
+}
+
+TEST_F(TelemetryMavlinkTest, TestMissionUploadRejectedWhenArmed)
+{
+    mavlink_message_t msg, sent[2];
+
+    // given
+    ENABLE_ARMING_FLAG(ARMED);
+
+    // when
+    mavlink_msg_mission_count_pack(255, 190, &msg, 0, 200, 3);
+    receiveMessage(&msg);
+
+    // then
+    ASSERT_EQ(1, decodeSentMessages(sent, 2));
+    EXPECT_EQ(MAVLINK_MSG_ID_MISSION_ACK, sent[0].msgid);
+    EXPECT_EQ(MAV_MISSION_ERROR, mavlink_msg_mission_ack_get_type(&sent[0]));
+    EXPECT_EQ(0, testMissionCount);
+}
+
+TEST_F(TelemetryMavlinkTest, TestMissionUploadTooLarge)
+{
+    mavlink_message_t msg, sent[2];
+
+    // when
+    mavlink_msg_mission_count_pack(255, 190, &msg, 0, 200, NAV_MAX_WAYPOINTS + 1);
+    receiveMessage(&msg);
+
+    // then
+    ASSERT_EQ(1, decodeSentMessages(sent, 2));
+    EXPECT_EQ(MAV_MISSION_NO_SPACE, mavlink_msg_mission_ack_get_type(&sent[0]));
+}
+
+TEST_F(TelemetryMavlinkTest, TestMissionUploadRepeatedAndOutOfSequenceItems)
+{
+    mavlink_message_t msg, sent[2];
+
+    // given
+    mavlink_msg_mission_count_pack(255, 190, &msg, 0, 200, 3);
+    receiveMessage(&msg);
+    mavlink_msg_mission_item_int_pack(255, 190, &msg, 0, 200, 0, MAV_FRAME_GLOBAL_RELATIVE_ALT_INT, MAV_CMD_NAV_WAYPOINT, 0, 1, 0, 0, 0, 0, 1, 2, 10.0f);
+    receiveMessage(&msg);
+    decodeSentMessages(sent, 2);
+
+    // when - our request for item #1 was lost and the ground station repeats item #0
+    receiveMessage(&msg);
+
+    // then
+    ASSERT_EQ(1, decodeSentMessages(sent, 2));
+    EXPECT_EQ(MAVLINK_MSG_ID_MISSION_REQUEST, sent[0].msgid);
+    EXPECT_EQ(1, mavlink_msg_mission_request_get_seq(&sent[0]));
+    EXPECT_EQ(1, testMissionCount);
+
+    // when - item #2 arrives before #1
+    mavlink_msg_mission_item_int_pack(255, 190, &msg, 0, 200, 2, MAV_FRAME_GLOBAL_RELATIVE_ALT_INT, MAV_CMD_NAV_WAYPOINT, 0, 1, 0, 0, 0, 0, 1, 2, 10.0f);
+    receiveMessage(&msg);
+
+    // then - upload is aborted
+    ASSERT_EQ(1, decodeSentMessages(sent, 2));
+    EXPECT_EQ(MAVLINK_MSG_ID_MISSION_ACK, sent[0].msgid);
+    EXPECT_EQ(MAV_MISSION_INVALID_SEQUENCE, mavlink_msg_mission_ack_get_type(&sent[0]));
+    EXPECT_FALSE(isWaypointListValid());
+}
+
+TEST_F(TelemetryMavlinkTest, TestMissionUploadUnsupportedItem)
+{
+    mavlink_message_t msg, sent[2];
+
+    // given
+    mavlink_msg_mission_count_pack(255, 190, &msg, 0, 200, 1);
+    receiveMessage(&msg);
+    decodeSentMessages(sent, 2);
+
+    // when - absolute altitude frame
+    mavlink_msg_mission_item_int_pack(255, 190, &msg, 0, 200, 0, MAV_FRAME_GLOBAL_INT, MAV_CMD_NAV_WAYPOINT, 0, 1, 0, 0, 0, 0, 1, 2, 10.0f);
+    receiveMessage(&msg);
+
+    // then
+    ASSERT_EQ(1, decodeSentMessages(sent, 2));
+    EXPECT_EQ(MAV_MISSION_UNSUPPORTED_FRAME, mavlink_msg_mission_ack_get_type(&sent[0]));
+    EXPECT_EQ(0, testMissionCount);
+}
+
+TEST_F(TelemetryMavlinkTest, TestMissionUploadFloatItem)
+{
+    mavlink_message_t msg, sent[2];
+
+    // given
+    mavlink_msg_mission_count_pack(255, 190, &msg, 0, 200, 1);
+    receiveMessage(&msg);
+    decodeSentMessages(sent, 2);
+
+    // when - legacy MISSION_ITEM with coordinates in degrees
+    mavlink_msg_mission_item_pack(255, 190, &msg, 0, 200, 0, MAV_FRAME_GLOBAL_RELATIVE_ALT, MAV_CMD_NAV_WAYPOINT, 0, 1, 0, 0, 0, 0, 50.549809f, 137.016569f, 10.0f);
+    receiveMessage(&msg);
+
+    // then - float coordinates are not degraded further by single precision scaling
+    ASSERT_EQ(1, decodeSentMessages(sent, 2));
+    EXPECT_EQ(MAV_MISSION_ACCEPTED, mavlink_msg_mission_ack_get_type(&sent[0]));
+    ASSERT_EQ(1, testMissionCount);
+    EXPECT_EQ(505498085, testMission[0].lat);     // 50.5498085 as float, lrintf(x * 1e7f) gives 505498080
+    EXPECT_EQ(1370165710, testMission[0].lon);    // 137.016571 as float, lrintf(x * 1e7f) gives 1370165760
+}
+
+TEST_F(TelemetryMavlinkTest, TestMissionUploadStorageFull)
+{
+    mavlink_message_t msg, sent[2];
+
+    // given
+    mavlink_msg_mission_count_pack(255, 190, &msg, 0, 200, 2);
+    receiveMessage(&msg);
+    decodeSentMessages(sent, 2);
+    testMissionUploadRejected = true;
+
+    // when
+    mavlink_msg_mission_item_int_pack(255, 190, &msg, 0, 200, 0, MAV_FRAME_GLOBAL_RELATIVE_ALT_INT, MAV_CMD_NAV_WAYPOINT, 0, 1, 0, 0, 0, 0, 1, 2, 10.0f);
+    receiveMessage(&msg);
+
+    // then
+    ASSERT_EQ(1, decodeSentMessages(sent, 2));
+    EXPECT_EQ(MAV_MISSION_NO_SPACE, mavlink_msg_mission_ack_get_type(&sent[0]));
+}
+
+TEST_F(TelemetryMavlinkTest, TestMissionDownload)
+{
+    mavlink_message_t msg, sent[2];
+
+    // given
+    receiveBytes(recordedMissionUpload, sizeof(recordedMissionUpload));
+    decodeSentMessages(sent, 2);
+
+    // when
+    mavlink_msg_mission_request_list_pack(255, 190, &msg, 0, 200);
+    receiveMessage(&msg);
+
+    // then
+    ASSERT_EQ(1, decodeSentMessages(sent, 2));
+    EXPECT_EQ(MAVLINK_MSG_ID_MISSION_COUNT, sent[0].msgid);
+    EXPECT_EQ(3, mavlink_msg_mission_count_get_count(&sent[0]));
+
+    // when
+    mavlink_msg_mission_request_pack(255, 190, &msg, 0, 200, 1);
+    receiveMessage(&msg);
+
+    // then
+    ASSERT_EQ(1, decodeSentMessages(sent, 2));
+    EXPECT_EQ(MAVLINK_MSG_ID_MISSION_ITEM_INT, sent[0].msgid);
+    EXPECT_EQ(1, mavlink_msg_mission_item_int_get_seq(&sent[0]));
+    EXPECT_EQ(MAV_CMD_NAV_WAYPOINT, mavlink_msg_mission_item_int_get_command(&sent[0]));
+    EXPECT_EQ(MAV_FRAME_GLOBAL_RELATIVE_ALT_INT, mavlink_msg_mission_item_int_get_frame(&sent[0]));
+    EXPECT_EQ(505499090, mavlink_msg_mission_item_int_get_x(&sent[0]));
+    EXPECT_EQ(1370175690, mavlink_msg_mission_item_int_get_y(&sent[0]));
+    EXPECT_FLOAT_EQ(25.0f, mavlink_msg_mission_item_int_get_z(&sent[0]));
+
+    // when
+    mavlink_msg_mission_request_pack(255, 190, &msg, 0, 200, 2);
+    receiveMessage(&msg);
+
+    // then
+    ASSERT_EQ(1, decodeSentMessages(sent, 2));
+    EXPECT_EQ(MAV_CMD_NAV_RETURN_TO_LAUNCH, mavlink_msg_mission_item_int_get_command(&sent[0]));
+
+    // when - past the end of mission
+    mavlink_msg_mission_request_pack(255, 190, &msg, 0, 200, 3);
+    receiveMessage(&msg);
+
+    // then
+    ASSERT_EQ(1, decodeSentMessages(sent, 2));
+    EXPECT_EQ(MAVLINK_MSG_ID_MISSION_ACK, sent[0].msgid);
+}
+
+TEST_F(TelemetryMavlinkTest, TestMissionClearAll)
+{
+    mavlink_message_t msg, sent[2];
+
+    // given
+    receiveBytes(recordedMissionUpload, sizeof(recordedMissionUpload));
+    decodeSentMessages(sent, 2);
+
+    // when
+    mavlink_msg_mission_clear_all_pack(255, 190, &msg, 0, 200);
+    receiveMessage(&msg);
+
+    // then
+    ASSERT_EQ(1, decodeSentMessages(sent, 2));
+    EXPECT_EQ(MAV_MISSION_ACCEPTED, mavlink_msg_mission_ack_get_type(&sent[0]));
+    EXPECT_EQ(0, testMissionCount);
+}
+
+TEST_F(TelemetryMavlinkTest, TestSetPositionTarget)
+{
+    mavlink_message_t msg, sent[2];
+
+    // when
+    mavlink_msg_set_position_target_global_int_pack(255, 190, &msg, 0, 0, 200, MAV_FRAME_GLOBAL_RELATIVE_ALT_INT, 0,
+        505498090, 1370165690, 12.5f, 0, 0, 0, 0, 0, 0, -M_PIf / 2, 0);
+    receiveMessage(&msg);
+
+    // then - hold is latched along with WP #255 target, no reply is expected
+    EXPECT_EQ(0, decodeSentMessages(sent, 2));
+    EXPECT_EQ(NAV_GCS_COMMAND_HOLD, lastGCSCommand);
+    ASSERT_EQ(1, gcsTargetCount);
+    EXPECT_EQ(NAV_WP_ACTION_WAYPOINT, lastGCSTarget.action);
+    EXPECT_EQ(505498090, lastGCSTarget.lat);
+    EXPECT_EQ(1370165690, lastGCSTarget.lon);
+    EXPECT_EQ(1250, lastGCSTarget.alt);
+    EXPECT_EQ(270, lastGCSTarget.p1);
+
+    // when
+    navigationPass(NAV_GCS_COMMAND_STATUS_ACCEPTED);
+
+    // then
+    EXPECT_EQ(0, decodeSentMessages(sent, 2));
+
+    // when - position ignored
+    mavlink_msg_set_position_target_global_int_pack(255, 190, &msg, 0, 0, 200, MAV_FRAME_GLOBAL_RELATIVE_ALT_INT, 0x0007,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    receiveMessage(&msg);
+
+    // then
+    EXPECT_EQ(1, gcsTargetCount);
+
+    // when - hold mode can't be activated
+    gcsCommandLatched = false;
+    mavlink_msg_set_position_target_global_int_pack(255, 190, &msg, 0, 0, 200, MAV_FRAME_GLOBAL_RELATIVE_ALT_INT, 0,
+        505498090, 1370165690, 12.5f, 0, 0, 0, 0, 0, 0, 0, 0);
+    receiveMessage(&msg);
+
+    // then
+    EXPECT_EQ(1, gcsTargetCount);
+}
+
+// STUBS
+
+extern "C" {
+
+int16_t debug[DEBUG16_VALUE_COUNT];
+uint8_t armingFlags;
+uint16_t flightModeFlags;
+uint8_t stateFlags;
+
+master_t masterConfig;
+rxRuntimeConfig_t rxRuntimeConfig;
+int16_t rcData[MAX_SUPPORTED_RC_CHANNEL_COUNT];
+uint16_t rssi;
+attitudeEulerAngles_t attitude;
+
+gpsSolutionData_t gpsSol;
+gpsLocation_t GPS_home;
+
+uint16_t vbat;
+int32_t amperage;
+
+uint32_t millis(void) { return 0; }
+uint32_t micros(void) { return 0; }
+
+bool sensors(uint32_t mask) { UNUSED(mask); return false; }
+bool feature(uint32_t mask) { UNUSED(mask); return false; }
+bool isCalibrating(void) { return false; }
+bool failsafeIsActive(void) { return false; }
+uint8_t calculateBatteryPercentage(void) { return 0; }
+
+float getEstimatedActualPosition(int axis) { UNUSED(axis); return 0; }
+float getEstimatedActualVelocity(int axis) { UNUSED(axis); return 0; }
+
+uint32_t serialRxBytesWaiting(serialPort_t *instance)
+{
+    UNUSED(instance);
+    return serialRxLength - serialRxPosition;
+}
+
+uint8_t serialRead(serialPort_t *instance)
+{
+    UNUSED(instance);
+    return serialRxBuffer[serialRxPosition++];
+}
+
+void serialWrite(serialPort_t *instance, uint8_t ch)
+{
+    UNUSED(instance);
+    if (serialTxLength < (int)sizeof(serialTxBuffer)) {
+        serialTxBuffer[serialTxLength++] = ch;
+    }
+}
+
+serialPort_t *openSerialPort(serialPortIdentifier_e identifier, serialPortFunction_e functionMask, serialReceiveCallbackPtr callback, uint32_t baudRate, portMode_t mode, portOptions_t options)
+{
+    UNUSED(identifier);
+    UNUSED(functionMask);
+    UNUSED(callback);
+    UNUSED(baudRate);
+    UNUSED(options);
+    EXPECT_EQ(MODE_RXTX, mode);
+    return &testSerialPort;
+}
+
+void closeSerialPort(serialPort_t *serialPort) { UNUSED(serialPort); }
+
+serialPortConfig_t *findSerialPortConfig(serialPortFunction_e function)
+{
+    UNUSED(function);
+    return &testSerialPortConfig;
+}
+
+portSharing_e determinePortSharing(serialPortConfig_t *portConfig, serialPortFunction_e function)
+{
+    UNUSED(portConfig);
+    UNUSED(function);
+    return PORTSHARING_NOT_SHARED;
+}
+
+bool telemetryDetermineEnabledState(portSharing_e portSharing)
+{
+    UNUSED(portSharing);
+    return true;
+}
+
+const uint32_t baudRates[] = {0, 9600, 19200, 38400, 57600, 115200, 230400, 250000};
+
+bool navigationSetGCSCommand(navGCSCommand_e command, const navWaypoint_t * target)
+{
+    if (!gcsCommandLatched) {
+        return false;
+    }
+
+    lastGCSCommand = command;
+    gcsCommandStatus = NAV_GCS_COMMAND_STATUS_PENDING;
+    if (target) {
+        gcsTargetCount++;
+        lastGCSTarget = *target;
+    }
+    return true;
+}
+
+navGCSCommandStatus_e navigationGetGCSCommandStatus(void)
+{
+    return gcsCommandStatus;
+}
+
+void resetWaypointList(void)
+{
+    testMissionCount = 0;
+}
+
+bool setMissionWaypoint(int wpNumber, navWaypoint_t * wpData)
+{
+    if (testMissionUploadRejected || wpNumber < 1 || wpNumber > TEST_MISSION_SIZE) {
+        return false;
+    }
+
+    if (wpNumber == 1) {
+        testMissionCount = 0;
+    }
+    else if (wpNumber != testMissionCount + 1) {
+        return false;
+    }
+
+    testMission[testMissionCount++] = *wpData;
+    return true;
+}
+
+bool getMissionWaypoint(int wpNumber, navWaypoint_t * wpData)
+{
+    if (wpNumber < 1 || wpNumber > testMissionCount) {
+        return false;
+    }
+
+    *wpData = testMission[wpNumber - 1];
+    return true;
+}
+
+int getWaypointCount(void)
+{
+    return testMissionCount;
+}
+
+bool isWaypointListValid(void)
+{
+    return (testMissionCount > 0) && (testMission[testMissionCount - 1].flag == NAV_WP_FLAG_LAST);
+}
+
+}